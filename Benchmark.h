@@ -0,0 +1,222 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*								Microbenchmarks								  */
+/*																			  */
+/* Every benchmark is timed in repetitions batches of the same number of	  */
+/* operations. The batch size is calibrated to take at least min_time, the	  */
+/* setup before a batch is not timed. The median and the median absolute	  */
+/* deviation of the batch means are robust against interrupts of single		  */
+/* batches. Results are written as JSON and can be compared with a previous	  */
+/* run to catch regressions.												  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Cpu_Dispatch.h"
+
+/* Keep the compiler from removing a computation whose result is unused */
+template <typename T>
+inline void do_not_optimize (const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Benchmark {
+public:
+    struct Result {
+        std::string		name;
+        std::string		unit;				/* what one operation is			*/
+        std::uint64_t	ops_per_batch;
+        double			median;				/* ns per operation					*/
+        double			mad;
+        double			min;
+        double			mean;
+        double			sd;
+        double			sim_rate;			/* simulated s per wall s, 0 if none */
+    };
+
+    Benchmark(unsigned repetitions = 31, double min_time = 2E-3, const std::string& filter = "")
+    : repetitions (repetitions), min_time (min_time), filter (filter) {
+        if (repetitions == 0 || min_time <= 0) {
+            throw std::invalid_argument("Benchmark: invalid settings");
+        }
+    }
+
+    /* Time body(), setup() runs before every batch. An operation of step_unit	*/
+    /* is one integration step, so the simulated time per wall time is known	*/
+    template <typename Setup, typename Body>
+    void run (const std::string& name, const std::string& unit, bool step_unit, Setup&& setup, Body&& body) {
+        if (!selected(name)) {
+            return;
+        }
+
+        /* Double the batch until it takes min_time */
+        std::uint64_t n = 1;
+        while (batch(n, setup, body) < min_time && n < (1ULL << 40)) {
+            n *= 2;
+        }
+
+        std::vector<double> ns(repetitions);
+        for (double& x : ns) {
+            x = 1E9*batch(n, setup, body)/n;
+        }
+
+        Result R;
+        R.name			= name;
+        R.unit			= unit;
+        R.ops_per_batch	= n;
+        R.median		= median(ns);
+        std::vector<double> deviation(ns.size());
+        for (unsigned i=0; i < ns.size(); ++i) {
+            deviation[i] = std::abs(ns[i] - R.median);
+        }
+        R.mad			= median(deviation);
+        R.min			= *std::min_element(ns.begin(), ns.end());
+        R.mean			= 0.0;
+        for (double x : ns) {
+            R.mean += x/ns.size();
+        }
+        R.sd			= 0.0;
+        for (double x : ns) {
+            R.sd += (x - R.mean)*(x - R.mean)/std::max<std::size_t>(ns.size() - 1, 1);
+        }
+        R.sd			= std::sqrt(R.sd);
+        R.sim_rate		= 0.0;
+        if (step_unit) {
+            extern const int res;
+            R.sim_rate	= 1E9/(R.median*res);
+        }
+        results.push_back(R);
+        print(std::cout, R);
+    }
+
+    /* Whether a benchmark passes the filter, e.g. to skip an expensive setup */
+    bool selected (const std::string& name) const {return name.find(filter) != std::string::npos;}
+
+    const std::vector<Result>& get_results (void) const {return results;}
+
+    /* Table row of a result */
+    static void print (std::ostream& out, const Result& R) {
+        out << std::left << std::setw(40) << R.name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(12) << R.median << " ns/" << std::left << std::setw(6) << R.unit << std::right
+            << " +- " << std::setw(8) << R.mad;
+        if (R.sim_rate > 0) {
+            out << std::setw(12) << std::setprecision(1) << R.sim_rate << " sim s/s";
+        }
+        out << "\n";
+    }
+
+    /* All results with the settings of the run */
+    void write_json (std::ostream& out) const {
+        out << std::setprecision(17);
+        out << "{\n  \"suite\": \"NM_TC\",\n  \"compiler\": \"" << __VERSION__ << "\",\n"
+            << "  \"dispatch\": \"" << cpu_dispatch_path() << "\",\n"
+            << "  \"repetitions\": " << repetitions << ",\n  \"min_time\": " << min_time << ",\n"
+            << "  \"benchmarks\": [";
+        for (unsigned i=0; i < results.size(); ++i) {
+            const Result& R = results[i];
+            out << (i ? "," : "") << "\n    {\"name\": \"" << R.name << "\", \"unit\": \"" << R.unit
+                << "\", \"ops_per_batch\": " << R.ops_per_batch << ", \"median_ns\": " << R.median
+                << ", \"mad_ns\": " << R.mad << ", \"min_ns\": " << R.min << ", \"mean_ns\": " << R.mean
+                << ", \"sd_ns\": " << R.sd << ", \"sim_s_per_wall_s\": " << R.sim_rate << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    /* Medians of a previous run by name, reads the output of write_json */
+    static std::map<std::string, double> read_medians (const std::string& file) {
+        std::ifstream input(file);
+        if (!input) {
+            throw std::runtime_error("Benchmark: cannot open " + file);
+        }
+        std::map<std::string, double> medians;
+        for (std::string line; std::getline(input, line);) {
+            const std::size_t name	 = line.find("\"name\": \"");
+            const std::size_t median = line.find("\"median_ns\": ");
+            if (name == std::string::npos || median == std::string::npos) {
+                continue;
+            }
+            const std::size_t begin = name + 9;
+            medians[line.substr(begin, line.find('"', begin) - begin)] = std::stod(line.substr(median + 13));
+        }
+        return medians;
+    }
+
+    /* Compare with a previous run, returns the number of benchmarks that are	*/
+    /* slower by more than threshold (relative) and more than 3 MAD			*/
+    unsigned compare (std::ostream& out, const std::string& file, double threshold) const {
+        const std::map<std::string, double> baseline = read_medians(file);
+        unsigned regressions = 0;
+        for (const Result& R : results) {
+            const auto it = baseline.find(R.name);
+            if (it == baseline.end()) {
+                continue;
+            }
+            const double ratio	 = R.median/it->second;
+            const bool	 slower	 = ratio > 1 + threshold && R.median - it->second > 3*R.mad;
+            regressions			+= slower;
+            out << std::left << std::setw(40) << R.name << std::right << std::fixed << std::setprecision(3)
+                << std::setw(8) << ratio << (slower ? "  REGRESSION" : "") << "\n";
+        }
+        return regressions;
+    }
+
+private:
+    /* Wall time of n operations in s */
+    template <typename Setup, typename Body>
+    static double batch (std::uint64_t n, Setup& setup, Body& body) {
+        setup();
+        const auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t i=0; i < n; ++i) {
+            body();
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static double median (std::vector<double> x) {
+        std::nth_element(x.begin(), x.begin() + x.size()/2, x.end());
+        double m = x[x.size()/2];
+        if (x.size() % 2 == 0) {
+            m = (m + *std::max_element(x.begin(), x.begin() + x.size()/2))/2;
+        }
+        return m;
+    }
+
+    unsigned				repetitions;
+    double					min_time;
+    std::string				filter;
+    std::vector<Result>		results;
+};
@@ -0,0 +1,226 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Sparse matrices in CSR format						  */
+/*																			  */
+/* Row i holds the weights of the afferents of target module i. The rows are */
+/* stored back to back, so a matrix vector product streams once through the  */
+/* column indices and values and only gathers the source vector. Every		  */
+/* weight can carry a conduction delay, they are only stored if any is set.	  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class CSR_Matrix {
+public:
+    /* Single weight in coordinate form, indices start at 0. The delay is in ms, */
+    /* 0 couples instantaneously and may be omitted in brace initialization		 */
+    struct Entry {
+        unsigned	row;
+        unsigned	col;
+        double		value;
+        double		delay;
+    };
+
+    /* Empty matrix */
+    CSR_Matrix(void) : row_begin (1, 0) {}
+
+    /* Matrix from weights in any order, entries with equal position and delay are summed */
+    CSR_Matrix(unsigned rows, unsigned cols, std::vector<Entry> entries)
+        : num_rows (rows), num_cols (cols), row_begin (rows+1, 0) {
+        bool delayed = false;
+        for (const Entry& e : entries) {
+            if (e.row >= rows || e.col >= cols) {
+                throw std::out_of_range("CSR_Matrix: entry outside of the matrix");
+            }
+            if (!(e.delay >= 0)) {
+                throw std::invalid_argument("CSR_Matrix: negative delay");
+            }
+            delayed |= e.delay > 0;
+        }
+        std::sort(entries.begin(), entries.end(), [] (const Entry& a, const Entry& b)
+                  {return a.row != b.row ? a.row < b.row :
+                          a.col != b.col ? a.col < b.col : a.delay < b.delay;});
+
+        columns.reserve(entries.size());
+        values.reserve(entries.size());
+        for (unsigned k=0; k < entries.size(); ++k) {
+            if (k > 0 && entries[k].row	  == entries[k-1].row &&
+                         entries[k].col	  == entries[k-1].col &&
+                         entries[k].delay == entries[k-1].delay) {
+                values.back() += entries[k].value;
+                continue;
+            }
+            columns.push_back(entries[k].col);
+            values.push_back(entries[k].value);
+            if (delayed) {
+                delays.push_back(entries[k].delay);
+            }
+            ++row_begin[entries[k].row+1];
+        }
+        for (unsigned i=0; i < rows; ++i) {
+            row_begin[i+1] += row_begin[i];
+        }
+    }
+
+    /* Diagonal matrix with weight w, e.g. one thalamus per cortical column */
+    static CSR_Matrix identity (unsigned n, double w = 1.0, double delay = 0.0) {
+        std::vector<Entry> entries(n);
+        for (unsigned i=0; i < n; ++i) {
+            entries[i] = Entry{i, i, w, delay};
+        }
+        return CSR_Matrix(n, n, std::move(entries));
+    }
+
+    /* Read a real, integer or pattern matrix in Matrix Market coordinate format.	*/
+    /* The delays in ms are optionally read from a second file with the same		*/
+    /* positions																	*/
+    static CSR_Matrix read (const std::string& file, const std::string& delay_file = "") {
+        unsigned rows = 0, cols = 0;
+        std::vector<Entry> entries = read_entries(file, rows, cols);
+        if (delay_file.empty()) {
+            return CSR_Matrix(rows, cols, std::move(entries));
+        }
+
+        unsigned delay_rows = 0, delay_cols = 0;
+        std::vector<Entry> delays = read_entries(delay_file, delay_rows, delay_cols);
+        auto position = [] (const Entry& a, const Entry& b)
+                        {return a.row != b.row ? a.row < b.row : a.col < b.col;};
+        std::stable_sort(entries.begin(), entries.end(), position);
+        std::stable_sort(delays.begin(),  delays.end(),	 position);
+        if (delay_rows != rows || delay_cols != cols || delays.size() != entries.size()) {
+            throw std::runtime_error("CSR_Matrix: " + delay_file + " does not match " + file);
+        }
+        for (unsigned k=0; k < entries.size(); ++k) {
+            if (delays[k].row != entries[k].row || delays[k].col != entries[k].col) {
+                throw std::runtime_error("CSR_Matrix: " + delay_file + " does not match " + file);
+            }
+            entries[k].delay = delays[k].value;
+        }
+        return CSR_Matrix(rows, cols, std::move(entries));
+    }
+
+    /* Weighted sum of the source values x over the afferents of row i */
+    double row_dot (unsigned i, const double* __restrict x) const {
+        double sum = 0.0;
+        for (unsigned k=row_begin[i]; k < row_begin[i+1]; ++k) {
+            sum += values[k] * x[columns[k]];
+        }
+        return sum;
+    }
+
+    /* Weighted sum over the afferents of row i, where source(j, delay) gives the	*/
+    /* value of source j as seen through the delay of the connection				*/
+    template <typename Source>
+    double row_sum (unsigned i, const Source& source) const {
+        double sum = 0.0;
+        for (unsigned k=row_begin[i]; k < row_begin[i+1]; ++k) {
+            sum += values[k] * source(columns[k], delay(k));
+        }
+        return sum;
+    }
+
+    /* All weights in coordinate form */
+    std::vector<Entry> entries (void) const {
+        std::vector<Entry> result;
+        result.reserve(nnz());
+        for (unsigned i=0; i < num_rows; ++i) {
+            for (unsigned k=row_begin[i]; k < row_begin[i+1]; ++k) {
+                result.push_back(Entry{i, columns[k], values[k], delay(k)});
+            }
+        }
+        return result;
+    }
+
+    /* Dimensions and number of stored weights */
+    unsigned	rows	(void) const {return num_rows;}
+    unsigned	cols	(void) const {return num_cols;}
+    std::size_t nnz		(void) const {return values.size();}
+
+    /* Number of stored weights of row i */
+    unsigned	row_nnz (unsigned i) const {return row_begin[i+1] - row_begin[i];}
+
+private:
+    /* Delay of the k-th stored weight */
+    double delay (unsigned k) const {return delays.empty() ? 0.0 : delays[k];}
+
+    /* Entries of a Matrix Market file and its dimensions */
+    static std::vector<Entry> read_entries (const std::string& file, unsigned& rows, unsigned& cols) {
+        std::ifstream in(file);
+        if (!in) {
+            throw std::runtime_error("CSR_Matrix: cannot open " + file);
+        }
+
+        std::string line, banner, object, format, field, symmetry;
+        std::getline(in, line);
+        std::istringstream(line) >> banner >> object >> format >> field >> symmetry;
+        std::transform(field.begin(),	 field.end(),	 field.begin(),	   ::tolower);
+        std::transform(symmetry.begin(), symmetry.end(), symmetry.begin(), ::tolower);
+        if (banner != "%%MatrixMarket" || format != "coordinate" ||
+            (field != "real" && field != "integer" && field != "pattern") ||
+            (symmetry != "general" && symmetry != "symmetric")) {
+            throw std::runtime_error("CSR_Matrix: " + file + " is no supported Matrix Market file");
+        }
+
+        /* Skip the comments */
+        while (std::getline(in, line) && (line.empty() || line[0] == '%')) {}
+
+        std::size_t nnz = 0;
+        std::istringstream(line) >> rows >> cols >> nnz;
+
+        std::vector<Entry> entries;
+        entries.reserve(symmetry == "symmetric" ? 2*nnz : nnz);
+        for (std::size_t k=0; k < nnz; ++k) {
+            unsigned i = 0, j = 0;
+            double w = 1.0;
+            if (!(in >> i >> j) || (field != "pattern" && !(in >> w)) || i == 0 || j == 0) {
+                throw std::runtime_error("CSR_Matrix: malformed entry in " + file);
+            }
+            entries.push_back(Entry{i-1, j-1, w, 0.0});
+            if (symmetry == "symmetric" && i != j) {
+                entries.push_back(Entry{j-1, i-1, w, 0.0});
+            }
+        }
+        return entries;
+    }
+
+    unsigned				num_rows = 0;
+    unsigned				num_cols = 0;
+
+    /* Begin of every row within columns and values, row_begin[rows] = nnz */
+    std::vector<unsigned>	row_begin;
+    std::vector<unsigned>	columns;
+    std::vector<double>		values;
+
+    /* Delays in the order of values, empty if all are 0 */
+    std::vector<double>		delays;
+};
@@ -0,0 +1,364 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Checkpoints of a running simulation					  */
+/*																			  */
+/* A checkpoint holds everything a simulation continues from:				  */
+/*	- all RK stages of the state block of both columns,						  */
+/*	- the positions of the noise streams, the drawn noise and its input,	  */
+/*	- the inputs and integration settings of the columns,					  */
+/*	- the stimulation protocols with their state, markers and queued events, */
+/*	  closed loop protocols excepted,										  */
+/*	- the number of steps done.												  */
+/* The noise streams are counter based, so their position and the seed are	  */
+/* their state. By default the system is reseeded with the stored seed, so a  */
+/* restored run continues bit identically whatever seed the system was		  */
+/* created with. Without restore_seed the system keeps its own seed and		  */
+/* continues from the stored state with different noise.					  */
+/*																			  */
+/* Layout, all numbers in native byte order:								  */
+/*		Checkpoint_Header													  */
+/*		payload				payload_bytes, the fields in the order of fields() */
+/* The file is written under a temporary name and renamed once complete, so	  */
+/* a killed job leaves the previous checkpoint intact.						  */
+/******************************************************************************/
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Cortical_Column.h"
+#include "Noise_Buffer.h"
+#include "Random_Stream.h"
+#include "Stim_Scheduler.h"
+#include "TC_System.h"
+#include "Thalamic_Column.h"
+
+/* Identification of the format */
+const char			checkpoint_magic[8] = {'N', 'M', '_', 'T', 'C', 'C', 'K', 'P'};
+const std::uint32_t checkpoint_version	= 2;
+
+struct Checkpoint_Header {
+    char			magic[8];
+    std::uint32_t	version;
+    std::uint32_t	has_stim;			/* whether the stimulation is stored		*/
+    std::uint64_t	seed;				/* seed of the noise streams				*/
+    std::uint64_t	step;				/* number of steps done						*/
+    std::uint64_t	payload_bytes;
+    std::uint64_t	checksum;			/* FNV-1a of the payload					*/
+};
+
+class Checkpoint {
+public:
+    /* Store the state after step steps, the stimulation is optional */
+    static void save (const std::string& file, const TC_System& System, const Stim_Scheduler* Stimulation,
+                      std::uint64_t step) {
+        Writer out;
+        fields(out, System.Cortex, System.Thalamus);
+        if (Stimulation) {
+            store(out, *Stimulation);
+        }
+
+        Checkpoint_Header header = {};
+        std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+        header.version		 = checkpoint_version;
+        header.has_stim		 = Stimulation != nullptr;
+        header.seed			 = System.seed;
+        header.step			 = step;
+        header.payload_bytes = out.bytes.size();
+        header.checksum		 = checksum(out.bytes);
+
+        const std::string temporary = file + ".tmp";
+        {
+            std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+            stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            stream.write(out.bytes.data(), out.bytes.size());
+            if (!stream.flush()) {
+                throw std::runtime_error("Checkpoint: cannot write " + temporary);
+            }
+        }
+        if (std::rename(temporary.c_str(), file.c_str()) != 0) {
+            throw std::runtime_error("Checkpoint: cannot rename " + temporary + " to " + file);
+        }
+    }
+
+    /* Restore the state and return the header with the number of steps done	*/
+    /* and the stored seed. The stimulation is restored if it is given and		*/
+    /* stored, it then replaces the protocols of the scheduler. The parameters	*/
+    /* have to match															*/
+    static Checkpoint_Header load (const std::string& file, TC_System& System,
+                                   Stim_Scheduler* Stimulation = nullptr, bool restore_seed = true) {
+        std::ifstream stream(file, std::ios::binary);
+        Checkpoint_Header header;
+        if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            throw std::runtime_error("Checkpoint: cannot read " + file);
+        }
+        if (std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0 ||
+            header.version != checkpoint_version) {
+            throw std::runtime_error("Checkpoint: " + file + " is no checkpoint of this version");
+        }
+        std::vector<char> bytes(header.payload_bytes);
+        if (!stream.read(bytes.data(), bytes.size()) || checksum(bytes) != header.checksum) {
+            throw std::runtime_error("Checkpoint: " + file + " is corrupted");
+        }
+
+        /* Reseeding draws the noise anew, so it has to precede the stored noise */
+        if (restore_seed) {
+            System.reseed(header.seed);
+        }
+        Reader in(bytes);
+        fields(in, System.Cortex, System.Thalamus);
+        if (Stimulation && header.has_stim) {
+            /* The ISI streams follow the seed of the system */
+            Stimulation->seed = System.seed;
+            restore(in, *Stimulation);
+        }
+        return header;
+    }
+
+private:
+    /* Serialization into a byte buffer */
+    struct Writer {
+        std::vector<char> bytes;
+
+        template <typename T>
+        void operator() (const T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "Checkpoint: field is not trivially copyable");
+            const char* p = reinterpret_cast<const char*>(&value);
+            bytes.insert(bytes.end(), p, p + sizeof(T));
+        }
+
+        template <typename T>
+        void operator() (const std::vector<T>& values) {
+            operator()((std::uint64_t) values.size());
+            array(values.data(), values.size());
+        }
+
+        template <typename T>
+        void array (const T* values, std::size_t n) {
+            const char* p = reinterpret_cast<const char*>(values);
+            bytes.insert(bytes.end(), p, p + n*sizeof(T));
+        }
+
+        /* Random streams are stored by their position */
+        template <typename Stream>
+        void stream (const Stream& R) {operator()(R.get_counter());}
+
+        /* Parameters are stored to check them when loading */
+        void parameter (double value) {operator()(value);}
+    };
+
+    /* Deserialization from a byte buffer */
+    struct Reader {
+        explicit Reader(const std::vector<char>& bytes)
+            : position (bytes.data()), end (bytes.data() + bytes.size()) {}
+
+        template <typename T>
+        void operator() (T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "Checkpoint: field is not trivially copyable");
+            array(&value, 1);
+        }
+
+        template <typename T>
+        void operator() (std::vector<T>& values) {
+            std::uint64_t size = 0;
+            operator()(size);
+            if (size > (std::uint64_t) (end - position)/sizeof(T)) {
+                throw std::runtime_error("Checkpoint: truncated payload");
+            }
+            values.resize(size);
+            array(values.data(), values.size());
+        }
+
+        template <typename T>
+        void array (T* values, std::size_t n) {
+            if ((std::size_t) (end - position) < n*sizeof(T)) {
+                throw std::runtime_error("Checkpoint: truncated payload");
+            }
+            std::memcpy(values, position, n*sizeof(T));
+            position += n*sizeof(T);
+        }
+
+        template <typename Stream>
+        void stream (Stream& R) {
+            std::uint64_t counter = 0;
+            operator()(counter);
+            R.set_counter(counter);
+        }
+
+        void parameter (double value) {
+            double stored = 0;
+            operator()(stored);
+            if (stored != value) {
+                throw std::invalid_argument("Checkpoint: parameters of the system differ");
+            }
+        }
+
+        const char* position;
+        const char* end;
+    };
+
+    /* Fields of the columns, C and T are const when saving */
+    template <typename Archive, typename C, typename T>
+    static void fields (Archive& ar, C& Cortex, T& Thalamus) {
+        for (double p : {Cortex.sigma_p, Cortex.g_KNa, Cortex.dphi, Cortex.N_pt, Cortex.N_it,
+                         Thalamus.g_LK, Thalamus.g_h, Thalamus.N_tp, Thalamus.N_rp}) {
+            ar.parameter(p);
+        }
+
+        ar.array(Cortex.state, Cortical_Column::num_vars * num_stages);
+        ar(Cortex.input);
+        ar(Cortex.Rand_vars);
+        ar(Cortex.Rand_input);
+        ar(Cortex.integrator);
+        for (auto& R : Cortex.Rand_Streams) {
+            ar.stream(R);
+        }
+
+        ar.array(Thalamus.state, Thalamic_Column::num_vars * num_stages);
+        ar(Thalamus.input);
+        ar(Thalamus.Rand_vars);
+        ar(Thalamus.Rand_input);
+        ar(Thalamus.integrator);
+        ar(Thalamus.gating);
+        for (auto& R : Thalamus.Rand_Streams) {
+            ar.stream(R);
+        }
+    }
+
+    /* Configuration of a stimulation protocol */
+    template <typename Archive>
+    static void fields (Archive& ar, Stim_Protocol& P) {
+        ar(P.kind);
+        ar(P.target);
+        ar(P.strength);
+        ar(P.duration);
+        ar(P.ISI);
+        ar(P.ISI_range);
+        ar(P.number_of_stimuli);
+        ar(P.time_between_stimuli);
+        ar(P.time_to_stimuli);
+        ar(P.threshold);
+        ar(P.burst_enabled);
+        ar(P.burst_length);
+        ar(P.burst_ISI);
+        ar(P.shorten_repeats);
+        ar(P.sample_steps);
+        std::vector<double> samples = P.samples ? *P.samples : std::vector<double>();
+        ar(samples);
+        P.samples = samples.empty() ? nullptr : std::make_shared<const std::vector<double>>(std::move(samples));
+    }
+
+    /* State of a stimulation protocol, P is const when saving */
+    template <typename Archive, typename P>
+    static void state (Archive& ar, P& Protocol) {
+        ar(Protocol.amplitude);
+        ar(Protocol.end);
+        ar(Protocol.stimulation_started);
+        ar(Protocol.stimulated);
+        ar(Protocol.paused);
+        ar(Protocol.threshold_crossed);
+        ar(Protocol.Vp_old);
+        ar(Protocol.markers);
+        ar.stream(Protocol.Uniform_Distribution);
+    }
+
+    /* Queued event, E is const when saving */
+    template <typename Archive, typename E>
+    static void event (Archive& ar, E& Event) {
+        ar(Event.step);
+        ar(Event.order);
+        ar(Event.protocol);
+        ar(Event.action);
+        ar(Event.index);
+    }
+
+    /* Protocols, their state and the event queue of a scheduler */
+    static void store (Writer& out, const Stim_Scheduler& S) {
+        out(S.origin);
+        out((std::uint64_t) S.protocols.size());
+        for (const Stim_Scheduler::Protocol& Protocol : S.protocols) {
+            if (Protocol.Loop) {
+                throw std::invalid_argument("Checkpoint: closed loop protocols cannot be stored");
+            }
+            Stim_Protocol P = Protocol.P;
+            fields(out, P);
+            state(out, Protocol);
+        }
+        out(S.watchers);
+        std::priority_queue<Stim_Scheduler::Event, std::vector<Stim_Scheduler::Event>,
+                            Stim_Scheduler::Later> events = S.events;
+        out((std::uint64_t) events.size());
+        for (; !events.empty(); events.pop()) {
+            event(out, events.top());
+        }
+        out(S.order);
+    }
+
+    static void restore (Reader& in, Stim_Scheduler& S) {
+        in(S.origin);
+        std::uint64_t count = 0;
+        in(count);
+        S.protocols.clear();
+        for (std::uint64_t i=0; i < count; ++i) {
+            Stim_Protocol P;
+            fields(in, P);
+            S.protocols.emplace_back(P, S.seed, S.stream + i);
+            state(in, S.protocols.back());
+        }
+        in(S.watchers);
+        for (unsigned i : S.watchers) {
+            if (i >= S.protocols.size()) {
+                throw std::runtime_error("Checkpoint: invalid stimulation protocol");
+            }
+        }
+        S.events = decltype(S.events)();
+        in(count);
+        for (std::uint64_t i=0; i < count; ++i) {
+            Stim_Scheduler::Event E;
+            event(in, E);
+            if (E.protocol >= S.protocols.size()) {
+                throw std::runtime_error("Checkpoint: invalid stimulation protocol");
+            }
+            S.events.push(E);
+        }
+        in(S.order);
+    }
+
+    static std::uint64_t checksum (const std::vector<char>& bytes) {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (char c : bytes) {
+            hash = (hash ^ (unsigned char) c) * 1099511628211ULL;
+        }
+        return hash;
+    }
+};
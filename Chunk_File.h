@@ -0,0 +1,389 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Chunked binary output files							  */
+/*																			  */
+/* Layout of a file, all numbers in native byte order:						  */
+/*		Chunk_File_Header													  */
+/*		variable names		num_vars   x 32 byte, zero padded				  */
+/*		parameters			num_params x (32 byte name, double)				  */
+/*		seeds				num_seeds  x uint64								  */
+/*		chunks				from data_offset on, chunk_bytes each			  */
+/* Every chunk is a Chunk_Header followed by one row of chunk_samples		  */
+/* doubles per variable, so a variable is contiguous within a chunk. Chunk k  */
+/* starts at data_offset + k*chunk_bytes and holds the samples from			  */
+/* k*chunk_samples on, which makes the chunk index implicit. Offsets are page */
+/* aligned, so readers can map the file and seek to any time window.		  */
+/*																			  */
+/* The writer appends chunks while the simulation runs and only then raises	  */
+/* num_samples in the header. Readers see every committed sample, also while  */
+/* the file is still being written or after the run was interrupted.		  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "State_Block.h"
+
+/* Identification of the format */
+const char			chunk_file_magic[8]	 = {'N', 'M', '_', 'T', 'C', 'D', 'A', 'T'};
+const std::uint32_t chunk_file_version	 = 1;
+
+/* Length of the stored names and alignment of the chunks in bytes */
+const std::size_t	chunk_name_length	 = 32;
+const std::size_t	chunk_page_size		 = 4096;
+
+struct Chunk_File_Header {
+    char			magic[8];
+    std::uint32_t	version;
+    std::uint32_t	num_vars;
+    std::uint32_t	num_params;
+    std::uint32_t	num_seeds;
+    std::uint64_t	chunk_samples;		/* samples per chunk						*/
+    double			sample_rate;		/* samples per s							*/
+    std::uint64_t	data_offset;		/* begin of the first chunk in bytes		*/
+    std::uint64_t	chunk_bytes;		/* size of a chunk including its header		*/
+    std::uint64_t	num_samples;		/* committed samples, written last			*/
+};
+
+/* 64 bytes, so the rows stay cache line aligned */
+struct Chunk_Header {
+    std::uint64_t	index;				/* number of the chunk						*/
+    std::uint64_t	first_sample;		/* first sample within the file				*/
+    std::uint64_t	num_samples;		/* valid samples of this chunk				*/
+    std::uint64_t	reserved[5];
+};
+
+/******************************************************************************/
+/*									Writer									  */
+/******************************************************************************/
+class Chunk_Writer {
+public:
+    /* Create a new file, an existing one is replaced */
+    Chunk_Writer(const std::string& file, const std::vector<std::string>& variables,
+                 double sample_rate,
+                 const std::vector<std::pair<std::string, double>>& parameters = {},
+                 const std::vector<std::uint64_t>& seeds = {},
+                 unsigned chunk_samples = 8192)
+        : num_vars (variables.size()), chunk_samples (chunk_samples) {
+        fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Chunk_Writer: cannot create " + file + ": " + std::strerror(errno));
+        }
+
+        try {
+            write_meta(variables, sample_rate, parameters, seeds);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        chunk.assign(header.chunk_bytes/sizeof(double), 0.0);
+    }
+
+    /* Commits the remaining samples */
+    ~Chunk_Writer(void) {
+        try {
+            flush();
+        } catch (...) {}
+        close(fd);
+    }
+
+    Chunk_Writer(const Chunk_Writer&) = delete;
+    Chunk_Writer& operator=(const Chunk_Writer&) = delete;
+
+    /* Add one sample of every variable */
+    void append (const double* values) {
+        double* data = chunk.data() + sizeof(Chunk_Header)/sizeof(double);
+        for (unsigned v=0; v < num_vars; ++v) {
+            data[v*chunk_samples + position] = values[v];
+        }
+        if (++position == chunk_samples) {
+            write_chunk();
+            ++index;
+            position = 0;
+        }
+    }
+
+    /* Write the samples of the incomplete chunk, so readers see them already */
+    void flush (void) {
+        if (position > 0) {
+            write_chunk();
+        }
+    }
+
+    /* Number of appended samples */
+    std::uint64_t num_samples (void) const {return index*chunk_samples + position;}
+
+private:
+    /* Write the header block, names, parameters and seeds follow the fixed header */
+    void write_meta (const std::vector<std::string>& variables, double sample_rate,
+                     const std::vector<std::pair<std::string, double>>& parameters,
+                     const std::vector<std::uint64_t>& seeds) {
+        std::vector<char> meta(sizeof(Chunk_File_Header), 0);
+        for (const std::string& name : variables) {
+            append_name(meta, name);
+        }
+        for (const std::pair<std::string, double>& p : parameters) {
+            append_name(meta, p.first);
+            append_bytes(meta, &p.second, sizeof(double));
+        }
+        for (std::uint64_t seed : seeds) {
+            append_bytes(meta, &seed, sizeof(seed));
+        }
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, chunk_file_magic, sizeof(header.magic));
+        header.version		 = chunk_file_version;
+        header.num_vars		 = num_vars;
+        header.num_params	 = parameters.size();
+        header.num_seeds	 = seeds.size();
+        header.chunk_samples = chunk_samples;
+        header.sample_rate	 = sample_rate;
+        header.data_offset	 = round_up(meta.size());
+        header.chunk_bytes	 = round_up(sizeof(Chunk_Header) + num_vars*chunk_samples*sizeof(double));
+        header.num_samples	 = 0;
+        std::memcpy(meta.data(), &header, sizeof(header));
+        meta.resize(header.data_offset, 0);
+        write_at(meta.data(), meta.size(), 0);
+    }
+
+    static std::size_t round_up (std::size_t bytes)
+    {return (bytes + chunk_page_size - 1)/chunk_page_size*chunk_page_size;}
+
+    static void append_bytes (std::vector<char>& meta, const void* data, std::size_t bytes) {
+        const char* begin = static_cast<const char*>(data);
+        meta.insert(meta.end(), begin, begin + bytes);
+    }
+
+    static void append_name (std::vector<char>& meta, const std::string& name) {
+        char field[chunk_name_length] = {0};
+        std::strncpy(field, name.c_str(), chunk_name_length-1);
+        append_bytes(meta, field, chunk_name_length);
+    }
+
+    void write_at (const void* data, std::size_t bytes, std::uint64_t offset) {
+        const char* begin = static_cast<const char*>(data);
+        while (bytes > 0) {
+            const ssize_t written = pwrite(fd, begin, bytes, offset);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Chunk_Writer: write failed: ") + std::strerror(errno));
+            }
+            begin  += written;
+            bytes  -= written;
+            offset += written;
+        }
+    }
+
+    /* Write the current chunk, then commit its samples in the header */
+    void write_chunk (void) {
+        Chunk_Header info;
+        std::memset(&info, 0, sizeof(info));
+        info.index		  = index;
+        info.first_sample = index*chunk_samples;
+        info.num_samples  = position;
+        std::memcpy(chunk.data(), &info, sizeof(info));
+        write_at(chunk.data(), header.chunk_bytes, header.data_offset + index*header.chunk_bytes);
+
+        header.num_samples = num_samples();
+        write_at(&header.num_samples, sizeof(header.num_samples), offsetof(Chunk_File_Header, num_samples));
+    }
+
+    /* File descriptor */
+    int					fd;
+
+    /* Number of variables and samples per chunk */
+    const unsigned		num_vars;
+    const unsigned		chunk_samples;
+
+    /* Copy of the file header */
+    Chunk_File_Header	header;
+
+    /* Current chunk including its header */
+    State_Block			chunk;
+
+    /* Number of the current chunk and position within it */
+    std::uint64_t		index	 = 0;
+    unsigned			position = 0;
+};
+
+/******************************************************************************/
+/*									Reader									  */
+/******************************************************************************/
+class Chunk_Reader {
+public:
+    /* Map an existing file, it may still be written */
+    explicit Chunk_Reader(const std::string& file) {
+        fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Chunk_Reader: cannot open " + file + ": " + std::strerror(errno));
+        }
+        try {
+            refresh();
+            if (std::memcmp(header.magic, chunk_file_magic, sizeof(header.magic)) != 0 ||
+                header.version != chunk_file_version) {
+                throw std::runtime_error("Chunk_Reader: " + file + " is no chunk file of version 1");
+            }
+        } catch (...) {
+            unmap();
+            close(fd);
+            throw;
+        }
+
+        /* Names, parameters and seeds */
+        const char* meta = base + sizeof(Chunk_File_Header);
+        for (unsigned v=0; v < header.num_vars; ++v, meta += chunk_name_length) {
+            names.push_back(std::string(meta, strnlen(meta, chunk_name_length)));
+        }
+        for (unsigned p=0; p < header.num_params; ++p) {
+            double value;
+            std::memcpy(&value, meta + chunk_name_length, sizeof(value));
+            params.push_back(std::make_pair(std::string(meta, strnlen(meta, chunk_name_length)), value));
+            meta += chunk_name_length + sizeof(value);
+        }
+        for (unsigned s=0; s < header.num_seeds; ++s, meta += sizeof(std::uint64_t)) {
+            std::uint64_t seed;
+            std::memcpy(&seed, meta, sizeof(seed));
+            seed_list.push_back(seed);
+        }
+    }
+
+    ~Chunk_Reader(void) {
+        unmap();
+        close(fd);
+    }
+
+    Chunk_Reader(const Chunk_Reader&) = delete;
+    Chunk_Reader& operator=(const Chunk_Reader&) = delete;
+
+    /* Map the samples committed since the last call, returns their total number */
+    std::uint64_t refresh (void) {
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (std::size_t) info.st_size < sizeof(Chunk_File_Header)) {
+            throw std::runtime_error("Chunk_Reader: file too short");
+        }
+        if ((std::size_t) info.st_size != mapped) {
+            unmap();
+            void* ptr = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (ptr == MAP_FAILED) {
+                throw std::runtime_error(std::string("Chunk_Reader: mmap failed: ") + std::strerror(errno));
+            }
+            base   = static_cast<const char*>(ptr);
+            mapped = info.st_size;
+        }
+
+        /* The counter is committed after its chunks, but the file may have grown */
+        /* since it was mapped, so only complete chunks within the mapping count  */
+        std::memcpy(&header, base, sizeof(header));
+        if (header.chunk_bytes > 0 && mapped >= header.data_offset) {
+            const std::uint64_t chunks = (mapped - header.data_offset)/header.chunk_bytes;
+            header.num_samples = std::min(header.num_samples, chunks*header.chunk_samples);
+        } else {
+            header.num_samples = 0;
+        }
+        return header.num_samples;
+    }
+
+    /* Description of the file */
+    const std::vector<std::string>&						variables	(void) const {return names;}
+    const std::vector<std::pair<std::string, double>>&	parameters	(void) const {return params;}
+    const std::vector<std::uint64_t>&					seeds		(void) const {return seed_list;}
+    double			sample_rate		(void) const {return header.sample_rate;}
+    std::uint64_t	chunk_samples	(void) const {return header.chunk_samples;}
+
+    /* Samples committed at the last refresh */
+    std::uint64_t	num_samples		(void) const {return header.num_samples;}
+
+    /* Index of a variable by name */
+    unsigned variable (const std::string& name) const {
+        for (unsigned v=0; v < names.size(); ++v) {
+            if (names[v] == name) {
+                return v;
+            }
+        }
+        throw std::out_of_range("Chunk_Reader: no variable " + name);
+    }
+
+    /* Row of variable v in chunk k, valid until the next refresh */
+    const double* chunk_data (std::uint64_t k, unsigned v) const {
+        const char* chunk = base + header.data_offset + k*header.chunk_bytes;
+        return reinterpret_cast<const double*>(chunk + sizeof(Chunk_Header)) + v*header.chunk_samples;
+    }
+
+    /* Copy samples [first, first+count) of variable v, returns the number of	*/
+    /* samples that were committed and copied									*/
+    std::uint64_t read (unsigned v, std::uint64_t first, std::uint64_t count, double* out) const {
+        if (v >= header.num_vars) {
+            throw std::out_of_range("Chunk_Reader: variable index out of range");
+        }
+        const std::uint64_t end = std::min(first + count, header.num_samples);
+        std::uint64_t sample = first;
+        while (sample < end) {
+            const std::uint64_t k	  = sample / header.chunk_samples;
+            const std::uint64_t begin = sample % header.chunk_samples;
+            const std::uint64_t n	  = std::min(end - sample, header.chunk_samples - begin);
+            std::memcpy(out, chunk_data(k, v) + begin, n*sizeof(double));
+            out	   += n;
+            sample += n;
+        }
+        return sample > first ? sample - first : 0;
+    }
+
+private:
+    void unmap (void) {
+        if (base) {
+            munmap(const_cast<char*>(base), mapped);
+            base   = nullptr;
+            mapped = 0;
+        }
+    }
+
+    /* File descriptor and mapping */
+    int					fd;
+    const char*			base	= nullptr;
+    std::size_t			mapped	= 0;
+
+    /* Copy of the file header at the last refresh */
+    Chunk_File_Header	header;
+
+    /* Names, parameters and seeds */
+    std::vector<std::string>						names;
+    std::vector<std::pair<std::string, double>>		params;
+    std::vector<std::uint64_t>						seed_list;
+};
@@ -36,26 +36,64 @@
 /*							Functions of the cortical module				  */
 /******************************************************************************/
 #include "Cortical_Column.h"
+#include "Cpu_Dispatch.h"
+
+/* Definitions of the SRK4 tables, which are indexed at runtime */
+constexpr double Cortical_Column::A[4];
+constexpr double Cortical_Column::B[4];
+
+/******************************************************************************/
+/*							Binding to the state block						  */
+/******************************************************************************/
+void Cortical_Column::bind(double* block) {
+    state	= block;
+    Vp		= block + 0 *num_stages;
+    Vi		= block + 1 *num_stages;
+    Na		= block + 2 *num_stages;
+    s_ep	= block + 3 *num_stages;
+    s_ei	= block + 4 *num_stages;
+    s_gp	= block + 5 *num_stages;
+    s_gi	= block + 6 *num_stages;
+    y		= block + 7 *num_stages;
+    x_ep	= block + 8 *num_stages;
+    x_ei	= block + 9 *num_stages;
+    x_gp	= block + 10*num_stages;
+    x_gi	= block + 11*num_stages;
+    x		= block + 12*num_stages;
+}
+
+void Cortical_Column::get_Thalamus(Thalamic_Column& T) {
+    set_afferent(T.y);
+}
+
+void Cortical_Column::init_state(void) {
+    for (unsigned i=0; i<num_vars; ++i) {
+        init(state + i*num_stages, 0.0);
+    }
+    init(Vp, E_L_p);
+    init(Vi, E_L_i);
+    init(Na, Na_eq);
+}
 
 /******************************************************************************/
 /*							Initialization of RNG 							  */
 /******************************************************************************/
-void Cortical_Column::set_RNG(void) {
+void Cortical_Column::set_RNG(std::uint64_t seed, unsigned stream) {
     extern const double dt;
-    unsigned numRandomVariables = 2;
+    unsigned numRandomVariables = num_streams/2;
 
-    MTRands.reserve(2*numRandomVariables);
+    Rand_Streams.reserve(2*numRandomVariables);
     Rand_vars.reserve(2*numRandomVariables);
     for (unsigned i=0; i < numRandomVariables; ++i){
         /* Add the RNG for I_{l}*/
-        MTRands.push_back(randomStreamNormal(0.0, dphi*dt));
+        Rand_Streams.push_back(Noise_Buffer(0.0, dphi*dt, seed, stream + 2*i));
 
         /* Add the RNG for I_{l,0} */
-        MTRands.push_back(randomStreamNormal(0.0, dt));
+        Rand_Streams.push_back(Noise_Buffer(0.0, dt, seed, stream + 2*i+1));
 
         /* Get the random number for the first iteration */
-        Rand_vars.push_back(MTRands[2*i]());
-        Rand_vars.push_back(MTRands[2*i+1]());
+        Rand_vars.push_back(Rand_Streams[2*i]());
+        Rand_vars.push_back(Rand_Streams[2*i+1]());
     }
 }
 
@@ -63,11 +101,11 @@ void Cortical_Column::set_RNG(void) {
 /*                          RK noise scaling 								  */
 /******************************************************************************/
 double Cortical_Column::noise_xRK(int N, int M) const{
-    return gamma_e * gamma_e * (Rand_vars[2*M] + Rand_vars[2*M+1]/std::sqrt(3))*B[N];
+    return gamma_e * gamma_e * ((Rand_vars[2*M] + Rand_input) + (Rand_vars[2*M+1] + Rand_input)/std::sqrt(3))*B[N];
 }
 
 double Cortical_Column::noise_aRK(int M) const{
-    return gamma_e * gamma_e * (Rand_vars[2*M] - Rand_vars[2*M+1]*std::sqrt(3))/4;
+    return gamma_e * gamma_e * ((Rand_vars[2*M] + Rand_input) - (Rand_vars[2*M+1] + Rand_input)*std::sqrt(3))/4;
 }
 
 /******************************************************************************/
@@ -132,43 +170,88 @@ double Cortical_Column::Na_pump (int N) const{
                    Na_eq*Na_eq*Na_eq/(Na_eq*Na_eq*Na_eq+3375));
 }
 
+/******************************************************************************/
+/*						Exact propagators of the kernels					  */
+/******************************************************************************/
+struct Cortical_Column::Kernels {
+    Alpha_Kernel e;
+    Alpha_Kernel g;
+    Alpha_Kernel nu;
+};
+
+const Cortical_Column::Kernels& Cortical_Column::kernels(void) {
+    extern const double dt;
+    static const Kernels K = {Alpha_Kernel(gamma_e, dt), Alpha_Kernel(gamma_g, dt), Alpha_Kernel(nu, dt)};
+    return K;
+}
+
+
 /******************************************************************************/
 /*                              SRK iteration                                 */
 /******************************************************************************/
+/* Every firing rate and the coupling is evaluated once per stage */
+Cortical_Column::Stage Cortical_Column::get_stage (int N) const{
+    Stage S;
+    S.Qp  = get_Qp(N);
+    S.Qi  = get_Qi(N);
+    S.y_T = afferent_T[N];
+    S.y_C = afferent_C ? afferent_C[N] : 0.0;
+    return S;
+}
+
+NM_TC_TARGET_CLONES
 void Cortical_Column::set_RK (int N) {
     extern const double dt;
+    const Stage S = get_stage(N);
     Vp	[N+1] = Vp  [0] + A[N] * dt*(-(I_L_p(N) + I_ep(N) + I_gp(N))/tau_p - I_KNa(N));
     Vi	[N+1] = Vi  [0] + A[N] * dt*(-(I_L_i(N) + I_ei(N) + I_gi(N))/tau_i);
-    Na	[N+1] = Na  [0] + A[N] * dt*(alpha_Na * get_Qp(N) - Na_pump(N))/tau_Na;
+    Na	[N+1] = Na  [0] + A[N] * dt*(alpha_Na * S.Qp - Na_pump(N))/tau_Na;
+    if (integrator == Integrator::Exponential) {
+        const Kernels& K   = kernels();
+        const double drive = Rand_input/dt_ref;
+        K.e .set_RK(N, s_ep, x_ep, gamma_e*gamma_e * (N_pp * S.Qp + N_pt * S.y_T + S.y_C + drive));
+        K.e .set_RK(N, s_ei, x_ei, gamma_e*gamma_e * (N_ip * S.Qp + N_it * S.y_T + S.y_C + drive));
+        K.g .set_RK(N, s_gp, x_gp, gamma_g*gamma_g * (N_pi * S.Qi));
+        K.g .set_RK(N, s_gi, x_gi, gamma_g*gamma_g * (N_ii * S.Qi));
+        K.nu.set_RK(N, y,	 x,	   nu * nu		   * (		  S.Qp));
+        return;
+    }
     s_ep[N+1] = s_ep[0] + A[N] * dt*(x_ep[N]);
     s_ei[N+1] = s_ei[0] + A[N] * dt*(x_ei[N]);
     s_gp[N+1] = s_gp[0] + A[N] * dt*(x_gp[N]);
     s_gi[N+1] = s_gi[0] + A[N] * dt*(x_gi[N]);
     y	[N+1] = y	[0] + A[N] * dt*(x	 [N]);
-    x_ep[N+1] = x_ep[0] + A[N] * dt*(gamma_e*gamma_e * (N_pp * get_Qp(N) + N_pt * Thalamus->y[N] - s_ep[N]) - 2 * gamma_e * x_ep[N]) + noise_xRK(N, 0);
-    x_ei[N+1] = x_ei[0] + A[N] * dt*(gamma_e*gamma_e * (N_ip * get_Qp(N) + N_it * Thalamus->y[N] - s_ei[N]) - 2 * gamma_e * x_ei[N]) + noise_xRK(N, 1)	;
-    x_gp[N+1] = x_gp[0] + A[N] * dt*(gamma_g*gamma_g * (N_pi * get_Qi(N)						 - s_gp[N]) - 2 * gamma_g * x_gp[N]);
-    x_gi[N+1] = x_gi[0] + A[N] * dt*(gamma_g*gamma_g * (N_ii * get_Qi(N)						 - s_gi[N]) - 2 * gamma_g * x_gi[N]);
-    x	[N+1] = x	[0] + A[N] * dt*(nu * nu         * (	   get_Qp(N)						 - y   [N])	- 2 * nu	  * x   [N]);
+    x_ep[N+1] = x_ep[0] + A[N] * dt*(gamma_e*gamma_e * (N_pp * S.Qp + N_pt * S.y_T + S.y_C - s_ep[N]) - 2 * gamma_e * x_ep[N]) + noise_xRK(N, 0);
+    x_ei[N+1] = x_ei[0] + A[N] * dt*(gamma_e*gamma_e * (N_ip * S.Qp + N_it * S.y_T + S.y_C - s_ei[N]) - 2 * gamma_e * x_ei[N]) + noise_xRK(N, 1);
+    x_gp[N+1] = x_gp[0] + A[N] * dt*(gamma_g*gamma_g * (N_pi * S.Qi				- s_gp[N]) - 2 * gamma_g * x_gp[N]);
+    x_gi[N+1] = x_gi[0] + A[N] * dt*(gamma_g*gamma_g * (N_ii * S.Qi				- s_gi[N]) - 2 * gamma_g * x_gi[N]);
+    x	[N+1] = x	[0] + A[N] * dt*(nu * nu         * (	   S.Qp				- y   [N])	- 2 * nu	  * x   [N]);
 }
 
 void Cortical_Column::add_RK(void) {
-    add_RK(Vp);
-    add_RK(Vi);
-    add_RK(Na);
-    add_RK(s_ep);
-    add_RK(s_ei);
-    add_RK(s_gp);
-    add_RK(s_gi);
-    add_RK(y);
-    add_RK_noise(x_ep, 0);
-    add_RK_noise(x_ei, 1);
-    add_RK(x_gp);
-    add_RK(x_gi);
-    add_RK(x);
+    /* The variables are contiguous, so sweep the whole block at once */
+    for (unsigned i=0; i<num_vars; ++i) {
+        add_RK(state + i*num_stages);
+    }
+    if (integrator == Integrator::Exponential) {
+        /* Standardize the noise to the intensity gamma_e^2 * dphi * sqrt(dt_ref) */
+        extern const double dt;
+        const Kernels& K = kernels();
+        const double c	 = gamma_e * gamma_e * std::sqrt(dt_ref)/dt;
+        K.e .add_RK(s_ep, x_ep, c * Rand_vars[0], c * dphi * Rand_vars[1]);
+        K.e .add_RK(s_ei, x_ei, c * Rand_vars[2], c * dphi * Rand_vars[3]);
+        K.g .add_RK(s_gp, x_gp);
+        K.g .add_RK(s_gi, x_gi);
+        K.nu.add_RK(y,	  x);
+    } else {
+        x_ep[0] += noise_aRK(0);
+        x_ei[0] += noise_aRK(1);
+    }
 
     /* Generate noise for the next iteration */
     for (unsigned i=0; i<Rand_vars.size(); ++i) {
-        Rand_vars[i] = MTRands[i]() + input;
+        Rand_vars[i] = Rand_Streams[i]();
     }
+    Rand_input = input;
 }
+
@@ -39,33 +39,74 @@
 #include <cmath>
 #include <vector>
 
-#include "Random_Stream.h"
+#include "Exponential_Integrator.h"
+#include "Noise_Buffer.h"
+#include "State_Block.h"
 #include "Thalamic_Column.h"
 class Thalamic_Column;
 
 class Cortical_Column {
 public:
-    Cortical_Column(double* Param, double* Con)
+    /* Constructor for simulation, state points into the system state block */
+    /* The noise streams are seeded with streams [stream, stream+num_streams) */
+    Cortical_Column(const double* Param, const double* Con, double* state, std::uint64_t seed, unsigned stream)
         :sigma_p 	(Param[0]),	g_KNa	(Param[1]), 	  dphi	(Param[2]),
           N_pt		(Con[2]),	N_it	(Con[3])
-    {set_RNG();}
+    {bind(state); init_state(); set_RNG(seed, stream);}
+
+    /* Number of state variables */
+    static const unsigned num_vars = 13;
+
+    /* Number of noise streams */
+    static const unsigned num_streams = 4;
+
+    /* Point the population variables into a state block */
+    void	bind		(double* state);
+
+    /* Continue with the noise streams of another seed, the noise of the next step is drawn anew */
+    void	reseed		(std::uint64_t seed, unsigned stream)
+    {Rand_Streams.clear(); Rand_vars.clear(); set_RNG(seed, stream);}
 
     /* Connect to the thalamic module */
-    void	get_Thalamus(Thalamic_Column& T) {Thalamus = &T;}
+    void	get_Thalamus(Thalamic_Column& T);
+
+    /* Read the afferent axonal flux per RK stage from external buffers, the	*/
+    /* cortical one is optional and drives both populations like the thalamus	*/
+    void	set_afferent(const double* thalamic, const double* cortical = nullptr)
+    {afferent_T = thalamic; afferent_C = cortical;}
 
     /* ODE functions */
     void 	set_RK		(int);
     void 	add_RK	 	(void);
 
+    /* Integrate the synaptic kernels with SRK4 or their exact propagator */
+    void	set_integrator (Integrator mode) {integrator = mode;}
+
+    /* Set strength of external input */
+    void	set_input	(double I) {input = I;}
+
 private:
     /* Declaration of private functions */
     /* Initialize the RNGs */
-    void 	set_RNG		(void);
+    void 	set_RNG		(std::uint64_t seed, unsigned stream);
 
     /* Firing rates */
     double 	get_Qp		(int) const;
     double 	get_Qi		(int) const;
 
+    /* Quantities used by several derivatives of a RK stage */
+    struct Stage {
+        double	Qp;				/* pyramidal firing rate								*/
+        double	Qi;				/* inhibitory firing rate								*/
+        double	y_T;			/* axonal flux of the thalamic module					*/
+        double	y_C;			/* weighted axonal flux of other cortical modules		*/
+    };
+    Stage	get_stage	(int) const;
+
+    /* Exact propagators of the synaptic kernels for dt, shared by all columns */
+    struct Kernels;
+    static const Kernels& kernels (void);
+
     /* Currents */
     double 	I_ep		(int) const;
     double 	I_ei		(int) const;
@@ -82,56 +123,58 @@ private:
     double 	noise_xRK 	(int,int) const;
     double 	noise_aRK 	(int) const;
 
+    /* Set the initial values of the population variables */
+    void 	init_state	(void);
+
     /* Helper functions */
-    inline std::vector<double> init (double value)
-    {return {value, 0.0, 0.0, 0.0, 0.0};}
+    inline void init (double* var, double value)
+    {var[0] = value; var[1] = var[2] = var[3] = var[4] = 0.0;}
 
-    inline void add_RK (std::vector<double>& var)
+    inline void add_RK (double* var)
     {var[0] = (-3*var[0] + 2*var[1] + 4*var[2] + 2*var[3] + var[4])/6;}
 
-    inline void add_RK_noise (std::vector<double>& var, unsigned noise)
-    {var[0] = (-3*var[0] + 2*var[1] + 4*var[2] + 2*var[3] + var[4])/6 + noise_aRK(noise);}
-
     /* Declaration and Initialization of parameters */
+    /* Fixed parameters are compile time constants shared by all instances, */
+    /* only the ones set by the constructor are stored per column			 */
     /* Membrane time in ms */
-    const double 	tau_p 		= 30;
-    const double 	tau_i 		= 30;
+    static constexpr double 	tau_p 		= 30;
+    static constexpr double 	tau_i 		= 30;
 
     /* Maximum firing rate in ms^-1 */
-    const double 	Qp_max		= 30.E-3;
-    const double 	Qi_max		= 60.E-3;
+    static constexpr double 	Qp_max		= 30.E-3;
+    static constexpr double 	Qi_max		= 60.E-3;
 
     /* Sigmoid threshold in mV */
-    const double 	theta_p		= -58.5;
-    const double 	theta_i		= -58.5;
+    static constexpr double 	theta_p		= -58.5;
+    static constexpr double 	theta_i		= -58.5;
 
     /* Sigmoid gain in mV */
     const double 	sigma_p		= 4;
-    const double 	sigma_i		= 6;
+    static constexpr double 	sigma_i		= 6;
 
     /* Scaling parameter for sigmoidal mapping (dimensionless) */
-    const double 	C1          = (M_PI/sqrt(3));
+    static constexpr double 	C1          = 1.8137993642342178;	/* pi/sqrt(3)	*/
 
     /* parameters of the firing adaption */
-    const double 	alpha_Na	= 2;			/* Sodium influx per spike			in mM ms 	*/
-    const double 	tau_Na		= 1.7;			/* Sodium time constant 			in ms 		*/
+    static constexpr double 	alpha_Na	= 2;			/* Sodium influx per spike			in mM ms 	*/
+    static constexpr double 	tau_Na		= 1.7;			/* Sodium time constant 			in ms 		*/
 
-    const double 	R_pump   	= 0.09;        	/* Na-K pump  constant              in mM/ms 	*/
-    const double 	Na_eq    	= 9.5;         	/* Na-eq concentration              in mM 		*/
+    static constexpr double 	R_pump   	= 0.09;        	/* Na-K pump  constant              in mM/ms 	*/
+    static constexpr double 	Na_eq    	= 9.5;         	/* Na-eq concentration              in mM 		*/
 
     /* PSP rise time in ms^-1 */
-    const double 	gamma_e		= 70E-3;
-    const double 	gamma_g		= 58.6E-3;
+    static constexpr double 	gamma_e		= 70E-3;
+    static constexpr double 	gamma_g		= 58.6E-3;
 
     /* Axonal flux time constant */
-    const double 	nu			= 120E-3;
+    static constexpr double 	nu			= 120E-3;
 
     /* Leak weight in aU*/
-    const double 	g_L    		= 1.;
+    static constexpr double 	g_L    		= 1.;
 
     /* Synaptic weight in ms */
-    const double 	g_AMPA 		= 1.;
-    const double 	g_GABA 		= 1.;
+    static constexpr double 	g_AMPA 		= 1.;
+    static constexpr double 	g_GABA 		= 1.;
 
     /* Conductivity */
     /* KNa in mS/cm^2 */
@@ -139,61 +182,83 @@ private:
 
     /* Reversal potentials in mV */
     /* Synaptic */
-    const double 	E_AMPA  	= 0;
-    const double 	E_GABA  	= -70;
+    static constexpr double 	E_AMPA  	= 0;
+    static constexpr double 	E_GABA  	= -70;
 
     /* Leak */
-    const double 	E_L_p 		= -64;
-    const double 	E_L_i 		= -64;
+    static constexpr double 	E_L_p 		= -64;
+    static constexpr double 	E_L_i 		= -64;
 
     /* Potassium */
-    const double 	E_K    		= -100;
+    static constexpr double 	E_K    		= -100;
 
     /* Noise parameters in ms^-1 */
-    const double 	mphi		= 0E-3;
+    static constexpr double 	mphi		= 0E-3;
     const double	dphi		= 20E-1;
     double			input		= 0.0;
 
     /* Connectivities (dimensionless) */
-    const double 	N_pp		= 115;
-    const double 	N_ip		= 72;
-    const double 	N_pi		= 90;
-    const double 	N_ii		= 90;
+    static constexpr double 	N_pp		= 115;
+    static constexpr double 	N_ip		= 72;
+    static constexpr double 	N_pi		= 90;
+    static constexpr double 	N_ii		= 90;
     const double 	N_pt		= 2.5;
     const double 	N_it		= 2.5;
 
-    /* Pointer to thalamic column */
-    Thalamic_Column* Thalamus;
+    /* Afferent axonal flux from the thalamus and other cortical columns per RK stage */
+    const double*	afferent_T	= nullptr;
+    const double*	afferent_C	= nullptr;
 
     /* Parameters for SRK4 iteration */
-    const std::vector<double> A = {0.5,  0.5,  1.0, 1.0};
-    const std::vector<double> B = {0.75, 0.75, 0.0, 0.0};
+    static constexpr double A[4] = {0.5,  0.5,  1.0, 1.0};
+    static constexpr double B[4] = {0.75, 0.75, 0.0, 0.0};
 
     /* Random number generators */
-    std::vector<randomStreamNormal> MTRands;
+    std::vector<Noise_Buffer>	Rand_Streams;
 
-    /* Container for noise */
+    /* Container for noise and the input at the time it was drawn */
     std::vector<double>	Rand_vars;
-
-    /* Population variables */
-    std::vector<double> Vp	= init(E_L_p),	/* excitatory membrane voltage						*/
-                        Vi	= init(E_L_i),	/* inhibitory membrane voltage						*/
-                        Na	= init(Na_eq),	/* Na concentration									*/
-                        s_ep= init(0.0),	/* PostSP from excitatory to excitatory population	*/
-                        s_ei= init(0.0),	/* PostSP from excitatory to inhibitory population	*/
-                        s_gp= init(0.0),	/* PostSP from inhibitory to excitatory population	*/
-                        s_gi= init(0.0),	/* PostSP from inhibitory to inhibitory population	*/
-                        y	= init(0.0),	/* axonal flux										*/
-                        x_ep= init(0.0),	/* derivative of s_ep								*/
-                        x_ei= init(0.0),	/* derivative of s_ei								*/
-                        x_gp= init(0.0),	/* derivative of s_gp				 				*/
-                        x_gi= init(0.0),	/* derivative of s_gi								*/
-                        x	= init(0.0);	/* derivative of y									*/
+    double				Rand_input	= 0.0;
+
+    /* Integration scheme of the synaptic kernels */
+    Integrator			integrator	= Integrator::SRK4;
+
+    /* Population variables, each a view of num_stages values in the state block	*/
+    double*	state;			/* begin of the state block of this column			*/
+    double*	Vp;				/* excitatory membrane voltage						*/
+    double*	Vi;				/* inhibitory membrane voltage						*/
+    double*	Na;				/* Na concentration									*/
+    double*	s_ep;			/* PostSP from excitatory to excitatory population	*/
+    double*	s_ei;			/* PostSP from excitatory to inhibitory population	*/
+    double*	s_gp;			/* PostSP from inhibitory to excitatory population	*/
+    double*	s_gi;			/* PostSP from inhibitory to inhibitory population	*/
+    double*	y;				/* axonal flux										*/
+    double*	x_ep;			/* derivative of s_ep								*/
+    double*	x_ei;			/* derivative of s_ei								*/
+    double*	x_gp;			/* derivative of s_gp				 				*/
+    double*	x_gi;			/* derivative of s_gi								*/
+    double*	x;				/* derivative of y									*/
 
     /* Data storage access */
     friend void get_data (int, Cortical_Column&, Thalamic_Column&, std::vector<double*>&);
 
     /* Stimulation protocol access */
     friend class Stim;
+    friend class Stim_Scheduler;
+
+    /* Ensemble engine access */
+    friend class TC_Ensemble;
     friend class Thalamic_Column;
+
+    /* Network engine access */
+    friend class TC_Network;
+
+    /* Recorder access */
+    friend class Recorder;
+
+    /* Checkpoint access */
+    friend class Checkpoint;
+
+    /* Real time mode access */
+    friend class Real_Time;
 };
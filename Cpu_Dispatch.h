@@ -0,0 +1,63 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Runtime selection of the instruction set			  */
+/*																			  */
+/* NM_TC_TARGET_CLONES compiles a kernel for AVX-512, AVX2 and generic		  */
+/* x86-64. The loader resolves the call once at startup from CPUID, so one	  */
+/* binary or mex file runs on every node with the widest vectors it has.	  */
+/* The kernels are elementwise and built with -ffp-contract=off, so the		  */
+/* AVX2 and AVX-512 variants do not fuse multiply adds and all variants		  */
+/* return bitwise identical results.										  */
+/* Dispatch needs GCC on x86-64 Linux, elsewhere and with NM_TC_NO_DISPATCH	  */
+/* the macro is empty and the kernels are built for the target of the		  */
+/* compiler flags. cpu_dispatch_path() names the variant in use.			  */
+/******************************************************************************/
+#pragma once
+#include <string>
+
+#if !defined(NM_TC_NO_DISPATCH) && defined(__GNUC__) && !defined(__clang__) && \
+     defined(__x86_64__) && defined(__linux__)
+#define NM_TC_DISPATCH 1
+#define NM_TC_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define NM_TC_TARGET_CLONES
+#endif
+
+/* Variant chosen by the loader, in the priority order of the clones */
+inline std::string cpu_dispatch_path (void) {
+#ifdef NM_TC_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return "avx512f";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return "avx2";
+    }
+    return "default";
+#else
+    return "static";
+#endif
+}
@@ -26,14 +26,51 @@
 /*                        Functions for data storage                          */
 /******************************************************************************/
 #pragma once
+#include <algorithm>
+#include <string>
+#include <utility>
 #include <vector>
+#include "Chunk_File.h"
 #include "Cortical_Column.h"
+#include "Recorder.h"
 #include "Thalamic_Column.h"
 
-void get_data(int counter, Cortical_Column& Cortex, Thalamic_Column& Thalamus,
-              std::vector<double*>& pData) {
+inline void get_data(int counter, Cortical_Column& Cortex, Thalamic_Column& Thalamus,
+                     std::vector<double*>& pData) {
     pData[0][counter] = Cortex.Vp		[0];
     pData[1][counter] = Thalamus.Vt		[0];
     pData[2][counter] = Thalamus.Ca		[0];
     pData[3][counter] = Thalamus.act_h	();
 }
+
+/* Names of the stored variables in the order of get_data, all of them are recordable */
+inline std::vector<std::string> data_names(void) {
+    return {"Vp", "Vt", "Ca", "act_h"};
+}
+
+/* Append the complete samples of a recorder to an output file and drop them */
+inline void get_data(Chunk_Writer& Output, Recorder& Rec) {
+    std::size_t count = Rec.data(0).size();
+    for (unsigned c=1; c < Rec.size(); ++c) {
+        count = std::min(count, Rec.data(c).size());
+    }
+    std::vector<double> sample(Rec.size());
+    for (std::size_t k=0; k < count; ++k) {
+        for (unsigned c=0; c < Rec.size(); ++c) {
+            sample[c] = Rec.data(c)[k];
+        }
+        Output.append(sample.data());
+    }
+    for (unsigned c=0; c < Rec.size(); ++c) {
+        Rec.data(c).erase(Rec.data(c).begin(), Rec.data(c).begin() + count);
+    }
+}
+
+/* Parameters of a simulation as stored in the output file header */
+inline std::vector<std::pair<std::string, double>> data_parameters(const double* Param_Cortex,
+        const double* Param_Thalamus, const double* Con) {
+    return {{"sigma_p", Param_Cortex[0]},	{"g_KNa", Param_Cortex[1]}, {"dphi", Param_Cortex[2]},
+            {"g_LK",	Param_Thalamus[0]}, {"g_h",	  Param_Thalamus[1]},
+            {"N_tp",	Con[0]},			{"N_rp",  Con[1]},
+            {"N_pt",	Con[2]},			{"N_it",  Con[3]}};
+}
@@ -0,0 +1,122 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Streaming decimation by a low pass FIR				  */
+/*																			  */
+/* The filter is a Kaiser windowed sinc of odd length, so its delay is an	  */
+/* integer number of input samples. It runs in polyphase form: every input	  */
+/* is multiplied into the K = length/factor outputs it contributes to, and	  */
+/* every factor-th input the oldest of these accumulators is complete. The	  */
+/* cost is K multiply adds per input and no input history is kept.			  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Cpu_Dispatch.h"
+
+class Decimator {
+public:
+    /* Decimate by factor with the passband up to f_pass and the stopband from	*/
+    /* f_stop, both relative to the input rate, attenuation in dB				*/
+    Decimator(unsigned factor, double f_pass, double f_stop, double attenuation = 80)
+        : factor (factor) {
+        /* Kaiser's estimates of length and shape */
+        const double transition = 2*M_PI*(f_stop - f_pass);
+        unsigned length = (unsigned) std::ceil((attenuation - 7.95)/(2.285*transition)) + 1;
+        length += 1 - length%2;
+        const double beta = attenuation > 50 ? 0.1102*(attenuation - 8.7) :
+                            attenuation > 21 ? 0.5842*std::pow(attenuation - 21, 0.4) + 0.07886*(attenuation - 21) : 0;
+
+        const double cutoff = (f_pass + f_stop)/2;
+        const double center = (length - 1)/2.;
+        std::vector<double> h(length);
+        double sum = 0;
+        for (unsigned k=0; k < length; ++k) {
+            const double x = k - center;
+            const double r = center > 0 ? x/center : 0;
+            const double sinc = x == 0 ? 2*cutoff : std::sin(2*M_PI*cutoff*x)/(M_PI*x);
+            h[k] = sinc * bessel_I0(beta*std::sqrt(std::max(0., 1 - r*r)))/bessel_I0(beta);
+            sum += h[k];
+        }
+
+        /* Unit gain at DC, phase p holds the taps h[i*factor + factor-1-p] */
+        num_taps	 = length;
+        num_partials = (length + factor - 1)/factor;
+        coefficients.assign(factor*num_partials, 0.0);
+        for (unsigned p=0; p < factor; ++p) {
+            for (unsigned i=0; i < num_partials; ++i) {
+                const unsigned k = i*factor + factor-1-p;
+                if (k < length) {
+                    coefficients[p*num_partials + i] = h[k]/sum;
+                }
+            }
+        }
+        partials.assign(num_partials, 0.0);
+    }
+
+    /* Feed one input, returns true once an output is complete and stored in y */
+    NM_TC_TARGET_CLONES
+    bool operator() (double x, double& y) {
+        const double* c = coefficients.data() + phase*num_partials;
+        for (unsigned i=0; i < num_partials; ++i) {
+            partials[i] += c[i] * x;
+        }
+        if (++phase < factor) {
+            return false;
+        }
+        phase = 0;
+        y = partials[0];
+        std::copy(partials.begin()+1, partials.end(), partials.begin());
+        partials.back() = 0.0;
+        return true;
+    }
+
+    /* Delay of the output in input samples */
+    unsigned delay		(void) const {return (num_taps - 1)/2;}
+
+private:
+    /* Modified Bessel function of order 0 for the window */
+    static double bessel_I0 (double x) {
+        double sum = 1, term = 1;
+        for (unsigned k=1; term > 1E-16*sum; ++k) {
+            term *= (x/(2*k))*(x/(2*k));
+            sum	 += term;
+        }
+        return sum;
+    }
+
+    unsigned			factor;
+    unsigned			num_taps;
+    unsigned			num_partials;
+    unsigned			phase = 0;
+
+    /* Polyphase taps, factor x num_partials */
+    std::vector<double>	coefficients;
+
+    /* Outputs that are still being accumulated, oldest first */
+    std::vector<double>	partials;
+};
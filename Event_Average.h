@@ -0,0 +1,131 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*							Event locked averaging							  */
+/*																			  */
+/* Mean and standard deviation of windows [event-before, event+after] of		  */
+/* several channels, accumulated with Welford's update while the samples		  */
+/* arrive. Every channel keeps a ring of its last samples, so an event may	  */
+/* be triggered up to latency samples after its window ended, e.g. a trough	  */
+/* that is only detected after the filter delay. Windows that do not fit		  */
+/* into the recording or have left the ring are dropped. The memory is		  */
+/* independent of the duration of the recording.								  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+class Event_Average {
+public:
+    /* Averages of num_channels channels over before + after + 1 samples */
+    Event_Average(unsigned num_channels, unsigned before, unsigned after, unsigned latency = 0)
+        : before (before), after (after), channels (num_channels) {
+        for (Channel& ch : channels) {
+            ch.history.assign(before + after + 1 + latency, 0.0);
+            ch.mean.assign(before + after + 1, 0.0);
+            ch.M2.assign(before + after + 1, 0.0);
+        }
+    }
+
+    /* Event at sample index, e.g. a stimulation marker or a detected trough */
+    void trigger (std::uint64_t index) {
+        for (Channel& ch : channels) {
+            ch.pending.insert(std::upper_bound(ch.pending.begin(), ch.pending.end(), index), index);
+            fold(ch);
+        }
+    }
+
+    /* Next sample of a channel, the indices of a channel have to be consecutive */
+    void push (unsigned channel, std::uint64_t index, double x) {
+        Channel& ch = channels.at(channel);
+        if (index != ch.next) {
+            throw std::invalid_argument("Event_Average: samples have to be consecutive");
+        }
+        ch.history[index % ch.history.size()] = x;
+        ch.next = index + 1;
+        fold(ch);
+    }
+
+    /* Window length, number of channels and number of averaged events of a channel */
+    unsigned			length		 (void)				const {return before + after + 1;}
+    unsigned			num_channels (void)				const {return channels.size();}
+    unsigned			count		 (unsigned channel) const {return channels.at(channel).count;}
+
+    /* Mean of a channel over the window */
+    const std::vector<double>& mean (unsigned channel) const {return channels.at(channel).mean;}
+
+    /* Standard deviation of a channel normalized by count-1 as std in MATLAB */
+    std::vector<double> sd (unsigned channel) const {
+        const Channel& ch = channels.at(channel);
+        std::vector<double> result(length(), 0.0);
+        if (ch.count > 1) {
+            for (unsigned k=0; k < length(); ++k) {
+                result[k] = std::sqrt(ch.M2[k]/(ch.count - 1));
+            }
+        }
+        return result;
+    }
+
+private:
+    struct Channel {
+        /* Last samples, index n at n % size */
+        std::vector<double>			history;
+        std::uint64_t				next	= 0;
+
+        /* Events in ascending order whose window is not yet complete */
+        std::deque<std::uint64_t>	pending;
+
+        /* Welford accumulators */
+        unsigned					count	= 0;
+        std::vector<double>			mean;
+        std::vector<double>			M2;
+    };
+
+    /* Fold all complete windows of a channel */
+    void fold (Channel& ch) {
+        while (!ch.pending.empty() && ch.pending.front() + after < ch.next) {
+            const std::uint64_t event = ch.pending.front();
+            ch.pending.pop_front();
+            if (event < before || ch.next - (event - before) > ch.history.size()) {
+                continue;
+            }
+            ++ch.count;
+            for (unsigned k=0; k < length(); ++k) {
+                const double x		= ch.history[(event - before + k) % ch.history.size()];
+                const double delta	= x - ch.mean[k];
+                ch.mean[k] += delta/ch.count;
+                ch.M2[k]   += delta*(x - ch.mean[k]);
+            }
+        }
+    }
+
+    const unsigned			before;
+    const unsigned			after;
+    std::vector<Channel>	channels;
+};
@@ -0,0 +1,367 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*					Streaming band-pass filters and event detection			  */
+/*																			  */
+/* The analysis of the recorded time series runs alongside the simulation	  */
+/* and keeps only a window of the data. It follows Data_SO_Average.m:		  */
+/*	- band-pass filters with 513 Hamming windowed taps as fieldtrip's 'fir',  */
+/*	- the Hilbert envelope of the filtered signals,							  */
+/*	- findpeaks with MINPEAKHEIGHT and MINPEAKDISTANCE.						  */
+/*																			  */
+/* A band is filtered with complex taps 2*lowpass*exp(i w0 n), whose real	  */
+/* part are the taps of fir1 and whose output is the analytic signal, so the  */
+/* envelope needs no extra Hilbert filter. The convolution is computed with	  */
+/* overlap-save FFTs, the input transform is shared by all bands.			  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "FFT.h"
+
+/******************************************************************************/
+/*								Band-pass filter bank						  */
+/******************************************************************************/
+class Band_Filter_Bank {
+public:
+    /* Filters of the given number of taps for samples at rate Hz, the FFT size	*/
+    /* defaults to the smallest power of two of at least twice the taps		*/
+    Band_Filter_Bank(double rate, unsigned taps = 513, unsigned fft_size = 0)
+        : rate (rate), taps (taps | 1u), fft (block_size(taps | 1u, fft_size)),
+          input (fft.get_size(), 0.0), spectrum (fft.get_size()) {}
+
+    /* Add the band [f_low, f_high] in Hz, returns its index */
+    unsigned add (double f_low, double f_high) {
+        if (!(0 <= f_low && f_low < f_high && f_high < rate/2)) {
+            throw std::invalid_argument("Band_Filter_Bank: invalid band");
+        }
+        const unsigned N = fft.get_size();
+        const double   M = delay();
+        const double   fc = (f_high - f_low)/(2*rate);
+        const double   w0 = M_PI*(f_high + f_low)/rate;
+
+        /* Modulated lowpass, scaled to unit gain of the real part at the center as fir1 */
+        std::vector<std::complex<double>> h(N, 0.0);
+        double gain = 0.0;
+        for (unsigned n=0; n < taps; ++n) {
+            const double x = n - M;
+            const double sinc   = x == 0 ? 2*fc : std::sin(2*M_PI*fc*x)/(M_PI*x);
+            const double window = 0.54 - 0.46*std::cos(2*M_PI*n/(taps-1));
+            h[n] = 2*sinc*window*std::polar(1.0, w0*x);
+            gain += h[n].real()*std::cos(w0*x);
+        }
+        for (unsigned n=0; n < taps; ++n) {
+            h[n] /= gain;
+        }
+        fft.forward(h);
+        responses.push_back(std::move(h));
+        outputs.emplace_back(N);
+        values.resize(responses.size());
+        return responses.size() - 1;
+    }
+
+    /* Feed sample number count(), out(index, z) is called for every completed	*/
+    /* sample index with the analytic signals z[band] of all bands. The		*/
+    /* outputs are aligned to the input and complete delay() samples and up	*/
+    /* to one block later														*/
+    template <typename Output>
+    void push (double x, Output&& out) {
+        if (num_inputs == 0) {
+            std::fill(input.begin(), input.begin() + taps-1, x);
+        }
+        input[fill++] = x;
+        ++num_inputs;
+        last = x;
+        if (fill == input.size()) {
+            process(out);
+        }
+    }
+
+    /* Complete the outputs of all fed samples, the input is continued with its	*/
+    /* last value. No samples can be fed afterwards							*/
+    template <typename Output>
+    void flush (Output&& out) {
+        if (num_inputs == 0) {
+            return;
+        }
+        limit = num_inputs;
+        while (num_outputs < limit) {
+            std::fill(input.begin() + fill, input.end(), last);
+            fill = input.size();
+            process(out);
+        }
+    }
+
+    /* Delay of the filters in samples */
+    unsigned		delay		(void) const {return (taps - 1)/2;}
+
+    /* Largest number of samples fed after a sample until its output is complete */
+    unsigned		latency		(void) const {return delay() + input.size() - (taps - 1);}
+    unsigned		num_bands	(void) const {return responses.size();}
+    std::uint64_t	count		(void) const {return num_inputs;}
+
+private:
+    static unsigned block_size (unsigned taps, unsigned fft_size) {
+        if (fft_size == 0) {
+            fft_size = 2;
+            while (fft_size < 2*taps) {
+                fft_size *= 2;
+            }
+        }
+        if (fft_size <= taps) {
+            throw std::invalid_argument("Band_Filter_Bank: FFT size has to exceed the taps");
+        }
+        return fft_size;
+    }
+
+    /* Filter the full input block, the last N-taps+1 outputs are valid */
+    template <typename Output>
+    void process (Output& out) {
+        const unsigned N = input.size();
+        std::copy(input.begin(), input.end(), spectrum.begin());
+        fft.forward(spectrum);
+        for (unsigned b=0; b < responses.size(); ++b) {
+            for (unsigned k=0; k < N; ++k) {
+                outputs[b][k] = spectrum[k] * responses[b][k];
+            }
+            fft.inverse(outputs[b]);
+        }
+
+        /* Position i holds the filter output of input block_begin + i-(taps-1), */
+        /* which belongs to the sample delay() earlier							 */
+        for (unsigned i=taps-1; i < N; ++i) {
+            const std::uint64_t n = block_begin + i - (taps-1);
+            if (n < delay()) {
+                continue;
+            }
+            const std::uint64_t index = n - delay();
+            if (index >= limit) {
+                break;
+            }
+            for (unsigned b=0; b < responses.size(); ++b) {
+                values[b] = outputs[b][i];
+            }
+            out(index, values.data());
+            num_outputs = index + 1;
+        }
+
+        std::copy(input.end() - (taps-1), input.end(), input.begin());
+        fill		 = taps - 1;
+        block_begin += N - (taps-1);
+    }
+
+    double			rate;
+    unsigned		taps;
+    FFT				fft;
+
+    /* Input block, the first taps-1 samples overlap with the previous block */
+    std::vector<double>					input;
+    unsigned							fill		= taps - 1;
+    double								last		= 0.0;
+
+    /* Transforms of the input and the filters, filter outputs per band */
+    std::vector<std::complex<double>>				spectrum;
+    std::vector<std::vector<std::complex<double>>>	responses;
+    std::vector<std::vector<std::complex<double>>>	outputs;
+    std::vector<std::complex<double>>				values;
+
+    /* Input index at position taps-1 of the block and counters of samples */
+    std::uint64_t	block_begin = 0;
+    std::uint64_t	num_inputs	= 0;
+    std::uint64_t	num_outputs = 0;
+    std::uint64_t	limit		= UINT64_MAX;
+};
+
+/******************************************************************************/
+/*								Peak detection								  */
+/* Same peaks as findpeaks(x, 'MINPEAKHEIGHT', height, 'MINPEAKDISTANCE', d): */
+/* local maxima above height, a flat peak counts at its first sample. Peaks	  */
+/* at most d from a higher one are dropped, starting from the highest. Only	  */
+/* peaks at most d apart interact, so a group of peaks is final once the	  */
+/* signal went on for more than d samples after its last one.				  */
+/******************************************************************************/
+class Peak_Detector {
+public:
+    /* Minimal height and distance in samples */
+    Peak_Detector(double min_height, double min_distance)
+        : min_height (min_height), min_distance (min_distance) {}
+
+    /* Feed the sample with the next index */
+    void push (std::uint64_t index, double x) {
+        if (has_previous) {
+            if (x > previous) {
+                candidate	   = Peak{index, x};
+                has_candidate = true;
+            } else if (x < previous && has_candidate) {
+                has_candidate = false;
+                if (candidate.height > min_height) {
+                    if (!group.empty() && candidate.index - group.back().index > min_distance) {
+                        resolve();
+                    }
+                    group.push_back(candidate);
+                }
+            }
+        }
+        has_previous = true;
+        previous	 = x;
+
+        /* Later peaks are not before the candidate or the next sample */
+        const std::uint64_t next = has_candidate ? candidate.index : index + 1;
+        if (!group.empty() && next - group.back().index > min_distance) {
+            resolve();
+        }
+    }
+
+    /* Decide the remaining peaks at the end of the signal */
+    void flush (void) {resolve();}
+
+    /* Indices of the detected peaks in ascending order */
+    const std::vector<std::uint64_t>& peaks (void) const {return found;}
+
+private:
+    struct Peak {
+        std::uint64_t	index;
+        double			height;
+    };
+
+    void resolve (void) {
+        std::vector<unsigned> order(group.size());
+        for (unsigned k=0; k < order.size(); ++k) {
+            order[k] = k;
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [this] (unsigned a, unsigned b) {return group[a].height > group[b].height;});
+
+        std::vector<bool> removed(group.size(), false);
+        for (unsigned k : order) {
+            if (removed[k]) {
+                continue;
+            }
+            for (unsigned j=0; j < group.size(); ++j) {
+                const double distance = group[j].index > group[k].index ? group[j].index - group[k].index
+                                                                         : group[k].index - group[j].index;
+                removed[j] = removed[j] || (j != k && distance <= min_distance);
+            }
+        }
+        for (unsigned k=0; k < group.size(); ++k) {
+            if (!removed[k]) {
+                found.push_back(group[k].index);
+            }
+        }
+        group.clear();
+    }
+
+    const double		min_height;
+    const double		min_distance;
+
+    /* Last sample and the start of the last rise */
+    bool				has_previous	= false;
+    double				previous		= 0.0;
+    bool				has_candidate	= false;
+    Peak				candidate		= {0, 0.0};
+
+    /* Peaks that may still interact with later ones */
+    std::vector<Peak>	group;
+
+    std::vector<std::uint64_t> found;
+};
+
+/******************************************************************************/
+/*							Slow oscillation analysis						  */
+/* Slow oscillation band (0.25-4 Hz) plus the mean of Vp, troughs below the	  */
+/* threshold and the power of the slow (9-12 Hz) and fast (12-15 Hz) spindle  */
+/* bands. The mean is the running mean of the samples so far, where			  */
+/* Data_SO_Average.m uses the mean of the whole trace.						  */
+/******************************************************************************/
+class SO_Analysis {
+public:
+    /* Filtered quantities of one sample */
+    struct Sample {
+        double	SO;				/* slow oscillation band of Vp in mV					*/
+        double	SSP;			/* slow spindle power in mV^2							*/
+        double	FSP;			/* fast spindle power in mV^2							*/
+    };
+
+    /* Samples at rate Hz, troughs below threshold in mV at least min_distance s apart */
+    SO_Analysis(double rate, double threshold = -68, double min_distance = 0.2)
+        : Bank (rate), Troughs (-threshold, min_distance*rate), min_distance (std::ceil(min_distance*rate)) {
+        Bank.add(0.25, 4);
+        Bank.add(9,	  12);
+        Bank.add(12,  15);
+    }
+
+    /* Feed the next sample of Vp, out(index, sample) is called for every	*/
+    /* completed sample													*/
+    template <typename Output>
+    void push (double Vp, Output&& out) {
+        sum += Vp;
+        Bank.push(Vp, [this, &out] (std::uint64_t index, const std::complex<double>* z)
+                      {emit(index, z, out);});
+    }
+
+    void push (double Vp) {push(Vp, [] (std::uint64_t, const Sample&) {});}
+
+    /* Offset the SO band by a fixed mean instead of the running mean of the	*/
+    /* fed samples, e.g. the mean of a whole recorded trace					*/
+    void set_mean (double mean) {fixed_mean = true; Vp_mean = mean;}
+
+    /* Complete all fed samples and decide the last troughs */
+    template <typename Output>
+    void flush (Output&& out) {
+        Bank.flush([this, &out] (std::uint64_t index, const std::complex<double>* z)
+                   {emit(index, z, out);});
+        Troughs.flush();
+    }
+
+    void flush (void) {flush([] (std::uint64_t, const Sample&) {});}
+
+    /* Samples fed after a trough until it is usually detected, a group of	*/
+    /* troughs closer than min_distance takes longer							*/
+    unsigned latency (void) const {return Bank.latency() + 4*min_distance + 2;}
+
+    /* Sample indices of the detected troughs */
+    const std::vector<std::uint64_t>& troughs (void) const {return Troughs.peaks();}
+
+private:
+    template <typename Output>
+    void emit (std::uint64_t index, const std::complex<double>* z, Output& out) {
+        const double mean = fixed_mean ? Vp_mean : sum/Bank.count();
+        const Sample S = {z[0].real() + mean, std::norm(z[1]), std::norm(z[2])};
+        Troughs.push(index, -S.SO);
+        out(index, S);
+    }
+
+    Band_Filter_Bank	Bank;
+    Peak_Detector		Troughs;
+    unsigned			min_distance;
+    double				sum = 0.0;
+    bool				fixed_mean = false;
+    double				Vp_mean = 0.0;
+};
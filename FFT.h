@@ -0,0 +1,102 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Radix-2 fast Fourier transform						  */
+/*																			  */
+/* In place complex transform of a fixed power of two size. The twiddle		  */
+/* factors and the bit reversal permutation are computed once, so repeated	  */
+/* transforms of streaming blocks only do the butterflies.					  */
+/******************************************************************************/
+#pragma once
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+class FFT {
+public:
+    /* Transform of size n, which has to be a power of two */
+    explicit FFT(unsigned n)
+        : size (n), twiddle (n/2), reversed (n) {
+        if (n < 2 || (n & (n-1)) != 0) {
+            throw std::invalid_argument("FFT: size has to be a power of two");
+        }
+        for (unsigned k=0; k < n/2; ++k) {
+            twiddle[k] = std::polar(1.0, -2*M_PI*k/n);
+        }
+        unsigned bits = 0;
+        while ((1u << bits) < n) {
+            ++bits;
+        }
+        for (unsigned i=0; i < n; ++i) {
+            unsigned r = 0;
+            for (unsigned b=0; b < bits; ++b) {
+                r |= ((i >> b) & 1u) << (bits-1-b);
+            }
+            reversed[i] = r;
+        }
+    }
+
+    /* Forward transform, sum_n x[n] exp(-2 pi i k n/size) */
+    void forward (std::vector<std::complex<double>>& x) const {transform(x, false);}
+
+    /* Inverse transform including the 1/size scaling */
+    void inverse (std::vector<std::complex<double>>& x) const {
+        transform(x, true);
+        for (std::complex<double>& v : x) {
+            v /= size;
+        }
+    }
+
+    unsigned get_size (void) const {return size;}
+
+private:
+    void transform (std::vector<std::complex<double>>& x, bool conjugate) const {
+        if (x.size() != size) {
+            throw std::invalid_argument("FFT: data does not match the size");
+        }
+        for (unsigned i=0; i < size; ++i) {
+            if (i < reversed[i]) {
+                std::swap(x[i], x[reversed[i]]);
+            }
+        }
+        for (unsigned len=2; len <= size; len *= 2) {
+            const unsigned stride = size/len;
+            for (unsigned i=0; i < size; i += len) {
+                for (unsigned k=0; k < len/2; ++k) {
+                    const std::complex<double> w = conjugate ? std::conj(twiddle[k*stride]) : twiddle[k*stride];
+                    const std::complex<double> v = x[i+k+len/2] * w;
+                    x[i+k+len/2] = x[i+k] - v;
+                    x[i+k]		+= v;
+                }
+            }
+        }
+    }
+
+    unsigned							size;
+    std::vector<std::complex<double>>	twiddle;
+    std::vector<unsigned>				reversed;
+};
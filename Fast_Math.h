@@ -0,0 +1,174 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*					Branch free math functions for SIMD loops				  */
+/******************************************************************************/
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+/******************************************************************************/
+/*								Exponential									  */
+/* exp(x) = 2^k * exp(r) with |r| <= ln(2)/2. The rounding of k uses the	  */
+/* 1.5*2^52 shift, so the integer part can be read from the mantissa bits	  */
+/* and no conversion instructions are needed. exp(r) is a degree 13 Taylor	  */
+/* polynomial, the relative error is below 3E-16 for |x| < 708.				  */
+/******************************************************************************/
+inline double fast_exp (double x) {
+    const double log2e	= 1.4426950408889634;
+    const double ln2_hi	= 6.93147180369123816490e-01;
+    const double ln2_lo	= 1.90821492927058770002e-10;
+    const double shift	= 6755399441055744.0;		/* 1.5*2^52				  */
+
+    /* Clamp to the range of normal doubles */
+    x = x >  708.0 ?  708.0 : x;
+    x = x < -708.0 ? -708.0 : x;
+
+    /* Round x/ln(2) to the nearest integer */
+    const double kd_shifted = x * log2e + shift;
+    const double kd			= kd_shifted - shift;
+    const double r			= (x - kd * ln2_hi) - kd * ln2_lo;
+
+    /* Taylor polynomial of exp(r) in Horner form */
+    double p = 1.0/6227020800.0;
+    p = p * r + 1.0/479001600.0;
+    p = p * r + 1.0/39916800.0;
+    p = p * r + 1.0/3628800.0;
+    p = p * r + 1.0/362880.0;
+    p = p * r + 1.0/40320.0;
+    p = p * r + 1.0/5040.0;
+    p = p * r + 1.0/720.0;
+    p = p * r + 1.0/120.0;
+    p = p * r + 1.0/24.0;
+    p = p * r + 1.0/6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    /* Build 2^k from the low mantissa bits of the shifted value */
+    std::int64_t k;
+    std::memcpy(&k, &kd_shifted, sizeof(k));
+    k = (k - 0x4338000000000000LL + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &k, sizeof(scale));
+    return p * scale;
+}
+
+/******************************************************************************/
+/*								Logarithm									  */
+/* x = 2^k * z with sqrt(1/2) <= z < sqrt(2), the split is done on the bits	  */
+/* so no conversion instructions are needed. log(z) = 2*atanh(s) with		  */
+/* s = (z-1)/(z+1), |s| < 0.172, is summed up to s^23. The relative error is  */
+/* below 4E-16 for positive normal x, other inputs are not handled.			  */
+/******************************************************************************/
+inline double fast_log (double x) {
+    const double ln2_hi	= 6.93147180369123816490e-01;
+    const double ln2_lo	= 1.90821492927058770002e-10;
+    const double shift	= 6755399441055744.0;		/* 1.5*2^52				  */
+
+    /* Exponent relative to sqrt(1/2) and the mantissa scaled into range */
+    std::int64_t ix;
+    std::memcpy(&ix, &x, sizeof(ix));
+    const std::int64_t tmp = ix - 0x3FE6A09E667F3BCDLL;
+    const std::int64_t k   = tmp >> 52;
+    const std::int64_t iz  = ix - (tmp & (0xFFFLL << 52));
+    double z;
+    std::memcpy(&z, &iz, sizeof(z));
+
+    /* Convert k to double via the 1.5*2^52 shift */
+    const std::int64_t k_shifted = k + 0x4338000000000000LL;
+    double kd;
+    std::memcpy(&kd, &k_shifted, sizeof(kd));
+    kd -= shift;
+
+    /* Series of atanh in Horner form */
+    const double s	= (z - 1.0) / (z + 1.0);
+    const double s2	= s * s;
+    double p = 1.0/23;
+    p = p * s2 + 1.0/21;
+    p = p * s2 + 1.0/19;
+    p = p * s2 + 1.0/17;
+    p = p * s2 + 1.0/15;
+    p = p * s2 + 1.0/13;
+    p = p * s2 + 1.0/11;
+    p = p * s2 + 1.0/9;
+    p = p * s2 + 1.0/7;
+    p = p * s2 + 1.0/5;
+    p = p * s2 + 1.0/3;
+    p = p * s2;
+
+    return kd * ln2_hi + ((2.0 * s + 2.0 * s * p) + kd * ln2_lo);
+}
+
+/******************************************************************************/
+/*								Sine and cosine								  */
+/* x = k*pi/2 + r with |r| <= pi/4 using a three part Cody-Waite reduction,	  */
+/* which is exact for |x| < 1E5. sin(r) and cos(r) are Taylor polynomials up  */
+/* to r^17 and r^18, the quadrant k mod 4 selects and signs them. The error	  */
+/* is at most 2 ulp within that range.									  */
+/******************************************************************************/
+inline void fast_sincos (double x, double& sin_x, double& cos_x) {
+    const double two_over_pi = 6.36619772367581382433e-01;
+    const double pio2_1		 = 1.57079632673412561417e+00;
+    const double pio2_2		 = 6.07710050630396597660e-11;
+    const double pio2_3		 = 2.02226624871116645580e-21;
+    const double shift		 = 6755399441055744.0;	/* 1.5*2^52				  */
+
+    /* Round x/(pi/2) to the nearest integer */
+    const double kd_shifted = x * two_over_pi + shift;
+    const double kd			= kd_shifted - shift;
+    const double r			= ((x - kd * pio2_1) - kd * pio2_2) - kd * pio2_3;
+    const double r2			= r * r;
+
+    /* Taylor polynomials in Horner form */
+    double ps = -1.0/355687428096000.0;
+    ps = ps * r2 + 1.0/1307674368000.0;
+    ps = ps * r2 - 1.0/6227020800.0;
+    ps = ps * r2 + 1.0/39916800.0;
+    ps = ps * r2 - 1.0/362880.0;
+    ps = ps * r2 + 1.0/5040.0;
+    ps = ps * r2 - 1.0/120.0;
+    ps = ps * r2 + 1.0/6.0;
+    ps = r - r * r2 * ps;
+
+    double pc = 1.0/6402373705728000.0;
+    pc = pc * r2 - 1.0/20922789888000.0;
+    pc = pc * r2 + 1.0/87178291200.0;
+    pc = pc * r2 - 1.0/479001600.0;
+    pc = pc * r2 + 1.0/3628800.0;
+    pc = pc * r2 - 1.0/40320.0;
+    pc = pc * r2 + 1.0/720.0;
+    pc = pc * r2 - 1.0/24.0;
+    pc = pc * r2 + 0.5;
+    pc = 1.0 - r2 * pc;
+
+    /* Quadrant from the low mantissa bits of the shifted value */
+    std::int64_t q;
+    std::memcpy(&q, &kd_shifted, sizeof(q));
+    const double s = (q & 1) ? pc : ps;
+    const double c = (q & 1) ? ps : pc;
+    sin_x = (q & 2)		  ? -s : s;
+    cos_x = ((q + 1) & 2) ? -c : c;
+}
@@ -12,7 +12,7 @@ cd ..;
 
 % Check if the executable exists and compile if needed
 if(exist('Thalamus_mex.mesa64', 'file')==0)
-    mex CXXFLAGS="\$CXXFLAGS -std=c++11 -O3" TC_mex.cpp Cortical_Column.cpp Thalamic_Column.cpp;
+    mex CXXFLAGS="\$CXXFLAGS -std=c++11 -O3 -fopenmp-simd -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread" LDFLAGS="\$LDFLAGS -pthread" TC_mex.cpp Cortical_Column.cpp TC_Ensemble.cpp Thalamic_Column.cpp;
 end
 
 % Add the path to the simulation routine
@@ -0,0 +1,81 @@
+function [Data, Info] = Read_Chunks(File, Variable, Window)
+% Reads a time window of one variable from a chunk file written by TC_mex
+% or TC without loading the whole file. The chunks are mapped with
+% memmapfile, so the file may still be written by a running simulation.
+%
+% File      name of the chunk file
+% Variable  name of the variable, e.g. 'Vp'
+% Window    [start, stop] in s, defaults to all committed samples
+%
+% Data      samples of the variable within the window as row vector
+% Info      struct with variable names, sample rate, parameters and seeds
+
+fid = fopen(File, 'r');
+if fid < 0
+    error('Read_Chunks:open', 'Cannot open %s', File);
+end
+Magic = fread(fid, [1 8], '*char');
+if ~strcmp(Magic, 'NM_TCDAT') || fread(fid, 1, 'uint32') ~= 1
+    fclose(fid);
+    error('Read_Chunks:format', '%s is no chunk file of version 1', File);
+end
+Num_Vars        = fread(fid, 1, 'uint32');
+Num_Params      = fread(fid, 1, 'uint32');
+Num_Seeds       = fread(fid, 1, 'uint32');
+Chunk_Samples   = fread(fid, 1, 'uint64');
+Info.Sample_Rate= fread(fid, 1, 'double');
+Data_Offset     = fread(fid, 1, 'uint64');
+Chunk_Bytes     = fread(fid, 1, 'uint64');
+Num_Samples     = fread(fid, 1, 'uint64');
+
+Info.Variables  = cell(1, Num_Vars);
+for i = 1:Num_Vars
+    Info.Variables{i} = deblank(fread(fid, [1 32], '*char'));
+end
+Info.Parameters = struct();
+for i = 1:Num_Params
+    Name = deblank(fread(fid, [1 32], '*char'));
+    Info.Parameters.(Name) = fread(fid, 1, 'double');
+end
+Info.Seeds      = fread(fid, Num_Seeds, '*uint64')';
+fclose(fid);
+
+% Only chunks that are completely on disk count
+File_Info       = dir(File);
+Num_Chunks      = floor((File_Info.bytes - Data_Offset) / Chunk_Bytes);
+Num_Samples     = min(Num_Samples, Num_Chunks * Chunk_Samples);
+Info.Num_Samples= Num_Samples;
+
+Var = find(strcmp(Info.Variables, Variable), 1);
+if isempty(Var)
+    error('Read_Chunks:variable', 'No variable %s in %s', Variable, File);
+end
+
+if nargin < 3
+    Window = [0, Num_Samples / Info.Sample_Rate];
+end
+First   = max(0, floor(Window(1) * Info.Sample_Rate));
+Last    = min(Num_Samples, ceil(Window(2) * Info.Sample_Rate));
+if Last <= First
+    Data = zeros(1, 0);
+    return;
+end
+
+% Every chunk is a 64 byte header, one row per variable and padding
+Padding = Chunk_Bytes - 64 - 8 * Chunk_Samples * Num_Vars;
+Format  = {'uint64', [8 1], 'Header'; 'double', [Chunk_Samples Num_Vars], 'Data'};
+if Padding > 0
+    Format(end+1, :) = {'uint8', [Padding 1], 'Padding'};
+end
+Map     = memmapfile(File, 'Offset', Data_Offset, 'Format', Format, 'Repeat', Num_Chunks);
+
+Data    = zeros(1, Last - First);
+Sample  = First;
+while Sample < Last
+    Chunk   = floor(Sample / Chunk_Samples);
+    Begin   = Sample - Chunk * Chunk_Samples;
+    N       = min(Last - Sample, Chunk_Samples - Begin);
+    Data(Sample-First+1 : Sample-First+N) = Map.Data(Chunk+1).Data(Begin+1 : Begin+N, Var);
+    Sample  = Sample + N;
+end
+end
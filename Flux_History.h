@@ -0,0 +1,100 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*					History of the axonal flux for delayed coupling			  */
+/*																			  */
+/* Every source keeps the flux at the last time steps in its own ring buffer. */
+/* The length is the longest delay of the connections leaving that source,	  */
+/* rounded up to a power of two, so memory grows with the actual delays and	  */
+/* sources without delayed connections keep nothing. Values between the		  */
+/* steps, e.g. for the intermediate RK stages, are interpolated linearly.	  */
+/******************************************************************************/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "State_Block.h"
+
+class Flux_History {
+public:
+    /* No sources */
+    Flux_History(void) {}
+
+    /* Source j has to provide values up to max_delay[j] steps into the past */
+    explicit Flux_History(const std::vector<double>& max_delay)
+        : offset (max_delay.size()+1, 0), mask (max_delay.size(), 0) {
+        for (unsigned j=0; j < max_delay.size(); ++j) {
+            /* Interpolation reads one step further back, and the newest step is */
+            /* written while the oldest one may still be read					 */
+            std::size_t length = 0;
+            if (max_delay[j] > 0) {
+                const std::size_t needed = (std::size_t) max_delay[j] + 3;
+                for (length = 1; length < needed; length *= 2) {}
+            }
+            offset[j+1] = offset[j] + length;
+            mask  [j]	= length - 1;
+        }
+        buffer.assign(offset.back(), 0.0);
+    }
+
+    /* Whether source j keeps a history */
+    bool	keeps	(unsigned j) const {return offset[j+1] > offset[j];}
+
+    /* Fill the whole history of source j with a constant flux */
+    void	init	(unsigned j, double y) {
+        for (std::size_t k=offset[j]; k < offset[j+1]; ++k) {
+            buffer[k] = y;
+        }
+    }
+
+    /* Store the flux of source j at time step t */
+    void	store	(unsigned j, std::uint64_t t, double y) {
+        if (keeps(j)) {
+            buffer[offset[j] + (t & mask[j])] = y;
+        }
+    }
+
+    /* Flux of source j at delay steps before time step t */
+    double	operator() (unsigned j, std::uint64_t t, double delay) const {
+        const std::uint64_t steps = (std::uint64_t) delay;
+        const double		frac  = delay - steps;
+        const double*		ring  = buffer.data() + offset[j];
+        return (1 - frac) * ring[(t - steps) & mask[j]] + frac * ring[(t - steps - 1) & mask[j]];
+    }
+
+    /* Number of stored values of all sources */
+    std::size_t size (void) const {return buffer.size();}
+
+private:
+    /* Begin of the ring of every source within the buffer */
+    std::vector<std::size_t>	offset;
+
+    /* Ring length - 1, the lengths are powers of two */
+    std::vector<std::uint64_t>	mask;
+
+    /* Rings of all sources back to back */
+    State_Block					buffer;
+};
@@ -0,0 +1,98 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Tabulated voltage dependent functions				  */
+/*																			  */
+/* A function of the membrane voltage is sampled on an equidistant grid		  */
+/* together with its derivative. Between the knots it is interpolated either  */
+/* linearly or by cubic Hermite polynomials, outside of the grid the exact	  */
+/* function is evaluated.													  */
+/******************************************************************************/
+#pragma once
+#include <cmath>
+#include <vector>
+
+/* Evaluation of gating functions, can be switched at runtime */
+enum class Gating_Mode {Exact, Linear, Cubic};
+
+class Gating_Table {
+public:
+    typedef double (*Function)(double);
+
+    Gating_Table(Function f, double V_min, double V_max, double dV)
+        : f (f), V_min (V_min), inv_dV (1/dV),
+          num_intervals ((unsigned) std::ceil((V_max - V_min)/dV)),
+          values (num_intervals+1), slopes (num_intervals+1) {
+        /* The derivative is taken by a central difference and scaled to dV */
+        const double eps = 1E-4;
+        for (unsigned i=0; i <= num_intervals; ++i) {
+            const double V = V_min + i*dV;
+            values[i] = f(V);
+            slopes[i] = dV * (f(V + eps) - f(V - eps))/(2*eps);
+        }
+    }
+
+    /* Interpolated value, falls back to the exact function outside of the grid */
+    double operator() (double V, Gating_Mode mode) const {
+        const double x = (V - V_min) * inv_dV;
+        if (!(x >= 0 && x < num_intervals) || mode == Gating_Mode::Exact) {
+            return f(V);
+        }
+        const unsigned i  = (unsigned) x;
+        const double   t  = x - i;
+        const double   f0 = values[i];
+        const double   f1 = values[i+1];
+        if (mode == Gating_Mode::Linear) {
+            return f0 + t * (f1 - f0);
+        }
+        const double   d0 = slopes[i];
+        const double   d1 = slopes[i+1];
+        return f0 + t * (d0 + t * (3*(f1 - f0) - 2*d0 - d1 + t * (2*(f0 - f1) + d0 + d1)));
+    }
+
+    /* Largest relative deviation from the exact function within the grid */
+    double max_error (Gating_Mode mode, unsigned samples = 16) const {
+        double error = 0;
+        for (unsigned i=0; i < num_intervals*samples; ++i) {
+            const double V	   = V_min + (i + 0.5)/(samples*inv_dV);
+            const double exact = f(V);
+            error = std::fmax(error, std::fabs(operator()(V, mode) - exact)/std::fabs(exact));
+        }
+        return error;
+    }
+
+private:
+    /* Exact function */
+    Function			f;
+
+    /* Grid */
+    double				V_min;
+    double				inv_dV;
+    unsigned			num_intervals;
+
+    /* Function values and derivatives times dV at the knots */
+    std::vector<double>	values;
+    std::vector<double>	slopes;
+};
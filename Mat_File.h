@@ -0,0 +1,340 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*							MATLAB level 5 MAT-files						  */
+/*																			  */
+/* The writer stores real double matrices uncompressed, as save -v6 does,	  */
+/* so the files load in MATLAB and Octave and with scipy.io.loadmat.			  */
+/* The reader covers what the data of the Figures folder needs: real numeric  */
+/* matrices of any element type, which are converted to double, and structs,  */
+/* also within compressed (miCOMPRESSED) elements of MATLAB 7. Fields of a	  */
+/* 1x1 struct are returned as variables named struct.field, other classes	  */
+/* are skipped. Matrices are column major as in MATLAB.						  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+/* Data types and classes of the format */
+enum Mat_Type : std::uint32_t {
+    miINT8 = 1, miUINT8, miINT16, miUINT16, miINT32, miUINT32, miSINGLE,
+    miDOUBLE = 9, miINT64 = 12, miUINT64, miMATRIX, miCOMPRESSED
+};
+enum Mat_Class : std::uint32_t {mxSTRUCT_CLASS = 2, mxDOUBLE_CLASS = 6, mxUINT64_CLASS = 15};
+
+struct Mat_Array {
+    std::size_t			rows = 0;
+    std::size_t			cols = 0;
+    std::vector<double>	data;
+};
+
+/******************************************************************************/
+/*									Writer									  */
+/******************************************************************************/
+class Mat_Writer {
+public:
+    /* Create a new file, an existing one is replaced */
+    explicit Mat_Writer(const std::string& file)
+        : file (file), out (file, std::ios::binary | std::ios::trunc) {
+        if (!out) {
+            throw std::runtime_error("Mat_Writer: cannot create " + file);
+        }
+        const std::time_t now = std::time(nullptr);
+        char created[32];
+        std::strftime(created, sizeof(created), "%a %b %d %H:%M:%S %Y", std::localtime(&now));
+        std::string text = std::string("MATLAB 5.0 MAT-file, Platform: GLNXA64, Created on: ") + created;
+        text.resize(116, ' ');
+        out.write(text.data(), text.size());
+        const std::uint64_t subsystem = 0;
+        const std::uint16_t version	  = 0x0100;
+        out.write((const char*) &subsystem, 8);
+        out.write((const char*) &version, 2);
+        out.write("IM", 2);
+        check();
+    }
+
+    /* Store a rows x cols matrix given in column major order */
+    void write (const std::string& name, std::size_t rows, std::size_t cols, const double* data) {
+        if (name.empty() || name.size() > 63) {
+            throw std::invalid_argument("Mat_Writer: invalid variable name " + name);
+        }
+        const std::uint64_t bytes = rows*cols*sizeof(double);
+        const std::uint64_t name_bytes = padded(name.size());
+        const std::uint64_t size = 16 + 16 + 8 + name_bytes + 8 + padded(bytes);
+        if (size > UINT32_MAX || rows > INT32_MAX || cols > INT32_MAX) {
+            throw std::length_error("Mat_Writer: " + name + " exceeds the limits of the format");
+        }
+
+        tag(miMATRIX, size);
+        tag(miUINT32, 8);
+        const std::uint32_t flags[2] = {mxDOUBLE_CLASS, 0};
+        out.write((const char*) flags, 8);
+        tag(miINT32, 8);
+        const std::int32_t dims[2] = {(std::int32_t) rows, (std::int32_t) cols};
+        out.write((const char*) dims, 8);
+        tag(miINT8, name.size());
+        out.write(name.data(), name.size());
+        pad(name.size());
+        tag(miDOUBLE, bytes);
+        out.write((const char*) data, bytes);
+        pad(bytes);
+        check();
+    }
+
+    /* Row vector as returned by TC_mex, column vector and scalar */
+    void row	(const std::string& name, const std::vector<double>& x) {write(name, 1, x.size(), x.data());}
+    void column	(const std::string& name, const std::vector<double>& x) {write(name, x.size(), 1, x.data());}
+    void scalar	(const std::string& name, double x) {write(name, 1, 1, &x);}
+
+private:
+    static std::uint64_t padded (std::uint64_t bytes) {return (bytes + 7)/8*8;}
+
+    void tag (Mat_Type type, std::uint64_t bytes) {
+        const std::uint32_t t[2] = {type, (std::uint32_t) bytes};
+        out.write((const char*) t, 8);
+    }
+
+    void pad (std::uint64_t bytes) {
+        const char zeros[8] = {0};
+        out.write(zeros, padded(bytes) - bytes);
+    }
+
+    void check (void) {
+        if (!out) {
+            throw std::runtime_error("Mat_Writer: cannot write " + file);
+        }
+    }
+
+    std::string		file;
+    std::ofstream	out;
+};
+
+/******************************************************************************/
+/*									Reader									  */
+/******************************************************************************/
+class Mat_Reader {
+public:
+    /* Read all supported variables of a file */
+    explicit Mat_Reader(const std::string& file) : file (file) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Mat_Reader: cannot open " + file);
+        }
+        const std::vector<char> content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (content.size() < 128 || content[126] != 'I' || content[127] != 'M') {
+            throw std::runtime_error("Mat_Reader: " + file + " is no little endian level 5 MAT-file");
+        }
+        parse_elements(content.data() + 128, content.size() - 128);
+    }
+
+    bool has (const std::string& name) const {return variables.count(name) != 0;}
+
+    const Mat_Array& get (const std::string& name) const {
+        const auto it = variables.find(name);
+        if (it == variables.end()) {
+            throw std::out_of_range("Mat_Reader: " + file + " holds no variable " + name);
+        }
+        return it->second;
+    }
+
+    const std::map<std::string, Mat_Array>& get_variables (void) const {return variables;}
+
+private:
+    /* A data element, the small format packs up to 4 bytes into the tag */
+    struct Element {
+        std::uint32_t	type;
+        std::uint32_t	bytes;
+        const char*		data;
+    };
+
+    Element element (const char*& p, const char* end) const {
+        if (end - p < 8) {
+            corrupt();
+        }
+        std::uint32_t t[2];
+        std::memcpy(t, p, 8);
+        if (t[0] >> 16) {
+            if ((t[0] >> 16) > 4) {
+                corrupt();
+            }
+            const Element e = {t[0] & 0xFFFF, t[0] >> 16, p + 4};
+            p += 8;
+            return e;
+        }
+        const Element e = {t[0], t[1], p + 8};
+        const std::uint64_t available = end - e.data;
+        if (available < e.bytes) {
+            corrupt();
+        }
+        /* Elements are padded to 8 bytes, except compressed ones */
+        const std::uint64_t step = e.type == miCOMPRESSED ? e.bytes : (e.bytes + 7ull)/8*8;
+        p = e.data + std::min(step, available);
+        return e;
+    }
+
+    void parse_elements (const char* p, std::size_t size) {
+        const char* end = p + size;
+        while (p < end) {
+            const Element e = element(p, end);
+            if (e.type == miCOMPRESSED) {
+                const std::vector<char> inflated = inflate(e.data, e.bytes);
+                parse_elements(inflated.data(), inflated.size());
+            } else if (e.type == miMATRIX) {
+                parse_matrix(e.data, e.bytes, "");
+            }
+        }
+    }
+
+    /* Matrix with the given prefix of its name, e.g. "data." within a struct */
+    void parse_matrix (const char* p, std::size_t size, const std::string& prefix) {
+        if (size == 0) {
+            return;
+        }
+        const char* end = p + size;
+        const Element flags = element(p, end);
+        const Element dims	= element(p, end);
+        const Element name	= element(p, end);
+        if (flags.bytes < 8 || dims.bytes < 8 || dims.bytes % 4) {
+            corrupt();
+        }
+        const std::uint32_t mx_class = (std::uint8_t) flags.data[0];
+        const bool complex = flags.data[1] & 0x08;
+        std::vector<std::int32_t> d(dims.bytes/4);
+        std::memcpy(d.data(), dims.data, dims.bytes);
+        std::size_t count = 1;
+        for (std::int32_t n : d) {
+            count *= n;
+        }
+        const std::string full_name = prefix + std::string(name.data, name.bytes);
+
+        if (mx_class == mxSTRUCT_CLASS) {
+            /* Fields of every element in order, only 1x1 structs are kept */
+            const Element length = element(p, end);
+            const Element names	 = element(p, end);
+            std::int32_t name_length = 0;
+            std::memcpy(&name_length, length.data, 4);
+            if (name_length <= 0 || names.bytes % name_length) {
+                corrupt();
+            }
+            std::vector<std::string> fields;
+            for (std::uint32_t k=0; k < names.bytes/name_length; ++k) {
+                fields.emplace_back(names.data + k*name_length);
+            }
+            for (std::size_t i=0; i < count; ++i) {
+                for (const std::string& field : fields) {
+                    const Element e = element(p, end);
+                    if (count == 1 && e.type == miMATRIX) {
+                        parse_matrix(e.data, e.bytes, full_name + "." + field);
+                    }
+                }
+            }
+            return;
+        }
+        if (mx_class < mxDOUBLE_CLASS || mx_class > mxUINT64_CLASS || complex || d.size() != 2) {
+            return;
+        }
+        const Element real = element(p, end);
+        Mat_Array& A = variables[full_name];
+        A.rows = d[0];
+        A.cols = d[1];
+        A.data = convert(real, count);
+    }
+
+    /* Elements of any numeric type as double, MATLAB stores doubles with	*/
+    /* integer values in the smallest type that holds them					*/
+    std::vector<double> convert (const Element& e, std::size_t count) const {
+        switch (e.type) {
+        case miINT8:	return convert<std::int8_t>	 (e, count);
+        case miUINT8:	return convert<std::uint8_t> (e, count);
+        case miINT16:	return convert<std::int16_t> (e, count);
+        case miUINT16:	return convert<std::uint16_t>(e, count);
+        case miINT32:	return convert<std::int32_t> (e, count);
+        case miUINT32:	return convert<std::uint32_t>(e, count);
+        case miSINGLE:	return convert<float>		 (e, count);
+        case miDOUBLE:	return convert<double>		 (e, count);
+        case miINT64:	return convert<std::int64_t> (e, count);
+        case miUINT64:	return convert<std::uint64_t>(e, count);
+        default:		corrupt();
+        }
+    }
+
+    template <typename T>
+    std::vector<double> convert (const Element& e, std::size_t count) const {
+        if (e.bytes < count*sizeof(T)) {
+            corrupt();
+        }
+        std::vector<double> x(count);
+        for (std::size_t i=0; i < count; ++i) {
+            T v;
+            std::memcpy(&v, e.data + i*sizeof(T), sizeof(T));
+            x[i] = v;
+        }
+        return x;
+    }
+
+    std::vector<char> inflate (const char* data, std::size_t bytes) const {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (inflateInit(&stream) != Z_OK) {
+            throw std::runtime_error("Mat_Reader: cannot initialize zlib");
+        }
+        std::vector<char> out;
+        char buffer[1 << 16];
+        stream.next_in	= (Bytef*) data;
+        stream.avail_in	= bytes;
+        int status = Z_OK;
+        while (status == Z_OK) {
+            stream.next_out	 = (Bytef*) buffer;
+            stream.avail_out = sizeof(buffer);
+            status = ::inflate(&stream, Z_NO_FLUSH);
+            out.insert(out.end(), buffer, buffer + sizeof(buffer) - stream.avail_out);
+            if (status == Z_BUF_ERROR && stream.avail_in == 0) {
+                break;
+            }
+        }
+        inflateEnd(&stream);
+        if (status != Z_STREAM_END) {
+            corrupt();
+        }
+        return out;
+    }
+
+    [[noreturn]] void corrupt (void) const {
+        throw std::runtime_error("Mat_Reader: " + file + " is corrupt or uses an unsupported feature");
+    }
+
+    std::string							file;
+    std::map<std::string, Mat_Array>	variables;
+};
@@ -6,20 +6,53 @@ CONFIG -= qt
 TARGET = release_binary
 
 SOURCES +=  Cortical_Column.cpp \
+			Sweep.cpp			\
 			TC.cpp				\
+			TC_Ensemble.cpp		\
+			TC_Network.cpp		\
 			TC_mex.cpp			\
+			TC_sweep_mex.cpp	\
 			Thalamic_Column.cpp
 
-HEADERS +=  Cortical_Column.h	\
+HEADERS +=  CSR_Matrix.h		\
+			Checkpoint.h		\
+			Chunk_File.h		\
+			Cpu_Dispatch.h		\
+			Cortical_Column.h	\
 			Data_Storage.h		\
+			Decimator.h			\
+			Event_Average.h		\
+			Event_Detection.h	\
+			Exponential_Integrator.h \
+			FFT.h				\
+			Fast_Math.h			\
+			Flux_History.h		\
+			Gating_Table.h		\
+			Noise_Buffer.h		\
 			ODE.h				\
+			Parameter_Sets.h	\
+			Phase_Estimator.h	\
+			Profiler.h		\
 			Random_Stream.h		\
+			Recorder.h			\
+			State_Block.h		\
+			Stim_Scheduler.h	\
 			Stimulation.h		\
-			Thalamic_Column.h
+			Sweep.h				\
+			TC_Ensemble.h		\
+			TC_Network.h		\
+			TC_System.h			\
+			Thalamic_Column.h	\
+			Thread_Pool.h
 
 SOURCES -= TC_mex.cpp
+SOURCES -= TC_sweep_mex.cpp
 
-QMAKE_CXXFLAGS += -std=c++11
+# Per phase timing report of the simulation loop, see Profiler.h
+# DEFINES += NM_TC_PROFILE
+
+QMAKE_CXXFLAGS += -std=c++11 -fopenmp-simd -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread
+LIBS		   += -pthread
 QMAKE_CXXFLAGS_RELEASE -= -O1
 QMAKE_CXXFLAGS_RELEASE -= -O2
 QMAKE_CXXFLAGS_RELEASE *= -O3
@@ -0,0 +1,34 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = TC_bench
+
+SOURCES +=  Cortical_Column.cpp \
+			TC_bench.cpp		\
+			TC_Ensemble.cpp		\
+			TC_Network.cpp		\
+			Thalamic_Column.cpp
+
+HEADERS +=  Benchmark.h			\
+			CSR_Matrix.h		\
+			Cpu_Dispatch.h		\
+			Cortical_Column.h	\
+			Data_Storage.h		\
+			Fast_Math.h			\
+			Noise_Buffer.h		\
+			ODE.h				\
+			Recorder.h			\
+			Stim_Scheduler.h	\
+			Stimulation.h		\
+			TC_Ensemble.h		\
+			TC_Network.h		\
+			TC_System.h			\
+			Thalamic_Column.h
+
+QMAKE_CXXFLAGS += -std=c++11 -fopenmp-simd -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread
+LIBS		   += -pthread
+QMAKE_CXXFLAGS_RELEASE -= -O1
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE *= -O3
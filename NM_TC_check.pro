@@ -0,0 +1,29 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = TC_check
+
+SOURCES +=  Cortical_Column.cpp \
+			TC_check.cpp		\
+			Thalamic_Column.cpp
+
+HEADERS +=  Checkpoint.h		\
+			Cortical_Column.h	\
+			Event_Detection.h	\
+			Noise_Buffer.h		\
+			ODE.h				\
+			Parameter_Sets.h	\
+			Phase_Estimator.h	\
+			Recorder.h			\
+			Stim_Scheduler.h	\
+			Stimulation.h		\
+			TC_System.h			\
+			Thalamic_Column.h
+
+QMAKE_CXXFLAGS += -std=c++11 -fopenmp-simd -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread
+LIBS		   += -pthread
+QMAKE_CXXFLAGS_RELEASE -= -O1
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE *= -O3
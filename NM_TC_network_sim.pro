@@ -0,0 +1,27 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = TC_network_sim
+
+SOURCES +=  Cortical_Column.cpp		\
+			TC_Network.cpp			\
+			TC_network_sim.cpp		\
+			Thalamic_Column.cpp
+
+HEADERS +=  CSR_Matrix.h			\
+			Cortical_Column.h		\
+			Flux_History.h			\
+			Mat_File.h				\
+			Parameter_Sets.h		\
+			Recorder.h				\
+			TC_Network.h			\
+			Thalamic_Column.h		\
+			Thread_Pool.h
+
+QMAKE_CXXFLAGS += -std=c++11 -fopenmp-simd -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread
+LIBS		   += -pthread -lz
+QMAKE_CXXFLAGS_RELEASE -= -O1
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE *= -O3
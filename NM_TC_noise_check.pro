@@ -0,0 +1,20 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = TC_noise_check
+
+SOURCES +=  TC_noise_check.cpp
+
+HEADERS +=  Cpu_Dispatch.h		\
+			Noise_Buffer.h		\
+			Profiler.h			\
+			Random_Stream.h		\
+			State_Block.h
+
+QMAKE_CXXFLAGS += -std=c++11 -fopenmp-simd -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread
+LIBS		   += -pthread
+QMAKE_CXXFLAGS_RELEASE -= -O1
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE *= -O3
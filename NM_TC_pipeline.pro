@@ -0,0 +1,27 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = TC_pipeline
+
+SOURCES +=  Cortical_Column.cpp \
+			TC_pipeline.cpp		\
+			Thalamic_Column.cpp
+
+HEADERS +=  Cortical_Column.h	\
+			Data_Storage.h		\
+			Event_Detection.h	\
+			Mat_File.h			\
+			Phase_Estimator.h	\
+			Recorder.h			\
+			Stim_Scheduler.h	\
+			TC_System.h			\
+			Thalamic_Column.h	\
+			Thread_Pool.h
+
+QMAKE_CXXFLAGS += -std=c++11 -fopenmp-simd -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread
+LIBS		   += -pthread -lz
+QMAKE_CXXFLAGS_RELEASE -= -O1
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE *= -O3
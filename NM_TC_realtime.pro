@@ -0,0 +1,23 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = TC_realtime
+
+SOURCES +=  Cortical_Column.cpp \
+			TC_realtime.cpp		\
+			Thalamic_Column.cpp
+
+HEADERS +=  Cortical_Column.h	\
+			Phase_Estimator.h	\
+			Real_Time.h			\
+			Shared_Ring.h		\
+			TC_System.h			\
+			Thalamic_Column.h
+
+QMAKE_CXXFLAGS += -std=c++11 -fopenmp-simd -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread
+LIBS		   += -pthread -lrt
+QMAKE_CXXFLAGS_RELEASE -= -O1
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE *= -O3
@@ -0,0 +1,243 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Buffered Gaussian noise streams						  */
+/*																			  */
+/* Generates a stream of randomStreamNormal in bulk. Philox blocks and the	  */
+/* Box-Muller transform of a whole buffer are computed in one SIMD loop, the  */
+/* integrator then only reads from memory. Draw n is identical to draw n of	  */
+/* the unbuffered stream with the same (seed, stream).						  */
+/* Optionally the next buffer is filled on a helper thread while the current  */
+/* one is consumed. A single persistent thread serves the refills of all	  */
+/* buffers of the process, so a refill costs a queue entry instead of a		  */
+/* thread. It pays off for single simulations with a spare core, sweeps		  */
+/* already keep every core busy.												  */
+/******************************************************************************/
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "Cpu_Dispatch.h"
+#include "Profiler.h"
+#include "Random_Stream.h"
+#include "State_Block.h"
+
+/******************************************************************************/
+/*								Refill thread								  */
+/* Refills are done in the order they were queued, so a refill is complete	  */
+/* once the number of completed refills reached its ticket.					  */
+/******************************************************************************/
+class Noise_Refill_Worker {
+public:
+    /* Job of a refill, the arguments of Noise_Buffer::generate */
+    struct Job {
+        double*			out;
+        unsigned		size;
+        Philox4x32		philox;
+        std::uint64_t	block;
+        double			mean;
+        double			stddev;
+    };
+
+    /* Worker of the process, started with the first asynchronous buffer */
+    static Noise_Refill_Worker& get (void) {static Noise_Refill_Worker worker; return worker;}
+
+    /* Queue a refill and return its ticket */
+    std::uint64_t submit (const Job& job) {
+        std::uint64_t ticket;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+            ticket = ++queued;
+        }
+        work_available.notify_one();
+        return ticket;
+    }
+
+    /* Block until the refill with the given ticket is done */
+    void wait (std::uint64_t ticket) {
+        std::unique_lock<std::mutex> lock(mutex);
+        work_done.wait(lock, [this, ticket] {return completed >= ticket;});
+    }
+
+private:
+    Noise_Refill_Worker(void) : thread (&Noise_Refill_Worker::work, this) {}
+
+    ~Noise_Refill_Worker(void) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        work_available.notify_one();
+        thread.join();
+    }
+
+    void work (void);
+
+    std::mutex				mutex;
+    std::condition_variable	work_available;
+    std::condition_variable	work_done;
+    std::deque<Job>			jobs;
+    std::uint64_t			queued		= 0;
+    std::uint64_t			completed	= 0;
+    bool					stop		= false;
+
+    /* Started last, after the members it uses */
+    std::thread				thread;
+};
+
+class Noise_Buffer {
+public:
+    /* Number of draws generated at once, has to be even */
+    static const unsigned default_size = 512;
+
+    /* Whether new buffers refill on a helper thread, set before the columns are created */
+    static bool& async_default (void) {static bool async = false; return async;}
+
+    explicit Noise_Buffer(double mean, double stddev, std::uint64_t seed, unsigned stream,
+                          std::uint64_t counter = 0, bool async = async_default(),
+                          unsigned size = default_size)
+    : philox(seed, stream), mean(mean), stddev(stddev), size(size), async(async),
+      front(size), back(async ? size : 0) {set_counter(counter);}
+
+    /* Copies wait for a pending refill of the original */
+    Noise_Buffer(const Noise_Buffer& other)
+    : philox(other.philox), mean(other.mean), stddev(other.stddev), size(other.size),
+      async(other.async), front((other.finish(), other.front)), back(other.back),
+      position(other.position), first(other.first) {}
+
+    Noise_Buffer(Noise_Buffer&&) = default;
+
+    /* The helper thread must not write into freed buffers */
+    ~Noise_Buffer(void) {finish();}
+
+    Noise_Buffer& operator=(const Noise_Buffer&) = delete;
+    Noise_Buffer& operator=(Noise_Buffer&&) = delete;
+
+    double operator ()(void) {
+        if (position == size) {
+            refill();
+        }
+        return front[position++];
+    }
+
+    /* Position within the stream, i.e. the number of draws so far */
+    std::uint64_t get_counter (void) const {return first + position;}
+    void set_counter (std::uint64_t counter) {
+        finish();
+        first	 = counter & ~(std::uint64_t) 1;
+        position = counter - first;
+        fill(front.data(), first);
+        if (async) {
+            fill(back.data(), first + size);
+        }
+    }
+
+    /* Skip n draws */
+    void discard (std::uint64_t n) {set_counter(get_counter() + n);}
+
+private:
+    /* Compute draws [counter, counter+size), counter has to be even */
+    void fill (double* out, std::uint64_t counter) const {
+        generate(out, size, philox, counter >> 1, mean, stddev);
+    }
+
+    friend class Noise_Refill_Worker;
+
+    /* Independent of the object, so a helper thread can run it while the buffer is moved */
+    NM_TC_TARGET_CLONES
+    static void generate (double* __restrict out, unsigned size, Philox4x32 philox,
+                          std::uint64_t block, double mean, double stddev) {
+        #pragma omp simd
+        for (unsigned j=0; j < size/2; ++j) {
+            double z0, z1;
+            box_muller(philox(block + j), z0, z1);
+            out[2*j]	= mean + stddev * z0;
+            out[2*j+1]	= mean + stddev * z1;
+        }
+    }
+
+    /* Advance to the next buffer, the back buffer always holds the one after the front */
+    void refill (void) {
+        NM_TC_PROFILE_SCOPE("noise");
+        first	+= size;
+        position = 0;
+        if (!async) {
+            fill(front.data(), first);
+            return;
+        }
+        finish();
+        std::swap(front, back);
+        ticket = Noise_Refill_Worker::get().submit({back.data(), size, philox, (first + size) >> 1, mean, stddev});
+    }
+
+    /* Wait for a pending refill */
+    void finish (void) const {
+        if (ticket) {
+            Noise_Refill_Worker::get().wait(ticket);
+        }
+    }
+
+    /* Generator and scaling of the stream */
+    Philox4x32		philox;
+    double			mean;
+    double			stddev;
+
+    /* Buffer length and refill mode */
+    unsigned		size;
+    bool			async;
+
+    /* Current buffer and the next one if refilled asynchronously */
+    State_Block		front;
+    State_Block		back;
+
+    /* Read position within front and stream position of front[0] */
+    unsigned		position = 0;
+    std::uint64_t	first	 = 0;
+
+    /* Ticket of the last refill of the back buffer, 0 if there was none */
+    std::uint64_t	ticket	 = 0;
+};
+
+inline void Noise_Refill_Worker::work (void) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_available.wait(lock, [this] {return stop || !jobs.empty();});
+        if (jobs.empty()) {
+            return;
+        }
+        const Job job = jobs.front();
+        jobs.pop_front();
+        lock.unlock();
+        Noise_Buffer::generate(job.out, job.size, job.philox, job.block, job.mean, job.stddev);
+        lock.lock();
+        ++completed;
+        work_done.notify_all();
+    }
+}
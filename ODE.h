@@ -32,17 +32,38 @@
 /*                        Functions for SRK iteration                         */
 /******************************************************************************/
 #pragma once
-#include "Cortical_Column.h"
-#include "Thalamic_Column.h"
+#include "Profiler.h"
+#include "TC_Ensemble.h"
+#include "TC_Network.h"
+#include "TC_System.h"
 
-void ODE(Cortical_Column& Cortex, Thalamic_Column& Thalamus) {
+inline void ODE(TC_System& System) {
     /* First calculate every ith RK moment. Has to be in order, 1th moment first */
+    {
+        NM_TC_PROFILE_SCOPE("set_RK");
+        for (unsigned i=0; i<4; ++i) {
+            System.Cortex.set_RK(i);
+            System.Thalamus.set_RK(i);
+        }
+    }
+
+    /* Add all moments */
+    NM_TC_PROFILE_SCOPE("add_RK");
+    System.Cortex.add_RK();
+    System.Thalamus.add_RK();
+}
+
+inline void ODE(TC_Ensemble& Ensemble) {
+    /* All lanes advance through the RK moments together */
     for (unsigned i=0; i<4; ++i) {
-        Cortex.set_RK(i);
-        Thalamus.set_RK(i);
+        Ensemble.set_RK(i);
     }
 
     /* Add all moments */
-    Cortex.add_RK();
-    Thalamus.add_RK();
+    Ensemble.add_RK();
+}
+
+inline void ODE(TC_Network& Network) {
+    /* Threads meet once per RK moment, longer runs should call Network.run directly */
+    Network.run(1);
 }
@@ -0,0 +1,53 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/*						Parameter sets of the thalamocortical model			  */
+/* Only the parameters that are varied between simulations are listed, the	  */
+/* remaining physiology is fixed at compile time in the column classes.		  */
+/******************************************************************************/
+#pragma once
+
+struct Parameter_Set {
+    /* Parameters of cortical module {sigma_p, g_KNa, dphi} */
+    double Cortex		[3];
+
+    /* Parameters of thalamic module {g_LK, g_h} */
+    double Thalamus		[2];
+
+    /* Connectivity values C <-> T {N_tp, N_rp, N_pt, N_it} */
+    double Connectivity	[4];
+};
+
+/* Sleep stage N2, see Figures/Data/Parameter_N2.mat */
+constexpr Parameter_Set Parameters_N2 = {{4.7, 1.33, 2}, {0.03,	 0.049}, {2.6, 2.6, 5, 10}};
+
+/* Sleep stage N3, see Figures/Data/Parameter_N3.mat */
+constexpr Parameter_Set Parameters_N3 = {{6,	 2,	   2}, {0.026, 0.049}, {2.6, 2.6, 5, 10}};
@@ -0,0 +1,195 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Causal slow oscillation phase estimation			  */
+/*																			  */
+/* A Butterworth high-pass removes the mean of Vp, a cascade of complex one-  */
+/* pole resonators at the center frequency then yields the analytic signal	  */
+/* of the band. At the center frequency the resonators have no phase lag, the */
+/* lag at other frequencies is removed with the model of the filter response  */
+/* at the tracked instantaneous frequency. The resonators also pass part of	  */
+/* the negative frequency of the real signal, which is removed with the same  */
+/* model, otherwise it biases phase and frequency. A sample costs a few		  */
+/* complex operations, the phase itself is only computed on request.		  */
+/* Phases are in rad, 0 is the peak and +-pi the trough of the oscillation.	  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/* Wrap an angle into (-pi, pi] */
+inline double wrap_phase (double phi) {
+    phi = std::fmod(phi + M_PI, 2*M_PI);
+    return phi <= 0 ? phi + M_PI : phi - M_PI;
+}
+
+/******************************************************************************/
+/*								Phase estimator								  */
+/******************************************************************************/
+class Phase_Estimator {
+public:
+    /* Samples at rate Hz, band of the given width in Hz around frequency, the	*/
+    /* mean is removed by a second order high-pass at f_highpass				*/
+    Phase_Estimator(double rate, double frequency = 1, double bandwidth = 1,
+                    double f_highpass = 0.2, unsigned stages = 2)
+    : stages (stages), z (stages, 0.0) {
+        if (!(0 < f_highpass && f_highpass < frequency && bandwidth > 0 &&
+              frequency + bandwidth/2 < rate/2 && stages > 0)) {
+            throw std::invalid_argument("Phase_Estimator: invalid band");
+        }
+        /* Half power width of the cascade */
+        w0		= 2*M_PI*frequency/rate;
+        w_half	= M_PI*bandwidth/rate;
+        r		= 1 - w_half/std::sqrt(std::pow(2.0, 1.0/stages) - 1);
+        if (r <= 0) {
+            throw std::invalid_argument("Phase_Estimator: bandwidth too large");
+        }
+        pole	= std::polar(r, w0);
+        omega	= w0;
+
+        /* High-pass with Q = 1/sqrt(2) */
+        const double w		= 2*M_PI*f_highpass/rate;
+        const double alpha	= std::sin(w)/std::sqrt(2.0);
+        const double a0		= 1 + alpha;
+        b0 = (1 + std::cos(w))/(2*a0);
+        b1 = -2*b0;
+        b2 = b0;
+        a1 = -2*std::cos(w)/a0;
+        a2 = (1 - alpha)/a0;
+
+        /* Group delay at the center frequency, numerically for the high-pass */
+        const double dw = 1E-3*w_half;
+        delay = stages*r/(1 - r) + (std::arg(highpass(w0 - dw)) - std::arg(highpass(w0 + dw)))/(2*dw);
+    }
+
+    /* Feed the next sample */
+    void push (double x) {
+        /* The high-pass starts in the steady state of the first sample */
+        if (count == 0) {
+            s1 = -b0*x;
+            s2 =  b2*x;
+        }
+        const double y = b0*x + s1;
+        s1 = b1*x - a1*y + s2;
+        s2 = b2*x - a2*y;
+
+        std::complex<double> u = y;
+        for (std::complex<double>& zk : z) {
+            zk = pole*zk + (1 - r)*u;
+            u  = zk;
+        }
+
+        /* A sinusoid Re(2p) at omega gives u = H(omega) p + H(-omega) conj(p) */
+        const std::complex<double> H = response(omega), G = response(-omega);
+        const std::complex<double> p = (std::conj(H)*u - G*std::conj(u))/(std::norm(H) - std::norm(G));
+
+        /* Instantaneous frequency from the rotation of the analytic signal,	*/
+        /* averaged over about a period, as p depends on it						*/
+        const double n = std::norm(p) * std::norm(previous);
+        if (n > 0) {
+            const double dphi = std::imag(p * std::conj(previous))/std::sqrt(n);
+            omega += w0/(2*M_PI)*(dphi - omega);
+            omega  = std::min(std::max(omega, w0 - w_half), w0 + w_half);
+        }
+        previous = p;
+        ++count;
+    }
+
+    /* Phase at the last sample */
+    double phase (void) const {return std::arg(previous);}
+
+    /* Amplitude of the band at the last sample */
+    double amplitude (void) const {return 2*std::abs(previous);}
+
+    /* Tracked frequency in rad per sample */
+    double frequency (void) const {return omega;}
+
+    /* Group delay at the center frequency in samples, the settling time of	*/
+    /* phase and amplitude after a change of the signal						*/
+    double latency (void) const {return delay;}
+
+    /* Whether the start transient has decayed */
+    bool ready (void) const {return count > 4*delay;}
+
+private:
+    /* Response of the high-pass and of the whole cascade at w rad per sample */
+    std::complex<double> highpass (double w) const {
+        const std::complex<double> e1 = std::polar(1.0, -w), e2 = e1*e1;
+        return (b0 + b1*e1 + b2*e2)/(1.0 + a1*e1 + a2*e2);
+    }
+
+    std::complex<double> response (double w) const {
+        const std::complex<double> stage = (1 - r)/(1.0 - r*std::polar(1.0, w0 - w));
+        return highpass(w) * std::pow(stage, (int) stages);
+    }
+
+    /* Resonators */
+    unsigned							stages;
+    double								w0, w_half, r;
+    std::complex<double>				pole;
+    std::vector<std::complex<double>>	z;
+
+    /* High-pass coefficients and state */
+    double	b0, b1, b2, a1, a2;
+    double	s1 = 0.0, s2 = 0.0;
+
+    /* Tracked frequency and the last analytic sample without the filter response */
+    double					omega;
+    std::complex<double>	previous = 0.0;
+
+    double			delay;
+    std::uint64_t	count = 0;
+};
+
+/******************************************************************************/
+/*							Circular statistics								  */
+/******************************************************************************/
+struct Phase_Statistics {
+    unsigned	N			= 0;
+    double		mean		= 0.0;	/* circular mean in rad						*/
+    double		resultant	= 0.0;	/* mean resultant length					*/
+    double		sd			= 0.0;	/* circular standard deviation in rad		*/
+};
+
+inline Phase_Statistics phase_statistics (const std::vector<double>& phases) {
+    Phase_Statistics S;
+    std::complex<double> sum = 0.0;
+    for (double phi : phases) {
+        if (!std::isnan(phi)) {
+            sum += std::polar(1.0, phi);
+            ++S.N;
+        }
+    }
+    if (S.N > 0) {
+        S.mean		= std::arg(sum);
+        S.resultant = std::abs(sum)/S.N;
+        S.sd		= std::sqrt(-2*std::log(std::max(S.resultant, 1E-300)));
+    }
+    return S;
+}
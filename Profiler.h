@@ -0,0 +1,292 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*							Hot path instrumentation						  */
+/*																			  */
+/* Compiled out unless NM_TC_PROFILE is defined. NM_TC_PROFILE_SCOPE(name)	  */
+/* times the rest of the enclosing block as phase name with the time stamp	  */
+/* counter. Phases nest, the exclusive time of a phase excludes the phases	  */
+/* opened within it. On Linux the instructions, cache misses and branch		  */
+/* misses of user space are read with perf_event_open. A read is a system	  */
+/* call that costs more than an integration step, so the counters are only	  */
+/* read on every sample_period-th call of a phase and scaled, they include	  */
+/* nested phases. Every thread has its own profiler, Profiler::get().json()	  */
+/* returns the breakdown of the calling thread.								  */
+/******************************************************************************/
+#pragma once
+
+#ifndef NM_TC_PROFILE
+#define NM_TC_PROFILE_SCOPE(name)
+#else
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define NM_TC_PROFILE_CONCAT_(a, b) a##b
+#define NM_TC_PROFILE_CONCAT(a, b) NM_TC_PROFILE_CONCAT_(a, b)
+#define NM_TC_PROFILE_SCOPE(name)															\
+    static const unsigned NM_TC_PROFILE_CONCAT(profile_phase_, __LINE__) = Profiler::phase(name); \
+    const Profiler::Scope NM_TC_PROFILE_CONCAT(profile_scope_, __LINE__)(NM_TC_PROFILE_CONCAT(profile_phase_, __LINE__))
+
+class Profiler {
+public:
+    /* Hardware counters per phase */
+    static const unsigned num_counters = 3;
+
+    /* Calls of a phase between two reads of the hardware counters */
+    static const unsigned sample_period = 256;
+
+    /* Profiler of the calling thread */
+    static Profiler& get (void) {
+        thread_local Profiler P;
+        return P;
+    }
+
+    /* Index of a phase, shared by all threads */
+    static unsigned phase (const char* name) {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        std::vector<std::string>& names = registry();
+        for (unsigned i=0; i < names.size(); ++i) {
+            if (names[i] == name) {
+                return i;
+            }
+        }
+        names.push_back(name);
+        return names.size() - 1;
+    }
+
+    /* Times the lifetime of the object as a call of a phase */
+    class Scope {
+    public:
+        explicit Scope(unsigned index)
+        : P (Profiler::get()), index (index), parent (P.current) {
+            P.current = this;
+            Phase& ph = P.at(index);
+            sampled = P.hardware && ph.calls % sample_period == 0;
+            ++ph.calls;
+            if (sampled) {
+                P.read(counters);
+            }
+            start = ticks();
+        }
+
+        ~Scope() {
+            const std::uint64_t elapsed = ticks() - start;
+            Phase& ph = P.phases[index];
+            ph.inclusive += elapsed;
+            if (parent) {
+                P.phases[parent->index].children += elapsed;
+            }
+            if (sampled) {
+                std::uint64_t end[num_counters];
+                P.read(end);
+                for (unsigned k=0; k < num_counters; ++k) {
+                    ph.counters[k] += end[k] - counters[k];
+                }
+                ++ph.sampled;
+            }
+            P.current = parent;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Profiler&		P;
+        unsigned		index;
+        Scope*			parent;
+        bool			sampled;
+        std::uint64_t	start;
+        std::uint64_t	counters[num_counters];
+    };
+
+    /* Breakdown of all phases of this thread so far */
+    std::string json (void) const {
+        const double wall = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+        const double per_ns = (ticks() - begin_ticks)/wall;
+        const char* counter_names[num_counters] = {"instructions", "cache_misses", "branch_misses"};
+
+        std::ostringstream out;
+        out << "{\n  \"clock\": \"" << clock_name() << "\",\n  \"ticks_per_ns\": " << per_ns
+            << ",\n  \"wall_ns\": " << wall << ",\n  \"hardware_counters\": " << (hardware ? "true" : "false");
+        if (!hardware) {
+            out << ",\n  \"hardware_error\": \"" << hardware_error << "\"";
+        }
+        out << ",\n  \"sample_period\": " << sample_period << ",\n  \"phases\": [";
+        const std::vector<std::string> names = registered();
+        bool first = true;
+        for (unsigned i=0; i < phases.size(); ++i) {
+            const Phase& ph = phases[i];
+            if (ph.calls == 0) {
+                continue;
+            }
+            const double inclusive = ph.inclusive/per_ns;
+            const double exclusive = (ph.inclusive - ph.children)/per_ns;
+            out << (first ? "" : ",") << "\n    {\"name\": \"" << names[i] << "\", \"calls\": " << ph.calls
+                << ", \"inclusive_ns\": " << inclusive << ", \"exclusive_ns\": " << exclusive
+                << ", \"ns_per_call\": " << inclusive/ph.calls << ", \"share\": " << exclusive/wall;
+            if (hardware && ph.sampled > 0) {
+                for (unsigned k=0; k < num_counters; ++k) {
+                    out << ", \"" << counter_names[k] << "\": " << (double) ph.counters[k]*ph.calls/ph.sampled;
+                }
+            }
+            out << "}";
+            first = false;
+        }
+        out << "\n  ]\n}\n";
+        return out.str();
+    }
+
+    /* Discard the measurements so far */
+    void reset (void) {
+        phases.clear();
+        begin		= std::chrono::steady_clock::now();
+        begin_ticks	= ticks();
+    }
+
+private:
+    struct Phase {
+        std::uint64_t	calls		= 0;
+        std::uint64_t	inclusive	= 0;		/* ticks									*/
+        std::uint64_t	children	= 0;		/* ticks of phases opened within			*/
+        std::uint64_t	sampled		= 0;		/* calls with read counters					*/
+        std::uint64_t	counters[num_counters] = {0, 0, 0};
+    };
+
+    Profiler() {
+        open_counters();
+        reset();
+    }
+
+    ~Profiler() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    Phase& at (unsigned index) {
+        if (index >= phases.size()) {
+            phases.resize(index + 1);
+        }
+        return phases[index];
+    }
+
+    /* Time stamp counter, or ns of the steady clock on other architectures */
+    static std::uint64_t ticks (void) {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static const char* clock_name (void) {
+#if defined(__x86_64__) || defined(__i386__)
+        return "tsc";
+#else
+        return "steady_clock";
+#endif
+    }
+
+    /* One group of user space counters of this thread */
+    void open_counters (void) {
+#ifdef __linux__
+        const std::uint64_t configs[num_counters] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+                                                     PERF_COUNT_HW_BRANCH_MISSES};
+        for (unsigned k=0; k < num_counters; ++k) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size			= sizeof(attr);
+            attr.type			= PERF_TYPE_HARDWARE;
+            attr.config			= configs[k];
+            attr.exclude_kernel	= 1;
+            attr.exclude_hv		= 1;
+            attr.read_format	= PERF_FORMAT_GROUP;
+            fds.push_back(syscall(SYS_perf_event_open, &attr, 0, -1, k == 0 ? -1 : fds[0], 0));
+            if (fds.back() < 0) {
+                hardware_error = std::string("perf_event_open: ") + std::strerror(errno);
+                return;
+            }
+        }
+        hardware = true;
+#else
+        hardware_error = "perf_event_open is only available on Linux";
+#endif
+    }
+
+    void read (std::uint64_t* values) const {
+#ifdef __linux__
+        std::uint64_t group[1 + num_counters];
+        if (::read(fds[0], group, sizeof(group)) == (ssize_t) sizeof(group)) {
+            std::memcpy(values, group + 1, sizeof(std::uint64_t)*num_counters);
+            return;
+        }
+#endif
+        std::memset(values, 0, sizeof(std::uint64_t)*num_counters);
+    }
+
+    static std::mutex&				 registry_mutex (void) {static std::mutex m; return m;}
+    static std::vector<std::string>& registry		(void) {static std::vector<std::string> names; return names;}
+    static std::vector<std::string>	 registered		(void) {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        return registry();
+    }
+
+    std::vector<Phase>	phases;
+    Scope*				current		= nullptr;
+
+    /* Hardware counters, the first one leads the group */
+    std::vector<int>	fds;
+    bool				hardware	= false;
+    std::string			hardware_error;
+
+    /* Start of the measurement */
+    std::chrono::steady_clock::time_point	begin;
+    std::uint64_t							begin_ticks = 0;
+};
+
+#endif
@@ -27,30 +27,159 @@
 /*                          Random number streams                             */
 /******************************************************************************/
 #pragma once
-#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 
+#include "Fast_Math.h"
+
+/******************************************************************************/
+/*						Counter based random number generator				  */
+/* Philox4x32-10 (Salmon et al., SC11). Every output block is a bijective	  */
+/* function of a 128 bit counter under a 64 bit key, so any position of any	  */
+/* stream can be computed directly without advancing a state.				  */
+/* The key holds the seed, the upper counter words the stream index and the	  */
+/* lower ones the position within the stream.								  */
+/******************************************************************************/
+class Philox4x32 {
+public:
+    struct Block {std::uint32_t v[4];};
+
+    explicit Philox4x32(std::uint64_t seed = 0, std::uint64_t stream = 0)
+    : key {(std::uint32_t) seed, (std::uint32_t) (seed >> 32)},
+      stream {(std::uint32_t) stream, (std::uint32_t) (stream >> 32)} {}
+
+    /* Random block at the given position of the stream. The rounds work on	  */
+    /* scalars, so the loops of bulk generation can keep them in registers	  */
+    Block operator ()(std::uint64_t position) const {
+        std::uint32_t c0 = (std::uint32_t) position;
+        std::uint32_t c1 = (std::uint32_t) (position >> 32);
+        std::uint32_t c2 = stream[0];
+        std::uint32_t c3 = stream[1];
+        std::uint32_t k0 = key[0];
+        std::uint32_t k1 = key[1];
+        for (unsigned i=0; i < 10; ++i) {
+            const std::uint64_t p0 = (std::uint64_t) 0xD2511F53 * c0;
+            const std::uint64_t p1 = (std::uint64_t) 0xCD9E8D57 * c2;
+            c0 = (std::uint32_t) (p1 >> 32) ^ c1 ^ k0;
+            c1 = (std::uint32_t) p1;
+            c2 = (std::uint32_t) (p0 >> 32) ^ c3 ^ k1;
+            c3 = (std::uint32_t) p0;
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+        return Block {{c0, c1, c2, c3}};
+    }
+
+    /* Two uniform 64 bit words of a block */
+    static std::uint64_t word (const Block& b, unsigned i) {
+        return ((std::uint64_t) b.v[2*i+1] << 32) | b.v[2*i];
+    }
+
+    /* Uniform double in (0, 1] with 52 bit resolution. The bits are placed	  */
+    /* in the mantissa of a double in [1, 2), so no conversion is needed	  */
+    static double uniform (std::uint64_t word) {
+        const std::uint64_t bits = (word >> 12) | 0x3FF0000000000000ULL;
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return 2.0 - d;
+    }
+
+private:
+    std::uint32_t key	[2];
+    std::uint32_t stream[2];
+};
+
+/******************************************************************************/
+/*							Box-Muller transform							  */
+/* Maps a block to two standard normal variates. Single draws and the bulk	  */
+/* generation of Noise_Buffer share it, so both yield identical numbers.	  */
+/******************************************************************************/
+inline void box_muller (const Philox4x32::Block& b, double& z0, double& z1) {
+    const double r	 = std::sqrt(-2.0 * fast_log(Philox4x32::uniform(Philox4x32::word(b, 0))));
+    const double phi = 6.283185307179586476925 * Philox4x32::uniform(Philox4x32::word(b, 1));
+    double sin_phi, cos_phi;
+    fast_sincos(phi, sin_phi, cos_phi);
+    z0 = r * cos_phi;
+    z1 = r * sin_phi;
+}
+
+/******************************************************************************/
+/*								Random streams								  */
+/* Draw n of a stream is computed from block n/2, so the position can be set  */
+/* in O(1). Together with (seed, stream) it is the complete state of a stream */
+/* and reproduces it independently of how the work is distributed.			  */
+/******************************************************************************/
 class randomStreamNormal {
 public:
     explicit randomStreamNormal(double mean, double stddev)
-    : mt(rand()), norm_dist(mean, stddev) {}
+    : randomStreamNormal(mean, stddev, (std::uint64_t) rand(), 0) {}
     explicit randomStreamNormal(double mean, double stddev, double seed)
-    : mt(seed), norm_dist(mean, stddev) {}
+    : randomStreamNormal(mean, stddev, (std::uint64_t) seed, 0) {}
+    explicit randomStreamNormal(double mean, double stddev, std::uint64_t seed, unsigned stream,
+                                std::uint64_t counter = 0)
+    : philox(seed, stream), mean(mean), stddev(stddev) {set_counter(counter);}
+
+    /* Box-Muller transform of one block yields two draws */
+    double operator ()(void) {
+        if (counter++ & 1) {
+            return second;
+        }
+        double z0, z1;
+        box_muller(philox(counter >> 1), z0, z1);
+        second = mean + stddev * z1;
+        return   mean + stddev * z0;
+    }
+
+    /* Position within the stream, i.e. the number of draws so far */
+    std::uint64_t get_counter (void) const {return counter;}
+    void set_counter (std::uint64_t position) {
+        counter = position & ~(std::uint64_t) 1;
+        if (position & 1) {
+            operator()();
+        }
+    }
+
+    /* Skip n draws */
+    void discard (std::uint64_t n) {set_counter(counter + n);}
 
-    double operator ()(void) { return norm_dist(mt); }
 private:
-    std::mt19937_64                     mt;
-    std::normal_distribution<double>    norm_dist;
+    Philox4x32		philox;
+    double			mean;
+    double			stddev;
+    std::uint64_t	counter = 0;
+    double			second	= 0.0;
 };
 
 class randomStreamUniformInt {
 public:
     explicit randomStreamUniformInt(int lower_bound, int upper_bound)
-    : mt(rand()), uniform_dist(lower_bound, upper_bound) {}
+    : randomStreamUniformInt(lower_bound, upper_bound, (std::uint64_t) rand(), 0) {}
     explicit randomStreamUniformInt(int lower_bound, int upper_bound, double seed)
-    : mt(seed), uniform_dist(lower_bound, upper_bound) {}
+    : randomStreamUniformInt(lower_bound, upper_bound, (std::uint64_t) seed, 0) {}
+    explicit randomStreamUniformInt(int lower_bound, int upper_bound, std::uint64_t seed, unsigned stream,
+                                    std::uint64_t counter = 0)
+    : philox(seed, stream), lower_bound(lower_bound),
+      range((std::uint64_t) ((std::int64_t) upper_bound - lower_bound) + 1), counter(counter) {}
+
+    /* The modulo bias is below range/2^64 */
+    int operator ()(void) {
+        const Philox4x32::Block b = philox(counter >> 1);
+        const std::uint64_t w	  = Philox4x32::word(b, counter++ & 1);
+        return (int) (lower_bound + (std::int64_t) (w % range));
+    }
+
+    /* Position within the stream, i.e. the number of draws so far */
+    std::uint64_t get_counter (void) const {return counter;}
+    void set_counter (std::uint64_t position) {counter = position;}
+
+    /* Skip n draws */
+    void discard (std::uint64_t n) {counter += n;}
 
-    int operator ()(void) { return uniform_dist(mt); }
 private:
-    std::mt19937_64                     mt;
-    std::uniform_int_distribution<>     uniform_dist;
+    Philox4x32		philox;
+    int				lower_bound;
+    std::uint64_t	range;
+    std::uint64_t	counter;
 };
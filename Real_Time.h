@@ -0,0 +1,213 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Wall clock paced simulation							  */
+/*																			  */
+/* Runs the system in real time for hardware or software in the loop tests.	  */
+/* Every step is paced to its own deadline. Block means of Vp and Vt at		  */
+/* sample_rate are published into a Shared_Ring at the wall clock time at	  */
+/* which the block ends, like the samples of an amplifier. Stimulation		  */
+/* commands are read back from a second ring before every step and applied	  */
+/* with set_input. A command names the sample it was computed from, so the	  */
+/* sample to stimulus latency is measured as the wall time between			  */
+/* publishing that sample and applying the command.							  */
+/* Times are CLOCK_MONOTONIC in ns, which is shared by all local processes.	  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ODE.h"
+#include "Shared_Ring.h"
+#include "TC_System.h"
+
+/* Published sample */
+struct RT_Sample {
+    std::uint64_t	index;			/* sample number							*/
+    double			Vp;				/* block mean of Vp in mV					*/
+    double			Vt;				/* block mean of Vt in mV					*/
+    std::int64_t	time;			/* wall time of publication in ns			*/
+};
+
+/* Stimulation command */
+struct RT_Command {
+    enum Target : std::uint32_t {Cortex, Thalamus};
+
+    std::uint64_t	sample;			/* sample the command was computed from		*/
+    std::uint32_t	target;
+    double			strength;		/* input in s^-1 (Hz) as in var_stim		*/
+    std::int64_t	time;			/* wall time of sending in ns				*/
+};
+
+/* Monotonic wall time in ns */
+inline std::int64_t monotonic_ns (void) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (std::int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct Real_Time_Options {
+    double		duration	= 60;		/* simulated time in s						*/
+    int			sample_rate	= 1000;		/* published samples per s, divides res		*/
+    double		speed		= 1;		/* simulated s per wall s					*/
+    int			spin		= 50000;	/* ns busy waited before a deadline			*/
+};
+
+/* Applied command */
+struct RT_Latency {
+    std::uint64_t	sample;			/* sample the command was computed from		*/
+    std::uint64_t	applied;		/* samples published before it was applied	*/
+    std::int64_t	latency;		/* wall time from publication to application */
+    std::int64_t	transit;		/* wall time from sending to application	*/
+};
+
+struct Real_Time_Report {
+    std::uint64_t	samples		= 0;
+    std::uint64_t	overruns	= 0;	/* steps computed after their deadline		*/
+    std::uint64_t	dropped		= 0;	/* samples not taken by the client in time	*/
+    std::uint64_t	rejected	= 0;	/* commands for unknown targets or samples	*/
+    std::int64_t	max_jitter	= 0;	/* latest publication after a deadline in ns */
+    double			mean_jitter	= 0;
+    std::vector<RT_Latency>	commands;
+
+    /* One line per applied command */
+    void write_log (const std::string& file) const {
+        std::ofstream log(file);
+        if (!log) {
+            throw std::runtime_error("Real_Time_Report: cannot create " + file);
+        }
+        log << "# samples " << samples << " overruns " << overruns << " dropped " << dropped
+            << " rejected " << rejected << " max_jitter_ns " << max_jitter
+            << " mean_jitter_ns " << mean_jitter << "\n";
+        log << "sample\tapplied\tlatency_ns\ttransit_ns\n";
+        for (const RT_Latency& L : commands) {
+            log << L.sample << "\t" << L.applied << "\t" << L.latency << "\t" << L.transit << "\n";
+        }
+    }
+};
+
+/******************************************************************************/
+/*								Run loop									  */
+/******************************************************************************/
+class Real_Time {
+public:
+    Real_Time(TC_System& System, Shared_Ring<RT_Sample>& Samples, Shared_Ring<RT_Command>& Commands,
+              const Real_Time_Options& options = Real_Time_Options())
+    : System (System), Samples (Samples), Commands (Commands), options (options) {
+        extern const int res;
+        if (options.sample_rate <= 0 || res % options.sample_rate != 0 || options.speed <= 0) {
+            throw std::invalid_argument("Real_Time: sample_rate has to divide res");
+        }
+    }
+
+    /* Run for options.duration, starting with the current state */
+    Real_Time_Report run (void);
+
+private:
+    /* Sleep until shortly before the deadline and spin for the rest, returns the time */
+    std::int64_t wait (std::int64_t deadline) const {
+        std::int64_t now = monotonic_ns();
+        if (deadline - now > options.spin) {
+            const std::int64_t wake = deadline - options.spin;
+            const timespec ts = {(time_t) (wake / 1000000000), (long) (wake % 1000000000)};
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+        }
+        while ((now = monotonic_ns()) < deadline) {}
+        return now;
+    }
+
+    TC_System&					System;
+    Shared_Ring<RT_Sample>&		Samples;
+    Shared_Ring<RT_Command>&	Commands;
+    Real_Time_Options			options;
+};
+
+/******************************************************************************/
+/*							Function definitions							  */
+/******************************************************************************/
+inline Real_Time_Report Real_Time::run (void) {
+    extern const int res;
+    const int			 steps		= res/options.sample_rate;
+    const std::uint64_t	 num_steps	= options.duration*res;
+    const double		 period		= 1E9/(res*options.speed);
+
+    /* Publication times of the samples a command may still refer to */
+    std::vector<std::int64_t> published(Samples.capacity() + Commands.capacity());
+
+    Real_Time_Report R;
+    double Vp = 0.0, Vt = 0.0;
+    const std::int64_t start = monotonic_ns();
+    for (std::uint64_t n=0; n < num_steps; ++n) {
+        /* Commands that arrived during the last step act on this one */
+        RT_Command C;
+        while (Commands.pop(C)) {
+            if (C.target > RT_Command::Thalamus || C.sample >= R.samples ||
+                R.samples - C.sample > published.size()) {
+                ++R.rejected;
+                continue;
+            }
+            if (C.target == RT_Command::Cortex) {
+                System.Cortex.set_input(C.strength / 1000);
+            } else {
+                System.Thalamus.set_input(C.strength / 1000);
+            }
+            const std::int64_t applied = monotonic_ns();
+            R.commands.push_back(RT_Latency {C.sample, R.samples, applied - published[C.sample % published.size()],
+                                             applied - C.time});
+        }
+
+        ODE(System);
+        Vp += System.Cortex.Vp[0];
+        Vt += System.Thalamus.Vt[0];
+
+        /* The step ends at its deadline in wall time */
+        const std::int64_t deadline = start + (std::int64_t) ((n + 1)*period);
+        if (monotonic_ns() > deadline) {
+            ++R.overruns;
+        }
+        const std::int64_t now = wait(deadline);
+        if ((n + 1) % steps != 0) {
+            continue;
+        }
+
+        /* Publish the block mean at the end of the block */
+        const std::uint64_t k = R.samples;
+        if (!Samples.push(RT_Sample {k, Vp/steps, Vt/steps, now})) {
+            ++R.dropped;
+        }
+        published[k % published.size()] = now;
+        R.max_jitter	= std::max(R.max_jitter, now - deadline);
+        R.mean_jitter  += (now - deadline - R.mean_jitter)/(k + 1);
+        R.samples		= k + 1;
+        Vp = Vt = 0.0;
+    }
+    return R;
+}
@@ -0,0 +1,254 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Recorder of selected variables						  */
+/*																			  */
+/* Every channel records one variable of a column pair at its own rate. The	  */
+/* values of every time step run through a cascade of decimating low pass	  */
+/* filters, so nothing above 0.4 of the output rate aliases into the data.	  */
+/* Only the added channels are evaluated in sample(), variables that are not  */
+/* recorded cost nothing.													  */
+/*																			  */
+/* The filters are linear phase and their delay is compensated: sample k of	  */
+/* a channel with decimation factor D belongs to time step start + k*D,		  */
+/* which is the grid of the point samples t%red == 0 used before. A channel	  */
+/* is therefore only complete delay() steps after its last time step.		  */
+/******************************************************************************/
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Cortical_Column.h"
+#include "Decimator.h"
+#include "TC_System.h"
+#include "Thalamic_Column.h"
+
+class Recorder {
+public:
+    /* Value of a variable at the current time step */
+    typedef double (*Probe) (const Cortical_Column&, const Thalamic_Column&);
+
+    /* Record the columns for the time steps [start, end) */
+    Recorder(const Cortical_Column& C, const Thalamic_Column& T,
+             std::uint64_t start = 0, std::uint64_t end = std::numeric_limits<std::uint64_t>::max())
+        : Cortex (C), Thalamus (T), start (start), end (end) {}
+
+    Recorder(const TC_System& System,
+             std::uint64_t start = 0, std::uint64_t end = std::numeric_limits<std::uint64_t>::max())
+        : Recorder(System.Cortex, System.Thalamus, start, end) {}
+
+    /* Add a channel of a variable with rate samples per s, which has to divide res */
+    unsigned add (const std::string& variable, double rate) {
+        extern const int res;
+        const unsigned factor = (unsigned) std::lround(res/rate);
+        if (!(rate > 0) || factor == 0 || std::fabs(res/rate - factor) > 1E-9*factor) {
+            throw std::invalid_argument("Recorder: rate " + std::to_string(rate) +
+                                        " does not divide " + std::to_string(res));
+        }
+
+        Channel ch;
+        ch.name	  = variable;
+        ch.rate	  = rate;
+        ch.probe  = probe(variable);
+        ch.factor = factor;
+
+        /* Passband of the output and stopband of every stage relative to its input */
+        const double f_pass = 0.4*rate;
+        double		 f_in	= res;
+        for (unsigned f : stage_factors(factor)) {
+            ch.stages.emplace_back(f, f_pass/f_in, (f_in/f - f_pass)/f_in);
+            ch.delay += (std::uint64_t) ch.stages.back().delay() * (std::uint64_t) (res/f_in + 0.5);
+            f_in /= f;
+        }
+
+        /* Feed from the first step whose block ends on the output grid, skipping	*/
+        /* what does not reach the first stored sample									*/
+        ch.first = (ch.delay + 1) % factor;
+        if (start > 2*ch.delay + factor + ch.first) {
+            const std::uint64_t warm = start - 2*ch.delay - factor;
+            ch.first = warm - (warm - ch.first) % factor;
+        }
+        ch.next = ch.first;
+
+        channels.push_back(std::move(ch));
+        return channels.size() - 1;
+    }
+
+    /* Evaluate the channels for time step t, called once per step in order. If	*/
+    /* the first call is late, e.g. after restoring a checkpoint, the filters	*/
+    /* start as if the variables had been constant before						*/
+    void sample (std::uint64_t t) {
+        for (Channel& ch : channels) {
+            if (t < ch.first) {
+                continue;
+            }
+            const double x = ch.probe(Cortex, Thalamus);
+            const std::uint64_t span = 2*ch.delay + ch.factor;
+            if (ch.next + span < t) {
+                ch.next += (t - span - ch.next)/ch.factor*ch.factor;
+            }
+            for (; ch.next <= t; ++ch.next) {
+                feed(ch, ch.next, x);
+            }
+        }
+    }
+
+    /* Largest filter delay in time steps, the steps that have to be run after end */
+    std::uint64_t delay (void) const {
+        std::uint64_t d = 0;
+        for (const Channel& ch : channels) {
+            d = std::max(d, ch.delay);
+        }
+        return d;
+    }
+
+    /* Channels in the order they were added */
+    unsigned			size (void) 			const {return channels.size();}
+    const std::string&	name (unsigned channel) const {return channels.at(channel).name;}
+    double				rate (unsigned channel) const {return channels.at(channel).rate;}
+
+    /* Recorded samples, they may be taken or erased e.g. after writing them */
+    std::vector<double>&		data (unsigned channel)		  {return channels.at(channel).data;}
+    const std::vector<double>&	data (unsigned channel) const {return channels.at(channel).data;}
+
+    /* Whether a variable belongs to the cortical or the thalamic column */
+    static bool cortical (const std::string& variable) {return find(variable).cortical;}
+
+    /* Names of all recordable variables */
+    static std::vector<std::string> variables (void) {
+        std::vector<std::string> names;
+        for (const Variable& v : catalog()) {
+            names.push_back(v.name);
+        }
+        return names;
+    }
+
+private:
+    struct Variable {
+        const char*	name;
+        bool		cortical;
+        Probe		probe;
+    };
+
+    struct Channel {
+        std::string				name;
+        double					rate	= 0;
+        Probe					probe	= nullptr;
+        unsigned				factor	= 1;
+        std::vector<Decimator>	stages;
+
+        /* Filter delay, first and next time step that is fed */
+        std::uint64_t			delay	= 0;
+        std::uint64_t			first	= 0;
+        std::uint64_t			next	= 0;
+
+        std::vector<double>		data;
+    };
+
+    /* Recordable variables, firing rates are in ms^-1 as within the model */
+    static const std::vector<Variable>& catalog (void) {
+        typedef const Cortical_Column& C;
+        typedef const Thalamic_Column& T;
+        static const std::vector<Variable> vars = {
+            {"Vp",		true,	[] (C c, T)	{return c.Vp	[0];}},
+            {"Vi",		true,	[] (C c, T)	{return c.Vi	[0];}},
+            {"Na",		true,	[] (C c, T)	{return c.Na	[0];}},
+            {"Qp",		true,	[] (C c, T)	{return c.get_Qp(0);}},
+            {"Qi",		true,	[] (C c, T)	{return c.get_Qi(0);}},
+            {"I_KNa",	true,	[] (C c, T)	{return c.I_KNa	(0);}},
+            {"s_ep",	true,	[] (C c, T)	{return c.s_ep	[0];}},
+            {"s_ei",	true,	[] (C c, T)	{return c.s_ei	[0];}},
+            {"s_gp",	true,	[] (C c, T)	{return c.s_gp	[0];}},
+            {"s_gi",	true,	[] (C c, T)	{return c.s_gi	[0];}},
+            {"y_p",		true,	[] (C c, T)	{return c.y		[0];}},
+            {"Vt",		false,	[] (C, T t)	{return t.Vt	[0];}},
+            {"Vr",		false,	[] (C, T t)	{return t.Vr	[0];}},
+            {"Ca",		false,	[] (C, T t)	{return t.Ca	[0];}},
+            {"Qt",		false,	[] (C, T t)	{return t.get_Qt(0);}},
+            {"Qr",		false,	[] (C, T t)	{return t.get_Qr(0);}},
+            {"I_T_t",	false,	[] (C, T t)	{return t.I_T_t	(0, t.m_inf_T_t(0));}},
+            {"I_T_r",	false,	[] (C, T t)	{return t.I_T_r	(0, t.m_inf_T_r(0));}},
+            {"I_h",		false,	[] (C, T t)	{return t.I_h	(0);}},
+            {"I_LK_t",	false,	[] (C, T t)	{return t.I_LK_t(0);}},
+            {"h_T_t",	false,	[] (C, T t)	{return t.h_T_t	[0];}},
+            {"h_T_r",	false,	[] (C, T t)	{return t.h_T_r	[0];}},
+            {"m_h",		false,	[] (C, T t)	{return t.m_h	[0];}},
+            {"m_h2",	false,	[] (C, T t)	{return t.m_h2	[0];}},
+            {"act_h",	false,	[] (C, T t)	{return t.act_h	();}},
+            {"y_t",		false,	[] (C, T t)	{return t.y		[0];}}};
+        return vars;
+    }
+
+    static const Variable& find (const std::string& variable) {
+        for (const Variable& v : catalog()) {
+            if (variable == v.name) {
+                return v;
+            }
+        }
+        throw std::invalid_argument("Recorder: unknown variable " + variable);
+    }
+
+    static Probe probe (const std::string& variable) {return find(variable).probe;}
+
+    /* Filter the value of time step t and store the output if it is complete */
+    void feed (Channel& ch, std::uint64_t t, double x) {
+        for (Decimator& stage : ch.stages) {
+            if (!stage(x, x)) {
+                return;
+            }
+        }
+        if (t >= start + ch.delay && t - ch.delay < end) {
+            ch.data.push_back(x);
+        }
+    }
+
+    /* Split a decimation factor into stages of at most 10, largest first */
+    static std::vector<unsigned> stage_factors (unsigned factor) {
+        std::vector<unsigned> factors;
+        while (factor > 1) {
+            unsigned f = 10;
+            while (f > 1 && factor%f != 0) {
+                --f;
+            }
+            f = f > 1 ? f : factor;
+            factors.push_back(f);
+            factor /= f;
+        }
+        return factors;
+    }
+
+    const Cortical_Column&	Cortex;
+    const Thalamic_Column&	Thalamus;
+
+    /* Stored time steps [start, end) */
+    const std::uint64_t		start;
+    const std::uint64_t		end;
+
+    std::vector<Channel>	channels;
+};
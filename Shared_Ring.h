@@ -0,0 +1,212 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Lock-free ring buffer in shared memory				  */
+/*																			  */
+/* Single producer, single consumer queue of fixed size records in a POSIX	  */
+/* shared memory object, so two processes can exchange samples without locks  */
+/* or system calls. The producer only writes head and the consumer only		  */
+/* writes tail, both are atomic counters that never wrap. A full ring rejects */
+/* the record instead of blocking the producer and counts it as dropped.	  */
+/* Layout of the object:													  */
+/*		Shared_Ring_Header, padded to a cache line per counter				  */
+/*		capacity records													  */
+/******************************************************************************/
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared_Ring needs lock-free 64 bit atomics");
+
+/* Identification of the layout */
+const char			shared_ring_magic[8] = {'N', 'M', '_', 'T', 'C', 'R', 'N', 'G'};
+const std::uint32_t	shared_ring_version	 = 1;
+
+struct Shared_Ring_Header {
+    char			magic[8];
+    std::uint32_t	version;
+    std::uint32_t	record_size;
+    std::uint64_t	capacity;			/* number of records, a power of two		*/
+    alignas(64) std::atomic<std::uint64_t>	head;		/* records written		*/
+    alignas(64) std::atomic<std::uint64_t>	tail;		/* records read			*/
+    alignas(64) std::atomic<std::uint64_t>	dropped;	/* records rejected		*/
+};
+
+template <typename Record>
+class Shared_Ring {
+    static_assert(std::is_trivially_copyable<Record>::value, "Shared_Ring records have to be trivially copyable");
+public:
+    /* Create the object name (see shm_open) for capacity records, an existing	*/
+    /* one is replaced. The creator removes the name again on destruction		*/
+    static Shared_Ring create (const std::string& name, std::uint64_t capacity) {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("Shared_Ring: capacity has to be a power of two");
+        }
+        shm_unlink(name.c_str());
+        const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Shared_Ring: cannot create " + name + ": " + std::strerror(errno));
+        }
+        const std::size_t bytes = size(capacity);
+        if (ftruncate(fd, bytes) != 0) {
+            const int error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("Shared_Ring: cannot resize " + name + ": " + std::strerror(error));
+        }
+        Shared_Ring ring(name, fd, bytes, true);
+
+        Shared_Ring_Header* H = new (ring.base) Shared_Ring_Header;
+        std::memcpy(H->magic, shared_ring_magic, sizeof(H->magic));
+        H->version		= shared_ring_version;
+        H->record_size	= sizeof(Record);
+        H->capacity		= capacity;
+        H->head.store(0);
+        H->tail.store(0);
+        H->dropped.store(0);
+        ring.header		= H;
+        return ring;
+    }
+
+    /* Attach to the object name created by another process */
+    static Shared_Ring open (const std::string& name) {
+        const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Shared_Ring: cannot open " + name + ": " + std::strerror(errno));
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (std::size_t) info.st_size < sizeof(Shared_Ring_Header)) {
+            close(fd);
+            throw std::runtime_error("Shared_Ring: " + name + " is too short");
+        }
+        Shared_Ring ring(name, fd, info.st_size, false);
+
+        Shared_Ring_Header* H = static_cast<Shared_Ring_Header*>(ring.base);
+        if (std::memcmp(H->magic, shared_ring_magic, sizeof(H->magic)) != 0 ||
+            H->version != shared_ring_version || H->record_size != sizeof(Record) ||
+            (std::size_t) info.st_size < size(H->capacity)) {
+            throw std::runtime_error("Shared_Ring: " + name + " does not hold rings of this record");
+        }
+        ring.header = H;
+        return ring;
+    }
+
+    Shared_Ring(Shared_Ring&& other)
+    : name (std::move(other.name)), base (other.base), bytes (other.bytes), owner (other.owner),
+      header (other.header) {
+        other.base	= nullptr;
+        other.owner	= false;
+    }
+
+    Shared_Ring(const Shared_Ring&) = delete;
+    Shared_Ring& operator=(const Shared_Ring&) = delete;
+    Shared_Ring& operator=(Shared_Ring&&) = delete;
+
+    ~Shared_Ring() {
+        if (base) {
+            munmap(base, bytes);
+        }
+        if (owner) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    /* Producer: append a record, false if the ring is full */
+    bool push (const Record& R) {
+        const std::uint64_t head = header->head.load(std::memory_order_relaxed);
+        if (head - header->tail.load(std::memory_order_acquire) == header->capacity) {
+            header->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::memcpy(records() + (head & (header->capacity - 1)), &R, sizeof(Record));
+        header->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer: take the oldest record, false if the ring is empty */
+    bool pop (Record& R) {
+        const std::uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        if (tail == header->head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        std::memcpy(&R, records() + (tail & (header->capacity - 1)), sizeof(Record));
+        header->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Records waiting for the consumer */
+    std::uint64_t	pending	 (void) const {
+        return header->head.load(std::memory_order_acquire) - header->tail.load(std::memory_order_acquire);
+    }
+    std::uint64_t	dropped	 (void) const {return header->dropped.load(std::memory_order_relaxed);}
+    std::uint64_t	capacity (void) const {return header->capacity;}
+
+private:
+    Shared_Ring(const std::string& name, int fd, std::size_t bytes, bool owner)
+    : name (name), bytes (bytes), owner (owner) {
+        void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        const int error = errno;
+        close(fd);
+        if (ptr == MAP_FAILED) {
+            if (owner) {
+                shm_unlink(name.c_str());
+            }
+            throw std::runtime_error("Shared_Ring: mmap failed: " + std::string(std::strerror(error)));
+        }
+        base = ptr;
+    }
+
+    /* Bytes of the object for capacity records */
+    static std::size_t size (std::uint64_t capacity) {
+        return records_offset() + capacity*sizeof(Record);
+    }
+
+    static std::size_t records_offset (void) {
+        const std::size_t align = alignof(Record) > 64 ? alignof(Record) : 64;
+        return (sizeof(Shared_Ring_Header) + align - 1)/align*align;
+    }
+
+    Record* records (void) const {
+        return reinterpret_cast<Record*>(static_cast<char*>(base) + records_offset());
+    }
+
+    std::string			name;
+    void*				base	= nullptr;
+    std::size_t			bytes	= 0;
+    bool				owner	= false;
+    Shared_Ring_Header*	header	= nullptr;
+};
@@ -0,0 +1,78 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*				Aligned contiguous storage for the state variables			  */
+/******************************************************************************/
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+/* Number of stored values per variable: current value and the 4 RK moments */
+const unsigned num_stages	= 5;
+
+/* Alignment of the state block in bytes (one cache line) */
+const std::size_t state_alignment = 64;
+
+/******************************************************************************/
+/*							Aligned allocator								  */
+/******************************************************************************/
+template <typename T, std::size_t Alignment = state_alignment>
+class Aligned_Allocator {
+public:
+    typedef T           value_type;
+    typedef T*          pointer;
+    typedef const T*    const_pointer;
+    typedef T&          reference;
+    typedef const T&    const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {typedef Aligned_Allocator<U, Alignment> other;};
+
+    Aligned_Allocator(void) {}
+    template <typename U>
+    Aligned_Allocator(const Aligned_Allocator<U, Alignment>&) {}
+
+    T* allocate (std::size_t n) {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, Alignment, n*sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate (T* ptr, std::size_t) {free(ptr);}
+
+    template <typename U>
+    bool operator==(const Aligned_Allocator<U, Alignment>&) const {return true;}
+    template <typename U>
+    bool operator!=(const Aligned_Allocator<U, Alignment>&) const {return false;}
+};
+
+/* Contiguous block holding all variables x RK stages of a system */
+typedef std::vector<double, Aligned_Allocator<double>> State_Block;
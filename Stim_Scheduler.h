@@ -0,0 +1,749 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/*						Event driven stimulation scheduler					  */
+/*																			  */
+/* Protocols schedule stimulus, on/off and amplitude events in a time ordered */
+/* queue, so a step without due events costs a single comparison. Only phase  */
+/* dependent protocols have to monitor Vp, and only while they search for the */
+/* next trough. Closed loop protocols estimate the slow oscillation phase	  */
+/* every step and stimulate at a target phase, see Phase_Estimator.h.		  */
+/* Several protocols can drive the cortical and the thalamic				  */
+/* input at the same time, the input of a target is the sum of the current	  */
+/* amplitudes of its protocols. Markers are kept separately per protocol.	  */
+/* Stimuli of a single protocol should not overlap.							  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Cortical_Column.h"
+#include "Event_Detection.h"
+#include "Phase_Estimator.h"
+#include "Random_Stream.h"
+#include "TC_System.h"
+#include "Thalamic_Column.h"
+
+/* Stimulated input of a protocol */
+enum class Stim_Target {Cortex, Thalamus};
+
+/******************************************************************************/
+/*								Stimulation protocol						  */
+/* All times are in dt, the strength in ms^-1. The factory functions take the */
+/* units of var_stim.														  */
+/******************************************************************************/
+struct Stim_Protocol {
+    /* Periodic:	stimulus events every ISI, jittered by +-ISI_range		  */
+    /* Phase:		stimulus events time_to_stimuli after a trough of Vp below */
+    /*				threshold, followed by a pause of ISI					  */
+    /* Waveform:	the samples are applied as amplitude every sample_steps,  */
+    /*				repeated every ISI if ISI > 0							  */
+    /* Closed_Loop:	stimulus events at target_phase of the slow oscillation,  */
+    /*				followed by a pause of ISI								  */
+    /* Inactive:	no stimulation, mode 0 of var_stim						  */
+    enum Kind {Periodic, Phase, Waveform, Closed_Loop, Inactive};
+
+    /* Values of a var_stim vector, the last one is optional */
+    static const unsigned var_stim_size = 9;
+
+    Kind		kind					= Periodic;
+    Stim_Target	target					= Stim_Target::Thalamus;
+
+    /* Stimulation strength */
+    double		strength				= 0.0;
+
+    /* Duration of a stimulus */
+    int			duration				= 120E1;
+
+    /* Interval between stimulus events and its range */
+    int			ISI						= 5E4;
+    int			ISI_range				= 0;
+
+    /* Number of stimuli per stimulus event and the time between them */
+    int			number_of_stimuli		= 1;
+    int			time_between_stimuli	= 1050E1;
+
+    /* Periodic and waveform: first event after the origin */
+    /* Phase: delay between the trough and the first stimulus */
+    int			time_to_stimuli			= 1E4;
+
+    /* Threshold for phase dependent stimulation */
+    double		threshold				= -68;
+
+    /* Bursted stimuli, on for burst_length and off for burst_ISI */
+    bool		burst_enabled			= false;
+    int			burst_length			= 20;
+    int			burst_ISI				= 280;
+
+    /* Closed loop: target phase in rad (0 == peak, pi == trough), band of the	*/
+    /* estimator in Hz, least amplitude of the band in mV, delay between the	*/
+    /* decision and the delivery and steps per estimator sample				*/
+    double		target_phase			= 0.0;
+    double		frequency				= 1.0;
+    double		bandwidth				= 1.0;
+    double		min_amplitude			= 0.0;
+    int			latency					= 0;
+    int			decimation				= 10;
+
+    /* The counters of Stim restart at 1, so every stimulus duration, pause and */
+    /* delay after a trough but the first is a step shorter. Protocols of		*/
+    /* var_stim keep that to reproduce the results of Stim						*/
+    bool		shorten_repeats			= false;
+
+    /* Waveform samples in ms^-1 and their spacing */
+    std::shared_ptr<const std::vector<double>> samples;
+    int			sample_steps			= 1;
+
+    /* Semi-periodic stimulation, strength in Hz, duration and time_between in ms, */
+    /* ISI, ISI_range and start in s											   */
+    static Stim_Protocol periodic (Stim_Target target, double strength, double duration, double ISI,
+                                   double ISI_range = 0, int number_of_stimuli = 1,
+                                   double time_between_stimuli = 0, double start = 1) {
+        Stim_Protocol P;
+        P.kind					= Periodic;
+        P.target				= target;
+        P.strength				= strength / 1000;
+        P.duration				= steps(duration / 1000);
+        P.ISI					= steps(ISI);
+        P.ISI_range				= steps(ISI_range);
+        P.number_of_stimuli		= number_of_stimuli;
+        P.time_between_stimuli	= steps(time_between_stimuli / 1000);
+        P.time_to_stimuli		= steps(start);
+        return P;
+    }
+
+    /* Phase dependent stimulation, time_to_stimuli in ms, the pause ISI in s */
+    static Stim_Protocol phase (Stim_Target target, double strength, double duration, double ISI,
+                                double time_to_stimuli, int number_of_stimuli = 1,
+                                double time_between_stimuli = 0, double threshold = -68) {
+        Stim_Protocol P			= periodic(target, strength, duration, ISI, 0, number_of_stimuli,
+                                           time_between_stimuli);
+        P.kind					= Phase;
+        P.time_to_stimuli		= steps(time_to_stimuli / 1000);
+        P.threshold				= threshold;
+        return P;
+    }
+
+    /* Closed loop stimulation at the target phase in rad, latency in ms */
+    static Stim_Protocol closed_loop (Stim_Target target, double strength, double duration, double ISI,
+                                      double target_phase, double latency = 0, int number_of_stimuli = 1,
+                                      double time_between_stimuli = 0, double min_amplitude = 0) {
+        Stim_Protocol P			= periodic(target, strength, duration, ISI, 0, number_of_stimuli,
+                                           time_between_stimuli);
+        P.kind					= Closed_Loop;
+        P.target_phase			= target_phase;
+        P.latency				= steps(latency / 1000);
+        P.min_amplitude			= min_amplitude;
+        return P;
+    }
+
+    /* Waveform from a text file of whitespace separated samples in Hz at the given */
+    /* rate in Hz, start and period of repetition (0 == none) in s					 */
+    static Stim_Protocol waveform (Stim_Target target, const std::string& file, double rate,
+                                   double start = 1, double period = 0, double scale = 1) {
+        extern const int res;
+        std::ifstream input(file);
+        if (!input) {
+            throw std::runtime_error("Stim_Protocol: cannot open waveform " + file);
+        }
+        std::vector<double> values;
+        for (double x; input >> x;) {
+            values.push_back(scale * x / 1000);
+        }
+        if (!input.eof() || values.empty()) {
+            throw std::runtime_error("Stim_Protocol: invalid waveform " + file);
+        }
+        if (rate <= 0 || rate > res) {
+            throw std::invalid_argument("Stim_Protocol: waveform rate has to be in (0, res]");
+        }
+
+        Stim_Protocol P;
+        P.kind					= Waveform;
+        P.target				= target;
+        P.sample_steps			= (int) std::lround(res / rate);
+        P.duration				= P.sample_steps * values.size();
+        P.ISI					= steps(period);
+        P.time_to_stimuli		= steps(start);
+        if (P.ISI != 0 && P.ISI < P.duration) {
+            throw std::invalid_argument("Stim_Protocol: waveform repeats before it ended");
+        }
+        P.samples = std::make_shared<const std::vector<double>>(std::move(values));
+        return P;
+    }
+
+    /* Protocol of the var_stim vector of Stim with mode 0, 1 or 2, an optional	*/
+    /* ninth value selects the target, 0 == thalamus and 1 == cortex. Mode 3 is	*/
+    /* closed loop stimulation {3, strength, duration, ISI, target_phase,		*/
+    /* number_of_stimuli, time_between_stimuli, latency}, target_phase in rad,	*/
+    /* the pause ISI in s and latency in ms, see closed_loop					*/
+    static Stim_Protocol from_var_stim (const double* var_stim, unsigned size = var_stim_size) {
+        extern const int res;
+        if (size != var_stim_size && size != var_stim_size - 1) {
+            throw std::invalid_argument("Stim_Protocol: var_stim has to have 8 or 9 values");
+        }
+        if (size == var_stim_size && var_stim[8] != 0 && var_stim[8] != 1) {
+            throw std::invalid_argument("Stim_Protocol: the target of var_stim has to be 0 or 1");
+        }
+        Stim_Protocol P;
+        P.target				= size == var_stim_size && var_stim[8] == 1 ? Stim_Target::Cortex
+                                                                            : Stim_Target::Thalamus;
+        if (var_stim[0] == 0) {
+            P.kind				= Inactive;
+            return P;
+        }
+        if (var_stim[0] == 3) {
+            return closed_loop(P.target, var_stim[1], var_stim[2], var_stim[3], var_stim[4], var_stim[7],
+                               std::max(1, (int) var_stim[5]), var_stim[6]);
+        }
+        if (var_stim[0] != 1 && var_stim[0] != 2) {
+            throw std::invalid_argument("Stim_Protocol: var_stim has to be mode 0, 1, 2 or 3");
+        }
+        P.kind					= var_stim[0] == 2 ? Phase : Periodic;
+        P.strength				= var_stim[1] / 1000;
+        P.duration				= (int) var_stim[2] * res / 1000;
+        P.ISI					= (int) var_stim[3] * res;
+        P.ISI_range				= (int) var_stim[4] * res;
+        /* Stim gives at least one stimulus per event */
+        P.number_of_stimuli		= std::max(1, (int) var_stim[5]);
+        P.time_between_stimuli	= (int) var_stim[6] * res / 1000;
+        P.time_to_stimuli		= P.kind == Phase ? (int) var_stim[7] * res / 1000 : res;
+        P.shorten_repeats		= true;
+        return P;
+    }
+
+    /* Protocols of consecutive var_stim vectors of width 8 or 9 */
+    static std::vector<Stim_Protocol> from_var_stim (const std::vector<double>& var_stim,
+                                                     unsigned width = var_stim_size) {
+        if ((width != var_stim_size && width != var_stim_size - 1) || var_stim.size() % width != 0) {
+            throw std::invalid_argument("Stim_Protocol: var_stim has to hold vectors of 8 or 9 values");
+        }
+        std::vector<Stim_Protocol> protocols;
+        for (std::size_t i=0; i < var_stim.size(); i += width) {
+            protocols.push_back(from_var_stim(var_stim.data() + i, width));
+        }
+        return protocols;
+    }
+
+    /* count var_stim vectors of width 8 or 9 as consecutive vectors of		*/
+    /* var_stim_size values, the target defaults to the thalamus				*/
+    static std::vector<double> widen_var_stim (const double* var_stim, std::size_t width, std::size_t count) {
+        if (width != var_stim_size && width != var_stim_size - 1) {
+            throw std::invalid_argument("Stim_Protocol: var_stim has to have 8 or 9 values");
+        }
+        std::vector<double> values(count*var_stim_size, 0.0);
+        for (std::size_t i=0; i < count; ++i) {
+            std::copy(var_stim + i*width, var_stim + (i+1)*width, values.begin() + i*var_stim_size);
+        }
+        return values;
+    }
+
+    /* Enable bursts, lengths in ms */
+    Stim_Protocol& bursts (double length, double pause) {
+        burst_enabled			= true;
+        burst_length			= steps(length / 1000);
+        burst_ISI				= steps(pause  / 1000);
+        return *this;
+    }
+
+private:
+    static int steps (double seconds) {
+        extern const int res;
+        return (int) std::lround(seconds * res);
+    }
+};
+
+/******************************************************************************/
+/*								Scheduler									  */
+/******************************************************************************/
+class Stim_Scheduler {
+public:
+    /* Constructor for a system, the ISI streams follow the noise streams of the columns */
+    Stim_Scheduler(TC_System& System, std::uint64_t origin)
+    : Stim_Scheduler(System.Cortex, System.Thalamus, origin, System.seed, TC_System::num_streams) {}
+
+    /* Markers are given in steps after origin, phase detection starts after it. */
+    /* Protocol i draws its ISI from stream + i									  */
+    Stim_Scheduler(Cortical_Column& C, Thalamic_Column& T, std::uint64_t origin,
+                   std::uint64_t seed = rand(), unsigned stream = 0)
+    : Stim_Scheduler(C.Vp, &C.input, &T.input, origin, seed, stream) {}
+
+    /* Constructor with the monitored voltage and the stimulated inputs, e.g. of an ensemble lane */
+    Stim_Scheduler(const double* V, double* cortical_input, double* thalamic_input, std::uint64_t origin,
+                   std::uint64_t seed = rand(), unsigned stream = 0)
+    : Vp(V), origin(origin), seed(seed), stream(stream) {
+        inputs[(int) Stim_Target::Cortex]	= cortical_input;
+        inputs[(int) Stim_Target::Thalamus]	= thalamic_input;
+    }
+
+    /* Add a protocol and schedule its first event, returns its index */
+    unsigned add (const Stim_Protocol& P) {
+        extern const int res;
+        if (P.number_of_stimuli < 1 || P.duration < 0 || P.ISI < 0 || P.ISI_range < 0 ||
+            P.ISI_range > P.ISI || P.time_between_stimuli < 0 || P.time_to_stimuli < 0 ||
+            (P.burst_enabled && (P.burst_length < 1 || P.burst_ISI < 1))) {
+            throw std::invalid_argument("Stim_Scheduler: invalid protocol");
+        }
+        if (P.kind == Stim_Protocol::Waveform && (!P.samples || P.samples->empty() || P.sample_steps < 1)) {
+            throw std::invalid_argument("Stim_Scheduler: waveform without samples");
+        }
+        if (P.kind == Stim_Protocol::Closed_Loop && (P.latency < 0 || P.decimation < 1 ||
+            res % P.decimation != 0 || res % reference_rate != 0 || P.frequency <= P.bandwidth/2)) {
+            throw std::invalid_argument("Stim_Scheduler: invalid closed loop protocol");
+        }
+
+        const unsigned index = protocols.size();
+        protocols.emplace_back(P, seed, stream + index);
+        if (P.kind == Stim_Protocol::Inactive) {
+            return index;
+        }
+        if (P.kind == Stim_Protocol::Closed_Loop) {
+            protocols.back().Loop.reset(new Closed_Loop(P));
+            watchers.push_back(index);
+        } else if (P.kind == Stim_Protocol::Phase) {
+            watchers.push_back(index);
+        } else {
+            schedule(origin + P.time_to_stimuli, index, Start, 0);
+        }
+        return index;
+    }
+
+    /* Called after the integration of step t, the amplitudes act from step t+1 on. */
+    /* Steps have to be passed in increasing order								  */
+    void advance (std::uint64_t t) {
+        for (unsigned i=0; i < watchers.size();) {
+            if (watch(watchers[i], t)) {
+                ++i;
+            } else {
+                watchers[i] = watchers.back();
+                watchers.pop_back();
+            }
+        }
+        while (!events.empty() && events.top().step <= t) {
+            const Event E = events.top();
+            events.pop();
+            fire(E);
+        }
+    }
+
+    /* Step of the next queued event, the maximum if there is none. Without		  */
+    /* watchers the steps up to it can be integrated without calling advance	  */
+    std::uint64_t next_event (void) const {
+        return events.empty() ? std::numeric_limits<std::uint64_t>::max() : events.top().step;
+    }
+
+    /* Whether a protocol monitors Vp, then advance has to be called every step */
+    bool watching (void) const {return !watchers.empty();}
+
+    /* Whether advance has to be called after step t */
+    bool due (std::uint64_t t) const {return !watchers.empty() || next_event() <= t;}
+
+    /* Number of protocols */
+    unsigned size (void) const {return protocols.size();}
+
+    /* Stimulation markers of a protocol in time steps after origin */
+    const std::vector<int>& get_markers (unsigned protocol) const {return protocols.at(protocol).markers;}
+
+    /* Settings of a protocol */
+    const Stim_Protocol& get_protocol (unsigned protocol) const {return protocols.at(protocol).P;}
+
+    /* Current amplitude of a protocol */
+    double get_amplitude (unsigned protocol) const {return protocols.at(protocol).amplitude;}
+
+    /* Phases of the stimuli of a closed loop protocol. The achieved phase is	*/
+    /* estimated from the whole signal around the marker, it is NaN until the	*/
+    /* reference filter completed it or if the marker preceded the reference	*/
+    struct Phase_Record {
+        int		marker;			/* time steps after origin						*/
+        double	predicted;		/* causal estimate of the phase at the marker	*/
+        double	achieved;		/* phase of the band-passed Vp at the marker	*/
+    };
+
+    const std::vector<Phase_Record>& get_phases (unsigned protocol) const {return loop(protocol).records;}
+
+    /* Error of the achieved phases relative to the target */
+    Phase_Statistics get_phase_error (unsigned protocol) const {
+        std::vector<double> errors;
+        for (const Phase_Record& R : loop(protocol).records) {
+            errors.push_back(wrap_phase(R.achieved - protocols[protocol].P.target_phase));
+        }
+        return phase_statistics(errors);
+    }
+
+    /* Algorithmic latency of the phase estimation of a closed loop protocol in	*/
+    /* steps, the group delay of the filters at the center frequency			*/
+    double get_latency (unsigned protocol) const {
+        const Closed_Loop& L = loop(protocol);
+        return L.Estimator.latency()*protocols[protocol].P.decimation + (protocols[protocol].P.decimation - 1)/2.0;
+    }
+
+    /* Complete the achieved phases at the end of the simulation */
+    void flush (void) {
+        for (Protocol& S : protocols) {
+            if (S.Loop) {
+                Closed_Loop& L = *S.Loop;
+                L.Reference.flush([&L] (std::uint64_t index, const std::complex<double>* z) {L.resolve(index, *z);});
+                L.pending.clear();
+            }
+        }
+    }
+
+private:
+    /* Checkpoint access */
+    friend class Checkpoint;
+
+    /* Start:	first stimulus of an event, or the first waveform sample	  */
+    /* Stimulus:further stimuli of an event, index is the stimulus			  */
+    /* Sample:	waveform sample index										  */
+    /* Burst_On, Burst_Off, Off: switching within and at the end of stimuli	  */
+    /* Arm:		end of the pause of a phase dependent protocol				  */
+    enum Action {Start, Stimulus, Sample, Burst_On, Burst_Off, Off, Arm};
+
+    struct Event {
+        std::uint64_t	step;
+        std::uint64_t	order;
+        unsigned		protocol;
+        Action			action;
+        int				index;
+    };
+
+    /* Earlier steps first, events of the same step in the order they were scheduled */
+    struct Later {
+        bool operator ()(const Event& a, const Event& b) const {
+            return a.step > b.step || (a.step == b.step && a.order > b.order);
+        }
+    };
+
+    /* Phase estimation and reference of a closed loop protocol */
+    struct Closed_Loop {
+        Closed_Loop(const Stim_Protocol& P)
+        : Estimator (res_of(P.decimation), P.frequency, P.bandwidth), Reference (reference_rate),
+          factor (res_of(1)/reference_rate) {
+            Reference.add(P.frequency - P.bandwidth/2, P.frequency + P.bandwidth/2);
+        }
+
+        static int res_of (int decimation) {extern const int res; return res/decimation;}
+
+        /* Block averages of Vp feed the estimator, whose samples then lag by	*/
+        /* (decimation-1)/2 steps												*/
+        Phase_Estimator		Estimator;
+        double				sum		= 0.0;
+        int					fill	= 0;
+        bool				armed	= true;
+
+        /* Steps until the target phase at the last estimator sample */
+        double				ahead	= std::numeric_limits<double>::infinity();
+
+        /* Linear phase reference at reference_rate, started at step begin */
+        Band_Filter_Bank	Reference;
+        int					factor;
+        double				reference_sum	= 0.0;
+        int					reference_fill	= 0;
+        bool				started			= false;
+        std::uint64_t		begin			= 0;
+        std::complex<double> previous		= 0.0;
+
+        /* Stimuli and the steps of those waiting for the reference */
+        std::vector<Phase_Record>								records;
+        std::deque<std::pair<std::size_t, std::uint64_t>>		pending;
+
+        /* Interpolate the phase of the pending stimuli that lie before sample index */
+        void resolve (std::uint64_t index, std::complex<double> z) {
+            while (!pending.empty()) {
+                const double u = (pending.front().second - (double) begin - (factor - 1)/2.0)/factor;
+                if (u > index) {
+                    break;
+                }
+                double& achieved = records[pending.front().first].achieved;
+                if (u >= (double) index - 1 && index > 0) {
+                    const double a = std::arg(previous);
+                    achieved = wrap_phase(a + (u - (index - 1))*wrap_phase(std::arg(z) - a));
+                } else if (u == index) {
+                    achieved = std::arg(z);
+                }
+                pending.pop_front();
+            }
+            previous = z;
+        }
+    };
+
+    struct Protocol {
+        Protocol(const Stim_Protocol& P, std::uint64_t seed, unsigned stream)
+        : P(P), Uniform_Distribution(P.ISI - P.ISI_range, P.ISI + P.ISI_range, seed, stream) {}
+
+        Stim_Protocol			P;
+
+        /* Current contribution to the input */
+        double					amplitude			= 0.0;
+
+        /* End of the running stimulus, whether there was a stimulus and a pause */
+        std::uint64_t			end					= 0;
+        bool					stimulation_started	= false;
+        bool					stimulated			= false;
+        bool					paused				= false;
+
+        /* Trough detection of phase dependent protocols */
+        bool					threshold_crossed	= false;
+        double					Vp_old				= 0.0;
+
+        std::vector<int>		markers;
+        randomStreamUniformInt	Uniform_Distribution;
+
+        /* Only closed loop protocols */
+        std::unique_ptr<Closed_Loop>	Loop;
+    };
+
+    /* Rate of the reference of the achieved phases in Hz */
+    static const int reference_rate = 100;
+
+    const Closed_Loop& loop (unsigned protocol) const {
+        if (!protocols.at(protocol).Loop) {
+            throw std::invalid_argument("Stim_Scheduler: not a closed loop protocol");
+        }
+        return *protocols[protocol].Loop;
+    }
+
+    void schedule (std::uint64_t step, unsigned protocol, Action action, int index) {
+        events.push(Event {step, order++, protocol, action, index});
+    }
+
+    /* Trough detection, returns whether the protocol keeps watching */
+    bool watch (unsigned i, std::uint64_t t) {
+        Protocol& S = protocols[i];
+        if (S.Loop) {
+            track(i, t);
+            return true;
+        }
+        if (!S.threshold_crossed && !S.stimulation_started && t > origin && *Vp <= S.P.threshold) {
+            S.threshold_crossed = true;
+        }
+        if (S.threshold_crossed) {
+            if (*Vp > S.Vp_old) {
+                S.threshold_crossed = false;
+                S.Vp_old			= 0;
+                schedule(t + S.P.time_to_stimuli - (S.P.shorten_repeats && S.paused), i, Start, 0);
+                return false;
+            }
+            S.Vp_old = *Vp;
+        }
+        return true;
+    }
+
+    /* Phase estimation of a closed loop protocol, a stimulus is scheduled at the	*/
+    /* target phase once it is at most one estimator sample after the latency	*/
+    void track (unsigned i, std::uint64_t t) {
+        Protocol& S		= protocols[i];
+        Closed_Loop& L	= *S.Loop;
+        if (!L.started) {
+            L.started	= true;
+            L.begin		= t;
+        }
+        L.reference_sum += *Vp;
+        if (++L.reference_fill == L.factor) {
+            L.Reference.push(L.reference_sum/L.factor, [&L] (std::uint64_t index, const std::complex<double>* z)
+                                                       {L.resolve(index, *z);});
+            L.reference_sum	 = 0.0;
+            L.reference_fill = 0;
+        }
+
+        L.sum += *Vp;
+        if (++L.fill < S.P.decimation) {
+            return;
+        }
+        L.Estimator.push(L.sum/S.P.decimation);
+        L.sum  = 0.0;
+        L.fill = 0;
+        if (!L.armed || t <= origin || !L.Estimator.ready() || L.Estimator.amplitude() < S.P.min_amplitude) {
+            L.ahead = std::numeric_limits<double>::infinity();
+            return;
+        }
+
+        /* Steps until the target phase, the estimate refers to the block center */
+        const double omega	= L.Estimator.frequency()/S.P.decimation;
+        const double phi	= L.Estimator.phase() + omega*(S.P.decimation - 1)/2;
+        double wait = wrap_phase(S.P.target_phase - phi)/omega;
+        while (wait < S.P.latency) {
+            wait += 2*M_PI/omega;
+        }
+
+        /* The wait falls by about decimation per sample, if the signal is		*/
+        /* faster than the estimate it may jump past the window to the next		*/
+        /* period. The target then lies just before the latency				*/
+        const bool skipped	= wait > L.ahead + M_PI/omega;
+        L.ahead				= wait;
+        if (skipped) {
+            wait			= S.P.latency;
+        }
+        if (wait < S.P.latency + S.P.decimation) {
+            const std::uint64_t step = t + std::lround(wait);
+            L.armed = false;
+            L.ahead = std::numeric_limits<double>::infinity();
+            L.records.push_back(Phase_Record {(int) (step - origin),
+                                              wrap_phase(phi + omega*(step - t)), std::nan("")});
+            L.pending.emplace_back(L.records.size() - 1, step);
+            schedule(step, i, Start, 0);
+        }
+    }
+
+    /* Switch on a stimulus, the off events are scheduled before the next stimulus */
+    void stimulate (Protocol& S, const Event& E) {
+        S.end					= E.step + S.P.duration - (S.P.shorten_repeats && S.stimulated);
+        S.stimulation_started	= true;
+        S.stimulated			= true;
+        set(S, S.P.strength);
+        schedule(S.end, E.protocol, Off, 0);
+        if (S.P.burst_enabled && E.step + S.P.burst_length < S.end) {
+            schedule(E.step + S.P.burst_length, E.protocol, Burst_Off, 0);
+        }
+    }
+
+    void fire (const Event& E) {
+        Protocol& S = protocols[E.protocol];
+        switch (E.action) {
+        case Start:
+            S.markers.push_back((int) (E.step - origin));
+            if (S.P.kind == Stim_Protocol::Waveform) {
+                S.stimulation_started	= true;
+                S.end					= E.step + S.P.duration;
+                fire(Event {E.step, E.order, E.protocol, Sample, 0});
+                if (S.P.ISI > 0) {
+                    schedule(E.step + S.P.ISI, E.protocol, Start, 0);
+                }
+                break;
+            }
+            /* fall through */
+        case Stimulus: {
+            stimulate(S, E);
+            const int count = E.action == Start ? 1 : E.index;
+            if (count < S.P.number_of_stimuli) {
+                schedule(E.step + S.P.time_between_stimuli, E.protocol, Stimulus, count + 1);
+            } else if (S.P.kind == Stim_Protocol::Phase || S.P.kind == Stim_Protocol::Closed_Loop) {
+                schedule(E.step + S.P.ISI - (S.P.shorten_repeats && S.paused), E.protocol, Arm, 0);
+                S.paused = true;
+            } else {
+                schedule(E.step + (S.P.ISI_range == 0 ? S.P.ISI : S.Uniform_Distribution()), E.protocol, Start, 0);
+            }
+            break;
+        }
+        case Sample: {
+            /* Runs of equal samples need no events */
+            const std::vector<double>& samples = *S.P.samples;
+            int next = E.index + 1;
+            while (next < (int) samples.size() && samples[next] == samples[E.index]) {
+                ++next;
+            }
+            set(S, samples[E.index]);
+            const std::uint64_t step = E.step + (std::uint64_t) (next - E.index) * S.P.sample_steps;
+            if (next < (int) samples.size()) {
+                schedule(step, E.protocol, Sample, next);
+            } else {
+                schedule(step, E.protocol, Off, 0);
+            }
+            break;
+        }
+        case Burst_On:
+            if (S.stimulation_started && E.step < S.end) {
+                set(S, S.P.strength);
+                if (E.step + S.P.burst_length < S.end) {
+                    schedule(E.step + S.P.burst_length, E.protocol, Burst_Off, 0);
+                }
+            }
+            break;
+        case Burst_Off:
+            if (S.stimulation_started && E.step < S.end) {
+                set(S, 0.0);
+                if (E.step + S.P.burst_ISI < S.end) {
+                    schedule(E.step + S.P.burst_ISI, E.protocol, Burst_On, 0);
+                }
+            }
+            break;
+        case Off:
+            /* A later stimulus of the same protocol has already taken over */
+            if (E.step != S.end) {
+                break;
+            }
+            S.stimulation_started = false;
+            set(S, 0.0);
+            break;
+        case Arm:
+            if (S.Loop) {
+                S.Loop->armed = true;
+            } else {
+                watchers.push_back(E.protocol);
+            }
+            break;
+        }
+    }
+
+    /* Update the amplitude of a protocol and the input of its target */
+    void set (Protocol& S, double amplitude) {
+        if (S.amplitude == amplitude) {
+            return;
+        }
+        S.amplitude = amplitude;
+        double sum = 0.0;
+        for (const Protocol& other : protocols) {
+            if (other.P.target == S.P.target) {
+                sum += other.amplitude;
+            }
+        }
+        *inputs[(int) S.P.target] = sum;
+    }
+
+    /* Monitored pyramidal voltage and the stimulated inputs */
+    const double*	Vp;
+    double*			inputs[2];
+
+    /* Start of the markers and of the phase detection */
+    std::uint64_t	origin;
+
+    /* RNG of the ISI */
+    std::uint64_t	seed;
+    unsigned		stream;
+
+    /* Protocols and the ones that currently monitor Vp */
+    std::vector<Protocol>	protocols;
+    std::vector<unsigned>	watchers;
+
+    /* Event queue, order keeps events of the same step in schedule order */
+    std::priority_queue<Event, std::vector<Event>, Later> events;
+    std::uint64_t	order = 0;
+};
@@ -32,10 +32,13 @@
 /*					Implementation of the stimulation protocol				  */
 /******************************************************************************/
 #pragma once
+#include <cstdint>
+#include <cstdlib>
 #include <vector>
 
 #include "Cortical_Column.h"
 #include "Random_Stream.h"
+#include "TC_System.h"
 #include "Thalamic_Column.h"
 
 /******************************************************************************/
@@ -45,16 +48,30 @@ class Stim {
 public:
     /* Constructor with references and stimulation variables */
     Stim(Cortical_Column& C, Thalamic_Column& T, double* var)
-    { Cortex   = &C;
-      Thalamus = &T;
-      setup(var);}
+    : Stim(C.Vp, &T.input, var) {}
+
+    /* Constructor for a system, the ISI stream follows the noise streams of the columns */
+    Stim(TC_System& System, double* var)
+    : Stim(System.Cortex.Vp, &System.Thalamus.input, var, System.seed, TC_System::num_streams) {}
+
+    /* Constructor with the monitored voltage and the stimulated input */
+    Stim(const double* V, double* I, double* var, std::uint64_t seed = rand(), unsigned stream = 0)
+    { Vp	= V;
+      input	= I;
+      setup(var, seed, stream);}
 
     /* Initialize stimulation class with respect to stimulation mode */
-    void setup		(double* var_stim);
+    void setup		(double* var_stim, std::uint64_t seed, unsigned stream);
 
     /* Check whether stimulation should be started/stopped */
     void check_stim	(int time);
+
+    /* Stimulation markers in time steps after onset */
+    const std::vector<int>& get_markers (void) const {return marker_stimulation;}
 private:
+    /* Checkpoint access */
+    friend class Checkpoint;
+
     /* Mode of stimulation 	*/
     /* 0 == none 			*/
     /* 1 == semi-periodic	*/
@@ -133,24 +150,21 @@ private:
     /* Old voltage value for minimum detection */
     double 	Vp_old					= 0.0;
 
-    /* Pointer to columns */
-    Cortical_Column* Cortex;
-    Thalamic_Column* Thalamus;
+    /* Pointer to the monitored pyramidal voltage and the stimulated thalamic input */
+    const double*	Vp;
+    double*			input;
 
     /* Data containers */
     std::vector<int>		marker_stimulation;
 
     /* Random number generator in case of semi-periodic stimulation */
     randomStreamUniformInt Uniform_Distribution = randomStreamUniformInt(0, 0);
-
-    /* Create MATLAB container for marker storage */
-    friend mxArray* get_marker(Stim &stim);
 };
 
 /******************************************************************************/
 /*							Function definitions							  */
 /******************************************************************************/
-void Stim::setup (double* var_stim) {
+inline void Stim::setup (double* var_stim, std::uint64_t seed, unsigned stream) {
     extern const int onset;
     extern const int res;
 
@@ -190,7 +204,7 @@ void Stim::setup (double* var_stim) {
         /* If ISI is random create RNG */
         if (ISI_range != 0){
             /* Generate uniform distribution */
-            Uniform_Distribution = randomStreamUniformInt(ISI-ISI_range, ISI+ISI_range);
+            Uniform_Distribution = randomStreamUniformInt(ISI-ISI_range, ISI+ISI_range, seed, stream);
         }
     } else {
         /* In case of phase dependent stimulation, time_to_stim is the time from minimum detection to start of stimulation */
@@ -199,7 +213,7 @@ void Stim::setup (double* var_stim) {
     }
 }
 
-void Stim::check_stim	(int time) {
+inline void Stim::check_stim	(int time) {
     /* Check if stimulation should start */
     switch (mode) {
 
@@ -213,7 +227,7 @@ void Stim::check_stim	(int time) {
         if(time == time_to_stimuli) {
             /* Switch stimulation on */
             stimulation_started 	= true;
-            Thalamus->set_input(strength);
+            *input = strength;
 
             /* Add marker for the first stimuli in the event */
             if(count_stimuli == 1) {
@@ -240,19 +254,19 @@ void Stim::check_stim	(int time) {
     case 2:
         /* Search for threshold */
         if(!stimulation_started && !minimum_found && !threshold_crossed && time>onset_correction && !stimulation_paused) {
-            if(Cortex->Vp[0]<=threshold) {
+            if(*Vp<=threshold) {
                 threshold_crossed 	= true;
             }
         }
 
         /* Search for minimum */
         if(threshold_crossed) {
-            if(Cortex->Vp[0]>Vp_old) {
+            if(*Vp>Vp_old) {
                 threshold_crossed 	= false;
                 minimum_found 		= true;
                 Vp_old = 0;
             } else {
-                Vp_old = Cortex->Vp[0];
+                Vp_old = *Vp;
             }
         }
 
@@ -261,7 +275,7 @@ void Stim::check_stim	(int time) {
             /* Start stimulation after time_to_stimuli has passed */
             if(count_to_start==time_to_stimuli + (count_stimuli-1) * time_between_stimuli) {
                 stimulation_started 	= true;
-                Thalamus->set_input(strength);
+                *input = strength;
 
                 /* Add marker for the first stimuli in the event */
                 if(count_stimuli == 1) {
@@ -296,7 +310,7 @@ void Stim::check_stim	(int time) {
             burst_started 			= true;
             count_duration			= 0;
             count_bursts			= 0;
-            Thalamus->set_input(0.0);
+            *input = 0.0;
         }
 
         count_duration++;
@@ -308,13 +322,13 @@ void Stim::check_stim	(int time) {
                 if(count_bursts%burst_length==0) {
                     count_bursts 	= 0;
                     burst_started 	= false;
-                    Thalamus->set_input(0.0);
+                    *input = 0.0;
                 }
             } else {
                 if(count_bursts%burst_ISI==0) {
                     count_bursts 	= 0;
                     burst_started	= true;
-                    Thalamus->set_input(strength);
+                    *input = strength;
                 }
             }
         }
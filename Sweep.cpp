@@ -0,0 +1,348 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Functions for parameter sweeps						  */
+/******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+
+#include "Data_Storage.h"
+#include "Event_Average.h"
+#include "Event_Detection.h"
+#include "ODE.h"
+#include "Recorder.h"
+#include "Stim_Scheduler.h"
+#include "Sweep.h"
+#include "TC_Ensemble.h"
+#include "TC_System.h"
+#include "Thread_Pool.h"
+
+/******************************************************************************/
+/*								Single job									  */
+/******************************************************************************/
+/* Mean and sd of all channels of an event locked average */
+static Event_Statistics get_statistics (const Event_Average& Average) {
+    Event_Statistics S;
+    S.N = Average.count(0);
+    for (unsigned c=0; c < Average.num_channels(); ++c) {
+        S.mean.push_back(Average.mean(c));
+        S.sd.push_back(Average.sd(c));
+    }
+    return S;
+}
+
+std::vector<Protocol_Result> get_protocols (Stim_Scheduler& Stimulation) {
+    extern const int red;
+    extern const double dt;
+    Stimulation.flush();
+
+    /* Markers are transformed from dt to sampling rate */
+    std::vector<Protocol_Result> protocols(Stimulation.size());
+    for (unsigned i=0; i < Stimulation.size(); ++i) {
+        Protocol_Result& P = protocols[i];
+        for (int marker : Stimulation.get_markers(i)) {
+            P.markers.push_back(marker/red);
+        }
+        if (Stimulation.get_protocol(i).kind != Stim_Protocol::Closed_Loop) {
+            continue;
+        }
+        P.closed_loop	= true;
+        P.phases		= Stimulation.get_phases(i);
+        for (Stim_Scheduler::Phase_Record& R : P.phases) {
+            R.marker /= red;
+        }
+        P.phase_error	= Stimulation.get_phase_error(i);
+        P.latency		= Stimulation.get_latency(i) * dt;
+    }
+    return protocols;
+}
+
+/* Stimulation, recording and online analysis of a job. A monitor is advanced */
+/* once per time step after its system was integrated, so the same protocol	  */
+/* runs on a TC_System or on a lane of a TC_Ensemble						  */
+class Job_Monitor {
+public:
+    /* Job on a system */
+    Job_Monitor(const Sweep_Job& job, TC_System& System)
+        : Job_Monitor(job, System, Stim_Scheduler(System, (std::uint64_t) onset()*res())) {}
+
+    /* Job on a lane of an ensemble, stimulated with the noise of a system with the seed of the lane */
+    Job_Monitor(const Sweep_Job& job, TC_Ensemble& Ensemble, unsigned lane)
+        : Job_Monitor(job, Ensemble.get_lane(lane),
+                      Stim_Scheduler(Ensemble.get_Vp(lane), Ensemble.get_input_C(lane), Ensemble.get_input_T(lane),
+                                     (std::uint64_t) onset()*res(), Ensemble.get_lane(lane).seed,
+                                     TC_System::num_streams)) {}
+
+    /* Number of time steps to integrate */
+    std::uint64_t steps (void) const {return Time + Rec.delay();}
+
+    /* Time step t after the integration. The scheduler is only called in steps */
+    /* with due events or while a protocol monitors Vp							 */
+    void step (std::uint64_t t) {
+        if (t < Time && Stimulation.due(t)) {
+            Stimulation.advance(t);
+        }
+        Rec.sample(t);
+
+        /* All channels have the same rate, so their samples arrive together */
+        auto spindles = [this] (std::uint64_t index, const SO_Analysis::Sample& S) {push_power(index, S);};
+        const std::size_t first = job.store_traces ? num_samples : 0;
+        for (std::size_t k=first; k < Rec.data(0).size(); ++k, ++num_samples) {
+            ERP.push(0, num_samples, Rec.data(0)[k]);
+            ERP.push(1, num_samples, Rec.data(1)[k]);
+            SO.push (0, num_samples, Rec.data(0)[k]);
+            Analysis.push(Rec.data(0)[k], spindles);
+        }
+        if (!job.store_traces) {
+            for (unsigned c=0; c < Rec.size(); ++c) {
+                Rec.data(c).clear();
+            }
+        }
+        trigger();
+    }
+
+    /* Complete the analysis and move the outcome into result */
+    void finish (Sweep_Result& result) {
+        Analysis.flush([this] (std::uint64_t index, const SO_Analysis::Sample& S) {push_power(index, S);});
+        trigger();
+
+        result.Vp = std::move(Rec.data(0));
+        result.Vt = std::move(Rec.data(1));
+        result.Ca = std::move(Rec.data(2));
+        result.ah = std::move(Rec.data(3));
+
+        result.Marker_Stim.clear();
+        result.Protocols = get_protocols(Stimulation);
+        for (const Protocol_Result& P : result.Protocols) {
+            result.Marker_Stim.insert(result.Marker_Stim.end(), P.markers.begin(), P.markers.end());
+        }
+        std::sort(result.Marker_Stim.begin(), result.Marker_Stim.end());
+        result.SO_Troughs.assign(Analysis.troughs().begin(), Analysis.troughs().end());
+
+        result.ERP = get_statistics(ERP);
+        result.SO  = get_statistics(SO);
+    }
+
+private:
+    /* The recorder probes the columns of System, the scheduler stimulates them */
+    Job_Monitor(const Sweep_Job& job, const TC_System& System, Stim_Scheduler&& Scheduler)
+        : job		 (job),
+          Time		 ((std::uint64_t) (job.T + onset())*res()),
+          Stimulation(std::move(Scheduler)),
+          Rec		 (System, (std::uint64_t) onset()*res(), Time),
+          Analysis	 (Fs()),
+          ERP		 (4, job.ERP_before*Fs(), job.ERP_after*Fs(), Analysis.latency()),
+          SO		 (2, job.SO_before *Fs(), job.SO_after *Fs(), Analysis.latency()) {
+        for (const Stim_Protocol& P : Stim_Protocol::from_var_stim(job.var_stim)) {
+            Stimulation.add(P);
+        }
+        num_markers.assign(Stimulation.size(), 0);
+
+        /* Record the anti-aliased time series, the filters need delay() more steps */
+        for (const std::string& name : data_names()) {
+            Rec.add(name, Fs());
+        }
+    }
+
+    /* Fixed simulation settings of the main translation unit */
+    static int		onset	(void) {extern const int onset; return onset;}
+    static int		res		(void) {extern const int res;	return res;}
+    static double	Fs		(void) {extern const int red;	return res()/red;}
+
+    /* Fast and slow spindle power are averaged stimulus and trough locked */
+    void push_power (std::uint64_t index, const SO_Analysis::Sample& S) {
+        ERP.push(2, index, S.FSP);
+        ERP.push(3, index, S.SSP);
+        SO.push (1, index, S.FSP);
+    }
+
+    /* Trigger the averages at the new markers and troughs */
+    void trigger (void) {
+        extern const int red;
+        for (unsigned i=0; i < Stimulation.size(); ++i) {
+            const std::vector<int>& markers = Stimulation.get_markers(i);
+            for (; num_markers[i] < markers.size(); ++num_markers[i]) {
+                if (markers[num_markers[i]] >= 0) {
+                    ERP.trigger(markers[num_markers[i]]/red);
+                }
+            }
+        }
+        for (; num_troughs < Analysis.troughs().size(); ++num_troughs) {
+            SO.trigger(Analysis.troughs()[num_troughs]);
+        }
+    }
+
+    const Sweep_Job&	job;
+    const std::uint64_t	Time;
+    Stim_Scheduler		Stimulation;
+    Recorder			Rec;
+
+    /* Slow oscillation troughs and spindle power are computed while Vp is recorded */
+    SO_Analysis			Analysis;
+
+    /* Stimulus locked averages of Vp, Vt, FSP and SSP, trough locked of Vp and FSP */
+    Event_Average		ERP;
+    Event_Average		SO;
+
+    /* Samples and events that were already processed */
+    std::uint64_t				num_samples = 0;
+    std::size_t					num_troughs = 0;
+    std::vector<std::size_t>	num_markers;
+};
+
+/* Simulate a system from step begin on with the protocol of a job, the steps */
+/* before the onset are not recorded										  */
+static void simulate (TC_System& System, const Sweep_Job& job, std::uint64_t begin, Sweep_Result& result) {
+    Job_Monitor Monitor(job, System);
+    const std::uint64_t numSteps = Monitor.steps();
+    for (std::uint64_t t=begin; t < numSteps; ++t) {
+        ODE (System);
+        Monitor.step(t);
+    }
+    Monitor.finish(result);
+}
+
+void run_job (const Sweep_Job& job, Sweep_Result& result) {
+    /* Local copies, the models take mutable parameter arrays */
+    std::vector<double> Param_Cortex	= job.Param_Cortex;
+    std::vector<double> Param_Thalamus	= job.Param_Thalamus;
+    std::vector<double> Connectivity	= job.Connectivity;
+
+    /* Initialize the populations */
+    TC_System System(Param_Cortex.data(), Param_Thalamus.data(), Connectivity.data(), job.seed);
+    System.Thalamus.set_gating(job.gating);
+    simulate(System, job, 0, result);
+}
+
+/******************************************************************************/
+/*								Parallel sweep								  */
+/******************************************************************************/
+/* Simulate the jobs of a group together, one lane per job */
+static void run_lanes (const std::vector<Sweep_Job>& jobs, const std::vector<unsigned>& group,
+                       std::vector<Sweep_Result>& results) {
+    /* Parameters one column per lane */
+    std::vector<double> Param_Cortex, Param_Thalamus, Connectivity;
+    std::vector<std::uint64_t> seeds;
+    for (unsigned i : group) {
+        Param_Cortex.insert	 (Param_Cortex.end(),	jobs[i].Param_Cortex.begin(),	jobs[i].Param_Cortex.end());
+        Param_Thalamus.insert(Param_Thalamus.end(),	jobs[i].Param_Thalamus.begin(), jobs[i].Param_Thalamus.end());
+        Connectivity.insert	 (Connectivity.end(),	jobs[i].Connectivity.begin(),	jobs[i].Connectivity.end());
+        seeds.push_back(jobs[i].seed);
+    }
+
+    /* The lanes are stimulated by their monitors instead of Stim */
+    TC_Ensemble Ensemble(group.size(), Param_Cortex.data(), Param_Thalamus.data(), Connectivity.data(),
+                         nullptr, seeds);
+    std::vector<std::unique_ptr<Job_Monitor>> Monitors;
+    for (unsigned l=0; l < group.size(); ++l) {
+        Monitors.emplace_back(new Job_Monitor(jobs[group[l]], Ensemble, l));
+    }
+
+    /* All lanes have the same T and so the same number of steps */
+    const std::uint64_t numSteps = Monitors[0]->steps();
+    for (std::uint64_t t=0; t < numSteps; ++t) {
+        ODE (Ensemble);
+        for (unsigned l=0; l < group.size(); ++l) {
+            /* Copy the state of the lane into the replica the recorder probes */
+            Ensemble.get_lane(l);
+            Monitors[l]->step(t);
+        }
+    }
+    for (unsigned l=0; l < group.size(); ++l) {
+        Monitors[l]->finish(results[group[l]]);
+    }
+}
+
+std::vector<Sweep_Result> run_sweep (const std::vector<Sweep_Job>& jobs, unsigned num_threads, unsigned lanes) {
+    /* Groups of jobs that share an ensemble, the others run on their own */
+    std::vector<std::vector<unsigned>> groups;
+    std::map<int, unsigned> open;
+    for (unsigned i=0; i < jobs.size(); ++i) {
+        if (lanes <= 1 || jobs[i].gating != Gating_Mode::Exact) {
+            groups.push_back({i});
+            continue;
+        }
+        auto group = open.find(jobs[i].T);
+        if (group == open.end() || groups[group->second].size() == lanes) {
+            open[jobs[i].T] = groups.size();
+            groups.push_back({});
+        }
+        groups[open[jobs[i].T]].push_back(i);
+    }
+
+    std::vector<Sweep_Result> results(jobs.size());
+    Thread_Pool Pool(num_threads);
+    for (const std::vector<unsigned>& group : groups) {
+        if (group.size() == 1) {
+            Pool.submit([&jobs, &results, &group] {run_job(jobs[group[0]], results[group[0]]);});
+        } else {
+            Pool.submit([&jobs, &results, &group] {run_lanes(jobs, group, results);});
+        }
+    }
+    Pool.wait();
+    return results;
+}
+
+/******************************************************************************/
+/*								Branching									  */
+/******************************************************************************/
+std::unique_ptr<TC_System> make_trunk (const Sweep_Job& job, double burn_in) {
+    extern const int res;
+    std::unique_ptr<TC_System> Trunk(new TC_System(job.Param_Cortex.data(), job.Param_Thalamus.data(),
+                                                   job.Connectivity.data(), job.seed));
+    Trunk->Thalamus.set_gating(job.gating);
+    const std::uint64_t numSteps = (std::uint64_t) std::lround(burn_in*res);
+    for (std::uint64_t t=0; t < numSteps; ++t) {
+        ODE (*Trunk);
+    }
+    return Trunk;
+}
+
+std::vector<Sweep_Result> run_branches (const TC_System& Trunk, const std::vector<Sweep_Job>& jobs,
+                                        Branch_Noise noise, unsigned num_threads) {
+    extern const int onset;
+    extern const int res;
+
+    /* The copies are made here, as copying waits for pending noise refills of the trunk */
+    std::vector<std::unique_ptr<TC_System>> Branches;
+    Branches.reserve(jobs.size());
+    for (const Sweep_Job& job : jobs) {
+        Branches.emplace_back(noise == Branch_Noise::Shared ? new TC_System(Trunk)
+                                                            : new TC_System(Trunk, job.seed));
+    }
+
+    std::vector<Sweep_Result> results(jobs.size());
+    Thread_Pool Pool(num_threads);
+    for (unsigned i=0; i < jobs.size(); ++i) {
+        Pool.submit([&jobs, &results, &Branches, i] {
+            simulate(*Branches[i], jobs[i], onset*res, results[i]);
+            Branches[i].reset();
+        });
+    }
+    Pool.wait();
+    return results;
+}
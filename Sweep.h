@@ -0,0 +1,157 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Parallel parameter sweeps							  */
+/******************************************************************************/
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Gating_Table.h"
+#include "Stim_Scheduler.h"
+#include "TC_System.h"
+
+/******************************************************************************/
+/*								Sweep job									  */
+/* Parameters of a single simulation, laid out as the inputs of TC_mex		  */
+/******************************************************************************/
+struct Sweep_Job {
+    /* Duration of the recorded simulation in s */
+    int					T				= 0;
+
+    /* Parameters of cortical module {sigma_p, g_KNa, dphi} */
+    std::vector<double>	Param_Cortex	= std::vector<double>(3, 0.0);
+
+    /* Parameters of thalamic module {g_LK, g_h} */
+    std::vector<double>	Param_Thalamus	= std::vector<double>(2, 0.0);
+
+    /* Connectivity values C <-> T {N_tp, N_rp, N_pt, N_it} */
+    std::vector<double>	Connectivity	= std::vector<double>(4, 0.0);
+
+    /* Parameters of the stimulation protocols, one or several var_stim		*/
+    /* vectors of 9 values that run at the same time, see						*/
+    /* Stim_Protocol::from_var_stim												*/
+    std::vector<double>	var_stim		= std::vector<double>(9, 0.0);
+
+    /* Seed of all noise streams of the job */
+    std::uint64_t		seed			= 0;
+
+    /* Evaluation of the thalamic gating functions */
+    Gating_Mode			gating			= Gating_Mode::Exact;
+
+    /* Windows of the stimulus and trough locked averages in s around the event */
+    double				ERP_before		= 1;
+    double				ERP_after		= 3;
+    double				SO_before		= 1.25;
+    double				SO_after		= 1.25;
+
+    /* Return the time series, without them the memory does not grow with T */
+    bool				store_traces	= true;
+};
+
+/******************************************************************************/
+/*								Sweep result								  */
+/******************************************************************************/
+/* Outcome of a stimulation protocol */
+struct Protocol_Result {
+    /* Stimulation markers in samples */
+    std::vector<int>	markers;
+
+    /* Closed loop protocols: the phases of the stimuli with their markers in	*/
+    /* samples, the error of the achieved phases relative to the target and	*/
+    /* the algorithmic latency of the phase estimate in ms					*/
+    bool											closed_loop	= false;
+    std::vector<Stim_Scheduler::Phase_Record>		phases;
+    Phase_Statistics								phase_error;
+    double											latency		= 0;
+};
+
+/* Outcome of the protocols at the end of a simulation, completes the achieved */
+/* phases of the closed loop protocols first								   */
+std::vector<Protocol_Result> get_protocols (Stim_Scheduler& Stimulation);
+
+/* Event locked average, mean and sd are samples per channel */
+struct Event_Statistics {
+    unsigned							N = 0;
+    std::vector<std::vector<double>>	mean;
+    std::vector<std::vector<double>>	sd;
+};
+
+struct Sweep_Result {
+    /* Recorded time series, sampled every red steps after onset, empty	*/
+    /* unless the job stores the traces									*/
+    std::vector<double>	Vp, Vt, Ca, ah;
+
+    /* Stimulation markers of all protocols in samples, in time order */
+    std::vector<int>	Marker_Stim;
+
+    /* Markers of the protocols in the order of var_stim */
+    std::vector<Protocol_Result>	Protocols;
+
+    /* Slow oscillation troughs in samples, detected as in Data_SO_Average.m */
+    std::vector<int>	SO_Troughs;
+
+    /* Stimulus locked averages of Vp, Vt, fast and slow spindle power as in	*/
+    /* Data_ERP_N3.m and trough locked averages of Vp and fast spindle power	*/
+    /* as in Data_SO_Average.m												*/
+    Event_Statistics	ERP;
+    Event_Statistics	SO;
+};
+
+/******************************************************************************/
+/*								Sweep runner								  */
+/******************************************************************************/
+/* Simulate a single job, same protocol as TC_mex */
+void run_job	(const Sweep_Job& job, Sweep_Result& result);
+
+/* Run all jobs on a work stealing thread pool, 0 uses all hardware threads.	  */
+/* With lanes > 1 jobs of equal T and exact gating are integrated together as */
+/* lanes of a TC_Ensemble, each ensemble of up to lanes jobs is one task.	  */
+/* Every lane is recorded, stimulated and analysed as its scalar job, the	  */
+/* ensemble kernels only differ by the rounding of fast_exp.				  */
+std::vector<Sweep_Result> run_sweep (const std::vector<Sweep_Job>& jobs, unsigned num_threads = 0,
+                                     unsigned lanes = 1);
+
+/******************************************************************************/
+/*								Branching									  */
+/* Forks a system that was advanced to some time into one branch per job,	  */
+/* e.g. stimulation and sham from the same pre-stimulus state. A branch		  */
+/* starts as after the onset of a job with its var_stim, T and averaging		  */
+/* windows, the parameters and gating are those of the trunk. Markers are	  */
+/* relative to the fork. With shared noise all branches continue the noise	  */
+/* streams of the trunk, with independent noise branch i draws from the		  */
+/* streams of jobs[i].seed. A branch copies only the state and noise of the	  */
+/* trunk, the fixed parameters are compile time constants and the kernels	  */
+/* and gating tables are shared.											  */
+/******************************************************************************/
+enum class Branch_Noise {Shared, Independent};
+
+std::vector<Sweep_Result> run_branches (const TC_System& Trunk, const std::vector<Sweep_Job>& jobs,
+                                        Branch_Noise noise, unsigned num_threads = 0);
+
+/* Trunk with the parameters, gating and seed of a job, integrated for		*/
+/* burn_in s without recording or stimulation								*/
+std::unique_ptr<TC_System> make_trunk (const Sweep_Job& job, double burn_in);
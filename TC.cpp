@@ -33,50 +33,76 @@
 /******************************************************************************/
 #include <iostream>
 #include <chrono>
+#include <memory>
 
-#include "Cortical_Column.h"
+#include "Cpu_Dispatch.h"
+#include "Data_Storage.h"
 #include "ODE.h"
-#include "Thalamic_Column.h"
+#include "Profiler.h"
+#include "Recorder.h"
+#include "TC_System.h"
 
 /******************************************************************************/
 /*                          Fixed simulation settings						  */
 /******************************************************************************/
 typedef std::chrono::high_resolution_clock::time_point timer;
 extern const int T      = 30;		/* Time until data is stored in  s		  */
+extern const int onset	= 0;		/* Time until stimulation starts in s	  */
 extern const int res 	= 1E4;		/* Number of iteration steps per s		  */
+extern const int red 	= 1E2;		/* Number of iterations steps not saved	  */
 extern const double dt 	= 1E3/res;	/* Duration of a time step in ms		  */
 extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
 
 /******************************************************************************/
 /*                              Main simulation routine						  */
 /******************************************************************************/
-int main(void) {
+int main(int argc, char* argv[]) {
     /* Initializing the populations */
-    std::vector<double> param = {6, 1.33, 1E-3};
-    std::vector<double> con   = {2, 10};
-    Cortical_Column Cortex(param.data(), con.data());
+    std::vector<double> param_C = {6, 1.33, 1E-3};
+    std::vector<double> param_T = {0.2, 0.06};
+    std::vector<double> con     = {2, 10, 2, 10};
+    TC_System System(param_C.data(), param_T.data(), con.data());
 
-    param = {0.2, 0.06};
-    con   = {2, 10};
-    Thalamic_Column Thalamus (param.data(), con.data());
+    /* Optionally store the time series in the chunk file given as first argument */
+    std::unique_ptr<Chunk_Writer> Output;
+    if (argc > 1) {
+        Output.reset(new Chunk_Writer(argv[1], data_names(), res/red,
+                                      data_parameters(param_C.data(), param_T.data(), con.data()),
+                                      {System.seed}));
+    }
 
-    /* Connect both modules */
-    Cortex.get_Thalamus(Thalamus);
-    Thalamus.get_Cortex(Cortex);
+    /* Anti-aliased recording of the stored variables */
+    Recorder Rec(System, onset*res, T*res);
+    if (Output) {
+        for (const std::string& name : data_names()) {
+            Rec.add(name, res/red);
+        }
+    }
 
     /* Take the time of the simulation */
-    time_t start,end;
-    time (&start);
+    const timer start = std::chrono::high_resolution_clock::now();
     /* Simulation */
-    for (unsigned t=0; t< T*res; ++t) {
-        ODE(Cortex, Thalamus);
+    for (std::uint64_t t=0; t < T*res + Rec.delay(); ++t) {
+        ODE(System);
+        {
+            NM_TC_PROFILE_SCOPE("recording");
+            Rec.sample(t);
+        }
+        if (Output) {
+            NM_TC_PROFILE_SCOPE("output");
+            get_data(*Output, Rec);
+        }
     }
+    Output.reset();
 
-    time (&end);
     /* Time consumed by the simulation */
-    double dif = difftime(end,start);
+    const double dif = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
     std::cout << "simulation done!\n";
     std::cout << "took " << dif 	<< " seconds" << "\n";
+    std::cout << "kernels " << cpu_dispatch_path() << "\n";
+#ifdef NM_TC_PROFILE
+    std::cout << Profiler::get().json();
+#endif
     std::cout << "end\n";
 }
 /****************************************************************************************************/
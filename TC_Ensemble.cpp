@@ -0,0 +1,443 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/*						Functions of the ensemble engine					  */
+/******************************************************************************/
+#include "Cpu_Dispatch.h"
+#include "Fast_Math.h"
+#include "TC_Ensemble.h"
+
+/******************************************************************************/
+/*								Initialization								  */
+/******************************************************************************/
+TC_Ensemble::TC_Ensemble(unsigned K, double* Param_Cortex, double* Param_Thalamus,
+                         double* Con, double* var_stim, const std::vector<std::uint64_t>& seeds)
+    : K		(K),
+      K_pad	((K + lane_width - 1) / lane_width * lane_width),
+      state	(TC_System::num_vars*num_stages*K_pad, 0.0),
+      sigma_p(K_pad, 1.0), g_KNa(K_pad, 0.0), N_pt(K_pad, 0.0), N_it(K_pad, 0.0),
+      g_LK	(K_pad, 0.0), g_h  (K_pad, 0.0), N_tp(K_pad, 0.0), N_rp(K_pad, 0.0),
+      Rand_C(4*K_pad, 0.0), Rand_T(2*K_pad, 0.0),
+      input_C(K_pad, 0.0), input_T(K_pad, 0.0) {
+    /* The ISI stream of each lane follows the noise streams of its columns */
+    const unsigned stream_Stim = TC_System::num_streams;
+
+    replicas.reserve(K);
+    Stims.reserve(K);
+    for (unsigned l=0; l < K; ++l) {
+        /* Same seeds as a scalar run, so lanes reproduce it */
+        replicas.emplace_back(Param_Cortex + 3*l, Param_Thalamus + 2*l, Con + 4*l, seeds.at(l));
+        const Cortical_Column& C = replicas[l].Cortex;
+        const Thalamic_Column& T = replicas[l].Thalamus;
+
+        if (var_stim) {
+            Stims.emplace_back(row(replicas[0].Cortex.Vp, 0) + l, &input_T[l], var_stim + 8*l,
+                               seeds[l], stream_Stim);
+        }
+
+        /* Copy the initial state and noise into the lane */
+        for (unsigned i=0; i < TC_System::num_vars*num_stages; ++i) {
+            state[i*K_pad + l] = C.state[i];
+        }
+        for (unsigned i=0; i < C.Rand_vars.size(); ++i) {
+            Rand_C[i*K_pad + l] = C.Rand_vars[i];
+        }
+        for (unsigned i=0; i < T.Rand_vars.size(); ++i) {
+            Rand_T[i*K_pad + l] = T.Rand_vars[i];
+        }
+
+        /* Gather the varied parameters */
+        sigma_p	[l] = C.sigma_p;
+        g_KNa	[l] = C.g_KNa;
+        N_pt	[l] = C.N_pt;
+        N_it	[l] = C.N_it;
+        g_LK	[l] = T.g_LK;
+        g_h		[l] = T.g_h;
+        N_tp	[l] = T.N_tp;
+        N_rp	[l] = T.N_rp;
+    }
+
+    /* Padding lanes repeat the first lane, so they stay in a sane range */
+    for (State_Block* block : {&sigma_p, &g_KNa, &N_pt, &N_it, &g_LK, &g_h, &N_tp, &N_rp}) {
+        for (unsigned l=K; l < K_pad; ++l) {
+            (*block)[l] = (*block)[0];
+        }
+    }
+    for (unsigned i=0; i < TC_System::num_vars*num_stages; ++i) {
+        for (unsigned l=K; l < K_pad; ++l) {
+            state[i*K_pad + l] = state[i*K_pad];
+        }
+    }
+}
+
+/******************************************************************************/
+/*                              SRK iteration                                 */
+/******************************************************************************/
+void TC_Ensemble::set_RK (int N) {
+    set_RK_Cortex(N);
+    set_RK_Thalamus(N);
+}
+
+NM_TC_TARGET_CLONES
+void TC_Ensemble::set_RK_Cortex (int N) {
+    extern const double dt;
+    const Cortical_Column& C = replicas[0].Cortex;
+    const Thalamic_Column& T = replicas[0].Thalamus;
+
+    /* Constants are copied to locals, so they cannot alias the state rows */
+    const double Adt		= C.A[N] * dt;
+    const double B_N		= C.B[N];
+    const double tau_p		= C.tau_p,		tau_i	= C.tau_i;
+    const double Qp_max		= C.Qp_max,		Qi_max	= C.Qi_max;
+    const double theta_p	= C.theta_p,	theta_i	= C.theta_i;
+    const double sigma_i	= C.sigma_i,	C1		= C.C1;
+    const double alpha_Na	= C.alpha_Na,	tau_Na	= C.tau_Na;
+    const double R_pump		= C.R_pump,		Na_eq	= C.Na_eq;
+    const double gamma_e	= C.gamma_e,	gamma_g	= C.gamma_g,	nu	= C.nu;
+    const double g_L		= C.g_L,		g_AMPA	= C.g_AMPA,		g_GABA	= C.g_GABA;
+    const double E_AMPA		= C.E_AMPA,		E_GABA	= C.E_GABA,		E_K		= C.E_K;
+    const double E_L_p		= C.E_L_p,		E_L_i	= C.E_L_i;
+    const double N_pp		= C.N_pp,		N_ip	= C.N_ip;
+    const double N_pi		= C.N_pi,		N_ii	= C.N_ii;
+    const double Na_pump_eq	= Na_eq*Na_eq*Na_eq/(Na_eq*Na_eq*Na_eq+3375);
+    const double sqrt3		= std::sqrt(3);
+
+    /* Rows of the current stage, the base value and the next stage */
+    const double* __restrict Vp		= row(C.Vp,	  N);
+    const double* __restrict Vi		= row(C.Vi,	  N);
+    const double* __restrict Na		= row(C.Na,	  N);
+    const double* __restrict s_ep	= row(C.s_ep, N);
+    const double* __restrict s_ei	= row(C.s_ei, N);
+    const double* __restrict s_gp	= row(C.s_gp, N);
+    const double* __restrict s_gi	= row(C.s_gi, N);
+    const double* __restrict y		= row(C.y,	  N);
+    const double* __restrict x_ep	= row(C.x_ep, N);
+    const double* __restrict x_ei	= row(C.x_ei, N);
+    const double* __restrict x_gp	= row(C.x_gp, N);
+    const double* __restrict x_gi	= row(C.x_gi, N);
+    const double* __restrict x		= row(C.x,	  N);
+    const double* __restrict y_T	= row(T.y,	  N);
+    const double* __restrict R		= Rand_C.data();
+    const double* __restrict s_p	= sigma_p.data();
+    const double* __restrict g_Na	= g_KNa.data();
+    const double* __restrict n_pt	= N_pt.data();
+    const double* __restrict n_it	= N_it.data();
+
+    const double* __restrict Vp_0	= row(C.Vp,	  0);
+    const double* __restrict Vi_0	= row(C.Vi,	  0);
+    const double* __restrict Na_0	= row(C.Na,	  0);
+    const double* __restrict s_ep_0	= row(C.s_ep, 0);
+    const double* __restrict s_ei_0	= row(C.s_ei, 0);
+    const double* __restrict s_gp_0	= row(C.s_gp, 0);
+    const double* __restrict s_gi_0	= row(C.s_gi, 0);
+    const double* __restrict y_0	= row(C.y,	  0);
+    const double* __restrict x_ep_0	= row(C.x_ep, 0);
+    const double* __restrict x_ei_0	= row(C.x_ei, 0);
+    const double* __restrict x_gp_0	= row(C.x_gp, 0);
+    const double* __restrict x_gi_0	= row(C.x_gi, 0);
+    const double* __restrict x_0	= row(C.x,	  0);
+
+    double* __restrict Vp_n		= row(C.Vp,	  N+1);
+    double* __restrict Vi_n		= row(C.Vi,	  N+1);
+    double* __restrict Na_n		= row(C.Na,	  N+1);
+    double* __restrict s_ep_n	= row(C.s_ep, N+1);
+    double* __restrict s_ei_n	= row(C.s_ei, N+1);
+    double* __restrict s_gp_n	= row(C.s_gp, N+1);
+    double* __restrict s_gi_n	= row(C.s_gi, N+1);
+    double* __restrict y_n		= row(C.y,	  N+1);
+    double* __restrict x_ep_n	= row(C.x_ep, N+1);
+    double* __restrict x_ei_n	= row(C.x_ei, N+1);
+    double* __restrict x_gp_n	= row(C.x_gp, N+1);
+    double* __restrict x_gi_n	= row(C.x_gi, N+1);
+    double* __restrict x_n		= row(C.x,	  N+1);
+
+    #pragma omp simd
+    for (unsigned l=0; l < K_pad; ++l) {
+        /* Firing rates */
+        const double Qp		= Qp_max / (1 + fast_exp(-C1 * (Vp[l] - theta_p) / s_p[l]));
+        const double Qi		= Qi_max / (1 + fast_exp(-C1 * (Vi[l] - theta_i) / sigma_i));
+
+        /* Sodium dependent potassium current, (38.7/Na)^3.5 without pow */
+        const double r		= 38.7/Na[l];
+        const double w_KNa	= 0.37/(1+r*r*r*std::sqrt(r));
+        const double I_KNa	= g_Na[l] * w_KNa * (Vp[l] - E_K);
+        const double Na_pump= R_pump*(Na[l]*Na[l]*Na[l]/(Na[l]*Na[l]*Na[l]+3375) - Na_pump_eq);
+
+        /* Currents */
+        const double I_L_p	= g_L * (Vp[l] - E_L_p);
+        const double I_L_i	= g_L * (Vi[l] - E_L_i);
+        const double I_ep	= g_AMPA * s_ep[l] * (Vp[l] - E_AMPA);
+        const double I_gp	= g_GABA * s_gp[l] * (Vp[l] - E_GABA);
+        const double I_ei	= g_AMPA * s_ei[l] * (Vi[l] - E_AMPA);
+        const double I_gi	= g_GABA * s_gi[l] * (Vi[l] - E_GABA);
+
+        /* Noise */
+        const double noise_0= gamma_e * gamma_e * (R[0*K_pad+l] + R[1*K_pad+l]/sqrt3)*B_N;
+        const double noise_1= gamma_e * gamma_e * (R[2*K_pad+l] + R[3*K_pad+l]/sqrt3)*B_N;
+
+        Vp_n  [l] = Vp_0  [l] + Adt*(-(I_L_p + I_ep + I_gp)/tau_p - I_KNa);
+        Vi_n  [l] = Vi_0  [l] + Adt*(-(I_L_i + I_ei + I_gi)/tau_i);
+        Na_n  [l] = Na_0  [l] + Adt*(alpha_Na * Qp - Na_pump)/tau_Na;
+        s_ep_n[l] = s_ep_0[l] + Adt*(x_ep[l]);
+        s_ei_n[l] = s_ei_0[l] + Adt*(x_ei[l]);
+        s_gp_n[l] = s_gp_0[l] + Adt*(x_gp[l]);
+        s_gi_n[l] = s_gi_0[l] + Adt*(x_gi[l]);
+        y_n	  [l] = y_0	  [l] + Adt*(x	 [l]);
+        x_ep_n[l] = x_ep_0[l] + Adt*(gamma_e*gamma_e * (N_pp * Qp + n_pt[l] * y_T[l] - s_ep[l]) - 2 * gamma_e * x_ep[l]) + noise_0;
+        x_ei_n[l] = x_ei_0[l] + Adt*(gamma_e*gamma_e * (N_ip * Qp + n_it[l] * y_T[l] - s_ei[l]) - 2 * gamma_e * x_ei[l]) + noise_1;
+        x_gp_n[l] = x_gp_0[l] + Adt*(gamma_g*gamma_g * (N_pi * Qi					 - s_gp[l]) - 2 * gamma_g * x_gp[l]);
+        x_gi_n[l] = x_gi_0[l] + Adt*(gamma_g*gamma_g * (N_ii * Qi					 - s_gi[l]) - 2 * gamma_g * x_gi[l]);
+        x_n	  [l] = x_0	  [l] + Adt*(nu * nu		 * (		Qp					 - y   [l]) - 2 * nu	  * x	[l]);
+    }
+}
+
+NM_TC_TARGET_CLONES
+void TC_Ensemble::set_RK_Thalamus (int N) {
+    extern const double dt;
+    const Cortical_Column& C = replicas[0].Cortex;
+    const Thalamic_Column& T = replicas[0].Thalamus;
+
+    /* Constants are copied to locals, so they cannot alias the state rows */
+    const double Adt		= T.A[N] * dt;
+    const double B_N		= T.B[N];
+    const double tau_t		= T.tau_t,		tau_r	= T.tau_r;
+    const double Qt_max		= T.Qt_max,		Qr_max	= T.Qr_max;
+    const double theta_t	= T.theta_t,	theta_r	= T.theta_r;
+    const double sigma_t	= T.sigma_t,	sigma_r	= T.sigma_r,	C1	= T.C1;
+    const double gamma_e	= T.gamma_e,	gamma_g	= T.gamma_g,	nu	= T.nu;
+    const double C_m		= T.C_m,		g_L		= T.g_L;
+    const double g_AMPA		= T.g_AMPA,		g_GABA	= T.g_GABA;
+    const double g_T_t		= T.g_T_t,		g_T_r	= T.g_T_r;
+    const double E_AMPA		= T.E_AMPA,		E_GABA	= T.E_GABA,		E_K	= T.E_K;
+    const double E_L_t		= T.E_L_t,		E_L_r	= T.E_L_r;
+    const double E_Ca		= T.E_Ca,		E_h		= T.E_h;
+    const double alpha_Ca	= T.alpha_Ca,	tau_Ca	= T.tau_Ca,		Ca_0= T.Ca_0;
+    const double k1			= T.k1,			k2		= T.k2;
+    const double k3			= T.k3,			k4		= T.k4,		g_inc	= T.g_inc;
+    const double N_rt		= T.N_rt,		N_tr	= T.N_tr,		N_rr	= T.N_rr;
+
+    /* Rows of the current stage, the base value and the next stage */
+    const double* __restrict Vt		= row(T.Vt,	   N);
+    const double* __restrict Vr		= row(T.Vr,	   N);
+    const double* __restrict Ca		= row(T.Ca,	   N);
+    const double* __restrict s_et	= row(T.s_et,  N);
+    const double* __restrict s_er	= row(T.s_er,  N);
+    const double* __restrict s_gt	= row(T.s_gt,  N);
+    const double* __restrict s_gr	= row(T.s_gr,  N);
+    const double* __restrict y		= row(T.y,	   N);
+    const double* __restrict x_et	= row(T.x_et,  N);
+    const double* __restrict x_er	= row(T.x_er,  N);
+    const double* __restrict x_gt	= row(T.x_gt,  N);
+    const double* __restrict x_gr	= row(T.x_gr,  N);
+    const double* __restrict x		= row(T.x,	   N);
+    const double* __restrict h_T_t	= row(T.h_T_t, N);
+    const double* __restrict h_T_r	= row(T.h_T_r, N);
+    const double* __restrict m_h	= row(T.m_h,   N);
+    const double* __restrict m_h2	= row(T.m_h2,  N);
+    const double* __restrict y_C	= row(C.y,	   N);
+    const double* __restrict R		= Rand_T.data();
+    const double* __restrict g_lk	= g_LK.data();
+    const double* __restrict g_hc	= g_h.data();
+    const double* __restrict n_tp	= N_tp.data();
+    const double* __restrict n_rp	= N_rp.data();
+
+    const double* __restrict Vt_0	= row(T.Vt,	   0);
+    const double* __restrict Vr_0	= row(T.Vr,	   0);
+    const double* __restrict Ca_0_	= row(T.Ca,	   0);
+    const double* __restrict s_et_0	= row(T.s_et,  0);
+    const double* __restrict s_er_0	= row(T.s_er,  0);
+    const double* __restrict s_gt_0	= row(T.s_gt,  0);
+    const double* __restrict s_gr_0	= row(T.s_gr,  0);
+    const double* __restrict y_0	= row(T.y,	   0);
+    const double* __restrict x_et_0	= row(T.x_et,  0);
+    const double* __restrict x_er_0	= row(T.x_er,  0);
+    const double* __restrict x_gt_0	= row(T.x_gt,  0);
+    const double* __restrict x_gr_0	= row(T.x_gr,  0);
+    const double* __restrict x_0	= row(T.x,	   0);
+    const double* __restrict h_T_t_0= row(T.h_T_t, 0);
+    const double* __restrict h_T_r_0= row(T.h_T_r, 0);
+    const double* __restrict m_h_0	= row(T.m_h,   0);
+    const double* __restrict m_h2_0	= row(T.m_h2,  0);
+
+    double* __restrict Vt_n		= row(T.Vt,	   N+1);
+    double* __restrict Vr_n		= row(T.Vr,	   N+1);
+    double* __restrict Ca_n		= row(T.Ca,	   N+1);
+    double* __restrict s_et_n	= row(T.s_et,  N+1);
+    double* __restrict s_er_n	= row(T.s_er,  N+1);
+    double* __restrict s_gt_n	= row(T.s_gt,  N+1);
+    double* __restrict s_gr_n	= row(T.s_gr,  N+1);
+    double* __restrict y_n		= row(T.y,	   N+1);
+    double* __restrict x_et_n	= row(T.x_et,  N+1);
+    double* __restrict x_er_n	= row(T.x_er,  N+1);
+    double* __restrict x_gt_n	= row(T.x_gt,  N+1);
+    double* __restrict x_gr_n	= row(T.x_gr,  N+1);
+    double* __restrict x_n		= row(T.x,	   N+1);
+    double* __restrict h_T_t_n	= row(T.h_T_t, N+1);
+    double* __restrict h_T_r_n	= row(T.h_T_r, N+1);
+    double* __restrict m_h_n	= row(T.m_h,   N+1);
+    double* __restrict m_h2_n	= row(T.m_h2,  N+1);
+
+    #pragma omp simd
+    for (unsigned l=0; l < K_pad; ++l) {
+        /* Firing rates */
+        const double Qt			= Qt_max / (1 + fast_exp(-C1 * (Vt[l] - theta_t) / sigma_t));
+        const double Qr			= Qr_max / (1 + fast_exp(-C1 * (Vr[l] - theta_r) / sigma_r));
+
+        /* I_T gating after Destexhe 1996 */
+        const double m_inf_T_t	= 1/(1+fast_exp(-(Vt[l]+59)/6.2));
+        const double m_inf_T_r	= 1/(1+fast_exp(-(Vr[l]+52)/7.4));
+        const double h_inf_T_t	= 1/(1+fast_exp( (Vt[l]+81)/4));
+        const double h_inf_T_r	= 1/(1+fast_exp( (Vr[l]+80)/5));
+        const double tau_h_T_t	= (30.8 + (211.4 + fast_exp((Vt[l]+115.2)/5))/(1 + fast_exp((Vt[l]+86)/3.2)))/3.7371928;
+        const double tau_h_T_r	= (85 + 1/(fast_exp((Vr[l]+48)/4) + fast_exp(-(Vr[l]+407)/50)))/3.7371928;
+
+        /* I_h gating after Destexhe 1993 and Chen 2012 */
+        const double m_inf_h	= 1/(1+fast_exp( (Vt[l]+75)/5.5));
+        const double tau_m_h	= (20 + 1000/(fast_exp((Vt[l]+ 71.5)/14.2) + fast_exp(-(Vt[l]+ 89)/11.6)));
+        const double Ca4		= Ca[l] * Ca[l] * Ca[l] * Ca[l];
+        const double P_h		= k1 * Ca4/(k1 * Ca4 + k2);
+
+        /* Currents */
+        const double I_L_t		= g_L * (Vt[l] - E_L_t);
+        const double I_L_r		= g_L * (Vr[l] - E_L_r);
+        const double I_LK_t		= g_lk[l] * (Vt[l] - E_K);
+        const double I_LK_r		= g_lk[l] * (Vr[l] - E_K);
+        const double I_et		= g_AMPA * s_et[l] * (Vt[l] - E_AMPA);
+        const double I_gt		= g_GABA * s_gt[l] * (Vt[l] - E_GABA);
+        const double I_er		= g_AMPA * s_er[l] * (Vr[l] - E_AMPA);
+        const double I_gr		= g_GABA * s_gr[l] * (Vr[l] - E_GABA);
+        const double I_T_t		= g_T_t * m_inf_T_t * m_inf_T_t * h_T_t[l] * (Vt[l] - E_Ca);
+        const double I_T_r		= g_T_r * m_inf_T_r * m_inf_T_r * h_T_r[l] * (Vr[l] - E_Ca);
+        const double I_h		= g_hc[l] * (m_h[l] + g_inc * m_h2[l]) * (Vt[l] - E_h);
+
+        /* Noise */
+        const double noise_0	= gamma_e * gamma_e * (R[0*K_pad+l] + R[1*K_pad+l]/std::sqrt(3))*B_N;
+
+        Vt_n   [l] = Vt_0	[l] + Adt*(-(I_L_t + I_et + I_gt)/tau_t - C_m * (I_LK_t + I_T_t + I_h));
+        Vr_n   [l] = Vr_0	[l] + Adt*(-(I_L_r + I_er + I_gr)/tau_r - C_m * (I_LK_r + I_T_r));
+        Ca_n   [l] = Ca_0_	[l] + Adt*(alpha_Ca * I_T_t - (Ca[l] - Ca_0)/tau_Ca);
+        h_T_t_n[l] = h_T_t_0[l] + Adt*(h_inf_T_t - h_T_t[l])/tau_h_T_t;
+        h_T_r_n[l] = h_T_r_0[l] + Adt*(h_inf_T_r - h_T_r[l])/tau_h_T_r;
+        m_h_n  [l] = m_h_0	[l] + Adt*((m_inf_h * (1 - m_h2[l]) - m_h[l])/tau_m_h - k3 * P_h * m_h[l] + k4 * m_h2[l]);
+        m_h2_n [l] = m_h2_0	[l] + Adt*(k3 * P_h * m_h[l] - k4 * m_h2[l]);
+        s_et_n [l] = s_et_0	[l] + Adt*(x_et[l]);
+        s_er_n [l] = s_er_0	[l] + Adt*(x_er[l]);
+        s_gt_n [l] = s_gt_0	[l] + Adt*(x_gt[l]);
+        s_gr_n [l] = s_gr_0	[l] + Adt*(x_gr[l]);
+        y_n	   [l] = y_0	[l] + Adt*(x   [l]);
+        x_et_n [l] = x_et_0	[l] + Adt*(gamma_e*gamma_e * (			 + n_tp[l] * y_C[l] - s_et[l]) - 2 * gamma_e * x_et[l]) + noise_0;
+        x_er_n [l] = x_er_0	[l] + Adt*(gamma_e*gamma_e * (N_rt * Qt + n_rp[l] * y_C[l] - s_er[l]) - 2 * gamma_e * x_er[l]);
+        x_gt_n [l] = x_gt_0	[l] + Adt*(gamma_g*gamma_g * (N_tr * Qr					 - s_gt[l]) - 2 * gamma_g * x_gt[l]);
+        x_gr_n [l] = x_gr_0	[l] + Adt*(gamma_g*gamma_g * (N_rr * Qr					 - s_gr[l]) - 2 * gamma_g * x_gr[l]);
+        x_n	   [l] = x_0	[l] + Adt*(nu * nu		   * (		  Qt				 - y   [l]) - 2 * nu	  * x	[l]);
+    }
+}
+
+NM_TC_TARGET_CLONES
+void TC_Ensemble::add_RK(void) {
+    const Cortical_Column& C = replicas[0].Cortex;
+    const Thalamic_Column& T = replicas[0].Thalamus;
+    const double sqrt3 = std::sqrt(3);
+
+    /* Every variable is a set of num_stages contiguous rows */
+    for (unsigned i=0; i < TC_System::num_vars; ++i) {
+        double* __restrict v0		= state.data() + (i*num_stages + 0)*K_pad;
+        const double* __restrict v1	= v0 + 1*K_pad;
+        const double* __restrict v2	= v0 + 2*K_pad;
+        const double* __restrict v3	= v0 + 3*K_pad;
+        const double* __restrict v4	= v0 + 4*K_pad;
+        #pragma omp simd
+        for (unsigned l=0; l < K_pad; ++l) {
+            v0[l] = (-3*v0[l] + 2*v1[l] + 4*v2[l] + 2*v3[l] + v4[l])/6;
+        }
+    }
+
+    /* Noise contributions of the final moment */
+    double* __restrict x_ep = row(C.x_ep, 0);
+    double* __restrict x_ei = row(C.x_ei, 0);
+    double* __restrict x_et = row(T.x_et, 0);
+    const double g2_C = C.gamma_e * C.gamma_e;
+    const double g2_T = T.gamma_e * T.gamma_e;
+    #pragma omp simd
+    for (unsigned l=0; l < K_pad; ++l) {
+        x_ep[l] += g2_C * (Rand_C[0*K_pad+l] - Rand_C[1*K_pad+l]*sqrt3)/4;
+        x_ei[l] += g2_C * (Rand_C[2*K_pad+l] - Rand_C[3*K_pad+l]*sqrt3)/4;
+        x_et[l] += g2_T * (Rand_T[0*K_pad+l] - Rand_T[1*K_pad+l]*sqrt3)/4;
+    }
+
+    /* Generate noise for the next iteration from the streams of each lane */
+    for (unsigned l=0; l < K; ++l) {
+        Cortical_Column& C_l = replicas[l].Cortex;
+        Thalamic_Column& T_l = replicas[l].Thalamus;
+        for (unsigned i=0; i < C_l.Rand_Streams.size(); ++i) {
+            Rand_C[i*K_pad+l] = C_l.Rand_Streams[i]() + input_C[l];
+        }
+        for (unsigned i=0; i < T_l.Rand_Streams.size(); ++i) {
+            Rand_T[i*K_pad+l] = T_l.Rand_Streams[i]() + input_T[l];
+        }
+    }
+}
+
+/******************************************************************************/
+/*							Stimulation protocols							  */
+/******************************************************************************/
+void TC_Ensemble::check_stim (int time) {
+    for (Stim& S : Stims) {
+        S.check_stim(time);
+    }
+}
+
+/******************************************************************************/
+/*								Data storage								  */
+/******************************************************************************/
+const TC_System& TC_Ensemble::get_lane (unsigned l) {
+    TC_System& S = replicas.at(l);
+    for (unsigned i=0; i < TC_System::num_vars; ++i) {
+        S.Cortex.state[i*num_stages] = state[i*num_stages*K_pad + l];
+    }
+    return S;
+}
+
+void TC_Ensemble::get_data (int counter, std::vector<double*>& pData) {
+    const Cortical_Column& C = replicas[0].Cortex;
+    const Thalamic_Column& T = replicas[0].Thalamus;
+    const double* Vp	= row(C.Vp,	  0);
+    const double* Vt	= row(T.Vt,	  0);
+    const double* Ca	= row(T.Ca,	  0);
+    const double* m_h	= row(T.m_h,  0);
+    const double* m_h2	= row(T.m_h2, 0);
+    for (unsigned l=0; l < K; ++l) {
+        pData[0][counter*K + l] = Vp[l];
+        pData[1][counter*K + l] = Vt[l];
+        pData[2][counter*K + l] = Ca[l];
+        pData[3][counter*K + l] = m_h[l] + T.g_inc * m_h2[l];
+    }
+}
@@ -0,0 +1,134 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/*		Ensemble of independent thalamocortical systems stepped in lockstep	  */
+/*																			  */
+/* The state of K replicas is stored structure of arrays style, every		  */
+/* variable and RK stage is a contiguous row of K_pad lanes. The right hand	  */
+/* side runs as SIMD loops over the lanes. Each lane has its own parameters,  */
+/* noise streams and stimulation protocol.									  */
+/******************************************************************************/
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "State_Block.h"
+#include "Stimulation.h"
+#include "TC_System.h"
+
+class TC_Ensemble {
+public:
+    /* Constructor for simulation. Parameters are given one column per lane, */
+    /* e.g. Param_Cortex is 3 x K in column major order as passed by MATLAB	 */
+    /* Lane l uses seed + l, so it reproduces a TC_System with that seed	 */
+    TC_Ensemble(unsigned K, double* Param_Cortex, double* Param_Thalamus,
+                double* Con, double* var_stim, std::uint64_t seed = rand())
+    : TC_Ensemble(K, Param_Cortex, Param_Thalamus, Con, var_stim, consecutive(seed, K)) {}
+
+    /* Constructor with a seed per lane. Without var_stim the lanes have no	 */
+    /* Stim, their inputs are then driven from outside, e.g. by a scheduler	 */
+    TC_Ensemble(unsigned K, double* Param_Cortex, double* Param_Thalamus,
+                double* Con, double* var_stim, const std::vector<std::uint64_t>& seeds);
+
+    TC_Ensemble(const TC_Ensemble&) = delete;
+    TC_Ensemble& operator=(const TC_Ensemble&) = delete;
+
+    /* ODE functions */
+    void 	set_RK		(int);
+    void 	add_RK	 	(void);
+
+    /* Check the stimulation protocol of every lane */
+    void 	check_stim	(int time);
+
+    /* Store Vp, Vt, Ca and act_h of every lane as K x samples matrices */
+    void	get_data	(int counter, std::vector<double*>& pData);
+
+    /* Number of replicas */
+    unsigned size		(void) const {return K;}
+
+    /* Stimulation protocol of a lane */
+    const Stim& get_stim(unsigned lane) const {return Stims[lane];}
+
+    /* Views of a lane for a Stim_Scheduler: Vp and the inputs of both columns */
+    const double* get_Vp	 (unsigned l) {return row(replicas[0].Cortex.Vp, 0) + l;}
+    double*		  get_input_C(unsigned l) {return &input_C[l];}
+    double*		  get_input_T(unsigned l) {return &input_T[l];}
+
+    /* Replica of a lane with the current state of the lane copied into it,	 */
+    /* e.g. for a Recorder. Only the state is updated, not the noise			 */
+    const TC_System& get_lane(unsigned l);
+
+    /* Lane count is padded to the widest vector unit (AVX-512) */
+    static const unsigned lane_width = 8;
+
+private:
+    /* Seeds seed, seed + 1, ... of K lanes */
+    static std::vector<std::uint64_t> consecutive (std::uint64_t seed, unsigned K) {
+        std::vector<std::uint64_t> seeds(K);
+        for (unsigned l=0; l < K; ++l) {
+            seeds[l] = seed + l;
+        }
+        return seeds;
+    }
+
+    /* Right hand side of both populations */
+    void 	set_RK_Cortex	(int);
+    void 	set_RK_Thalamus	(int);
+
+    /* Row of a state variable at a given RK stage. The variable is given by */
+    /* its view in the first replica, so the rows follow the scalar layout	 */
+    double* row (const double* var, unsigned stage)
+    {return state.data() + ((var - replicas[0].Cortex.state) + stage)*K_pad;}
+
+    /* Number of replicas and padded number of lanes */
+    const unsigned K;
+    const unsigned K_pad;
+
+    /* Scalar replicas, they hold the constants and the per lane noise streams */
+    std::vector<TC_System> replicas;
+
+    /* Stimulation protocol per lane */
+    std::vector<Stim> Stims;
+
+    /* State of all lanes: (variables x RK stages) x K_pad */
+    State_Block	state;
+
+    /* Per lane parameters that are varied between replicas */
+    State_Block	sigma_p, g_KNa, N_pt, N_it;
+    State_Block	g_LK, g_h, N_tp, N_rp;
+
+    /* Per lane noise, rows as in Rand_vars of the respective column */
+    State_Block	Rand_C, Rand_T;
+
+    /* Per lane external input */
+    State_Block	input_C, input_T;
+};
@@ -0,0 +1,332 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/*				Functions of the network of thalamocortical modules			  */
+/******************************************************************************/
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+
+#include "TC_Network.h"
+
+/******************************************************************************/
+/*								Initialization								  */
+/******************************************************************************/
+/* Weights without delay */
+static CSR_Matrix instantaneous (const CSR_Matrix& W) {
+    std::vector<CSR_Matrix::Entry> entries;
+    for (const CSR_Matrix::Entry& e : W.entries()) {
+        if (e.delay == 0) {
+            entries.push_back(e);
+        }
+    }
+    return CSR_Matrix(W.rows(), W.cols(), std::move(entries));
+}
+
+/* Weights with delay, the delays are converted to time steps */
+static CSR_Matrix delayed (const CSR_Matrix& W) {
+    extern const double dt;
+    std::vector<CSR_Matrix::Entry> entries;
+    for (CSR_Matrix::Entry e : W.entries()) {
+        if (e.delay == 0) {
+            continue;
+        }
+        if (e.delay < dt) {
+            throw std::invalid_argument("TC_Network: delays have to be 0 or at least one time step");
+        }
+        e.delay /= dt;
+        entries.push_back(e);
+    }
+    return CSR_Matrix(W.rows(), W.cols(), std::move(entries));
+}
+
+/* Longest delay of the weights leaving every source */
+static std::vector<double> max_delay (unsigned sources, std::initializer_list<const CSR_Matrix*> D) {
+    std::vector<double> delay(sources, 0.0);
+    for (const CSR_Matrix* W : D) {
+        for (const CSR_Matrix::Entry& e : W->entries()) {
+            delay[e.col] = std::max(delay[e.col], e.delay);
+        }
+    }
+    return delay;
+}
+
+TC_Network::TC_Network(const std::vector<Parameter_Set>& Param_Cortex,
+                       const std::vector<Parameter_Set>& Param_Thalamus,
+                       const CSR_Matrix& W_CC, const CSR_Matrix& W_CT, const CSR_Matrix& W_TC,
+                       std::uint64_t seed, unsigned num_threads)
+    : seed	(seed),
+      num_C	(Param_Cortex.size()),
+      num_T	(Param_Thalamus.size()),
+      W_CC	(instantaneous(W_CC)),
+      W_CT	(instantaneous(W_CT)),
+      W_TC	(instantaneous(W_TC)),
+      D_CC	(delayed(W_CC)),
+      D_CT	(delayed(W_CT)),
+      D_TC	(delayed(W_TC)),
+      state	((num_C*Cortical_Column::num_vars + num_T*Thalamic_Column::num_vars)*num_stages, 0.0),
+      flux_C(4*num_C, 0.0),
+      flux_T(4*num_T, 0.0),
+      history_C(max_delay(num_C, {&D_CC, &D_CT})),
+      history_T(max_delay(num_T, {&D_TC})),
+      afferent_TC(num_C*num_stages, 0.0),
+      afferent_CC(num_C*num_stages, 0.0),
+      afferent_CT(num_T*num_stages, 0.0) {
+    if (W_CT.rows() != num_T || W_CT.cols() != num_C ||
+        W_TC.rows() != num_C || W_TC.cols() != num_T ||
+        (W_CC.rows() != 0 && (W_CC.rows() != num_C || W_CC.cols() != num_C))) {
+        throw std::invalid_argument("TC_Network: coupling matrices do not match the number of modules");
+    }
+
+    /* Streams as in TC_System, so a single pair reproduces it */
+    const bool cortical = W_CC.nnz() > 0;
+    double* block = state.data();
+    Cortex.reserve(num_C);
+    for (unsigned i=0; i < num_C; ++i) {
+        Cortex.emplace_back(Param_Cortex[i].Cortex, Param_Cortex[i].Connectivity, block,
+                            seed, i*Cortical_Column::num_streams);
+        Cortex[i].set_afferent(&afferent_TC[i*num_stages], cortical ? &afferent_CC[i*num_stages] : nullptr);
+        block += Cortical_Column::num_vars*num_stages;
+    }
+    Thalamus.reserve(num_T);
+    for (unsigned k=0; k < num_T; ++k) {
+        Thalamus.emplace_back(Param_Thalamus[k].Thalamus, Param_Thalamus[k].Connectivity, block,
+                              seed, num_C*Cortical_Column::num_streams + k*Thalamic_Column::num_streams);
+        Thalamus[k].set_afferent(&afferent_CT[k*num_stages]);
+        block += Thalamic_Column::num_vars*num_stages;
+    }
+
+    /* Initial flux of all modules, the history is constant before the start */
+    publish(Partition{0, num_C, 0, num_T}, 0);
+    for (unsigned i=0; i < num_C; ++i) {
+        history_C.init(i, Cortex[i].y[0]);
+    }
+    for (unsigned k=0; k < num_T; ++k) {
+        history_T.init(k, Thalamus[k].y[0]);
+    }
+
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    partition(std::max(1u, std::min(num_threads, std::max(num_C, num_T))));
+
+    barrier.reset(new Spin_Barrier(partitions.size()));
+    for (unsigned id=1; id < partitions.size(); ++id) {
+        workers.emplace_back(&TC_Network::work, this, id);
+    }
+}
+
+TC_Network::~TC_Network(void) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    start.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/******************************************************************************/
+/*							Partition of the modules						  */
+/******************************************************************************/
+void TC_Network::partition(unsigned num_threads) {
+    /* Work of a module in units of stored weights, the right hand side costs	*/
+    /* about as much as a few dozen weights										*/
+    const double cost_RHS = 32;
+
+    /* Boundaries of ranges with about equal summed cost */
+    auto split = [num_threads] (const std::vector<double>& cost) {
+        std::vector<double> sum(cost.size()+1, 0.0);
+        for (unsigned i=0; i < cost.size(); ++i) {
+            sum[i+1] = sum[i] + cost[i];
+        }
+        std::vector<unsigned> bounds(num_threads+1, cost.size());
+        for (unsigned p=0; p < num_threads; ++p) {
+            bounds[p] = std::lower_bound(sum.begin(), sum.end(), sum.back()*p/num_threads) - sum.begin();
+        }
+        return bounds;
+    };
+
+    std::vector<double> cost_C(num_C), cost_T(num_T);
+    for (unsigned i=0; i < num_C; ++i) {
+        cost_C[i] = cost_RHS + W_TC.row_nnz(i) + (W_CC.nnz() > 0 ? W_CC.row_nnz(i) : 0);
+    }
+    for (unsigned k=0; k < num_T; ++k) {
+        cost_T[k] = cost_RHS + W_CT.row_nnz(k);
+    }
+
+    const std::vector<unsigned> bounds_C = split(cost_C);
+    const std::vector<unsigned> bounds_T = split(cost_T);
+    for (unsigned p=0; p < num_threads; ++p) {
+        partitions.push_back(Partition{bounds_C[p], bounds_C[p+1], bounds_T[p], bounds_T[p+1]});
+    }
+}
+
+/******************************************************************************/
+/*                              SRK iteration                                 */
+/******************************************************************************/
+void TC_Network::set_afferent (const Partition& P, int N, std::uint64_t t) {
+    /* Time of the RK stages after the begin of the step in steps */
+    static const double stage_time[4] = {0.0, 0.5, 0.5, 1.0};
+
+    const double* y_C = flux_C.data() + N*num_C;
+    const double* y_T = flux_T.data() + N*num_T;
+    auto past_C = [&] (unsigned j, double delay) {return history_C(j, t, delay - stage_time[N]);};
+    auto past_T = [&] (unsigned k, double delay) {return history_T(k, t, delay - stage_time[N]);};
+
+    const bool cortical = W_CC.nnz() + D_CC.nnz() > 0;
+    for (unsigned i=P.cortex_begin; i < P.cortex_end; ++i) {
+        double afferent = W_TC.row_dot(i, y_T);
+        if (D_TC.nnz() > 0) {
+            afferent += D_TC.row_sum(i, past_T);
+        }
+        afferent_TC[i*num_stages + N] = afferent;
+
+        if (cortical) {
+            afferent = W_CC.row_dot(i, y_C);
+            if (D_CC.nnz() > 0) {
+                afferent += D_CC.row_sum(i, past_C);
+            }
+            afferent_CC[i*num_stages + N] = afferent;
+        }
+    }
+    for (unsigned k=P.thalamus_begin; k < P.thalamus_end; ++k) {
+        double afferent = W_CT.row_dot(k, y_C);
+        if (D_CT.nnz() > 0) {
+            afferent += D_CT.row_sum(k, past_C);
+        }
+        afferent_CT[k*num_stages + N] = afferent;
+    }
+}
+
+void TC_Network::publish (const Partition& P, int N) {
+    for (unsigned i=P.cortex_begin; i < P.cortex_end; ++i) {
+        flux_C[N*num_C + i] = Cortex[i].y[N];
+    }
+    for (unsigned k=P.thalamus_begin; k < P.thalamus_end; ++k) {
+        flux_T[N*num_T + k] = Thalamus[k].y[N];
+    }
+}
+
+/* Other threads only read the flux of the current stage, while the new flux */
+/* goes to the next one, so a single barrier per stage suffices				 */
+void TC_Network::step (const Partition& P, std::uint64_t t) {
+    for (int N=0; N < 4; ++N) {
+        set_afferent(P, N, t);
+        for (unsigned i=P.cortex_begin; i < P.cortex_end; ++i) {
+            Cortex[i].set_RK(N);
+        }
+        for (unsigned k=P.thalamus_begin; k < P.thalamus_end; ++k) {
+            Thalamus[k].set_RK(N);
+        }
+
+        /* Add all moments */
+        if (N == 3) {
+            for (unsigned i=P.cortex_begin; i < P.cortex_end; ++i) {
+                Cortex[i].add_RK();
+            }
+            for (unsigned k=P.thalamus_begin; k < P.thalamus_end; ++k) {
+                Thalamus[k].add_RK();
+            }
+
+            /* The oldest value of each ring is no longer read in the last stage */
+            for (unsigned i=P.cortex_begin; i < P.cortex_end; ++i) {
+                history_C.store(i, t+1, Cortex[i].y[0]);
+            }
+            for (unsigned k=P.thalamus_begin; k < P.thalamus_end; ++k) {
+                history_T.store(k, t+1, Thalamus[k].y[0]);
+            }
+        }
+        publish(P, (N+1) % 4);
+        barrier->wait();
+    }
+}
+
+void TC_Network::run (unsigned num_steps) {
+    if (!workers.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            steps	   = num_steps;
+            first_step = step_count;
+            ++run_id;
+        }
+        start.notify_all();
+    }
+
+    /* The last barrier of the final step is also the end of the run */
+    for (unsigned t=0; t < num_steps; ++t) {
+        step(partitions[0], step_count + t);
+    }
+    step_count += num_steps;
+}
+
+void TC_Network::work (unsigned id) {
+    unsigned seen = 0;
+    while (true) {
+        unsigned num_steps;
+        std::uint64_t first;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start.wait(lock, [&] {return stop || run_id != seen;});
+            if (stop) {
+                return;
+            }
+            seen	  = run_id;
+            num_steps = steps;
+            first	  = first_step;
+        }
+        for (unsigned t=0; t < num_steps; ++t) {
+            step(partitions[id], first + t);
+        }
+    }
+}
+
+/******************************************************************************/
+/*								Settings and data							  */
+/******************************************************************************/
+void TC_Network::set_integrator (Integrator mode) {
+    for (Cortical_Column& C : Cortex) {
+        C.set_integrator(mode);
+    }
+    for (Thalamic_Column& T : Thalamus) {
+        T.set_integrator(mode);
+    }
+}
+
+void TC_Network::get_data (int counter, std::vector<double*>& pData) {
+    for (unsigned i=0; i < num_C; ++i) {
+        pData[0][counter*num_C + i] = Cortex[i].Vp[0];
+    }
+    for (unsigned k=0; k < num_T; ++k) {
+        pData[1][counter*num_T + k] = Thalamus[k].Vt[0];
+    }
+}
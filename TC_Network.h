@@ -0,0 +1,182 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/*				Network of coupled thalamocortical modules					  */
+/*																			  */
+/* N cortical and M thalamic modules, each with its own parameters, interact  */
+/* through their axonal flux y. The weights are sparse matrices:			  */
+/*		W_CC	N x N	cortex	 to cortex									  */
+/*		W_CT	M x N	cortex	 to thalamus								  */
+/*		W_TC	N x M	thalamus to cortex									  */
+/* Cortical module i receives (W_TC y_T)_i scaled by its N_pt and N_it and	  */
+/* (W_CC y_C)_i on both populations, thalamic module k receives (W_CT y_C)_k  */
+/* scaled by its N_tp and N_rp. A single pair coupled by identity matrices	  */
+/* reproduces TC_System with the same seed.									  */
+/*																			  */
+/* Weights with a conduction delay read the flux of their source at the time  */
+/* of the RK stage minus the delay from a Flux_History, weights without one	  */
+/* use the flux of the current stage. Delays have to be at least one step.	  */
+/*																			  */
+/* All modules share one state block. It is split into contiguous ranges of	  */
+/* roughly equal work, one per thread. In every RK stage a thread computes	  */
+/* the coupling of its modules from compact flux vectors, advances them and	  */
+/* publishes their new flux. A barrier separates the stages, so the only	  */
+/* shared data are the flux vectors.										  */
+/******************************************************************************/
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CSR_Matrix.h"
+#include "Cortical_Column.h"
+#include "Flux_History.h"
+#include "Parameter_Sets.h"
+#include "State_Block.h"
+#include "Thalamic_Column.h"
+#include "Thread_Pool.h"
+
+class TC_Network {
+public:
+    /* Cortical module i takes Cortex and Connectivity of Param_Cortex[i], thalamic */
+    /* module k Thalamus and Connectivity of Param_Thalamus[k]. An empty W_CC		 */
+    /* disables the cortico-cortical coupling. 0 threads selects one per core.		 */
+    TC_Network(const std::vector<Parameter_Set>& Param_Cortex,
+               const std::vector<Parameter_Set>& Param_Thalamus,
+               const CSR_Matrix& W_CC, const CSR_Matrix& W_CT, const CSR_Matrix& W_TC,
+               std::uint64_t seed = rand(), unsigned num_threads = 0);
+
+    /* Stops the workers */
+    ~TC_Network(void);
+
+    TC_Network(const TC_Network&) = delete;
+    TC_Network& operator=(const TC_Network&) = delete;
+
+    /* Advance all modules by a number of time steps, the calling thread takes part */
+    void	run			(unsigned steps);
+
+    /* Integration scheme of the synaptic kernels of all modules */
+    void	set_integrator (Integrator mode);
+
+    /* Store Vp of every cortical module as N x samples and Vt of every thalamic	*/
+    /* module as M x samples matrix												*/
+    void	get_data	(int counter, std::vector<double*>& pData);
+
+    /* Number of completed time steps */
+    std::uint64_t	time_step	(void) const {return step_count;}
+
+    /* Number of modules and threads */
+    unsigned	num_cortex		(void) const {return num_C;}
+    unsigned	num_thalamus	(void) const {return num_T;}
+    unsigned	num_threads		(void) const {return partitions.size();}
+
+    /* Seed of the noise streams, module streams follow each other */
+    const std::uint64_t seed;
+
+private:
+    /* Modules advanced by one thread */
+    struct Partition {
+        unsigned	cortex_begin,	cortex_end;
+        unsigned	thalamus_begin, thalamus_end;
+    };
+
+    /* Split the modules into ranges of about equal work */
+    void	partition	(unsigned num_threads);
+
+    /* Time step t of the modules of a partition */
+    void	step		(const Partition& P, std::uint64_t t);
+
+    /* Coupling of RK stage N of time step t */
+    void	set_afferent(const Partition& P, int N, std::uint64_t t);
+
+    /* Copy the flux of RK stage N into the compact flux vectors */
+    void	publish		(const Partition& P, int N);
+
+    /* Worker loop, waits for run and steps its partition */
+    void	work		(unsigned id);
+
+    /* Number of cortical and thalamic modules */
+    const unsigned num_C;
+    const unsigned num_T;
+
+    /* Instantaneous coupling weights */
+    const CSR_Matrix W_CC;
+    const CSR_Matrix W_CT;
+    const CSR_Matrix W_TC;
+
+    /* Delayed coupling weights, with the delays in time steps */
+    const CSR_Matrix D_CC;
+    const CSR_Matrix D_CT;
+    const CSR_Matrix D_TC;
+
+    /* State block of all modules, cortical modules first */
+    State_Block		state;
+
+public:
+    /* Modules as views into the state block, e.g. to set their input between */
+    /* calls of run																*/
+    std::vector<Cortical_Column> Cortex;
+    std::vector<Thalamic_Column> Thalamus;
+
+private:
+    /* Flux of every module for the RK stages 0-3: stage x modules */
+    State_Block		flux_C;
+    State_Block		flux_T;
+
+    /* Past flux of the sources of delayed weights */
+    Flux_History	history_C;
+    Flux_History	history_T;
+
+    /* Afferent flux of every module: modules x num_stages */
+    State_Block		afferent_TC;
+    State_Block		afferent_CC;
+    State_Block		afferent_CT;
+
+    /* Module ranges of the threads, the calling thread takes the first */
+    std::vector<Partition>		 partitions;
+    std::unique_ptr<Spin_Barrier> barrier;
+
+    /* Helper threads and their wake up */
+    std::vector<std::thread>	workers;
+    std::mutex					mutex;
+    std::condition_variable		start;
+    unsigned					run_id	= 0;
+    unsigned					steps	= 0;
+    bool						stop	= false;
+
+    /* Number of completed time steps and the first step of the current run */
+    std::uint64_t				step_count = 0;
+    std::uint64_t				first_step = 0;
+};
@@ -0,0 +1,107 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/*				Coupled thalamocortical system with a unified state			  */
+/******************************************************************************/
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+
+#include "Cortical_Column.h"
+#include "Parameter_Sets.h"
+#include "State_Block.h"
+#include "Thalamic_Column.h"
+
+class TC_System {
+public:
+    /* Constructor for simulation, all noise streams are derived from seed */
+    TC_System(const double* Param_Cortex, const double* Param_Thalamus, const double* Con,
+              std::uint64_t seed = rand())
+        : state		(num_vars*num_stages, 0.0),
+          Cortex	(Param_Cortex,   Con, state.data(), seed, 0),
+          Thalamus	(Param_Thalamus, Con, state.data() + offset_Thalamus, seed, Cortical_Column::num_streams),
+          seed		(seed)
+    {connect();}
+
+    /* Constructor from a parameter set, e.g. Parameters_N2 or Parameters_N3 */
+    explicit TC_System(const Parameter_Set& P, std::uint64_t seed = rand())
+        : TC_System(P.Cortex, P.Thalamus, P.Connectivity, seed) {}
+
+    /* Copies get their own state block, so the views have to be rebound */
+    TC_System(const TC_System& other)
+        : state		(other.state),
+          Cortex	(other.Cortex),
+          Thalamus	(other.Thalamus),
+          seed		(other.seed)
+    {Cortex.bind(state.data()); Thalamus.bind(state.data() + offset_Thalamus); connect();}
+
+    /* Copy of the state that continues with the noise streams of another seed */
+    TC_System(const TC_System& other, std::uint64_t seed)
+        : state		(other.state),
+          Cortex	(other.Cortex),
+          Thalamus	(other.Thalamus),
+          seed		(seed)
+    {Cortex.bind(state.data()); Thalamus.bind(state.data() + offset_Thalamus); connect();
+     Cortex.reseed(seed, 0); Thalamus.reseed(seed, Cortical_Column::num_streams);}
+
+    TC_System& operator=(const TC_System&) = delete;
+
+    /* Continue with the noise streams of another seed, e.g. the one of a checkpoint */
+    void reseed (std::uint64_t new_seed)
+    {seed = new_seed; Cortex.reseed(seed, 0); Thalamus.reseed(seed, Cortical_Column::num_streams);}
+
+    /* Integration scheme of the synaptic kernels of both columns */
+    void set_integrator (Integrator mode) {Cortex.set_integrator(mode); Thalamus.set_integrator(mode);}
+
+    /* Number of state variables of the whole system */
+    static const unsigned num_vars 		  = Cortical_Column::num_vars + Thalamic_Column::num_vars;
+
+    /* Offset of the thalamic variables within the state block */
+    static const unsigned offset_Thalamus = Cortical_Column::num_vars * num_stages;
+
+    /* Number of noise streams used by the columns, later streams are free */
+    static const unsigned num_streams	  = Cortical_Column::num_streams + Thalamic_Column::num_streams;
+
+private:
+    /* State block of both columns (variables x RK stages), has to be initialized first */
+    State_Block		state;
+
+    /* Link both modules */
+    void	connect		(void) {Cortex.get_Thalamus(Thalamus); Thalamus.get_Cortex(Cortex);}
+
+public:
+    /* Column models as views into the state block */
+    Cortical_Column	Cortex;
+    Thalamic_Column	Thalamus;
+
+    /* Seed of the noise streams, only changed by reseed */
+    std::uint64_t	seed;
+};
@@ -0,0 +1,234 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/* Microbenchmarks of the integrator hot paths								  */
+/*	TC_bench [--filter name] [--repetitions n] [--min-time s] [--json file]	  */
+/*			 [--compare file] [--threshold r]								  */
+/* --json writes the results, --compare reports the ratio to the medians of	  */
+/* an earlier --json file and exits with 2 if a benchmark is slower by more	  */
+/* than the relative threshold (default 0.1).								  */
+/******************************************************************************/
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "CSR_Matrix.h"
+#include "Data_Storage.h"
+#include "Noise_Buffer.h"
+#include "ODE.h"
+#include "Recorder.h"
+#include "Stim_Scheduler.h"
+#include "Stimulation.h"
+#include "TC_Ensemble.h"
+#include "TC_Network.h"
+#include "TC_System.h"
+
+/******************************************************************************/
+/*                          Fixed simulation settings						  */
+/******************************************************************************/
+extern const int onset	= 0;		/* Time until stimulation starts in s	  */
+extern const int res 	= 1E4;		/* Number of iteration steps per s		  */
+extern const int red 	= 1E2;		/* Number of iterations steps not saved	  */
+extern const double dt 	= 1E3/res;	/* Duration of a time step in ms		  */
+extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
+
+/******************************************************************************/
+/*                              Benchmarks									  */
+/******************************************************************************/
+static void run_all (Benchmark& B) {
+    /* Every batch starts from a copy of the same state in N3 sleep */
+    TC_System Trunk(Parameters_N3, 1);
+    for (int t=0; t < 2*res; ++t) {
+        ODE(Trunk);
+    }
+    std::unique_ptr<TC_System> S;
+    auto copy = [&] {S.reset(new TC_System(Trunk));};
+
+    /* Parts of an integration step */
+    B.run("Cortical_Column::set_RK", "step", true, copy, [&] {
+        for (int i=0; i < 4; ++i) {
+            S->Cortex.set_RK(i);
+        }
+    });
+    B.run("Thalamic_Column::set_RK", "step", true, copy, [&] {
+        for (int i=0; i < 4; ++i) {
+            S->Thalamus.set_RK(i);
+        }
+    });
+    B.run("Cortical_Column::add_RK", "step", true, copy, [&] {S->Cortex.add_RK();});
+    B.run("Thalamic_Column::add_RK", "step", true, copy, [&] {S->Thalamus.add_RK();});
+
+    /* Full coupled step */
+    B.run("ODE SRK4", "step", true, copy, [&] {ODE(*S);});
+    B.run("ODE exponential", "step", true, [&] {copy(); S->set_integrator(Integrator::Exponential);},
+          [&] {ODE(*S);});
+
+    /* Ensemble step of all lanes, per lane it compares with ODE SRK4 */
+    std::unique_ptr<TC_Ensemble> E;
+    for (unsigned K : {8, 32}) {
+        std::vector<double> Param_Cortex, Param_Thalamus, Connectivity;
+        for (unsigned l=0; l < K; ++l) {
+            Param_Cortex.insert	 (Param_Cortex.end(),	Parameters_N3.Cortex,		Parameters_N3.Cortex + 3);
+            Param_Thalamus.insert(Param_Thalamus.end(),	Parameters_N3.Thalamus,		Parameters_N3.Thalamus + 2);
+            Connectivity.insert	 (Connectivity.end(),	Parameters_N3.Connectivity,	Parameters_N3.Connectivity + 4);
+        }
+        B.run("TC_Ensemble ODE " + std::to_string(K) + " lanes", "step", true,
+              [&] {E.reset(new TC_Ensemble(K, Param_Cortex.data(), Param_Thalamus.data(), Connectivity.data(),
+                                           nullptr, 1));},
+              [&] {ODE(*E);});
+    }
+
+    /* Network of 10k column pairs with 8 cortical neighbours each, one	*/
+    /* benchmark per thread count up to the number of cores. Consecutive	*/
+    /* steps continue the same network, its construction is not timed		*/
+    const unsigned num_columns = 10000;
+    std::vector<CSR_Matrix::Entry> ring;
+    for (unsigned i=0; i < num_columns; ++i) {
+        for (unsigned d=1; d <= 4; ++d) {
+            ring.push_back(CSR_Matrix::Entry{i, (i + d) % num_columns, 0.125, 0});
+            ring.push_back(CSR_Matrix::Entry{i, (i + num_columns - d) % num_columns, 0.125, 0});
+        }
+    }
+    const CSR_Matrix W_CC(num_columns, num_columns, ring);
+    const CSR_Matrix W_CT = CSR_Matrix::identity(num_columns);
+    const std::vector<Parameter_Set> Params(num_columns, Parameters_N3);
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> thread_counts;
+    for (unsigned threads=1; threads < cores; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(cores);
+    for (unsigned threads : thread_counts) {
+        const std::string name = "TC_Network 10k columns " + std::to_string(threads) + " threads";
+        if (!B.selected(name)) {
+            continue;
+        }
+        TC_Network Network(Params, Params, W_CC, W_CT, W_CT, 1, threads);
+        B.run(name, "step", true, [] {}, [&] {Network.run(1);});
+    }
+
+    /* Noise generation */
+    std::unique_ptr<Noise_Buffer> Buffer;
+    B.run("Noise_Buffer", "draw", false, [&] {Buffer.reset(new Noise_Buffer(0, 1, 1, 0, 0, false));},
+          [&] {do_not_optimize((*Buffer)());});
+    std::unique_ptr<randomStreamNormal> Stream;
+    B.run("randomStreamNormal", "draw", false, [&] {Stream.reset(new randomStreamNormal(0, 1, 1, 0));},
+          [&] {do_not_optimize((*Stream)());});
+
+    /* Stimulation protocols, ISI of 1 s so events occur within a batch */
+    std::unique_ptr<Stim> Stimulation;
+    int time = 0;
+    for (double mode : {1, 2}) {
+        std::vector<double> var_stim = {mode, 60, 100, 1, 0, 2, 200, 400};
+        B.run(mode == 1 ? "Stim::check_stim semi-periodic" : "Stim::check_stim phase", "step", true,
+              [&] {copy(); Stimulation.reset(new Stim(*S, var_stim.data())); time = 0;},
+              [&] {Stimulation->check_stim(time++);});
+    }
+    std::unique_ptr<Stim_Scheduler> Scheduler;
+    std::uint64_t step = 0;
+    B.run("Stim_Scheduler::advance periodic", "step", true,
+          [&] {copy(); Scheduler.reset(new Stim_Scheduler(*S, 0));
+               Scheduler->add(Stim_Protocol::periodic(Stim_Target::Thalamus, 60, 100, 1, 0, 2, 200)); step = 0;},
+          [&] {Scheduler->advance(step++);});
+
+    /* Data storage */
+    const unsigned length = 1 << 16;
+    std::vector<std::vector<double>> data(4, std::vector<double>(length));
+    std::vector<double*> pData = {data[0].data(), data[1].data(), data[2].data(), data[3].data()};
+    unsigned counter = 0;
+    B.run("get_data", "step", true, copy, [&] {
+        get_data(counter, S->Cortex, S->Thalamus, pData);
+        counter = (counter + 1) % length;
+    });
+    std::unique_ptr<Recorder> Rec;
+    B.run("Recorder::sample", "step", true,
+          [&] {copy(); Rec.reset(new Recorder(*S)); step = 0;
+               for (const std::string& name : data_names()) {
+                   Rec->add(name, res/red);
+               }},
+          [&] {Rec->sample(step++);});
+}
+
+/******************************************************************************/
+/*                              Main routine								  */
+/******************************************************************************/
+int main(int argc, char* argv[]) {
+    std::string filter, json, baseline;
+    unsigned	repetitions = 31;
+    double		min_time	= 2E-3;
+    double		threshold	= 0.1;
+    for (int i=1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "missing value of " << arg << "\n";
+            return 1;
+        }
+        const std::string value = argv[++i];
+        if		(arg == "--filter")			{filter		 = value;}
+        else if (arg == "--repetitions")	{repetitions = std::atoi(value.c_str());}
+        else if (arg == "--min-time")		{min_time	 = std::atof(value.c_str());}
+        else if (arg == "--json")			{json		 = value;}
+        else if (arg == "--compare")		{baseline	 = value;}
+        else if (arg == "--threshold")		{threshold	 = std::atof(value.c_str());}
+        else {
+            std::cerr << "unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    try {
+        Benchmark B(repetitions, min_time, filter);
+        run_all(B);
+        if (!json.empty()) {
+            std::ofstream output(json);
+            if (!output) {
+                throw std::runtime_error("cannot create " + json);
+            }
+            B.write_json(output);
+        }
+        if (!baseline.empty() && B.compare(std::cout, baseline, threshold) > 0) {
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+/****************************************************************************************************/
+/*										 		end													*/
+/****************************************************************************************************/
@@ -0,0 +1,234 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/* Consistency checks of the simulation components							  */
+/*	TC_check [name]															  */
+/* Runs every check, or those whose name contains the argument, prints one	  */
+/* line per check and exits with 1 if any of them failed.					  */
+/******************************************************************************/
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "Event_Detection.h"
+#include "ODE.h"
+#include "Parameter_Sets.h"
+#include "Recorder.h"
+#include "Stim_Scheduler.h"
+#include "Stimulation.h"
+#include "TC_System.h"
+
+/******************************************************************************/
+/*                          Fixed simulation settings						  */
+/******************************************************************************/
+extern const int onset	= 2;		/* Time until stimulation starts in s	  */
+extern const int res 	= 1E4;		/* Number of iteration steps per s		  */
+extern const int red 	= 1E2;		/* Number of iterations steps not saved	  */
+extern const double dt 	= 1E3/res;	/* Duration of a time step in ms		  */
+extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
+
+/******************************************************************************/
+/*								Stimulation									  */
+/******************************************************************************/
+/* Markers of a var_stim protocol are those of Stim, and so is the recorded Vp */
+static bool scheduler_matches_stim (std::vector<double> var_stim, int T, std::string& detail) {
+    const std::uint64_t Time = (std::uint64_t) (onset + T)*res;
+    TC_System A(Parameters_N3, 7), B(Parameters_N3, 7);
+    Recorder Rec_A(A, 0, Time), Rec_B(B, 0, Time);
+    Rec_A.add("Vp", res/red);
+    Rec_B.add("Vp", res/red);
+    Stim Reference(A, var_stim.data());
+    Stim_Scheduler Scheduler(B, (std::uint64_t) onset*res);
+    Scheduler.add(Stim_Protocol::from_var_stim(var_stim.data(), var_stim.size()));
+
+    for (std::uint64_t t=0; t < Time; ++t) {
+        ODE (A);
+        Reference.check_stim(t);
+        Rec_A.sample(t);
+        ODE (B);
+        if (Scheduler.due(t)) {
+            Scheduler.advance(t);
+        }
+        Rec_B.sample(t);
+    }
+    detail = std::to_string(Reference.get_markers().size()) + " markers";
+    return !Reference.get_markers().empty() && Reference.get_markers() == Scheduler.get_markers(0) &&
+           Rec_A.data(0) == Rec_B.data(0);
+}
+
+static bool scheduler_periodic (std::string& detail) {
+    return scheduler_matches_stim({1, 60, 100, 3, 1, 2, 200, 0}, 60, detail);
+}
+
+static bool scheduler_phase (std::string& detail) {
+    return scheduler_matches_stim({2, 70, 80, 5, 0, 2, 1050, 450}, 60, detail);
+}
+
+/* A run continued from a checkpoint of the scheduler is the uninterrupted run */
+static bool scheduler_checkpoint (std::string& detail) {
+    const std::string file = "TC_check.ckp";
+    const std::uint64_t Half = (std::uint64_t) (onset + 20)*res, Time = (std::uint64_t) (onset + 40)*res;
+    const std::vector<Stim_Protocol> protocols = {
+        Stim_Protocol::from_var_stim(std::vector<double>{2, 70, 80, 5, 0, 2, 1050, 450, 0}.data()),
+        Stim_Protocol::from_var_stim(std::vector<double>{1, 40, 50, 3, 1, 1, 0, 0, 1}.data())};
+
+    TC_System A(Parameters_N3, 11), B(Parameters_N3, 12);
+    /* The filters of the recorders settle within a second after the restart */
+    Recorder Rec_A(A, Half + res, Time), Rec_B(B, Half + res, Time);
+    Rec_A.add("Vp", res/red);
+    Rec_B.add("Vp", res/red);
+    Stim_Scheduler Full(A, (std::uint64_t) onset*res), Continued(B, (std::uint64_t) onset*res);
+    for (const Stim_Protocol& P : protocols) {
+        Full.add(P);
+    }
+    for (std::uint64_t t=0; t < Time; ++t) {
+        ODE (A);
+        if (Full.due(t)) {
+            Full.advance(t);
+        }
+        Rec_A.sample(t);
+        if (t+1 == Half) {
+            Checkpoint::save(file, A, &Full, Half);
+        }
+    }
+
+    const std::uint64_t begin = Checkpoint::load(file, B, &Continued).step;
+    std::remove(file.c_str());
+    for (std::uint64_t t=begin; t < Time; ++t) {
+        ODE (B);
+        if (Continued.due(t)) {
+            Continued.advance(t);
+        }
+        Rec_B.sample(t);
+    }
+    detail = std::to_string(Full.get_markers(0).size()) + " + " + std::to_string(Full.get_markers(1).size()) + " markers";
+    return Continued.size() == 2 && Full.get_markers(0) == Continued.get_markers(0) &&
+           Full.get_markers(1) == Continued.get_markers(1) && Rec_A.data(0) == Rec_B.data(0);
+}
+
+/* Closed loop stimulation of a 1 Hz sinusoid hits the target phase */
+static bool scheduler_closed_loop (std::string& detail) {
+    const double target = M_PI/2, frequency = 1;
+    const std::uint64_t Time = (std::uint64_t) (onset + 60)*res;
+    double V = 0, cortical_input = 0, thalamic_input = 0;
+    Stim_Scheduler Scheduler(&V, &cortical_input, &thalamic_input, (std::uint64_t) onset*res, 3);
+    Scheduler.add(Stim_Protocol::from_var_stim(std::vector<double>{3, 50, 50, 2, target, 1, 0, 20, 0}.data()));
+
+    /* Phase 0 is the peak */
+    auto phase = [frequency] (std::uint64_t t) {return wrap_phase(2*M_PI*frequency*t/res);};
+    for (std::uint64_t t=0; t < Time; ++t) {
+        V = -60 + 10*std::cos(phase(t));
+        if (Scheduler.due(t)) {
+            Scheduler.advance(t);
+        }
+    }
+    Scheduler.flush();
+
+    /* The achieved phases are those of the sinusoid at the markers */
+    double deviation = 0;
+    for (const Stim_Scheduler::Phase_Record& R : Scheduler.get_phases(0)) {
+        deviation = std::max(deviation, std::fabs(wrap_phase(R.achieved - phase(R.marker + onset*res))));
+    }
+    const Phase_Statistics Error = Scheduler.get_phase_error(0);
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "%u stimuli, mean error %.3f rad, R %.4f, reference %.3f rad",
+                  Error.N, Error.mean, Error.resultant, deviation);
+    detail = buffer;
+    return Error.N >= 15 && Error.N == Scheduler.get_markers(0).size() && std::fabs(Error.mean) < 0.05 &&
+           Error.resultant > 0.99 && deviation < 0.05;
+}
+
+/******************************************************************************/
+/*								Event detection								  */
+/******************************************************************************/
+/* Peaks of a signal of triangles with the given apexes, distances in samples */
+static std::vector<std::uint64_t> find_peaks (const std::vector<std::pair<std::uint64_t, double>>& apexes,
+                                              double min_distance) {
+    std::vector<double> x(apexes.back().first + 20, 0.0);
+    for (const auto& apex : apexes) {
+        for (std::uint64_t i=0; i < x.size(); ++i) {
+            const double distance = i > apex.first ? i - apex.first : apex.first - i;
+            x[i] = std::max(x[i], apex.second - 0.1*distance);
+        }
+    }
+    Peak_Detector Detector(0.5, min_distance);
+    for (std::uint64_t i=0; i < x.size(); ++i) {
+        Detector.push(i, x[i]);
+    }
+    Detector.flush();
+    return Detector.peaks();
+}
+
+/* As findpeaks, peaks exactly d apart exclude each other, d+1 apart do not */
+static bool peak_distance (std::string& detail) {
+    const std::vector<std::uint64_t> apart		= find_peaks({{100, 2}, {150, 1}}, 50);
+    const std::vector<std::uint64_t> further	= find_peaks({{100, 2}, {151, 1}}, 50);
+    const std::vector<std::uint64_t> chained	= find_peaks({{100, 1}, {150, 2}, {200, 1.5}, {251, 3}}, 50);
+    detail = std::to_string(apart.size()) + ", " + std::to_string(further.size()) + " and " +
+             std::to_string(chained.size()) + " peaks";
+    return apart == std::vector<std::uint64_t>{100} && further == std::vector<std::uint64_t>{100, 151} &&
+           chained == std::vector<std::uint64_t>{150, 251};
+}
+
+/******************************************************************************/
+/*								Check runner								  */
+/******************************************************************************/
+struct Check {
+    const char*								name;
+    std::function<bool (std::string&)>		run;
+};
+
+int main (int argc, char* argv[]) {
+    const std::vector<Check> checks = {
+        {"Stim_Scheduler var_stim periodic",	scheduler_periodic},
+        {"Stim_Scheduler var_stim phase",		scheduler_phase},
+        {"Stim_Scheduler checkpoint",			scheduler_checkpoint},
+        {"Stim_Scheduler closed loop",			scheduler_closed_loop},
+        {"Peak_Detector distance",				peak_distance},
+    };
+
+    const std::string filter = argc > 1 ? argv[1] : "";
+    unsigned failed = 0;
+    for (const Check& C : checks) {
+        if (std::string(C.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        std::string detail;
+        bool passed = false;
+        try {
+            passed = C.run(detail);
+        } catch (const std::exception& e) {
+            detail = e.what();
+        }
+        failed += !passed;
+        std::printf("%-40s %s  %s\n", C.name, passed ? "ok  " : "FAIL", detail.c_str());
+    }
+    std::printf("%s\n", failed ? "FAILED" : "PASSED");
+    return failed ? 1 : 0;
+}
@@ -30,23 +30,61 @@
 
 /******************************************************************************/
 /* Implementation of the simulation as MATLAB routine (mex compiler)		  */
+/* [Vp, Vt, Ca, ah, Marker_Stim, seed, Rec, Phases] = TC_mex(T, Param_Cortex, */
+/*		Param_Thalamus, Connectivity, var_stim, seed, file, channels,		  */
+/*		restore, checkpoint)												  */
+/* seed is optional and defaults to the current time, the returned seed is	  */
+/* the one that was used													  */
+/* var_stim is a vector of 8 or 9 values, see Stim_Protocol::from_var_stim,   */
+/* or a matrix with one such vector per column for protocols that run at the  */
+/* same time, Marker_Stim is then a cell array with the markers per protocol  */
+/* Phases is a struct array with one entry per protocol, for closed loop		  */
+/* protocols (mode 3) it holds the marker, predicted and achieved phase of	  */
+/* each stimulus, phase_error with N, mean, resultant and sd of the achieved  */
+/* minus the target phase and the latency of the phase estimate in ms		  */
+/* The time series are low pass filtered before they are decimated to res/red */
+/* If a file name is given the time series are appended to that chunk file	  */
+/* while the simulation runs and Vp, Vt, Ca and ah are returned empty		  */
+/* channels is an optional cell array {name, rate; ...} of further variables  */
+/* with their rate in Hz, see Recorder::variables, file may be [] then. They  */
+/* are returned in the struct array Rec with the fields name, rate and data	  */
+/* restore is an optional checkpoint file, the onset is skipped then. With	  */
+/* an empty var_stim the run continues the stored step count and protocols,   */
+/* so chained calls simulate exactly one long call, only the filters of the   */
+/* recorded series restart. The noise then continues with the stored seed,	  */
+/* a different explicit seed is an error. Otherwise the new protocol starts	  */
+/* as after the onset with the noise of seed, e.g. on an equilibrated state.  */
+/* checkpoint is an optional file the state is stored in after the last		  */
+/* recorded step, T = 0 only simulates the onset							  */
+/* Compiled with -DNM_TC_PROFILE the time per phase of the loop is printed	  */
+/* as JSON, see Profiler.h													  */
 /* mex command is given by:													  */
-/* mex CXXFLAGS="\$CXXFLAGS -std=c++11 -O3" TC_mex.cpp Cortical_Column.cpp    */
-/*                                          Thalamic_Column.cpp               */
+/* mex CXXFLAGS="\$CXXFLAGS -std=c++11 -O3 -fopenmp-simd -fno-math-errno	  */
+/*     -fno-trapping-math -ffp-contract=off -pthread"						  */
+/*     LDFLAGS="\$LDFLAGS -pthread"											  */
+/*     TC_mex.cpp Cortical_Column.cpp TC_Ensemble.cpp Thalamic_Column.cpp	  */
 /******************************************************************************/
 #include "mex.h"
 #include "matrix.h"
 
+#include <algorithm>
+#include <ctime>
 #include <iterator>
+#include <memory>
+#include <string>
 #include <vector>
 
-#include "Cortical_Column.h"
+#include "Checkpoint.h"
 #include "Data_Storage.h"
 #include "ODE.h"
-#include "Stimulation.h"
-#include "Thalamic_Column.h"
+#include "Profiler.h"
+#include "Recorder.h"
+#include "Stim_Scheduler.h"
+#include "TC_System.h"
 mxArray* GetMexArray(int N, int M);
-mxArray* get_marker(Stim &stim);
+mxArray* GetMexArray(const std::vector<double>& data);
+mxArray* get_marker(const std::vector<int>& markers, size_t skip = 0, std::uint64_t offset = 0);
+mxArray* get_phases(const Stim_Scheduler& Stimulation, std::uint64_t offset = 0);
 
 /******************************************************************************/
 /*                          Fixed simulation settings						  */
@@ -63,60 +101,190 @@ extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
 /*								rhs defines inputs							  */
 /******************************************************************************/
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-    /* Initialize the seeder */
-    srand(time(NULL));
-
     /* Fetch inputs */
     const int T				= (int) (mxGetScalar(prhs[0]));	/* Duration of simulation in s			*/
-    const int Time 			= (T+onset)*res;				/* Total number of iteration steps		*/
     double* Param_Cortex	= mxGetPr (prhs[1]);			/* Parameters of cortical module		*/
     double* Param_Thalamus	= mxGetPr (prhs[2]);			/* Parameters of thalamic module		*/
     double* Connections		= mxGetPr (prhs[3]);			/* Connectivity values C <-> T			*/
-    double* var_stim	 	= mxGetPr (prhs[4]);			/* Parameters of stimulation protocol	*/
+    const bool one_stim		= mxGetM(prhs[4]) == 1 || mxGetN(prhs[4]) == 1;	/* Protocols, one per column	*/
+    const size_t stim_width	= one_stim ? mxGetNumberOfElements(prhs[4]) : mxGetM(prhs[4]);
+    const size_t num_stim	= mxIsEmpty(prhs[4]) ? 0 : one_stim ? 1 : mxGetN(prhs[4]);
+    const bool has_seed		= nrhs > 5 && !mxIsEmpty(prhs[5]);
+    const std::uint64_t seed= has_seed ? (std::uint64_t) mxGetScalar(prhs[5]) : time(NULL);
+    const bool to_file		= nrhs > 6 && mxIsChar(prhs[6]);			/* Store in a chunk file				*/
+    const bool restore		= nrhs > 8 && mxIsChar(prhs[8]);			/* Start from a checkpoint				*/
+    const bool checkpoint	= nrhs > 9 && mxIsChar(prhs[9]);			/* Store a checkpoint at the end		*/
 
-    /* Initialize the populations */
-    Cortical_Column Cortex	 = Cortical_Column(Param_Cortex,   Connections);
-    Thalamic_Column Thalamus = Thalamic_Column(Param_Thalamus, Connections);
+    /* Initialize the coupled populations */
+    TC_System System(Param_Cortex, Param_Thalamus, Connections, seed);
 
-    /* Link both modules */
-    Cortex.get_Thalamus(Thalamus);
-    Thalamus.get_Cortex(Cortex);
+    /* Initialize the stimulation protocols, markers are counted from the onset */
+    Stim_Scheduler Stimulation(System, (std::uint64_t) onset*res);
+    try {
+        std::vector<double> var_stim(Stim_Protocol::var_stim_size, 0.0);
+        if (num_stim) {
+            var_stim = Stim_Protocol::widen_var_stim(mxGetPr(prhs[4]), stim_width, num_stim);
+        }
+        for (const Stim_Protocol& P : Stim_Protocol::from_var_stim(var_stim)) {
+            Stimulation.add(P);
+        }
+    } catch (const std::exception& e) {
+        mexErrMsgTxt(e.what());
+    }
 
-    /* Initialize the stimulation protocol */
-    Stim Stimulation(Cortex, Thalamus, var_stim);
+    /* Restore the state, the step count and protocol only when continuing it */
+    std::uint64_t begin = 0;
+    if (restore) {
+        const bool resume = mxIsEmpty(prhs[4]);
+        char* file = mxArrayToString(prhs[8]);
+        const std::string name(file);
+        mxFree(file);
+        try {
+            const Checkpoint_Header header = Checkpoint::load(name, System, resume ? &Stimulation : nullptr, resume);
+            if (resume && has_seed && header.seed != seed) {
+                throw std::invalid_argument("TC_mex: seed differs from the one of checkpoint " + name);
+            }
+            begin = resume ? header.step : onset*res;
+        } catch (const std::exception& e) {
+            mexErrMsgTxt(e.what());
+        }
+    }
+    std::vector<size_t> numMarkers;
+    for (unsigned i=0; i < Stimulation.size(); ++i) {
+        numMarkers.push_back(Stimulation.get_markers(i).size());
+    }
 
-    /* Create data containers */
-    std::vector<mxArray*> dataArray;
-    dataArray.reserve(4);
-    dataArray.push_back(GetMexArray(1, T*res/red));	// Vt
-    dataArray.push_back(GetMexArray(1, T*res/red));	// Vr
-    dataArray.push_back(GetMexArray(1, T*res/red));	// Ca
-    dataArray.push_back(GetMexArray(1, T*res/red));	// act_h
-
-    /* Pointer to the data blocks */
-    std::vector<double*> dataPointer;
-    dataPointer.reserve(dataArray.size());
-    for (mxArray* dataptr : dataArray) {
-        dataPointer.push_back(mxGetPr(dataptr));
+    /* Recorded steps [first, Time) */
+    const std::uint64_t first = std::max(begin, (std::uint64_t) onset*res);
+    const std::uint64_t Time  = first + (std::uint64_t) T*res;
+
+    /* Store a checkpoint after the last recorded step */
+    auto save = [&] (std::uint64_t step) {
+        char* file = mxArrayToString(prhs[9]);
+        const std::string name(file);
+        mxFree(file);
+        try {
+            Checkpoint::save(name, System, &Stimulation, step);
+        } catch (const std::exception& e) {
+            mexErrMsgTxt(e.what());
+        }
+    };
+    if (checkpoint && Time == begin) {
+        save(begin);
     }
 
-    /* Simulation */
-    int count = 0;
-    for (unsigned t=0; t < Time; ++t) {
-        ODE (Cortex, Thalamus);
-        Stimulation.check_stim(t);
-        if(t >= onset*res && t%red == 0){
-            get_data(count, Cortex, Thalamus, dataPointer);
-            ++count;
+    /* Recorder of the stored variables and the requested channels */
+    Recorder Rec(System, first, Time);
+    for (const std::string& name : data_names()) {
+        Rec.add(name, res/red);
+    }
+    const unsigned numData = Rec.size();
+    if (nrhs > 7 && mxIsCell(prhs[7])) {
+        const size_t numChannels = mxGetM(prhs[7]);
+        if (mxGetN(prhs[7]) != 2) {
+            mexErrMsgTxt("TC_mex: channels has to be a cell array {name, rate; ...}");
+        }
+        for (size_t i=0; i < numChannels; ++i) {
+            char* name = mxArrayToString(mxGetCell(prhs[7], i));
+            const mxArray* rate = mxGetCell(prhs[7], i + numChannels);
+            const std::string variable(name ? name : "");
+            mxFree(name);
+            try {
+                Rec.add(variable, rate ? mxGetScalar(rate) : 0.0);
+            } catch (const std::exception& e) {
+                mexErrMsgTxt(e.what());
+            }
+        }
+    }
+
+    /* Output file with bounded memory */
+    std::unique_ptr<Chunk_Writer> Output;
+    if (to_file) {
+        char* file = mxArrayToString(prhs[6]);
+        const std::string name(file);
+        mxFree(file);
+        try {
+            Output.reset(new Chunk_Writer(name, data_names(), res/red,
+                                          data_parameters(Param_Cortex, Param_Thalamus, Connections),
+                                          {System.seed}));
+        } catch (const std::exception& e) {
+            mexErrMsgTxt(e.what());
+        }
+    }
+
+    /* Simulation, continued until the filters have passed the last stored step */
+    const std::uint64_t numSteps = Time + Rec.delay();
+#ifdef NM_TC_PROFILE
+    Profiler::get().reset();
+#endif
+    for (std::uint64_t t=begin; t < numSteps; ++t) {
+        ODE (System);
+        if (t < Time && Stimulation.due(t)) {
+            NM_TC_PROFILE_SCOPE("stimulation");
+            Stimulation.advance(t);
+        }
+        if (checkpoint && t+1 == Time) {
+            NM_TC_PROFILE_SCOPE("checkpoint");
+            save(Time);
+        }
+        {
+            NM_TC_PROFILE_SCOPE("recording");
+            Rec.sample(t);
+        }
+        if (Output) {
+            NM_TC_PROFILE_SCOPE("output");
+            get_data(*Output, Rec);
         }
     }
+    Output.reset();
+#ifdef NM_TC_PROFILE
+    mexPrintf("%s", Profiler::get().json().c_str());
+#endif
+
+    /* Create data containers, they stay empty if the data went to a file */
+    std::vector<mxArray*> dataArray;
+    dataArray.reserve(numData);
+    for (unsigned i=0; i < numData; ++i) {
+        dataArray.push_back(GetMexArray(Rec.data(i)));
+    }
 
     /* Return the data containers */
     size_t numOutputs = 0;
     for (mxArray* dataptr : dataArray) {
         plhs[numOutputs++] = dataptr;
     }
-    plhs[numOutputs++] = get_marker(Stimulation);
+    if (num_stim <= 1 && Stimulation.size() == 1) {
+        plhs[numOutputs++] = get_marker(Stimulation.get_markers(0), numMarkers[0], first - onset*res);
+    } else {
+        mxArray* markers = mxCreateCellMatrix(1, Stimulation.size());
+        for (unsigned i=0; i < Stimulation.size(); ++i) {
+            mxSetCell(markers, i, get_marker(Stimulation.get_markers(i), numMarkers[i], first - onset*res));
+        }
+        plhs[numOutputs++] = markers;
+    }
+
+    /* The seed reproduces the run when passed back in */
+    if (nlhs > (int) numOutputs) {
+        plhs[numOutputs++] = mxCreateDoubleScalar(System.seed);
+    }
+
+    /* The further channels */
+    if (nlhs > (int) numOutputs) {
+        const char* fields[] = {"name", "rate", "data"};
+        mxArray* channels = mxCreateStructMatrix(1, Rec.size() - numData, 3, fields);
+        for (unsigned i=numData; i < Rec.size(); ++i) {
+            mxSetField(channels, i - numData, "name", mxCreateString(Rec.name(i).c_str()));
+            mxSetField(channels, i - numData, "rate", mxCreateDoubleScalar(Rec.rate(i)));
+            mxSetField(channels, i - numData, "data", GetMexArray(Rec.data(i)));
+        }
+        plhs[numOutputs++] = channels;
+    }
+
+    /* Phases of the closed loop protocols */
+    if (nlhs > (int) numOutputs) {
+        Stimulation.flush();
+        plhs[numOutputs++] = get_phases(Stimulation, first - onset*res);
+    }
 
     return;
 }
@@ -132,17 +300,58 @@ mxArray* GetMexArray(int N, int M) {
     return Array;
 }
 
-mxArray* get_marker(Stim &stim) {
+mxArray* GetMexArray(const std::vector<double>& data) {
+    mxArray* Array	= GetMexArray(1, data.size());
+    std::copy(data.begin(), data.end(), mxGetPr(Array));
+    return Array;
+}
+
+/* Markers after the first skip ones, relative to offset steps after the onset */
+mxArray* get_marker(const std::vector<int>& markers, size_t skip, std::uint64_t offset) {
     extern const int red;
+    const size_t numMarkers = markers.size() - skip;
     mxArray* marker	= mxCreateDoubleMatrix(0, 0, mxREAL);
     mxSetM(marker, 1);
-    mxSetN(marker, stim.marker_stimulation.size());
-    mxSetData(marker, mxMalloc(sizeof(double)*stim.marker_stimulation.size()));
+    mxSetN(marker, numMarkers);
+    mxSetData(marker, mxMalloc(sizeof(double)*numMarkers));
     double* Pr_Marker = mxGetPr(marker);
     unsigned counter  = 0;
     /* Division by res transforms marker time from dt to sampling rate */
-    for(auto & elem : stim.marker_stimulation) {
-        Pr_Marker[counter++] = elem/red;
+    for(size_t i=skip; i < markers.size(); ++i) {
+        Pr_Marker[counter++] = (markers[i] - (std::int64_t) offset)/red;
     }
     return marker;
 }
+
+/* Phase records and their statistics per protocol, empty unless closed loop */
+mxArray* get_phases(const Stim_Scheduler& Stimulation, std::uint64_t offset) {
+    extern const int red;
+    extern const double dt;
+    const char* fields[]		= {"marker", "predicted", "achieved", "phase_error", "latency"};
+    const char* statistics[]	= {"N", "mean", "resultant", "sd"};
+    mxArray* phases = mxCreateStructMatrix(1, Stimulation.size(), 5, fields);
+    for (unsigned i=0; i < Stimulation.size(); ++i) {
+        if (Stimulation.get_protocol(i).kind != Stim_Protocol::Closed_Loop) {
+            continue;
+        }
+        const std::vector<Stim_Scheduler::Phase_Record>& records = Stimulation.get_phases(i);
+        std::vector<double> marker, predicted, achieved;
+        for (const Stim_Scheduler::Phase_Record& R : records) {
+            marker.push_back((R.marker - (std::int64_t) offset)/red);
+            predicted.push_back(R.predicted);
+            achieved.push_back(R.achieved);
+        }
+        const Phase_Statistics S = Stimulation.get_phase_error(i);
+        mxArray* error = mxCreateStructMatrix(1, 1, 4, statistics);
+        mxSetField(error, 0, "N",			mxCreateDoubleScalar(S.N));
+        mxSetField(error, 0, "mean",		mxCreateDoubleScalar(S.mean));
+        mxSetField(error, 0, "resultant",	mxCreateDoubleScalar(S.resultant));
+        mxSetField(error, 0, "sd",			mxCreateDoubleScalar(S.sd));
+        mxSetField(phases, i, "marker",		 GetMexArray(marker));
+        mxSetField(phases, i, "predicted",	 GetMexArray(predicted));
+        mxSetField(phases, i, "achieved",	 GetMexArray(achieved));
+        mxSetField(phases, i, "phase_error", error);
+        mxSetField(phases, i, "latency",	 mxCreateDoubleScalar(Stimulation.get_latency(i) * dt));
+    }
+    return phases;
+}
@@ -0,0 +1,331 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/* Simulation of a network of thalamocortical modules						  */
+/*	TC_network_sim config													  */
+/* The config file holds lines key = value:									  */
+/*	T, onset	recorded duration and unrecorded onset in s (20)			  */
+/*	seed, threads	seed of the noise and threads, 0 uses all cores			  */
+/*	cortex		file with one row per cortical module: sigma_p g_KNa dphi	  */
+/*				N_tp N_rp N_pt N_it, or N2 n / N3 n for n equal modules		  */
+/*	thalamus	file with one row per thalamic module: g_LK g_h				  */
+/*				N_tp N_rp N_pt N_it, or N2 n / N3 n							  */
+/*	W_CC, W_CT, W_TC	coupling matrices in Matrix Market format, see		  */
+/*				TC_Network.h, W_CC may be omitted							  */
+/*	D_CC, D_CT, D_TC	optional delays in ms at the positions of the weights */
+/*	rate		samples per s of the recorded outputs (100)					  */
+/*	record		a variable of nm_tc.variables and the modules to record,	  */
+/*				indices from 0 and ranges a-b, all modules if none are given  */
+/*	output		MAT-file of the outputs (TC_network_sim.mat)				  */
+/* Every record line stores the variable as modules x samples matrix and the  */
+/* recorded modules, counted from 1, as <variable>_modules. The outputs are	  */
+/* anti-aliased by a Recorder per module.									  */
+/******************************************************************************/
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CSR_Matrix.h"
+#include "Mat_File.h"
+#include "Parameter_Sets.h"
+#include "Recorder.h"
+#include "TC_Network.h"
+
+/******************************************************************************/
+/*                          Fixed simulation settings						  */
+/******************************************************************************/
+extern const int res 	= 1E4;		/* Number of iteration steps per s		  */
+extern const int red 	= 1E2;		/* Number of iterations steps not saved	  */
+extern const double dt 	= 1E3/res;	/* Duration of a time step in ms		  */
+extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
+
+/******************************************************************************/
+/*								Configuration								  */
+/******************************************************************************/
+/* Variable and modules of a record line */
+struct Output {
+    std::string				variable;
+    std::vector<unsigned>	modules;
+};
+
+struct Network_Config {
+    /* Recorded duration and onset in s */
+    int								T		= 0;
+    int								onset	= 20;
+
+    std::uint64_t					seed	= time(NULL);
+
+    /* Worker threads, 0 uses all hardware threads */
+    unsigned						threads	= 0;
+
+    /* Parameters of every module */
+    std::vector<Parameter_Set>		Param_Cortex;
+    std::vector<Parameter_Set>		Param_Thalamus;
+
+    /* Matrix Market files of the weights and their delays by name */
+    std::map<std::string, std::string> matrices;
+
+    /* Samples per s of every output */
+    double							rate	= res/red;
+
+    /* Record lines, the modules are resolved after all modules are known */
+    std::vector<std::string>		records;
+    std::vector<Output>				outputs;
+
+    std::string						output	= "TC_network_sim.mat";
+};
+
+/* Modules of a parameter file, every row holds the varied parameters of the	*/
+/* population followed by the connectivity. N2 n and N3 n repeat a set n times */
+static std::vector<Parameter_Set> get_modules (const std::string& key, const std::string& value, bool cortex) {
+    std::istringstream words(value);
+    std::string stage;
+    long count = 0;
+    if (words >> stage >> count && (stage == "N2" || stage == "N3")) {
+        if (count <= 0) {
+            throw std::invalid_argument("config: " + key + " needs a positive number of modules");
+        }
+        return std::vector<Parameter_Set>(count, stage == "N2" ? Parameters_N2 : Parameters_N3);
+    }
+
+    std::ifstream in(value);
+    if (!in) {
+        throw std::runtime_error("config: cannot open " + value);
+    }
+    const unsigned width = cortex ? 3 : 2;
+    std::vector<Parameter_Set> modules;
+    std::string line;
+    for (unsigned number=1; std::getline(in, line); ++number) {
+        std::istringstream row(line.substr(0, line.find('#')));
+        std::vector<double> x;
+        double v;
+        while (row >> v) {
+            x.push_back(v);
+        }
+        if (x.empty() && row.eof()) {
+            continue;
+        }
+        if (!row.eof() || x.size() != width + 4) {
+            throw std::invalid_argument(value + ": line " + std::to_string(number) + " needs " +
+                                        std::to_string(width + 4) + " numbers");
+        }
+        Parameter_Set P = Parameters_N3;
+        std::copy(x.begin(), x.begin() + width, cortex ? P.Cortex : P.Thalamus);
+        std::copy(x.begin() + width, x.end(), P.Connectivity);
+        modules.push_back(P);
+    }
+    if (modules.empty()) {
+        throw std::invalid_argument("config: " + value + " holds no modules");
+    }
+    return modules;
+}
+
+/* Variable and modules of a record line, all modules if none are given */
+static Output get_output (const std::string& value, unsigned num_C, unsigned num_T) {
+    std::istringstream words(value);
+    Output O;
+    words >> O.variable;
+    const unsigned count = Recorder::cortical(O.variable) ? num_C : num_T;
+    std::string range;
+    while (words >> range) {
+        const std::size_t dash = range.find('-');
+        std::size_t end = 0;
+        const unsigned long first = std::stoul(range, &end);
+        const unsigned long last  = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        if ((dash == std::string::npos ? end != range.size() : end != dash) || last < first || last >= count) {
+            throw std::invalid_argument("config: record " + value + " names no modules of " + O.variable);
+        }
+        for (unsigned long k=first; k <= last; ++k) {
+            O.modules.push_back(k);
+        }
+    }
+    if (O.modules.empty()) {
+        for (unsigned k=0; k < count; ++k) {
+            O.modules.push_back(k);
+        }
+    }
+    return O;
+}
+
+static Network_Config read_config (const std::string& file) {
+    std::ifstream in(file);
+    if (!in) {
+        throw std::runtime_error("config: cannot open " + file);
+    }
+    Network_Config C;
+    std::string line;
+    for (unsigned number=1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        const std::size_t equal = line.find('=');
+        auto trim = [] (const std::string& s) {
+            const std::size_t first = s.find_first_not_of(" \t\r");
+            return first == std::string::npos ? std::string() : s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+        };
+        if (trim(line).empty()) {
+            continue;
+        }
+        if (equal == std::string::npos) {
+            throw std::invalid_argument("config: line " + std::to_string(number) + " is no key = value");
+        }
+        const std::string key	= trim(line.substr(0, equal));
+        const std::string value	= trim(line.substr(equal + 1));
+        if		(key == "T")		{C.T		= std::stoi(value);}
+        else if (key == "onset")	{C.onset	= std::stoi(value);}
+        else if (key == "seed")		{C.seed		= std::stoull(value);}
+        else if (key == "threads")	{C.threads	= std::stoul(value);}
+        else if (key == "cortex")	{C.Param_Cortex	  = get_modules(key, value, true);}
+        else if (key == "thalamus")	{C.Param_Thalamus = get_modules(key, value, false);}
+        else if (key == "rate")		{C.rate		= std::stod(value);}
+        else if (key == "record")	{C.records.push_back(value);}
+        else if (key == "output")	{C.output	= value;}
+        else if (key == "W_CC" || key == "W_CT" || key == "W_TC" ||
+                 key == "D_CC" || key == "D_CT" || key == "D_TC") {C.matrices[key] = value;}
+        else {
+            throw std::invalid_argument("config: unknown key " + key + " in line " + std::to_string(number));
+        }
+    }
+    if (C.T <= 0 || C.onset < 0) {
+        throw std::invalid_argument("config: T has to be positive and onset non negative");
+    }
+    if (C.Param_Cortex.empty() || C.Param_Thalamus.empty()) {
+        throw std::invalid_argument("config: cortex and thalamus are needed");
+    }
+    if (!C.matrices.count("W_CT") || !C.matrices.count("W_TC")) {
+        throw std::invalid_argument("config: W_CT and W_TC are needed");
+    }
+    for (const std::string& record : C.records) {
+        C.outputs.push_back(get_output(record, C.Param_Cortex.size(), C.Param_Thalamus.size()));
+        for (std::size_t i=0; i + 1 < C.outputs.size(); ++i) {
+            if (C.outputs[i].variable == C.outputs.back().variable) {
+                throw std::invalid_argument("config: " + C.outputs[i].variable + " is recorded twice");
+            }
+        }
+    }
+    return C;
+}
+
+/* Weights of a matrix with the delays of the matching D_ entry, empty if not given */
+static CSR_Matrix get_matrix (const Network_Config& C, const std::string& name) {
+    const auto W = C.matrices.find("W_" + name);
+    const auto D = C.matrices.find("D_" + name);
+    if (W == C.matrices.end()) {
+        if (D != C.matrices.end()) {
+            throw std::invalid_argument("config: D_" + name + " without W_" + name);
+        }
+        return CSR_Matrix();
+    }
+    return CSR_Matrix::read(W->second, D == C.matrices.end() ? "" : D->second);
+}
+
+/******************************************************************************/
+/*                              Main routine								  */
+/******************************************************************************/
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: TC_network_sim config\n";
+        return 1;
+    }
+    try {
+        const Network_Config C = read_config(argv[1]);
+        TC_Network Network(C.Param_Cortex, C.Param_Thalamus, get_matrix(C, "CC"), get_matrix(C, "CT"),
+                           get_matrix(C, "TC"), C.seed, C.threads);
+
+        /* One recorder per recorded module, the unused column is the first one */
+        const std::uint64_t start = (std::uint64_t) C.onset*res;
+        const std::uint64_t Time  = (std::uint64_t) (C.onset + C.T)*res;
+        std::map<unsigned, std::unique_ptr<Recorder>> Cortex, Thalamus;
+        std::vector<std::vector<std::pair<Recorder*, unsigned>>> channels(C.outputs.size());
+        for (std::size_t o=0; o < C.outputs.size(); ++o) {
+            const bool cortical = Recorder::cortical(C.outputs[o].variable);
+            for (unsigned k : C.outputs[o].modules) {
+                std::unique_ptr<Recorder>& Rec = cortical ? Cortex[k] : Thalamus[k];
+                if (!Rec) {
+                    Rec.reset(cortical ? new Recorder(Network.Cortex[k], Network.Thalamus[0], start, Time)
+                                       : new Recorder(Network.Cortex[0], Network.Thalamus[k], start, Time));
+                }
+                channels[o].push_back(std::make_pair(Rec.get(), Rec->add(C.outputs[o].variable, C.rate)));
+            }
+        }
+        std::vector<Recorder*> Recorders;
+        for (auto* population : {&Cortex, &Thalamus}) {
+            for (auto& R : *population) {
+                Recorders.push_back(R.second.get());
+            }
+        }
+
+        /* The onset runs in one go, the threads meet every step only while the	*/
+        /* recorders are fed. Their filters settle within lead steps before start	*/
+        std::uint64_t delay = 0;
+        for (Recorder* R : Recorders) {
+            delay = std::max(delay, R->delay());
+        }
+        const std::uint64_t numSteps = Time + delay;
+        const std::uint64_t lead	 = 2*delay + res;
+        const std::uint64_t skip	 = Recorders.empty() ? numSteps : start > lead ? start - lead : 0;
+        Network.run(skip);
+        for (std::uint64_t t=skip; t < numSteps; ++t) {
+            Network.run(1);
+            for (Recorder* R : Recorders) {
+                R->sample(t);
+            }
+        }
+
+        /* Outputs as modules x samples */
+        Mat_Writer File(C.output);
+        const std::size_t num_samples = (std::size_t) C.T*C.rate;
+        for (std::size_t o=0; o < C.outputs.size(); ++o) {
+            const Output& O = C.outputs[o];
+            std::vector<double> data(O.modules.size()*num_samples);
+            std::vector<double> modules;
+            for (std::size_t m=0; m < O.modules.size(); ++m) {
+                const std::vector<double>& x = channels[o][m].first->data(channels[o][m].second);
+                for (std::size_t s=0; s < num_samples && s < x.size(); ++s) {
+                    data[s*O.modules.size() + m] = x[s];
+                }
+                modules.push_back(O.modules[m] + 1);
+            }
+            File.write(O.variable, O.modules.size(), num_samples, data.data());
+            File.row(O.variable + "_modules", modules);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/* Statistical check of the buffered Philox noise against mt19937_64		  */
+/*	TC_noise_check [--draws n] [--seed s]									  */
+/* Compares moments, tail frequencies and the lag 1 autocorrelation of		  */
+/* Noise_Buffer and of std::normal_distribution on std::mt19937_64 with the	  */
+/* standard normal, runs a one sample KS test of both against the normal cdf  */
+/* and a two sample KS test between them. Also checks that the asynchronous	  */
+/* refill reproduces the synchronous stream. Exits with 1 on any failure.	  */
+/******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Noise_Buffer.h"
+
+/* Deviation in standard errors beyond which a statistic fails */
+static const double z_limit  = 4.0;
+/* Critical value of sqrt(n)*D for the KS tests at the 1% level */
+static const double ks_limit = 1.63;
+
+struct Summary {
+    double mean, variance, skewness, kurtosis, tail3, tail4, lag1;
+};
+
+static Summary summarize (const std::vector<double>& X) {
+    const double n = X.size();
+    double m = 0;
+    for (double x : X) {
+        m += x;
+    }
+    m /= n;
+    double m2 = 0, m3 = 0, m4 = 0, c1 = 0, t3 = 0, t4 = 0;
+    for (std::size_t i=0; i < X.size(); ++i) {
+        const double d = X[i] - m;
+        m2 += d*d;
+        m3 += d*d*d;
+        m4 += d*d*d*d;
+        t3 += std::fabs(X[i]) > 3;
+        t4 += std::fabs(X[i]) > 4;
+        if (i) {
+            c1 += d * (X[i-1] - m);
+        }
+    }
+    return {m, m2/n, (m3/n)/std::pow(m2/n, 1.5), (m4/n)/std::pow(m2/n, 2) - 3,
+            t3/n, t4/n, c1/m2};
+}
+
+/* Standard normal cdf */
+static double Phi (double x) {return 0.5*std::erfc(-x/std::sqrt(2.0));}
+
+/* sqrt(n)*D of a sorted sample against the normal cdf */
+static double ks_normal (const std::vector<double>& S) {
+    const double n = S.size();
+    double D = 0;
+    for (std::size_t i=0; i < S.size(); ++i) {
+        const double F = Phi(S[i]);
+        D = std::max(D, std::max((i+1)/n - F, F - i/n));
+    }
+    return std::sqrt(n)*D;
+}
+
+/* sqrt(n*m/(n+m))*D of two sorted samples */
+static double ks_two (const std::vector<double>& A, const std::vector<double>& B) {
+    const double n = A.size(), m = B.size();
+    std::size_t i = 0, j = 0;
+    double D = 0;
+    while (i < A.size() && j < B.size()) {
+        const double x = std::min(A[i], B[j]);
+        while (i < A.size() && A[i] <= x) {++i;}
+        while (j < B.size() && B[j] <= x) {++j;}
+        D = std::max(D, std::fabs(i/n - j/m));
+    }
+    return std::sqrt(n*m/(n+m))*D;
+}
+
+static bool passed = true;
+
+static void report (const char* name, double value, double expected, double error) {
+    const double z = (value - expected)/error;
+    const bool ok  = std::fabs(z) < z_limit;
+    passed = passed && ok;
+    std::printf("  %-12s %12.6g  (expected %9.3g, z = %+6.2f) %s\n",
+                name, value, expected, z, ok ? "" : "FAIL");
+}
+
+static void check (const char* name, std::vector<double>& X) {
+    const double n  = X.size();
+    const double p3 = std::erfc(3/std::sqrt(2.0));
+    const double p4 = std::erfc(4/std::sqrt(2.0));
+    const Summary S = summarize(X);
+    std::printf("%s\n", name);
+    report("mean",     S.mean,     0,  std::sqrt(1/n));
+    report("variance", S.variance, 1,  std::sqrt(2/n));
+    report("skewness", S.skewness, 0,  std::sqrt(6/n));
+    report("kurtosis", S.kurtosis, 0,  std::sqrt(24/n));
+    report("P(|x|>3)", S.tail3,    p3, std::sqrt(p3*(1-p3)/n));
+    report("P(|x|>4)", S.tail4,    p4, std::sqrt(p4*(1-p4)/n));
+    report("lag 1",    S.lag1,     0,  std::sqrt(1/n));
+    std::sort(X.begin(), X.end());
+    const double ks = ks_normal(X);
+    passed = passed && ks < ks_limit;
+    std::printf("  %-12s %12.6g  (limit %12.3g) %s\n", "KS normal", ks, ks_limit,
+                ks < ks_limit ? "" : "FAIL");
+}
+
+int main (int argc, char* argv[]) {
+    std::size_t   draws = 10000000;
+    std::uint64_t seed  = 1;
+    for (int i=1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--draws") && i+1 < argc) {
+            draws = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--seed") && i+1 < argc) {
+            seed  = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            std::fprintf(stderr, "usage: %s [--draws n] [--seed s]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<double> Philox(draws), Async(draws), Twister(draws);
+    {
+        Noise_Buffer Sync (0, 1, seed, 0, 0, false);
+        Noise_Buffer Ahead(0, 1, seed, 0, 0, true);
+        for (std::size_t i=0; i < draws; ++i) {
+            Philox[i] = Sync();
+            Async[i]  = Ahead();
+        }
+    }
+    std::mt19937_64 Engine(seed);
+    std::normal_distribution<double> Normal(0, 1);
+    for (std::size_t i=0; i < draws; ++i) {
+        Twister[i] = Normal(Engine);
+    }
+
+    const bool same = Philox == Async;
+    passed = passed && same;
+    std::printf("%zu draws, seed %llu\n", draws, (unsigned long long) seed);
+    std::printf("asynchronous refill identical: %s\n", same ? "yes" : "no FAIL");
+    check("Noise_Buffer", Philox);
+    check("mt19937_64",   Twister);
+
+    const double ks = ks_two(Philox, Twister);
+    passed = passed && ks < ks_limit;
+    std::printf("two sample KS %.6g (limit %.3g) %s\n", ks, ks_limit, ks < ks_limit ? "" : "FAIL");
+    std::printf("%s\n", passed ? "PASSED" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,460 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/* Data production of Figures/Create_Data.m without MATLAB					  */
+/*	TC_pipeline [config]													  */
+/* The config file (default Figures/Create_Data.cfg) holds lines key = value  */
+/* with the directory of the data, the duration, seed, threads, the			  */
+/* parameter sets and the stimulation protocol, see Create_Data.cfg. Missing  */
+/* parameter sets are read from Parameter_N2.mat and Parameter_N3.mat.		  */
+/* The stages of Create_Data.m are									  		  */
+/*	- Import_Data(1-3)		done first, the averages need the data			  */
+/*	- Data_Time_Series(1)	and Data_SO_Average(1) on one N2 simulation		  */
+/*	- Data_Time_Series(2)	and Data_SO_Average(2) on one N3 simulation		  */
+/*	- Data_ERP_N3			on a stimulated N3 simulation					  */
+/* The three simulations run in parallel, each is analysed as soon as it	  */
+/* is done. Band-pass filtering, Hilbert envelope and trough detection are	  */
+/* those of Event_Detection.h, the windows and outputs are those of the		  */
+/* scripts, so the MAT-files can be used by the plot functions unchanged.	  */
+/* The band-pass is a single pass of the 513 tap FIR with its delay			  */
+/* compensated, while ft_preproc_bandpassfilter(..., 513, 'fir') filters	  */
+/* forward and backward, so the filtered traces differ sample by sample		  */
+/* and the averages agree closely but not exactly with the scripts.		  */
+/* Simulation i uses seed + i.												  */
+/******************************************************************************/
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Data_Storage.h"
+#include "Event_Detection.h"
+#include "Mat_File.h"
+#include "ODE.h"
+#include "Recorder.h"
+#include "Stim_Scheduler.h"
+#include "TC_System.h"
+#include "Thread_Pool.h"
+
+/******************************************************************************/
+/*                          Fixed simulation settings						  */
+/******************************************************************************/
+extern const int onset	= 20;		/* Time until data is stored in  s		  */
+extern const int res 	= 1E4;		/* Number of iteration steps per s		  */
+extern const int red 	= 1E2;		/* Number of iterations steps not saved	  */
+extern const double dt 	= 1E3/res;	/* Duration of a time step in ms		  */
+extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
+
+/* Sampling rate of the stored time series */
+static const double Fs = res/red;
+
+/******************************************************************************/
+/*								Configuration								  */
+/******************************************************************************/
+struct Parameters {
+    std::vector<double>	Param_Cortex;
+    std::vector<double>	Param_Thalamus;
+    std::vector<double>	Connectivity;
+};
+
+struct Pipeline_Config {
+    /* Directory of Parameter_N*.mat and Orig/, the outputs are written there */
+    std::string						data	= "Figures/Data";
+
+    /* Duration of every simulation in s */
+    int								T		= 3600;
+
+    std::uint64_t					seed	= time(NULL);
+
+    /* Worker threads, 0 uses all hardware threads */
+    unsigned						threads	= 0;
+
+    /* Parameter sets by name, N2 and N3 */
+    std::map<std::string, Parameters> stages;
+
+    /* Protocol of Data_ERP_N3, see Stim_Protocol::from_var_stim */
+    std::vector<double>				var_stim = {2, 70, 80, 5, 0, 2, 1050, 450};
+};
+
+static std::vector<double> get_numbers (const std::string& key, const std::string& value, std::size_t count) {
+    std::istringstream in(value);
+    std::vector<double> numbers;
+    double x;
+    while (in >> x) {
+        numbers.push_back(x);
+    }
+    if (!in.eof() || numbers.size() != count) {
+        throw std::invalid_argument("config: " + key + " needs " + std::to_string(count) + " numbers");
+    }
+    return numbers;
+}
+
+static Pipeline_Config read_config (const std::string& file) {
+    std::ifstream in(file);
+    if (!in) {
+        throw std::runtime_error("config: cannot open " + file);
+    }
+    Pipeline_Config C;
+    std::string line;
+    for (unsigned number=1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        const std::size_t equal = line.find('=');
+        auto trim = [] (const std::string& s) {
+            const std::size_t first = s.find_first_not_of(" \t\r");
+            return first == std::string::npos ? std::string() : s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+        };
+        if (trim(line).empty()) {
+            continue;
+        }
+        if (equal == std::string::npos) {
+            throw std::invalid_argument("config: line " + std::to_string(number) + " is no key = value");
+        }
+        const std::string key	= trim(line.substr(0, equal));
+        const std::string value	= trim(line.substr(equal + 1));
+        const std::size_t dot	= key.find('.');
+        const std::string field	= dot == std::string::npos ? "" : key.substr(dot + 1);
+        if		(key == "data")		{C.data	   = value;}
+        else if (key == "T")		{C.T	   = (int)		 get_numbers(key, value, 1)[0];}
+        else if (key == "seed")		{C.seed	   = std::stoull(value);}
+        else if (key == "threads")	{C.threads = (unsigned)	 get_numbers(key, value, 1)[0];}
+        else if (key == "stim")		{C.var_stim = get_numbers(key, value, 8);}
+        else if (field == "cortex")		  {C.stages[key.substr(0, dot)].Param_Cortex   = get_numbers(key, value, 3);}
+        else if (field == "thalamus")	  {C.stages[key.substr(0, dot)].Param_Thalamus = get_numbers(key, value, 2);}
+        else if (field == "connectivity") {C.stages[key.substr(0, dot)].Connectivity   = get_numbers(key, value, 4);}
+        else {
+            throw std::invalid_argument("config: unknown key " + key + " in line " + std::to_string(number));
+        }
+    }
+    if (C.T < 5) {
+        throw std::invalid_argument("config: T has to be at least 5 s for the event windows");
+    }
+    return C;
+}
+
+/* Parameter set of a stage, missing entries are taken from Parameter_<stage>.mat */
+static Parameters get_parameters (const Pipeline_Config& C, const std::string& stage) {
+    Parameters P;
+    const auto it = C.stages.find(stage);
+    if (it != C.stages.end()) {
+        P = it->second;
+    }
+    if (P.Param_Cortex.empty() || P.Param_Thalamus.empty() || P.Connectivity.empty()) {
+        const Mat_Reader File(C.data + "/Parameter_" + stage + ".mat");
+        if (P.Param_Cortex.empty())	  {P.Param_Cortex	= File.get("Param_Cortex").data;}
+        if (P.Param_Thalamus.empty()) {P.Param_Thalamus = File.get("Param_Thalamus").data;}
+        if (P.Connectivity.empty())	  {P.Connectivity	= File.get("Connectivity").data;}
+    }
+    return P;
+}
+
+/******************************************************************************/
+/*								Import_Data									  */
+/******************************************************************************/
+/* Columns of the experimental averages of Ngo et al 2013 */
+static const std::vector<std::string> data_columns = {"time_events", "mean_ERP", "mean_ERP_sham", "sem_ERP",
+    "sem_ERP_sham", "mean_FSP", "mean_FSP_sham", "sem_FSP", "sem_FSP_sham"};
+
+/* Split data.<average> of Experimental_Data.mat into its columns and store them */
+static std::map<std::string, std::vector<double>> import_data (const Mat_Reader& Orig, const std::string& average,
+                                                               const std::string& file) {
+    const Mat_Array& A = Orig.get("data." + average);
+    if (A.cols != data_columns.size()) {
+        throw std::runtime_error("Import_Data: data." + average + " has to have 9 columns");
+    }
+    std::map<std::string, std::vector<double>> columns;
+    Mat_Writer Output(file);
+    for (std::size_t c=0; c < A.cols; ++c) {
+        columns[data_columns[c]].assign(A.data.begin() + c*A.rows, A.data.begin() + (c+1)*A.rows);
+        Output.column(data_columns[c], columns[data_columns[c]]);
+    }
+    return columns;
+}
+
+/******************************************************************************/
+/*								Simulation									  */
+/******************************************************************************/
+struct Simulation {
+    std::vector<double>	Vp, Vt, Ca, ah;
+
+    /* Stimulation markers in samples */
+    std::vector<double>	Marker_Stim;
+};
+
+/* T s after the onset with the protocol of TC_mex */
+static Simulation simulate (const Parameters& P, std::vector<double> var_stim, int T, std::uint64_t seed) {
+    Parameters Q = P;
+    TC_System System(Q.Param_Cortex.data(), Q.Param_Thalamus.data(), Q.Connectivity.data(), seed);
+    Stim_Scheduler Stimulation(System, (std::uint64_t) onset*res);
+    Stimulation.add(Stim_Protocol::from_var_stim(var_stim.data(), var_stim.size()));
+
+    const std::uint64_t Time = (std::uint64_t) (onset + T)*res;
+    Recorder Rec(System, (std::uint64_t) onset*res, Time);
+    for (const std::string& name : data_names()) {
+        Rec.add(name, res/red);
+    }
+    const std::uint64_t numSteps = Time + Rec.delay();
+    for (std::uint64_t t=0; t < numSteps; ++t) {
+        ODE (System);
+        if (t < Time && Stimulation.due(t)) {
+            Stimulation.advance(t);
+        }
+        Rec.sample(t);
+    }
+
+    Simulation S;
+    S.Vp = std::move(Rec.data(0));
+    S.Vt = std::move(Rec.data(1));
+    S.Ca = std::move(Rec.data(2));
+    S.ah = std::move(Rec.data(3));
+    /* Division by red transforms marker time from dt to sampling rate */
+    for (int marker : Stimulation.get_markers(0)) {
+        S.Marker_Stim.push_back(marker/red);
+    }
+    return S;
+}
+
+/******************************************************************************/
+/*								Analysis									  */
+/******************************************************************************/
+/* Slow oscillation band, spindle power and troughs of a whole trace of Vp */
+struct Filtered {
+    std::vector<double>			SO, SSP, FSP;
+    std::vector<std::uint64_t>	troughs;
+};
+
+static Filtered filter (const std::vector<double>& Vp) {
+    Filtered F;
+    F.SO.resize(Vp.size());
+    F.SSP.resize(Vp.size());
+    F.FSP.resize(Vp.size());
+    /* The SO band is offset by mean(Vp) of the whole trace as in the scripts */
+    SO_Analysis Analysis(Fs);
+    double sum = 0.0;
+    for (double x : Vp) {
+        sum += x;
+    }
+    Analysis.set_mean(Vp.empty() ? 0.0 : sum/Vp.size());
+    auto store = [&F] (std::uint64_t index, const SO_Analysis::Sample& S) {
+        F.SO [index] = S.SO;
+        F.SSP[index] = S.SSP;
+        F.FSP[index] = S.FSP;
+    };
+    for (double x : Vp) {
+        Analysis.push(x, store);
+    }
+    Analysis.flush(store);
+    F.troughs = Analysis.troughs();
+    return F;
+}
+
+/* Windows around the events as a samples x events matrix, the MATLAB index x	*/
+/* of an event covers y(x+first+1 : x+last+1) as in the scripts				*/
+static std::vector<double> segment (const std::vector<double>& y, const std::vector<std::size_t>& events,
+                                    int first, int last) {
+    std::vector<double> E;
+    E.reserve(events.size()*(last - first + 1));
+    for (std::size_t x : events) {
+        E.insert(E.end(), y.begin() + (x + first), y.begin() + (x + last + 1));
+    }
+    return E;
+}
+
+/* Mean and standard deviation over the events as mean(E, 2) and std(E, 0, 2) */
+static void statistics (const std::vector<double>& E, std::size_t length,
+                        std::vector<double>& mean, std::vector<double>& sd) {
+    const std::size_t N = length ? E.size()/length : 0;
+    mean.assign(length, N ? 0.0 : std::numeric_limits<double>::quiet_NaN());
+    sd.assign(length, N ? 0.0 : std::numeric_limits<double>::quiet_NaN());
+    for (std::size_t k=0; k < length && N; ++k) {
+        for (std::size_t i=0; i < N; ++i) {
+            mean[k] += E[i*length + k]/N;
+        }
+        for (std::size_t i=0; i < N && N > 1; ++i) {
+            sd[k] += (E[i*length + k] - mean[k])*(E[i*length + k] - mean[k])/(N - 1);
+        }
+        sd[k] = std::sqrt(sd[k]);
+    }
+}
+
+/******************************************************************************/
+/*						Data_Time_Series and Data_SO_Average				  */
+/******************************************************************************/
+static void time_series (const Pipeline_Config& C, const std::string& stage, const Simulation& S) {
+    Mat_Writer Full(C.data + "/Time_Series_" + stage + ".mat");
+    Full.row("Vp", S.Vp);
+    Full.row("Vt", S.Vt);
+    Full.row("Ca", S.Ca);
+    Full.row("ah", S.ah);
+
+    /* Snippet for the example time series plot */
+    auto head = [] (const std::vector<double>& x) {
+        return std::vector<double>(x.begin(), x.begin() + std::min<std::size_t>(x.size(), 3000));
+    };
+    Mat_Writer Short(C.data + "/Time_Series_Short_" + stage + ".mat");
+    Short.row("Vp", head(S.Vp));
+    Short.row("Vt", head(S.Vt));
+    Short.row("Ca", head(S.Ca));
+    Short.row("ah", head(S.ah));
+}
+
+static void so_average (const Pipeline_Config& C, const Simulation& S,
+                        const std::map<std::string, std::vector<double>>& Data, const std::string& file) {
+    const Filtered F = filter(S.Vp);
+
+    /* Troughs as MATLAB indices, those too close to begin and end are removed */
+    std::vector<std::size_t> x_SO;
+    for (std::uint64_t trough : F.troughs) {
+        const std::size_t x = trough + 1;
+        if (x < (C.T - 2)*Fs && x > 2*Fs) {
+            x_SO.push_back(x);
+        }
+    }
+
+    /* Segmentation and averaging over [-1.25, 1.25] s */
+    const int first = -1.25*Fs, last = 1.25*Fs;
+    const std::size_t length = last - first + 1;
+    std::vector<double> mean_ERP_model, sd_ERP_model, mean_FSP_model, sd_FSP_model;
+    statistics(segment(S.Vp,  x_SO, first, last), length, mean_ERP_model, sd_ERP_model);
+    statistics(segment(F.FSP, x_SO, first, last), length, mean_FSP_model, sd_FSP_model);
+
+    Mat_Writer Output(file);
+    Output.scalar("N_Stim",			x_SO.size());
+    Output.column("time_events",	Data.at("time_events"));
+    Output.column("mean_ERP_data",	Data.at("mean_ERP_sham"));
+    Output.column("mean_FSP_data",	Data.at("mean_FSP_sham"));
+    Output.column("sem_ERP_data",	Data.at("sem_ERP_sham"));
+    Output.column("sem_FSP_data",	Data.at("sem_FSP_sham"));
+    Output.column("mean_ERP_model",	mean_ERP_model);
+    Output.column("mean_FSP_model",	mean_FSP_model);
+    Output.column("sd_ERP_model",	sd_ERP_model);
+    Output.column("sd_FSP_model",	sd_FSP_model);
+}
+
+/******************************************************************************/
+/*								Data_ERP_N3									  */
+/******************************************************************************/
+static void erp (const Pipeline_Config& C, const Simulation& S) {
+    const Filtered F = filter(S.Vp);
+
+    /* Stimuli whose window [-1, 3] s lies within the recording */
+    std::vector<double>		 Marker_Stim;
+    std::vector<std::size_t> events;
+    for (double marker : S.Marker_Stim) {
+        if (marker > 1*Fs && marker < (C.T - 3)*Fs) {
+            Marker_Stim.push_back(marker);
+            events.push_back(marker);
+        }
+    }
+
+    const int first = -1*Fs, last = 3*Fs;
+    const std::size_t length = last - first + 1;
+    Mat_Writer Output(C.data + "/ERP_Stim_Model.mat");
+    Output.write("Events",		length, events.size(), segment(S.Vp,  events, first, last).data());
+    Output.write("Events_T",	length, events.size(), segment(S.Vt,  events, first, last).data());
+    Output.write("Events_FSP",	length, events.size(), segment(F.FSP, events, first, last).data());
+    Output.write("Events_SSP",	length, events.size(), segment(F.SSP, events, first, last).data());
+    Output.row	("Marker_Stim", Marker_Stim);
+
+    Mat_Writer Depletion(C.data + "/Ca_Depletion.mat");
+    Depletion.row("Vp", S.Vp);
+    Depletion.row("Vt", S.Vt);
+    Depletion.row("Ca", S.Ca);
+    Depletion.row("ah", S.ah);
+    Depletion.row("Marker_Stim", Marker_Stim);
+}
+
+/******************************************************************************/
+/*                              Main routine								  */
+/******************************************************************************/
+int main(int argc, char* argv[]) {
+    const auto start = std::chrono::steady_clock::now();
+    auto elapsed = [start] {return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();};
+    std::mutex log_mutex;
+    auto report = [&] (const std::string& message) {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        std::cout << "[" << std::fixed << std::setprecision(1) << elapsed() << " s] " << message << std::endl;
+    };
+
+    try {
+        const Pipeline_Config C = read_config(argc > 1 ? argv[1] : "Figures/Create_Data.cfg");
+        const Parameters N2 = get_parameters(C, "N2");
+        const Parameters N3 = get_parameters(C, "N3");
+
+        /* Import_Data */
+        const Mat_Reader Orig(C.data + "/Orig/Experimental_Data.mat");
+        const auto KC_Data = import_data(Orig, "KC_Average", C.data + "/KC_Average_data.mat");
+        const auto SO_Data = import_data(Orig, "SO_Average", C.data + "/SO_Average_data.mat");
+        import_data(Orig, "ERP_Average", C.data + "/ERP_Average_data.mat");
+        report("imported the experimental data");
+
+        /* The simulations are independent, each is analysed on its worker */
+        const std::vector<double> no_stim(8, 0.0);
+        Thread_Pool Pool(C.threads);
+        Pool.submit([&] {
+            report("N2 time series, seed " + std::to_string(C.seed));
+            const Simulation S = simulate(N2, no_stim, C.T, C.seed);
+            time_series(C, "N2", S);
+            so_average(C, S, KC_Data, C.data + "/KC_Average.mat");
+            report("N2 time series and KC average done");
+        });
+        Pool.submit([&] {
+            report("N3 time series, seed " + std::to_string(C.seed + 1));
+            const Simulation S = simulate(N3, no_stim, C.T, C.seed + 1);
+            time_series(C, "N3", S);
+            so_average(C, S, SO_Data, C.data + "/SO_Average.mat");
+            report("N3 time series and SO average done");
+        });
+        Pool.submit([&] {
+            report("N3 stimulation, seed " + std::to_string(C.seed + 2));
+            erp(C, simulate(N3, C.var_stim, C.T, C.seed + 2));
+            report("N3 stimulation done");
+        });
+        Pool.wait();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    report("end");
+    return 0;
+}
+/****************************************************************************************************/
+/*										 		end													*/
+/****************************************************************************************************/
@@ -0,0 +1,930 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/* Implementation of the simulation as Python extension module nm_tc		  */
+/*																			  */
+/* nm_tc.run(T, cortex, thalamus, connectivity, stim=None, seed=None,		  */
+/*		channels=(), gating=0)												  */
+/* simulates one system as TC_mex and returns a dict with Vp, Vt, Ca, ah,	  */
+/* markers (in samples), protocols, seed and channels. stim may hold several  */
+/* protocols that run at the same time, markers holds those of all of them	  */
+/* in time order and protocols a list with a dict per protocol with its		  */
+/* markers. Closed loop protocols (mode 3) add the phases of the stimuli,	  */
+/* a dict of the arrays marker, predicted and achieved, the phase_error with  */
+/* N, mean, resultant and sd of the achieved minus the target phase and the	  */
+/* latency of the phase estimate in ms. channels is							  */
+/* a sequence of (name, rate) pairs of further variables, see				  */
+/* nm_tc.variables, they are returned in a dict by name.					  */
+/*																			  */
+/* nm_tc.run_batch(T, cortex, thalamus, connectivity, stim=None, seed=None,	  */
+/*		threads=0, gating=0, traces=True, lanes=1)							  */
+/* runs one job per parameter set on a thread pool as TC_sweep_mex. The		  */
+/* parameters are jobs x 3, jobs x 2, jobs x 4 and jobs x 9 arrays, a single  */
+/* set is used for every job. Job i uses seed + i. Vp, Vt, Ca and ah are	  */
+/* returned as jobs x samples, markers, troughs, ERP, SO and protocols as	  */
+/* lists. lanes > 1 integrates up to lanes jobs with exact gating together	  */
+/* in a TC_Ensemble, see run_sweep.											  */
+/*																			  */
+/* nm_tc.run_branches(T, burn_in, cortex, thalamus, connectivity, stim,		  */
+/*		seed=None, threads=0, gating=0, traces=True, independent=False)		  */
+/* simulates burn_in s of a single parameter set and forks that state into	  */
+/* one branch per stim protocol, e.g. stimulation and sham, that runs for T s */
+/* as after the onset. The branches continue the noise of the trunk, with	  */
+/* independent=True branch i draws its noise from seed + 1 + i. The result	  */
+/* is that of run_batch with one row per branch.							  */
+/*																			  */
+/* Parameters are any nested sequence of numbers or buffer of doubles, e.g.	  */
+/* numpy arrays. stim is either the var_stim vector of TC_mex with 8 or 9	  */
+/* values or a dict with the fields of nm_tc.stim_fields, missing ones are 0, */
+/* or a sequence of them. Mode 3 dicts may name ISI_range target_phase and	  */
+/* time_to_stimuli latency. The time series are								  */
+/* nm_tc.Array objects that take over the buffers of the recorder, they		  */
+/* export them with the buffer protocol, so numpy.asarray(x) does not copy.	  */
+/* The simulations release the GIL, so several runs can be driven from		  */
+/* Python threads in parallel.												  */
+/*																			  */
+/* Build command, after that import nm_tc from the build directory:			  */
+/* g++ -std=c++11 -O3 -fopenmp-simd -fno-math-errno -fno-trapping-math		  */
+/*     -ffp-contract=off -pthread -shared -fPIC \$(python3-config --includes)  */
+/*     TC_python.cpp Cortical_Column.cpp Sweep.cpp TC_Ensemble.cpp			  */
+/*     Thalamic_Column.cpp -o nm_tc\$(python3-config --extension-suffix)	  */
+/* or python3 setup.py build_ext --inplace									  */
+/******************************************************************************/
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Data_Storage.h"
+#include "ODE.h"
+#include "Parameter_Sets.h"
+#include "Recorder.h"
+#include "Stim_Scheduler.h"
+#include "Sweep.h"
+#include "TC_System.h"
+#include "Thread_Pool.h"
+
+/******************************************************************************/
+/*                          Fixed simulation settings						  */
+/******************************************************************************/
+extern const int onset	= 20;		/* Time until data is stored in  s		  */
+extern const int res 	= 1E4;		/* Number of iteration steps per s		  */
+extern const int red 	= 1E2;		/* Number of iterations steps not saved	  */
+extern const double dt 	= 1E3/res;	/* Duration of a time step in ms		  */
+extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
+
+/* Fields of var_stim, see Stim_Protocol::from_var_stim */
+static const char* stim_fields[] = {"mode", "strength", "duration", "ISI", "ISI_range",
+                                    "number_of_stimuli", "time_between_stimuli", "time_to_stimuli",
+                                    "target"};
+static const std::size_t num_stim_fields = sizeof(stim_fields)/sizeof(stim_fields[0]);
+
+/* Names of the fields that closed loop protocols (mode 3) use differently */
+static const std::pair<const char*, const char*> stim_aliases[] = {{"target_phase", "ISI_range"},
+                                                                   {"latency", "time_to_stimuli"}};
+
+/******************************************************************************/
+/*								Array type									  */
+/* Owns the samples of a channel and exports them as a C contiguous buffer	  */
+/* of doubles with one or two dimensions. The size never changes, so views	  */
+/* stay valid as long as they hold a reference to the array.				  */
+/******************************************************************************/
+struct Array_Object {
+    PyObject_HEAD
+    std::vector<double>*	data;
+    int						ndim;
+    Py_ssize_t				shape	[2];
+    Py_ssize_t				strides	[2];
+};
+
+static void Array_dealloc (Array_Object* self) {
+    delete self->data;
+    Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+/* The samples are writable and C contiguous, so every request but a Fortran */
+/* contiguous view of a matrix can be served. Shape and strides are only		 */
+/* given if the consumer asked for them, without shape the view is flat		 */
+static int Array_getbuffer (Array_Object* self, Py_buffer* view, int flags) {
+    if (!view) {
+        PyErr_SetString(PyExc_BufferError, "nm_tc.Array: view is NULL");
+        return -1;
+    }
+    const bool column = self->ndim == 1 || self->shape[0] == 1 || self->shape[1] == 1;
+    if ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS && !column) {
+        view->obj = nullptr;
+        PyErr_SetString(PyExc_BufferError, "nm_tc.Array: matrices are not Fortran contiguous");
+        return -1;
+    }
+    view->obj		= (PyObject*) self;
+    view->buf		= self->data->data();
+    view->len		= (Py_ssize_t) (self->data->size()*sizeof(double));
+    view->readonly	= 0;
+    view->itemsize	= sizeof(double);
+    view->format	= (flags & PyBUF_FORMAT) ? (char*) "d" : nullptr;
+    view->ndim		= (flags & PyBUF_ND) == PyBUF_ND ? self->ndim : 1;
+    view->shape		= (flags & PyBUF_ND) == PyBUF_ND ? self->shape : nullptr;
+    view->strides	= (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : nullptr;
+    view->suboffsets= nullptr;
+    view->internal	= nullptr;
+    Py_INCREF(self);
+    return 0;
+}
+
+static Py_ssize_t Array_length (Array_Object* self) {
+    return self->shape[0];
+}
+
+static PyObject* Array_get_shape (Array_Object* self, void*) {
+    return self->ndim == 1 ? Py_BuildValue("(n)",  self->shape[0])
+                           : Py_BuildValue("(nn)", self->shape[0], self->shape[1]);
+}
+
+static PyObject* Array_tolist (Array_Object* self, PyObject*) {
+    PyObject* list = PyList_New(self->data->size());
+    if (!list) {
+        return nullptr;
+    }
+    for (std::size_t i=0; i < self->data->size(); ++i) {
+        PyList_SET_ITEM(list, i, PyFloat_FromDouble((*self->data)[i]));
+    }
+    return list;
+}
+
+static PyGetSetDef Array_getset[] = {
+    {"shape", (getter) Array_get_shape, nullptr, "Dimensions of the array", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}
+};
+
+static PyMethodDef Array_methods[] = {
+    {"tolist", (PyCFunction) Array_tolist, METH_NOARGS, "Copy of the samples as flat list"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+/* The members of the type and its slot tables are set in the module init */
+static PyBufferProcs		Array_buffer;
+static PySequenceMethods	Array_sequence;
+static PyTypeObject			Array_Type;
+
+/* Take over the samples, ndim = 2 gives rows x columns in row major order */
+static PyObject* make_array (std::vector<double>&& data, int ndim, Py_ssize_t rows, Py_ssize_t columns) {
+    Array_Object* self = PyObject_New(Array_Object, &Array_Type);
+    if (!self) {
+        return nullptr;
+    }
+    self->data = new (std::nothrow) std::vector<double>(std::move(data));
+    if (!self->data) {
+        Py_TYPE(self)->tp_free((PyObject*) self);
+        return PyErr_NoMemory();
+    }
+    self->ndim		= ndim;
+    self->shape[0]	= rows;
+    self->shape[1]	= columns;
+    self->strides[0]= ndim == 2 ? columns*sizeof(double) : sizeof(double);
+    self->strides[1]= sizeof(double);
+    return (PyObject*) self;
+}
+
+static PyObject* make_array (std::vector<double>&& data) {
+    const Py_ssize_t size = data.size();
+    return make_array(std::move(data), 1, size, 1);
+}
+
+/* Sample indices of events */
+static PyObject* make_markers (const std::vector<int>& markers) {
+    std::vector<double> samples(markers.begin(), markers.end());
+    return make_array(std::move(samples));
+}
+
+/******************************************************************************/
+/*								Input conversion							  */
+/******************************************************************************/
+/* Append all numbers of a nested sequence or buffer of doubles, false with	  */
+/* a Python error set if an element is not a number							  */
+static bool flatten (PyObject* object, std::vector<double>& values) {
+    if (PyObject_CheckBuffer(object)) {
+        Py_buffer view;
+        if (PyObject_GetBuffer(object, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0) {
+            const bool is_double = view.format && std::string(view.format) == "d";
+            if (is_double) {
+                const double* data = (const double*) view.buf;
+                values.insert(values.end(), data, data + view.len/sizeof(double));
+            }
+            PyBuffer_Release(&view);
+            if (is_double) {
+                return true;
+            }
+        } else {
+            PyErr_Clear();
+        }
+    }
+    if (PySequence_Check(object) && !PyUnicode_Check(object) && !PyBytes_Check(object)) {
+        PyObject* items = PySequence_Fast(object, "expected a sequence");
+        if (!items) {
+            return false;
+        }
+        const Py_ssize_t n = PySequence_Fast_GET_SIZE(items);
+        for (Py_ssize_t i=0; i < n; ++i) {
+            if (!flatten(PySequence_Fast_GET_ITEM(items, i), values)) {
+                Py_DECREF(items);
+                return false;
+            }
+        }
+        Py_DECREF(items);
+        return true;
+    }
+    const double value = PyFloat_AsDouble(object);
+    if (value == -1 && PyErr_Occurred()) {
+        return false;
+    }
+    values.push_back(value);
+    return true;
+}
+
+/* Parameter sets of size width, the number of sets is stored in count */
+static bool get_sets (PyObject* object, const char* name, std::size_t width,
+                      std::vector<double>& values, std::size_t& count) {
+    values.clear();
+    if (!flatten(object, values)) {
+        return false;
+    }
+    if (values.empty() || values.size() % width != 0) {
+        PyErr_Format(PyExc_ValueError, "%s has to hold sets of %zu values, got %zu values",
+                     name, width, values.size());
+        return false;
+    }
+    count = values.size()/width;
+    return true;
+}
+
+/* var_stim of a dict with the fields of stim_fields or their aliases */
+static bool get_stim_fields (PyObject* dict, std::vector<double>& values) {
+    const std::size_t num_fields = num_stim_fields;
+    values.assign(num_fields, 0.0);
+    PyObject *key, *value;
+    Py_ssize_t position = 0;
+    while (PyDict_Next(dict, &position, &key, &value)) {
+        const char* field = PyUnicode_Check(key) ? PyUnicode_AsUTF8(key) : nullptr;
+        for (const auto& alias : stim_aliases) {
+            if (field && std::string(alias.first) == field) {
+                field = alias.second;
+            }
+        }
+        const char* const* match = field ? std::find_if(stim_fields, stim_fields + num_fields,
+                                   [field] (const char* f) {return std::string(f) == field;})
+                                         : stim_fields + num_fields;
+        if (match == stim_fields + num_fields) {
+            PyErr_Format(PyExc_ValueError, "stim: unknown field %R", key);
+            return false;
+        }
+        const double x = PyFloat_AsDouble(value);
+        if (x == -1 && PyErr_Occurred()) {
+            return false;
+        }
+        values[match - stim_fields] = x;
+    }
+    return true;
+}
+
+/* Length of the rows of a two dimensional buffer or nested sequence, 0 if flat */
+static Py_ssize_t row_length (PyObject* object) {
+    if (PyObject_CheckBuffer(object)) {
+        Py_buffer view;
+        if (PyObject_GetBuffer(object, &view, PyBUF_STRIDES) == 0) {
+            const Py_ssize_t length = view.ndim == 2 ? view.shape[1] : 0;
+            PyBuffer_Release(&view);
+            return length;
+        }
+        PyErr_Clear();
+    }
+    Py_ssize_t length = 0;
+    if (PySequence_Check(object) && PySequence_Size(object) > 0) {
+        PyObject* first = PySequence_GetItem(object, 0);
+        if (first && PySequence_Check(first) && !PyUnicode_Check(first) && !PyBytes_Check(first)) {
+            length = PySequence_Size(first);
+        }
+        Py_XDECREF(first);
+    }
+    PyErr_Clear();
+    return length;
+}
+
+/* Stimulation protocols as var_stim vectors of 9 values, None is no stimulation */
+static bool get_stim (PyObject* object, std::vector<double>& values, std::size_t& count) {
+    if (!object || object == Py_None) {
+        values.assign(Stim_Protocol::var_stim_size, 0.0);
+        count = 1;
+        return true;
+    }
+    if (PyDict_Check(object)) {
+        count = 1;
+        return get_stim_fields(object, values);
+    }
+    if (PySequence_Check(object) && PySequence_Size(object) > 0) {
+        PyObject* first = PySequence_GetItem(object, 0);
+        const bool dicts = first && PyDict_Check(first);
+        Py_XDECREF(first);
+        if (dicts) {
+            values.clear();
+            count = PySequence_Size(object);
+            for (std::size_t i=0; i < count; ++i) {
+                PyObject* item = PySequence_GetItem(object, i);
+                std::vector<double> set;
+                const bool valid = item && PyDict_Check(item) && get_stim_fields(item, set);
+                if (item && !PyDict_Check(item)) {
+                    PyErr_SetString(PyExc_TypeError, "stim: expected a dict per job");
+                }
+                Py_XDECREF(item);
+                if (!valid) {
+                    return false;
+                }
+                values.insert(values.end(), set.begin(), set.end());
+            }
+            return true;
+        }
+    }
+    /* A flat sequence is a single vector or a sequence of vectors of 9 values */
+    std::size_t width = row_length(object);
+    values.clear();
+    if (!flatten(object, values)) {
+        return false;
+    }
+    if (width == 0) {
+        width = values.size() == 8 || values.size() % Stim_Protocol::var_stim_size != 0 ? 8 : 9;
+    }
+    if ((width != 8 && width != 9) || values.empty() || values.size() % width != 0) {
+        PyErr_Format(PyExc_ValueError, "stim has to hold sets of 8 or 9 values, got %zu values", values.size());
+        return false;
+    }
+    count  = values.size()/width;
+    values = Stim_Protocol::widen_var_stim(values.data(), width, count);
+    return true;
+}
+
+static bool get_seed (PyObject* object, std::uint64_t& seed) {
+    if (!object || object == Py_None) {
+        seed = time(NULL);
+        return true;
+    }
+    seed = PyLong_AsUnsignedLongLong(object);
+    return !PyErr_Occurred();
+}
+
+static bool get_gating (int mode, Gating_Mode& gating) {
+    if (mode < 0 || mode > 2) {
+        PyErr_SetString(PyExc_ValueError, "gating has to be 0 (exact), 1 (linear) or 2 (cubic)");
+        return false;
+    }
+    gating = (Gating_Mode) mode;
+    return true;
+}
+
+/* Translate an exception of the simulation into a Python error */
+static PyObject* set_error (std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::invalid_argument& e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+    } catch (const std::out_of_range& e) {
+        PyErr_SetString(PyExc_IndexError, e.what());
+    } catch (const std::bad_alloc&) {
+        PyErr_NoMemory();
+    } catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+    }
+    return nullptr;
+}
+
+/* Add a new reference to a dict under name, consumes the reference */
+static bool set_item (PyObject* dict, const char* name, PyObject* value) {
+    if (!value) {
+        return false;
+    }
+    const int status = PyDict_SetItemString(dict, name, value);
+    Py_DECREF(value);
+    return status == 0;
+}
+
+/* Circular statistics as dict with N, mean, resultant and sd */
+static PyObject* make_phase_statistics (const Phase_Statistics& S) {
+    return Py_BuildValue("{s:I,s:d,s:d,s:d}", "N", S.N, "mean", S.mean, "resultant", S.resultant, "sd", S.sd);
+}
+
+/* Phase records as dict of arrays with marker, predicted and achieved */
+static PyObject* make_phases (const std::vector<Stim_Scheduler::Phase_Record>& records) {
+    std::vector<double> marker, predicted, achieved;
+    for (const Stim_Scheduler::Phase_Record& R : records) {
+        marker.push_back(R.marker);
+        predicted.push_back(R.predicted);
+        achieved.push_back(R.achieved);
+    }
+    PyObject* dict = PyDict_New();
+    if (dict && set_item(dict, "marker", make_array(std::move(marker)))
+             && set_item(dict, "predicted", make_array(std::move(predicted)))
+             && set_item(dict, "achieved", make_array(std::move(achieved)))) {
+        return dict;
+    }
+    Py_XDECREF(dict);
+    return nullptr;
+}
+
+/* Outcome of the stimulation protocols as list of dicts, closed loop ones	*/
+/* add phases, phase_error and latency in ms								*/
+static PyObject* make_protocols (const std::vector<Protocol_Result>& protocols) {
+    PyObject* list = PyList_New(protocols.size());
+    for (std::size_t i=0; list && i < protocols.size(); ++i) {
+        const Protocol_Result& P = protocols[i];
+        PyObject* dict = PyDict_New();
+        bool valid = dict && set_item(dict, "markers", make_markers(P.markers));
+        if (valid && P.closed_loop) {
+            valid = set_item(dict, "phases", make_phases(P.phases))
+                 && set_item(dict, "phase_error", make_phase_statistics(P.phase_error))
+                 && set_item(dict, "latency", PyFloat_FromDouble(P.latency));
+        }
+        if (!valid) {
+            Py_XDECREF(dict);
+            Py_DECREF(list);
+            return nullptr;
+        }
+        PyList_SET_ITEM(list, i, dict);
+    }
+    return list;
+}
+
+/******************************************************************************/
+/*                              Single simulation							  */
+/******************************************************************************/
+static PyObject* run (PyObject*, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"T", "cortex", "thalamus", "connectivity", "stim", "seed",
+                                     "channels", "gating", nullptr};
+    int T;
+    PyObject *cortex, *thalamus, *connectivity;
+    PyObject *stim = nullptr, *seed_object = nullptr, *channel_list = nullptr;
+    int gating_mode = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iOOO|OOOi", (char**) keywords, &T, &cortex,
+                                     &thalamus, &connectivity, &stim, &seed_object, &channel_list,
+                                     &gating_mode)) {
+        return nullptr;
+    }
+    if (T < 0) {
+        PyErr_SetString(PyExc_ValueError, "T has to be non negative");
+        return nullptr;
+    }
+
+    std::vector<double> Param_Cortex, Param_Thalamus, Connections, var_stim;
+    std::size_t n_C, n_T, n_Con, n_stim;
+    std::uint64_t seed;
+    Gating_Mode gating;
+    if (!get_sets(cortex, "cortex", 3, Param_Cortex, n_C) ||
+        !get_sets(thalamus, "thalamus", 2, Param_Thalamus, n_T) ||
+        !get_sets(connectivity, "connectivity", 4, Connections, n_Con) ||
+        !get_stim(stim, var_stim, n_stim) || !get_seed(seed_object, seed) ||
+        !get_gating(gating_mode, gating)) {
+        return nullptr;
+    }
+    if (n_C != 1 || n_T != 1 || n_Con != 1) {
+        PyErr_SetString(PyExc_ValueError, "run takes a single parameter set, see run_batch");
+        return nullptr;
+    }
+
+    /* Further channels as (name, rate) pairs */
+    std::vector<std::pair<std::string, double>> channels;
+    if (channel_list && channel_list != Py_None) {
+        PyObject* items = PySequence_Fast(channel_list, "channels has to be a sequence of (name, rate)");
+        if (!items) {
+            return nullptr;
+        }
+        for (Py_ssize_t i=0; i < PySequence_Fast_GET_SIZE(items); ++i) {
+            const char* name;
+            double rate;
+            if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(items, i), "sd;channels has to hold (name, rate) pairs",
+                                  &name, &rate)) {
+                Py_DECREF(items);
+                return nullptr;
+            }
+            channels.emplace_back(name, rate);
+        }
+        Py_DECREF(items);
+    }
+
+    /* Simulation without the GIL, exceptions are raised after it is taken back */
+    std::unique_ptr<Recorder> Rec;
+    std::vector<int> markers;
+    std::vector<Protocol_Result> protocols;
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        TC_System System(Param_Cortex.data(), Param_Thalamus.data(), Connections.data(), seed);
+        System.Thalamus.set_gating(gating);
+        Stim_Scheduler Stimulation(System, (std::uint64_t) onset*res);
+        for (const Stim_Protocol& P : Stim_Protocol::from_var_stim(var_stim)) {
+            Stimulation.add(P);
+        }
+
+        const std::uint64_t first = (std::uint64_t) onset*res;
+        const std::uint64_t Time  = first + (std::uint64_t) T*res;
+        Rec.reset(new Recorder(System, first, Time));
+        for (const std::string& name : data_names()) {
+            Rec->add(name, res/red);
+        }
+        for (const auto& channel : channels) {
+            Rec->add(channel.first, channel.second);
+        }
+
+        const std::uint64_t numSteps = Time + Rec->delay();
+        for (std::uint64_t t=0; t < numSteps; ++t) {
+            ODE (System);
+            if (t < Time && Stimulation.due(t)) {
+                Stimulation.advance(t);
+            }
+            Rec->sample(t);
+        }
+
+        protocols = get_protocols(Stimulation);
+        for (const Protocol_Result& P : protocols) {
+            markers.insert(markers.end(), P.markers.begin(), P.markers.end());
+        }
+        std::sort(markers.begin(), markers.end());
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+
+    /* The arrays take over the recorded samples */
+    PyObject* result = PyDict_New();
+    PyObject* further = PyDict_New();
+    bool valid = result && further;
+    const unsigned numData = data_names().size();
+    for (unsigned i=0; valid && i < numData; ++i) {
+        valid = set_item(result, i == 3 ? "ah" : Rec->name(i).c_str(), make_array(std::move(Rec->data(i))));
+    }
+    for (unsigned i=numData; valid && i < Rec->size(); ++i) {
+        valid = set_item(further, Rec->name(i).c_str(), make_array(std::move(Rec->data(i))));
+    }
+    valid = valid && set_item(result, "markers", make_markers(markers))
+                  && set_item(result, "protocols", make_protocols(protocols))
+                  && set_item(result, "seed", PyLong_FromUnsignedLongLong(seed));
+    if (valid && PyDict_SetItemString(result, "channels", further) == 0) {
+        Py_DECREF(further);
+        return result;
+    }
+    Py_XDECREF(further);
+    Py_XDECREF(result);
+    return nullptr;
+}
+
+/******************************************************************************/
+/*                              Batch of simulations						  */
+/******************************************************************************/
+/* Event locked averages as dict with N, mean and sd, channels x samples */
+static PyObject* make_statistics (const Event_Statistics& S) {
+    auto stack = [] (const std::vector<std::vector<double>>& rows) {
+        std::vector<double> data;
+        for (const std::vector<double>& row : rows) {
+            data.insert(data.end(), row.begin(), row.end());
+        }
+        return make_array(std::move(data), 2, rows.size(), rows.empty() ? 0 : rows[0].size());
+    };
+    PyObject* dict = PyDict_New();
+    if (dict && set_item(dict, "N", PyLong_FromUnsignedLong(S.N)) &&
+        set_item(dict, "mean", stack(S.mean)) && set_item(dict, "sd", stack(S.sd))) {
+        return dict;
+    }
+    Py_XDECREF(dict);
+    return nullptr;
+}
+
+/* Move the traces of job i into the stacked outputs once it is done, so the */
+/* memory holds the time series only once									 */
+static void stack_traces (Sweep_Result& result, std::vector<std::vector<double>>& stacked,
+                          std::size_t num_samples, std::size_t i) {
+    std::vector<double>* channels[] = {&result.Vp, &result.Vt, &result.Ca, &result.ah};
+    for (unsigned k=0; k < 4; ++k) {
+        const std::size_t n = std::min(num_samples, channels[k]->size());
+        std::copy(channels[k]->begin(), channels[k]->begin() + n, stacked[k].begin() + i*num_samples);
+        std::vector<double>().swap(*channels[k]);
+    }
+}
+
+/* Results of a batch as dict, the traces are stacked as jobs x samples */
+static PyObject* make_batch (const std::vector<Sweep_Result>& results, std::vector<std::vector<double>>& stacked,
+                             std::size_t num_samples, std::uint64_t seed) {
+    const std::size_t num_jobs = results.size();
+    PyObject* result = PyDict_New();
+    PyObject* lists[5] = {PyList_New(num_jobs), PyList_New(num_jobs), PyList_New(num_jobs), PyList_New(num_jobs),
+                          PyList_New(num_jobs)};
+    const char* list_names[5] = {"markers", "troughs", "ERP", "SO", "protocols"};
+    bool valid = result && lists[0] && lists[1] && lists[2] && lists[3] && lists[4];
+    for (std::size_t i=0; valid && i < num_jobs; ++i) {
+        PyObject* items[5] = {make_markers(results[i].Marker_Stim), make_markers(results[i].SO_Troughs),
+                              make_statistics(results[i].ERP), make_statistics(results[i].SO),
+                              make_protocols(results[i].Protocols)};
+        for (unsigned k=0; k < 5; ++k) {
+            valid = valid && items[k];
+            if (items[k]) {
+                PyList_SET_ITEM(lists[k], i, items[k]);
+            }
+        }
+    }
+    const char* names[4] = {"Vp", "Vt", "Ca", "ah"};
+    for (unsigned k=0; valid && k < 4; ++k) {
+        valid = set_item(result, names[k], make_array(std::move(stacked[k]), 2, num_jobs, num_samples));
+    }
+    for (unsigned k=0; k < 5; ++k) {
+        if (valid) {
+            valid = PyDict_SetItemString(result, list_names[k], lists[k]) == 0;
+        }
+        Py_XDECREF(lists[k]);
+    }
+    valid = valid && set_item(result, "seed", PyLong_FromUnsignedLongLong(seed));
+    if (valid) {
+        return result;
+    }
+    Py_XDECREF(result);
+    return nullptr;
+}
+
+static PyObject* run_batch (PyObject*, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"T", "cortex", "thalamus", "connectivity", "stim", "seed",
+                                     "threads", "gating", "traces", "lanes", nullptr};
+    int T;
+    PyObject *cortex, *thalamus, *connectivity;
+    PyObject *stim = nullptr, *seed_object = nullptr;
+    unsigned threads = 0;
+    int gating_mode = 0;
+    int traces = 1;
+    unsigned lanes = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iOOO|OOIipI", (char**) keywords, &T, &cortex,
+                                     &thalamus, &connectivity, &stim, &seed_object, &threads,
+                                     &gating_mode, &traces, &lanes)) {
+        return nullptr;
+    }
+    if (T < 0) {
+        PyErr_SetString(PyExc_ValueError, "T has to be non negative");
+        return nullptr;
+    }
+
+    std::vector<double> Param_Cortex, Param_Thalamus, Connections, var_stim;
+    std::size_t n_C, n_T, n_Con, n_stim;
+    std::uint64_t seed;
+    Gating_Mode gating;
+    if (!get_sets(cortex, "cortex", 3, Param_Cortex, n_C) ||
+        !get_sets(thalamus, "thalamus", 2, Param_Thalamus, n_T) ||
+        !get_sets(connectivity, "connectivity", 4, Connections, n_Con) ||
+        !get_stim(stim, var_stim, n_stim) || !get_seed(seed_object, seed) ||
+        !get_gating(gating_mode, gating)) {
+        return nullptr;
+    }
+
+    /* Single sets are used for every job */
+    const std::size_t num_jobs = std::max(std::max(n_C, n_T), std::max(n_Con, n_stim));
+    for (std::size_t n : {n_C, n_T, n_Con, n_stim}) {
+        if (n != 1 && n != num_jobs) {
+            PyErr_Format(PyExc_ValueError, "run_batch: parameter sets for %zu and %zu jobs", n, num_jobs);
+            return nullptr;
+        }
+    }
+    auto set = [] (const std::vector<double>& values, std::size_t count, std::size_t width, std::size_t i) {
+        const std::size_t k = count == 1 ? 0 : i;
+        return std::vector<double>(values.begin() + k*width, values.begin() + (k+1)*width);
+    };
+    std::vector<Sweep_Job> jobs(num_jobs);
+    for (std::size_t i=0; i < num_jobs; ++i) {
+        jobs[i].T				= T;
+        jobs[i].Param_Cortex	= set(Param_Cortex,	  n_C,	  3, i);
+        jobs[i].Param_Thalamus	= set(Param_Thalamus, n_T,	  2, i);
+        jobs[i].Connectivity	= set(Connections,	  n_Con,  4, i);
+        jobs[i].var_stim		= set(var_stim,		  n_stim, Stim_Protocol::var_stim_size, i);
+        jobs[i].seed			= seed + i;
+        jobs[i].gating			= gating;
+        jobs[i].store_traces	= traces != 0;
+    }
+
+    const std::size_t num_samples = traces ? (std::size_t) T*res/red : 0;
+    std::vector<std::vector<double>> stacked(4, std::vector<double>());
+    std::vector<Sweep_Result> results(num_jobs);
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        for (std::vector<double>& channel : stacked) {
+            channel.assign(num_jobs*num_samples, 0.0);
+        }
+        if (lanes > 1) {
+            /* The lanes of an ensemble finish together, so the traces are stacked afterwards */
+            results = run_sweep(jobs, threads, lanes);
+            for (std::size_t i=0; i < num_jobs; ++i) {
+                stack_traces(results[i], stacked, num_samples, i);
+            }
+        } else {
+            Thread_Pool Pool(threads);
+            for (std::size_t i=0; i < num_jobs; ++i) {
+                Pool.submit([&jobs, &results, &stacked, num_samples, i] {
+                    run_job(jobs[i], results[i]);
+                    stack_traces(results[i], stacked, num_samples, i);
+                });
+            }
+            Pool.wait();
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+    return make_batch(results, stacked, num_samples, seed);
+}
+
+/******************************************************************************/
+/*                              Branches of a trunk							  */
+/******************************************************************************/
+static PyObject* run_trunk_branches (PyObject*, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"T", "burn_in", "cortex", "thalamus", "connectivity", "stim", "seed",
+                                     "threads", "gating", "traces", "independent", nullptr};
+    int T;
+    double burn_in;
+    PyObject *cortex, *thalamus, *connectivity, *stim;
+    PyObject *seed_object = nullptr;
+    unsigned threads = 0;
+    int gating_mode = 0;
+    int traces = 1;
+    int independent = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "idOOOO|OIipp", (char**) keywords, &T, &burn_in, &cortex,
+                                     &thalamus, &connectivity, &stim, &seed_object, &threads,
+                                     &gating_mode, &traces, &independent)) {
+        return nullptr;
+    }
+    if (T < 0 || burn_in < 0) {
+        PyErr_SetString(PyExc_ValueError, "T and burn_in have to be non negative");
+        return nullptr;
+    }
+
+    Sweep_Job trunk;
+    std::vector<double> var_stim;
+    std::size_t n_C, n_T, n_Con, n_stim;
+    std::uint64_t seed;
+    if (!get_sets(cortex, "cortex", 3, trunk.Param_Cortex, n_C) ||
+        !get_sets(thalamus, "thalamus", 2, trunk.Param_Thalamus, n_T) ||
+        !get_sets(connectivity, "connectivity", 4, trunk.Connectivity, n_Con) ||
+        !get_stim(stim, var_stim, n_stim) || !get_seed(seed_object, seed) ||
+        !get_gating(gating_mode, trunk.gating)) {
+        return nullptr;
+    }
+    if (n_C != 1 || n_T != 1 || n_Con != 1) {
+        PyErr_SetString(PyExc_ValueError, "run_branches takes a single parameter set for the trunk");
+        return nullptr;
+    }
+    trunk.seed = seed;
+
+    /* One branch per protocol, independent noise of branch i uses seed + 1 + i */
+    std::vector<Sweep_Job> jobs(n_stim, trunk);
+    for (std::size_t i=0; i < n_stim; ++i) {
+        jobs[i].T				= T;
+        jobs[i].var_stim.assign(var_stim.begin() + i*Stim_Protocol::var_stim_size,
+                                var_stim.begin() + (i+1)*Stim_Protocol::var_stim_size);
+        jobs[i].seed			= seed + 1 + i;
+        jobs[i].store_traces	= traces != 0;
+    }
+
+    const std::size_t num_samples = traces ? (std::size_t) T*res/red : 0;
+    std::vector<std::vector<double>> stacked(4, std::vector<double>());
+    std::vector<Sweep_Result> results;
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        const std::unique_ptr<TC_System> Trunk = make_trunk(trunk, burn_in);
+        results = run_branches(*Trunk, jobs, independent ? Branch_Noise::Independent : Branch_Noise::Shared,
+                               threads);
+        for (std::vector<double>& channel : stacked) {
+            channel.assign(n_stim*num_samples, 0.0);
+        }
+        for (std::size_t i=0; i < n_stim; ++i) {
+            stack_traces(results[i], stacked, num_samples, i);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+    return make_batch(results, stacked, num_samples, seed);
+}
+
+/******************************************************************************/
+/*                              Module definition							  */
+/******************************************************************************/
+static PyMethodDef module_methods[] = {
+    {"run", (PyCFunction) (void(*)(void)) run, METH_VARARGS | METH_KEYWORDS,
+     "run(T, cortex, thalamus, connectivity, stim=None, seed=None, channels=(), gating=0)\n"
+     "Simulate T s after the onset, returns Vp, Vt, Ca, ah, markers, seed and channels"},
+    {"run_batch", (PyCFunction) (void(*)(void)) run_batch, METH_VARARGS | METH_KEYWORDS,
+     "run_batch(T, cortex, thalamus, connectivity, stim=None, seed=None, threads=0, gating=0, traces=True,\n"
+     "          lanes=1)\n"
+     "Simulate one job per parameter set on a thread pool, the traces are jobs x samples"},
+    {"run_branches", (PyCFunction) (void(*)(void)) run_trunk_branches, METH_VARARGS | METH_KEYWORDS,
+     "run_branches(T, burn_in, cortex, thalamus, connectivity, stim, seed=None, threads=0, gating=0, traces=True,\n"
+     "             independent=False)\n"
+     "Simulate burn_in s of one system, then one branch per stim protocol from that state"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyModuleDef module_definition = {
+    PyModuleDef_HEAD_INIT, "nm_tc", "Thalamocortical neural mass model of NREM sleep", -1, module_methods,
+    nullptr, nullptr, nullptr, nullptr
+};
+
+/* Parameter set as dict of cortex, thalamus and connectivity */
+static PyObject* make_parameters (const Parameter_Set& P) {
+    return Py_BuildValue("{s:(ddd),s:(dd),s:(dddd)}",
+                         "cortex",		 P.Cortex[0], P.Cortex[1], P.Cortex[2],
+                         "thalamus",	 P.Thalamus[0], P.Thalamus[1],
+                         "connectivity", P.Connectivity[0], P.Connectivity[1], P.Connectivity[2], P.Connectivity[3]);
+}
+
+PyMODINIT_FUNC PyInit_nm_tc (void) {
+    const PyVarObject head[] = {PyVarObject_HEAD_INIT(nullptr, 0)};
+    Array_buffer.bf_getbuffer	= (getbufferproc) Array_getbuffer;
+    Array_sequence.sq_length	= (lenfunc) Array_length;
+    Array_Type.ob_base		= head[0];
+    Array_Type.tp_name		= "nm_tc.Array";
+    Array_Type.tp_basicsize	= sizeof(Array_Object);
+    Array_Type.tp_dealloc	= (destructor) Array_dealloc;
+    Array_Type.tp_as_buffer	= &Array_buffer;
+    Array_Type.tp_as_sequence= &Array_sequence;
+    Array_Type.tp_getset	= Array_getset;
+    Array_Type.tp_methods	= Array_methods;
+    Array_Type.tp_flags		= Py_TPFLAGS_DEFAULT;
+    Array_Type.tp_doc		= "Samples of the simulation, exported with the buffer protocol";
+    if (PyType_Ready(&Array_Type) < 0) {
+        return nullptr;
+    }
+
+    PyObject* module = PyModule_Create(&module_definition);
+    if (!module) {
+        return nullptr;
+    }
+    PyObject* fields = PyTuple_New(num_stim_fields);
+    PyObject* variables = PyTuple_New(Recorder::variables().size());
+    bool valid = fields && variables;
+    for (unsigned i=0; valid && i < num_stim_fields; ++i) {
+        PyTuple_SET_ITEM(fields, i, PyUnicode_FromString(stim_fields[i]));
+    }
+    for (unsigned i=0; valid && i < Recorder::variables().size(); ++i) {
+        PyTuple_SET_ITEM(variables, i, PyUnicode_FromString(Recorder::variables()[i].c_str()));
+    }
+    Py_INCREF(&Array_Type);
+    if (valid &&
+        PyModule_AddObject(module, "Array", (PyObject*) &Array_Type) == 0 &&
+        PyModule_AddObject(module, "stim_fields", fields) == 0 &&
+        PyModule_AddObject(module, "variables", variables) == 0 &&
+        PyModule_AddObject(module, "N2", make_parameters(Parameters_N2)) == 0 &&
+        PyModule_AddObject(module, "N3", make_parameters(Parameters_N3)) == 0 &&
+        PyModule_AddIntConstant(module, "rate", res/red) == 0) {
+        return module;
+    }
+    Py_DECREF(module);
+    return nullptr;
+}
+/****************************************************************************************************/
+/*										 		end													*/
+/****************************************************************************************************/
@@ -0,0 +1,179 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/* Real time mode for closed loop tests against the model					  */
+/*	TC_realtime server <name> [T]	runs T s of N3 sleep in real time and		  */
+/*									exchanges samples and commands through	  */
+/*									the shared memory rings <name>_samples	  */
+/*									and <name>_commands						  */
+/*	TC_realtime client <name> [T]	stand-in client, stimulates the thalamus	  */
+/*									for 100 ms at the up state of the slow	  */
+/*									oscillation								  */
+/*	TC_realtime demo [T] [log]		runs both as two processes and writes the  */
+/*									command latencies to log				  */
+/******************************************************************************/
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Phase_Estimator.h"
+#include "Real_Time.h"
+
+/******************************************************************************/
+/*                          Fixed simulation settings						  */
+/******************************************************************************/
+extern const int onset	= 0;		/* Time until stimulation starts in s	  */
+extern const int res 	= 1E4;		/* Number of iteration steps per s		  */
+extern const int red 	= 1E2;		/* Number of iterations steps not saved	  */
+extern const double dt 	= 1E3/res;	/* Duration of a time step in ms		  */
+extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
+
+/* Published samples per s and ring sizes */
+const int			sample_rate	= 1000;
+const std::uint64_t	ring_size	= 4096;
+
+/******************************************************************************/
+/*								Server										  */
+/******************************************************************************/
+static Real_Time_Report run_server (Shared_Ring<RT_Sample>& Samples, Shared_Ring<RT_Command>& Commands, double T) {
+    TC_System System(Parameters_N3);
+
+    Real_Time_Options options;
+    options.duration	= T;
+    options.sample_rate	= sample_rate;
+    return Real_Time(System, Samples, Commands, options).run();
+}
+
+static void print (const Real_Time_Report& R) {
+    std::int64_t max_latency = 0;
+    double mean_latency = 0;
+    for (const RT_Latency& L : R.commands) {
+        max_latency	  = std::max(max_latency, L.latency);
+        mean_latency += (double) L.latency/R.commands.size();
+    }
+    std::cout << "samples " << R.samples << ", overruns " << R.overruns << ", dropped " << R.dropped
+              << ", jitter mean " << R.mean_jitter/1E3 << " us max " << R.max_jitter/1E3 << " us\n";
+    std::cout << "commands " << R.commands.size() << ", rejected " << R.rejected
+              << ", sample to stimulus latency mean " << mean_latency/1E3 << " us max " << max_latency/1E3 << " us\n";
+}
+
+/******************************************************************************/
+/*								Stand-in client								  */
+/******************************************************************************/
+static void run_client (const std::string& name, double T) {
+    Shared_Ring<RT_Sample>	Samples	 = Shared_Ring<RT_Sample>::open (name + "_samples");
+    Shared_Ring<RT_Command> Commands = Shared_Ring<RT_Command>::open(name + "_commands");
+
+    /* Up state target, 100 ms stimuli at least 2.5 s apart */
+    Phase_Estimator Estimator(sample_rate);
+    const std::uint64_t duration = 0.1*sample_rate, pause = 2.5*sample_rate;
+    const std::uint64_t last	 = T*sample_rate - 1;
+    std::uint64_t next = 0, off = 0;
+    bool on = false;
+
+    RT_Sample S = {0, 0, 0, 0};
+    do {
+        if (!Samples.pop(S)) {
+            const timespec ts = {0, 20000};
+            nanosleep(&ts, nullptr);
+            continue;
+        }
+        Estimator.push(S.Vp);
+        if (on && S.index >= off) {
+            Commands.push(RT_Command {S.index, RT_Command::Thalamus, 0.0, monotonic_ns()});
+            on = false;
+        }
+        if (!on && S.index >= next && Estimator.ready() && Estimator.amplitude() > 2) {
+            /* Stimulate if the target is reached before the next sample, a	*/
+            /* negative wait means it has already been passed				*/
+            const double wait = wrap_phase(0 - Estimator.phase()) / Estimator.frequency();
+            if (0 <= wait && wait < 1) {
+                Commands.push(RT_Command {S.index, RT_Command::Thalamus, 60.0, monotonic_ns()});
+                on	 = true;
+                off	 = S.index + duration;
+                next = S.index + pause;
+            }
+        }
+    } while (S.index < last);
+}
+
+/******************************************************************************/
+/*                              Main routine								  */
+/******************************************************************************/
+int main(int argc, char* argv[]) {
+    const std::string mode = argc > 1 ? argv[1] : "demo";
+    try {
+        if (mode == "server" && argc > 2) {
+            Shared_Ring<RT_Sample>	Samples	 = Shared_Ring<RT_Sample>::create (std::string(argv[2]) + "_samples",  ring_size);
+            Shared_Ring<RT_Command> Commands = Shared_Ring<RT_Command>::create(std::string(argv[2]) + "_commands", ring_size);
+            print(run_server(Samples, Commands, argc > 3 ? atof(argv[3]) : 60));
+        } else if (mode == "client" && argc > 2) {
+            run_client(argv[2], argc > 3 ? atof(argv[3]) : 60);
+        } else if (mode == "demo") {
+            const double T	= argc > 2 ? atof(argv[2]) : 30;
+            const std::string name = "/NM_TC_" + std::to_string(getpid());
+            Shared_Ring<RT_Sample>	Samples	 = Shared_Ring<RT_Sample>::create (name + "_samples",  ring_size);
+            Shared_Ring<RT_Command> Commands = Shared_Ring<RT_Command>::create(name + "_commands", ring_size);
+
+            /* The client attaches by name, it must not remove the rings on exit */
+            const pid_t client = fork();
+            if (client == 0) {
+                try {
+                    run_client(name, T);
+                } catch (const std::exception& e) {
+                    std::cerr << "client: " << e.what() << "\n";
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            const Real_Time_Report R = run_server(Samples, Commands, T);
+            waitpid(client, nullptr, 0);
+            print(R);
+            if (argc > 3) {
+                R.write_log(argv[3]);
+            }
+        } else {
+            std::cerr << "usage: TC_realtime server <name> [T] | client <name> [T] | demo [T] [log]\n";
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+/****************************************************************************************************/
+/*										 		end													*/
+/****************************************************************************************************/
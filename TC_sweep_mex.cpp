@@ -0,0 +1,245 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ *
+ *	Based on:	A thalamocortical neural mass model of the EEG during NREM sleep and its response
+ *				to auditory stimulation.
+ *				M Schellenberger Costa, A Weigenand, H-VV Ngo, L Marshall, J Born, T Martinetz,
+ *				JC Claussen.
+ *				PLoS Computational Biology http://dx.doi.org/10.1371/journal.pcbi.1005022
+ */
+
+/******************************************************************************/
+/* Parallel parameter sweep as MATLAB routine (mex compiler)				  */
+/* Every column of the parameter matrices defines one job:					  */
+/* [Vp, Vt, Ca, ah, Marker_Stim, SO_Troughs, Averages, Phases] =			  */
+/*		TC_sweep_mex(T, Param_Cortex, Param_Thalamus, Connectivity, var_stim, */
+/*		seed, threads, gating, traces, branch, lanes)						  */
+/* var_stim holds 8 or 9 rows, see Stim_Protocol::from_var_stim.			  */
+/* Time series are returned as samples x jobs, markers as 1 x jobs cell.	  */
+/* SO_Troughs are the troughs of Data_SO_Average.m in samples, 1 x jobs cell. */
+/* Averages is a 1 x jobs struct of the event locked averages with the		  */
+/* fields N_ERP, mean_ERP_model, sd_ERP_model (samples x [Vp Vt FSP SSP]),	  */
+/* N_SO, mean_SO_model and sd_SO_model (samples x [Vp FSP]).				  */
+/* Phases is a 1 x jobs struct of closed loop protocols (mode 3) with the	  */
+/* marker, predicted and achieved phase of each stimulus, phase_error with N, */
+/* mean, resultant and sd of the achieved minus the target phase and the	  */
+/* latency of the phase estimate in ms, it is empty for other protocols.	  */
+/* traces = 0 returns empty time series, the memory then does not grow with T */
+/* Job i uses seed + i, results do not depend on the number of threads.		  */
+/* branch = [burn_in] or [burn_in, independent] forks a single parameter set  */
+/* after burn_in s into one branch per column of var_stim, see run_branches.  */
+/* The branches continue the noise of the trunk, with independent = 1 branch  */
+/* i draws its noise from seed + 1 + i.										  */
+/* gating selects exact (0), linear (1) or cubic (2) tabulated gating.		  */
+/* lanes > 1 integrates up to lanes jobs with exact gating together in a	  */
+/* TC_Ensemble, see run_sweep.												  */
+/* mex command is given by:													  */
+/* mex CXXFLAGS="\$CXXFLAGS -std=c++11 -O3 -fopenmp-simd -fno-math-errno	  */
+/*     -fno-trapping-math -ffp-contract=off -pthread"						  */
+/*     LDFLAGS="\$LDFLAGS -pthread"											  */
+/*     TC_sweep_mex.cpp Cortical_Column.cpp Sweep.cpp TC_Ensemble.cpp		  */
+/*     Thalamic_Column.cpp													  */
+/******************************************************************************/
+#include "mex.h"
+#include "matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+
+#include "Stim_Scheduler.h"
+#include "Sweep.h"
+mxArray* GetMexArray(int N, int M);
+mxArray* GetMexArray(const std::vector<std::vector<double>>& columns);
+void set_phases(mxArray* phases, unsigned index, const Protocol_Result& P);
+
+/******************************************************************************/
+/*                          Fixed simulation settings						  */
+/******************************************************************************/
+extern const int onset	= 20;		/* Time until data is stored in  s		  */
+extern const int res 	= 1E4;		/* Number of iteration steps per s		  */
+extern const int red 	= 1E2;		/* Number of iterations steps not saved	  */
+extern const double dt 	= 1E3/res;	/* Duration of a time step in ms		  */
+extern const double h	= sqrt(dt); /* Square root of dt for SRK iteration	  */
+
+/******************************************************************************/
+/*                              Simulation routine	 						  */
+/*								lhs defines outputs							  */
+/*								rhs defines inputs							  */
+/******************************************************************************/
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    /* Fetch inputs */
+    const int T				= (int) (mxGetScalar(prhs[0]));	/* Duration of simulation in s			*/
+    const bool branch		= nrhs > 9 && !mxIsEmpty(prhs[9]);	/* Fork a trunk per var_stim column	*/
+    const unsigned num_jobs	= mxGetN(prhs[branch ? 4 : 1]);	/* One job per column					*/
+    double* Param_Cortex	= mxGetPr (prhs[1]);			/* Parameters of cortical module		*/
+    double* Param_Thalamus	= mxGetPr (prhs[2]);			/* Parameters of thalamic module		*/
+    double* Connections		= mxGetPr (prhs[3]);			/* Connectivity values C <-> T			*/
+    double* var_stim	 	= mxGetPr (prhs[4]);			/* Parameters of stimulation protocol	*/
+    const size_t stim_width	= num_jobs ? mxGetNumberOfElements(prhs[4])/num_jobs : 0;
+    const std::uint64_t seed= nrhs > 5 ? (std::uint64_t) mxGetScalar(prhs[5]) : time(NULL);
+    const unsigned threads	= nrhs > 6 ? (unsigned) mxGetScalar(prhs[6]) : 0;
+    const Gating_Mode gating= nrhs > 7 ? (Gating_Mode) (int) mxGetScalar(prhs[7]) : Gating_Mode::Exact;
+    const bool traces		= nrhs > 8 ? mxGetScalar(prhs[8]) != 0 : true;
+    const unsigned lanes	= nrhs > 10 ? (unsigned) mxGetScalar(prhs[10]) : 1;
+
+    /* Set up the jobs */
+    if (mxGetNumberOfElements(prhs[4]) != stim_width*num_jobs || (stim_width != 8 && stim_width != 9)) {
+        mexErrMsgTxt("TC_sweep_mex: var_stim has to have 8 or 9 rows and one column per job");
+    }
+    if (branch && (mxGetN(prhs[1]) != 1 || mxGetN(prhs[2]) != 1 || mxGetN(prhs[3]) != 1)) {
+        mexErrMsgTxt("TC_sweep_mex: branches take a single parameter set for the trunk");
+    }
+    std::vector<Sweep_Job> jobs(num_jobs);
+    for (unsigned i=0; i < num_jobs; ++i) {
+        const unsigned k = branch ? 0 : i;
+        jobs[i].T = T;
+        jobs[i].Param_Cortex.assign	 (Param_Cortex	 + 3*k, Param_Cortex	+ 3*(k+1));
+        jobs[i].Param_Thalamus.assign(Param_Thalamus + 2*k, Param_Thalamus	+ 2*(k+1));
+        jobs[i].Connectivity.assign	 (Connections	 + 4*k, Connections		+ 4*(k+1));
+        jobs[i].var_stim = Stim_Protocol::widen_var_stim(var_stim + stim_width*i, stim_width, 1);
+        jobs[i].seed = branch ? seed + 1 + i : seed + i;
+        jobs[i].gating = gating;
+        jobs[i].store_traces = traces;
+    }
+
+    /* Simulation */
+    std::vector<Sweep_Result> results;
+    try {
+        if (branch) {
+            const double burn_in	= mxGetPr(prhs[9])[0];
+            const bool independent	= mxGetNumberOfElements(prhs[9]) > 1 && mxGetPr(prhs[9])[1] != 0;
+            if (burn_in < 0) {
+                throw std::invalid_argument("TC_sweep_mex: burn_in has to be non negative");
+            }
+            Sweep_Job trunk	= jobs.empty() ? Sweep_Job() : jobs[0];
+            trunk.seed		= seed;
+            results = run_branches(*make_trunk(trunk, burn_in), jobs,
+                                   independent ? Branch_Noise::Independent : Branch_Noise::Shared, threads);
+        } else {
+            results = run_sweep(jobs, threads, lanes);
+        }
+    } catch (const std::exception& e) {
+        mexErrMsgTxt(e.what());
+    }
+
+    /* Return the data containers */
+    const int num_samples = traces ? T*res/red : 0;
+    for (unsigned k=0; k < 4; ++k) {
+        plhs[k] = GetMexArray(num_samples, num_jobs);
+        double* data = mxGetPr(plhs[k]);
+        for (unsigned i=0; i < num_jobs; ++i) {
+            const std::vector<double>& channel = k==0 ? results[i].Vp :
+                                                 k==1 ? results[i].Vt :
+                                                 k==2 ? results[i].Ca : results[i].ah;
+            std::copy(channel.begin(), channel.end(), data + i*num_samples);
+        }
+    }
+
+    plhs[4] = mxCreateCellMatrix(1, num_jobs);
+    for (unsigned i=0; i < num_jobs; ++i) {
+        mxArray* marker = GetMexArray(1, results[i].Marker_Stim.size());
+        std::copy(results[i].Marker_Stim.begin(), results[i].Marker_Stim.end(), mxGetPr(marker));
+        mxSetCell(plhs[4], i, marker);
+    }
+
+    if (nlhs > 5) {
+        plhs[5] = mxCreateCellMatrix(1, num_jobs);
+        for (unsigned i=0; i < num_jobs; ++i) {
+            mxArray* troughs = GetMexArray(1, results[i].SO_Troughs.size());
+            std::copy(results[i].SO_Troughs.begin(), results[i].SO_Troughs.end(), mxGetPr(troughs));
+            mxSetCell(plhs[5], i, troughs);
+        }
+    }
+
+    if (nlhs > 6) {
+        const char* fields[] = {"N_ERP", "mean_ERP_model", "sd_ERP_model", "N_SO", "mean_SO_model", "sd_SO_model"};
+        plhs[6] = mxCreateStructMatrix(1, num_jobs, 6, fields);
+        for (unsigned i=0; i < num_jobs; ++i) {
+            mxSetField(plhs[6], i, "N_ERP",			 mxCreateDoubleScalar(results[i].ERP.N));
+            mxSetField(plhs[6], i, "mean_ERP_model", GetMexArray(results[i].ERP.mean));
+            mxSetField(plhs[6], i, "sd_ERP_model",	 GetMexArray(results[i].ERP.sd));
+            mxSetField(plhs[6], i, "N_SO",			 mxCreateDoubleScalar(results[i].SO.N));
+            mxSetField(plhs[6], i, "mean_SO_model",	 GetMexArray(results[i].SO.mean));
+            mxSetField(plhs[6], i, "sd_SO_model",	 GetMexArray(results[i].SO.sd));
+        }
+    }
+
+    if (nlhs > 7) {
+        const char* fields[] = {"marker", "predicted", "achieved", "phase_error", "latency"};
+        plhs[7] = mxCreateStructMatrix(1, num_jobs, 5, fields);
+        for (unsigned i=0; i < num_jobs; ++i) {
+            if (!results[i].Protocols.empty() && results[i].Protocols[0].closed_loop) {
+                set_phases(plhs[7], i, results[i].Protocols[0]);
+            }
+        }
+    }
+    return;
+}
+
+/******************************************************************************/
+/*                          Create MATLAB data containers					  */
+/******************************************************************************/
+mxArray* GetMexArray(int N, int M) {
+    mxArray* Array	= mxCreateDoubleMatrix(0, 0, mxREAL);
+    mxSetM(Array, N);
+    mxSetN(Array, M);
+    mxSetData(Array, mxMalloc(sizeof(double)*M*N));
+    return Array;
+}
+
+mxArray* GetMexArray(const std::vector<std::vector<double>>& columns) {
+    const int N = columns.empty() ? 0 : columns[0].size();
+    mxArray* Array = GetMexArray(N, columns.size());
+    double* data = mxGetPr(Array);
+    for (unsigned c=0; c < columns.size(); ++c) {
+        std::copy(columns[c].begin(), columns[c].end(), data + c*N);
+    }
+    return Array;
+}
+
+/* Phase records and their statistics of a closed loop protocol */
+void set_phases(mxArray* phases, unsigned index, const Protocol_Result& P) {
+    const char* statistics[] = {"N", "mean", "resultant", "sd"};
+    mxArray* marker		= GetMexArray(1, P.phases.size());
+    mxArray* predicted	= GetMexArray(1, P.phases.size());
+    mxArray* achieved	= GetMexArray(1, P.phases.size());
+    for (unsigned k=0; k < P.phases.size(); ++k) {
+        mxGetPr(marker)[k]		= P.phases[k].marker;
+        mxGetPr(predicted)[k]	= P.phases[k].predicted;
+        mxGetPr(achieved)[k]	= P.phases[k].achieved;
+    }
+    mxArray* error = mxCreateStructMatrix(1, 1, 4, statistics);
+    mxSetField(error, 0, "N",			mxCreateDoubleScalar(P.phase_error.N));
+    mxSetField(error, 0, "mean",		mxCreateDoubleScalar(P.phase_error.mean));
+    mxSetField(error, 0, "resultant",	mxCreateDoubleScalar(P.phase_error.resultant));
+    mxSetField(error, 0, "sd",			mxCreateDoubleScalar(P.phase_error.sd));
+    mxSetField(phases, index, "marker",		 marker);
+    mxSetField(phases, index, "predicted",	 predicted);
+    mxSetField(phases, index, "achieved",	 achieved);
+    mxSetField(phases, index, "phase_error", error);
+    mxSetField(phases, index, "latency",	 mxCreateDoubleScalar(P.latency));
+}
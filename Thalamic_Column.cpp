@@ -31,38 +31,129 @@
 /******************************************************************************/
 /*							Functions of the thalamic module				  */
 /******************************************************************************/
+#include "Cpu_Dispatch.h"
 #include "Thalamic_Column.h"
 
+/* Definitions of the SRK4 tables, which are indexed at runtime */
+constexpr double Thalamic_Column::A[4];
+constexpr double Thalamic_Column::B[4];
+
+/******************************************************************************/
+/*						Voltage dependence of the gating					  */
+/* The lookup tables cover the physiological range of -100 mV to 0 mV with	  */
+/* 0.1 mV resolution, i.e. 16 kB per function. Within the range the largest  */
+/* relative error is 8E-5 for linear and 1E-9 for cubic interpolation.		  */
+/* Outside of it the exact functions are evaluated.							  */
+/******************************************************************************/
+namespace Gating {
+double m_inf_T_t	(double V) {return 1/(1+exp(-(V+59)/6.2));}
+double m_inf_T_r	(double V) {return 1/(1+exp(-(V+52)/7.4));}
+double h_inf_T_t	(double V) {return 1/(1+exp( (V+81)/4));}
+double h_inf_T_r	(double V) {return 1/(1+exp( (V+80)/5));}
+double tau_h_T_t	(double V) {return (30.8 + (211.4 + exp((V+115.2)/5))/(1 + exp((V+86)/3.2)))/3.7371928;}
+double tau_h_T_r	(double V) {return (85 + 1/(exp((V+48)/4) + exp(-(V+407)/50)))/3.7371928;}
+double m_inf_h		(double V) {return 1/(1+exp( (V+75)/5.5));}
+double tau_m_h		(double V) {return (20 + 1000/(exp((V+ 71.5)/14.2) + exp(-(V+ 89)/11.6)));}
+
+struct Tables {
+    const double V_min = -100;
+    const double V_max = 0;
+    const double dV	   = 0.1;
+
+    const Gating_Table m_inf_T_t = Gating_Table(Gating::m_inf_T_t, V_min, V_max, dV);
+    const Gating_Table m_inf_T_r = Gating_Table(Gating::m_inf_T_r, V_min, V_max, dV);
+    const Gating_Table h_inf_T_t = Gating_Table(Gating::h_inf_T_t, V_min, V_max, dV);
+    const Gating_Table h_inf_T_r = Gating_Table(Gating::h_inf_T_r, V_min, V_max, dV);
+    const Gating_Table tau_h_T_t = Gating_Table(Gating::tau_h_T_t, V_min, V_max, dV);
+    const Gating_Table tau_h_T_r = Gating_Table(Gating::tau_h_T_r, V_min, V_max, dV);
+    const Gating_Table m_inf_h	 = Gating_Table(Gating::m_inf_h,   V_min, V_max, dV);
+    const Gating_Table tau_m_h	 = Gating_Table(Gating::tau_m_h,   V_min, V_max, dV);
+};
+
+/* Shared by all columns, built on first use */
+const Tables& tables (void) {
+    static const Tables T;
+    return T;
+}
+}
+
+double Thalamic_Column::gating_error(Gating_Mode mode) {
+    const Gating::Tables& T = Gating::tables();
+    double error = 0;
+    for (const Gating_Table* table : {&T.m_inf_T_t, &T.m_inf_T_r, &T.h_inf_T_t, &T.h_inf_T_r,
+                                      &T.tau_h_T_t, &T.tau_h_T_r, &T.m_inf_h,   &T.tau_m_h}) {
+        error = std::fmax(error, table->max_error(mode));
+    }
+    return error;
+}
+
+/******************************************************************************/
+/*							Binding to the state block						  */
+/******************************************************************************/
+void Thalamic_Column::bind(double* block) {
+    state	= block;
+    Vt		= block + 0 *num_stages;
+    Vr		= block + 1 *num_stages;
+    Ca		= block + 2 *num_stages;
+    s_et	= block + 3 *num_stages;
+    s_er	= block + 4 *num_stages;
+    s_gt	= block + 5 *num_stages;
+    s_gr	= block + 6 *num_stages;
+    y		= block + 7 *num_stages;
+    x_et	= block + 8 *num_stages;
+    x_er	= block + 9 *num_stages;
+    x_gt	= block + 10*num_stages;
+    x_gr	= block + 11*num_stages;
+    x		= block + 12*num_stages;
+    h_T_t	= block + 13*num_stages;
+    h_T_r	= block + 14*num_stages;
+    m_h		= block + 15*num_stages;
+    m_h2	= block + 16*num_stages;
+}
+
+void Thalamic_Column::get_Cortex(Cortical_Column& C) {
+    set_afferent(C.y);
+}
+
+void Thalamic_Column::init_state(void) {
+    for (unsigned i=0; i<num_vars; ++i) {
+        init(state + i*num_stages, 0.0);
+    }
+    init(Vt, E_L_t);
+    init(Vr, E_L_r);
+    init(Ca, Ca_0);
+}
+
 /******************************************************************************/
 /*							Initialization of RNG 							  */
 /******************************************************************************/
-void Thalamic_Column::set_RNG(void) {
+void Thalamic_Column::set_RNG(std::uint64_t seed, unsigned stream) {
     extern const double dt;
-    unsigned numRandomVariables = 1;
+    unsigned numRandomVariables = num_streams/2;
 
-    MTRands.reserve(2*numRandomVariables);
+    Rand_Streams.reserve(2*numRandomVariables);
     Rand_vars.reserve(2*numRandomVariables);
     for (unsigned i=0; i < numRandomVariables; ++i){
         /* Add the RNG for I_{l}*/
-        MTRands.push_back(randomStreamNormal(0.0, dphi*dt));
+        Rand_Streams.push_back(Noise_Buffer(0.0, dphi*dt, seed, stream + 2*i));
 
         /* Add the RNG for I_{l,0} */
-        MTRands.push_back(randomStreamNormal(0.0, dt));
+        Rand_Streams.push_back(Noise_Buffer(0.0, dt, seed, stream + 2*i+1));
 
         /* Get the random number for the first iteration */
-        Rand_vars.push_back(MTRands[2*i]());
-        Rand_vars.push_back(MTRands[2*i+1]());
+        Rand_vars.push_back(Rand_Streams[2*i]());
+        Rand_vars.push_back(Rand_Streams[2*i+1]());
     }
 }
 /******************************************************************************/
 /*                          RK noise scaling 								  */
 /******************************************************************************/
 double Thalamic_Column::noise_xRK(int N, int M) const{
-    return gamma_e * gamma_e * (Rand_vars[2*M] + Rand_vars[2*M+1]/std::sqrt(3))*B[N];
+    return gamma_e * gamma_e * ((Rand_vars[2*M] + Rand_input) + (Rand_vars[2*M+1] + Rand_input)/std::sqrt(3))*B[N];
 }
 
 double Thalamic_Column::noise_aRK(int M) const{
-    return gamma_e * gamma_e * (Rand_vars[2*M] - Rand_vars[2*M+1]*std::sqrt(3))/4;
+    return gamma_e * gamma_e * ((Rand_vars[2*M] + Rand_input) - (Rand_vars[2*M+1] + Rand_input)*std::sqrt(3))/4;
 }
 
 /******************************************************************************/
@@ -103,32 +194,32 @@ double Thalamic_Column::I_gr	(int N) const{
 /******************************************************************************/
 /* Activation in TC population after Destexhe 1996 */
 double Thalamic_Column::m_inf_T_t	(int N) const{
-    return 1/(1+exp(-(Vt[N]+59)/6.2));
+    return gating == Gating_Mode::Exact ? Gating::m_inf_T_t(Vt[N]) : Gating::tables().m_inf_T_t(Vt[N], gating);
 }
 
 /* Activation in RE population after Destexhe 1996 */
 double Thalamic_Column::m_inf_T_r	(int N) const{
-    return 1/(1+exp(-(Vr[N]+52)/7.4));
+    return gating == Gating_Mode::Exact ? Gating::m_inf_T_r(Vr[N]) : Gating::tables().m_inf_T_r(Vr[N], gating);
 }
 
 /* Deactivation in TC population after Destexhe 1996 */
 double Thalamic_Column::h_inf_T_t	(int N) const{
-    return 1/(1+exp( (Vt[N]+81)/4));
+    return gating == Gating_Mode::Exact ? Gating::h_inf_T_t(Vt[N]) : Gating::tables().h_inf_T_t(Vt[N], gating);
 }
 
 /* Deactivation in RE population after Destexhe 1996 */
 double Thalamic_Column::h_inf_T_r	(int N) const{
-    return 1/(1+exp( (Vr[N]+80)/5));
+    return gating == Gating_Mode::Exact ? Gating::h_inf_T_r(Vr[N]) : Gating::tables().h_inf_T_r(Vr[N], gating);
 }
 
 /* Deactivation time in RE population after Destexhe 1996 */
 double Thalamic_Column::tau_h_T_t	(int N) const{
-    return (30.8 + (211.4 + exp((Vt[N]+115.2)/5))/(1 + exp((Vt[N]+86)/3.2)))/3.7371928;
+    return gating == Gating_Mode::Exact ? Gating::tau_h_T_t(Vt[N]) : Gating::tables().tau_h_T_t(Vt[N], gating);
 }
 
 /* Deactivation time in RE population after Destexhe 1996 */
 double Thalamic_Column::tau_h_T_r	(int N) const{
-    return (85 + 1/(exp((Vr[N]+48)/4) + exp(-(Vr[N]+407)/50)))/3.7371928;
+    return gating == Gating_Mode::Exact ? Gating::tau_h_T_r(Vr[N]) : Gating::tables().tau_h_T_r(Vr[N], gating);
 }
 
 /******************************************************************************/
@@ -136,12 +227,12 @@ double Thalamic_Column::tau_h_T_r	(int N) const{
 /******************************************************************************/
 /* Activation in TC population after Destexhe 1993 */
 double Thalamic_Column::m_inf_h	(int N) const{
-    return 1/(1+exp( (Vt[N]+75)/5.5));
+    return gating == Gating_Mode::Exact ? Gating::m_inf_h(Vt[N]) : Gating::tables().m_inf_h(Vt[N], gating);
 }
 
 /* Activation time for slow components in TC population after Chen2012 */
 double Thalamic_Column::tau_m_h	(int N) const{
-    return (20 + 1000/(exp((Vt[N]+ 71.5)/14.2) + exp(-(Vt[N]+ 89)/11.6)));
+    return gating == Gating_Mode::Exact ? Gating::tau_m_h(Vt[N]) : Gating::tables().tau_m_h(Vt[N], gating);
 }
 
 /* Instantaneous calcium binding onto messenger protein after Chen2012 */
@@ -179,14 +270,14 @@ double Thalamic_Column::I_LK_r	(int N) const{
     return g_LK	* (Vr[N]- E_K);
 }
 
-/* T-type current of TC population */
-double Thalamic_Column::I_T_t	(int N) const{
-    return g_T_t * m_inf_T_t(N) * m_inf_T_t(N) * h_T_t[N] * (Vt[N]- E_Ca);
+/* T-type current of TC population given its activation */
+double Thalamic_Column::I_T_t	(int N, double m_inf) const{
+    return g_T_t * m_inf * m_inf * h_T_t[N] * (Vt[N]- E_Ca);
 }
 
-/* T-type current of RE population */
-double Thalamic_Column::I_T_r	(int N) const{
-    return g_T_r * m_inf_T_r(N) * m_inf_T_r(N) * h_T_r[N] * (Vr[N]- E_Ca);
+/* T-type current of RE population given its activation */
+double Thalamic_Column::I_T_r	(int N, double m_inf) const{
+    return g_T_r * m_inf * m_inf * h_T_r[N] * (Vr[N]- E_Ca);
 }
 
 /* h-type current of TC population */
@@ -194,51 +285,99 @@ double Thalamic_Column::I_h		(int N) const{
     return g_h * (m_h[N] + g_inc * m_h2[N]) * (Vt[N]- E_h);
 }
 
+/******************************************************************************/
+/*						Exact propagators of the kernels					  */
+/******************************************************************************/
+struct Thalamic_Column::Kernels {
+    Alpha_Kernel e;
+    Alpha_Kernel g;
+    Alpha_Kernel nu;
+};
+
+const Thalamic_Column::Kernels& Thalamic_Column::kernels(void) {
+    extern const double dt;
+    static const Kernels K = {Alpha_Kernel(gamma_e, dt), Alpha_Kernel(gamma_g, dt), Alpha_Kernel(nu, dt)};
+    return K;
+}
+
+
 /******************************************************************************/
 /*                              SRK iteration                                 */
 /******************************************************************************/
+/* Every firing rate, gating function and the coupling is evaluated once per stage */
+Thalamic_Column::Stage Thalamic_Column::get_stage (int N) const{
+    Stage S;
+    S.Qt		= get_Qt(N);
+    S.Qr		= get_Qr(N);
+    S.I_T_t		= I_T_t(N, m_inf_T_t(N));
+    S.I_T_r		= I_T_r(N, m_inf_T_r(N));
+    S.h_inf_T_t	= h_inf_T_t(N);
+    S.h_inf_T_r	= h_inf_T_r(N);
+    S.tau_h_T_t	= tau_h_T_t(N);
+    S.tau_h_T_r	= tau_h_T_r(N);
+    S.m_inf_h	= m_inf_h(N);
+    S.tau_m_h	= tau_m_h(N);
+    S.P_h		= P_h(N);
+    S.y_C		= afferent_C[N];
+    return S;
+}
+
+NM_TC_TARGET_CLONES
 void Thalamic_Column::set_RK (int N) {
     extern const double dt;
-    Vt	  	[N+1] = Vt   [0] + A[N]*dt*(-(I_L_t(N) + I_et(N) + I_gt(N))/tau_t - C_m * (I_LK_t(N) + I_T_t(N) + I_h(N)));
-    Vr	  	[N+1] = Vr   [0] + A[N]*dt*(-(I_L_r(N) + I_er(N) + I_gr(N))/tau_r - C_m * (I_LK_r(N) + I_T_r(N)));
-    Ca      [N+1] = Ca   [0] + A[N]*dt*(alpha_Ca * I_T_t(N) - (Ca[N] - Ca_0)/tau_Ca);
-    h_T_t   [N+1] = h_T_t[0] + A[N]*dt*(h_inf_T_t(N) - h_T_t[N])/tau_h_T_t(N);
-    h_T_r 	[N+1] = h_T_r[0] + A[N]*dt*(h_inf_T_r(N) - h_T_r[N])/tau_h_T_r(N);
-    m_h 	[N+1] = m_h  [0] + A[N]*dt*((m_inf_h(N) * (1 - m_h2[N]) - m_h[N])/tau_m_h(N) - k3 * P_h(N) * m_h[N] + k4 * m_h2[N]);
-    m_h2 	[N+1] = m_h2 [0] + A[N]*dt*(k3 * P_h(N) * m_h[N] - k4 * m_h2[N]);
+    const Stage S = get_stage(N);
+    Vt	  	[N+1] = Vt   [0] + A[N]*dt*(-(I_L_t(N) + I_et(N) + I_gt(N))/tau_t - C_m * (I_LK_t(N) + S.I_T_t + I_h(N)));
+    Vr	  	[N+1] = Vr   [0] + A[N]*dt*(-(I_L_r(N) + I_er(N) + I_gr(N))/tau_r - C_m * (I_LK_r(N) + S.I_T_r));
+    Ca      [N+1] = Ca   [0] + A[N]*dt*(alpha_Ca * S.I_T_t - (Ca[N] - Ca_0)/tau_Ca);
+    h_T_t   [N+1] = h_T_t[0] + A[N]*dt*(S.h_inf_T_t - h_T_t[N])/S.tau_h_T_t;
+    h_T_r 	[N+1] = h_T_r[0] + A[N]*dt*(S.h_inf_T_r - h_T_r[N])/S.tau_h_T_r;
+    m_h 	[N+1] = m_h  [0] + A[N]*dt*((S.m_inf_h * (1 - m_h2[N]) - m_h[N])/S.tau_m_h - k3 * S.P_h * m_h[N] + k4 * m_h2[N]);
+    m_h2 	[N+1] = m_h2 [0] + A[N]*dt*(k3 * S.P_h * m_h[N] - k4 * m_h2[N]);
+    if (integrator == Integrator::Exponential) {
+        const Kernels& K   = kernels();
+        const double drive = Rand_input/dt_ref;
+        K.e .set_RK(N, s_et, x_et, gamma_e*gamma_e * (			   N_tp * S.y_C + drive));
+        K.e .set_RK(N, s_er, x_er, gamma_e*gamma_e * (N_rt * S.Qt + N_rp * S.y_C));
+        K.g .set_RK(N, s_gt, x_gt, gamma_g*gamma_g * (N_tr * S.Qr));
+        K.g .set_RK(N, s_gr, x_gr, gamma_g*gamma_g * (N_rr * S.Qr));
+        K.nu.set_RK(N, y,	 x,	   nu * nu		   * (		  S.Qt));
+        return;
+    }
     s_et	[N+1] = s_et [0] + A[N]*dt*(x_et[N]);
     s_er	[N+1] = s_er [0] + A[N]*dt*(x_er[N]);
     s_gt	[N+1] = s_gt [0] + A[N]*dt*(x_gt[N]);
     s_gr	[N+1] = s_gr [0] + A[N]*dt*(x_gr[N]);
     y		[N+1] = y	 [0] + A[N]*dt*(x	[N]);
-    x_et  	[N+1] = x_et [0] + A[N]*dt*(gamma_e*gamma_e * (                 + N_tp * Cortex->y[N] - s_et[N]) - 2 * gamma_e * x_et[N]) + noise_xRK(N,0);
-    x_er  	[N+1] = x_er [0] + A[N]*dt*(gamma_e*gamma_e * (N_rt * get_Qt(N)	+ N_rp * Cortex->y[N] - s_er[N]) - 2 * gamma_e * x_er[N]);
-    x_gt  	[N+1] = x_gt [0] + A[N]*dt*(gamma_g*gamma_g * (N_tr * get_Qr(N)						  - s_gt[N]) - 2 * gamma_g * x_gt[N]);
-    x_gr  	[N+1] = x_gr [0] + A[N]*dt*(gamma_g*gamma_g * (N_rr * get_Qr(N)						  - s_gr[N]) - 2 * gamma_g * x_gr[N]);
-    x	  	[N+1] = x	 [0] + A[N]*dt*(nu * nu         * (		  get_Qt(N)						  - y   [N]) - 2 * nu	   * x   [N]);
+    x_et  	[N+1] = x_et [0] + A[N]*dt*(gamma_e*gamma_e * (              + N_tp * S.y_C - s_et[N]) - 2 * gamma_e * x_et[N]) + noise_xRK(N,0);
+    x_er  	[N+1] = x_er [0] + A[N]*dt*(gamma_e*gamma_e * (N_rt * S.Qt	+ N_rp * S.y_C - s_er[N]) - 2 * gamma_e * x_er[N]);
+    x_gt  	[N+1] = x_gt [0] + A[N]*dt*(gamma_g*gamma_g * (N_tr * S.Qr				   - s_gt[N]) - 2 * gamma_g * x_gt[N]);
+    x_gr  	[N+1] = x_gr [0] + A[N]*dt*(gamma_g*gamma_g * (N_rr * S.Qr				   - s_gr[N]) - 2 * gamma_g * x_gr[N]);
+    x	  	[N+1] = x	 [0] + A[N]*dt*(nu * nu         * (	   S.Qt				   - y   [N]) - 2 * nu	   * x   [N]);
 }
 
 void Thalamic_Column::add_RK(void) {
-    add_RK(Vt);
-    add_RK(Vr);
-    add_RK(Ca);
-    add_RK(s_et);
-    add_RK(s_er);
-    add_RK(s_gt);
-    add_RK(s_gr);
-    add_RK(y);
-    add_RK_noise(x_et, 0);
-    add_RK(x_er);
-    add_RK(x_gt);
-    add_RK(x_gr);
-    add_RK(x);
-    add_RK(h_T_t);
-    add_RK(h_T_r);
-    add_RK(m_h);
-    add_RK(m_h2);
+    /* The variables are contiguous, so sweep the whole block at once */
+    for (unsigned i=0; i<num_vars; ++i) {
+        add_RK(state + i*num_stages);
+    }
+    if (integrator == Integrator::Exponential) {
+        /* Standardize the noise to the intensity gamma_e^2 * dphi * sqrt(dt_ref) */
+        extern const double dt;
+        const Kernels& K = kernels();
+        const double c	 = gamma_e * gamma_e * std::sqrt(dt_ref)/dt;
+        K.e .add_RK(s_et, x_et, c * Rand_vars[0], c * dphi * Rand_vars[1]);
+        K.e .add_RK(s_er, x_er);
+        K.g .add_RK(s_gt, x_gt);
+        K.g .add_RK(s_gr, x_gr);
+        K.nu.add_RK(y,	  x);
+    } else {
+        x_et[0] += noise_aRK(0);
+    }
 
     /* Generate noise for the next iteration */
     for (unsigned i=0; i<Rand_vars.size(); ++i) {
-        Rand_vars[i] = MTRands[i]() + input;
+        Rand_vars[i] = Rand_Streams[i]();
     }
+    Rand_input = input;
 }
+
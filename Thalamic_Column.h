@@ -36,36 +36,86 @@
 #include <vector>
 
 #include "Cortical_Column.h"
-#include "Random_Stream.h"
+#include "Exponential_Integrator.h"
+#include "Gating_Table.h"
+#include "Noise_Buffer.h"
+#include "State_Block.h"
 class Cortical_Column;
 
 class Thalamic_Column {
 public:
-    /* Constructor for simulation */
-    Thalamic_Column(double* Param, double* Con)
+    /* Constructor for simulation, state points into the system state block */
+    /* The noise streams are seeded with streams [stream, stream+num_streams) */
+    Thalamic_Column(const double* Param, const double* Con, double* state, std::uint64_t seed, unsigned stream)
         : g_LK		(Param[0]),	g_h 	(Param[1]),
           N_tp 		(Con[0]),	N_rp	(Con[1])
-    {set_RNG();}
+    {bind(state); init_state(); set_RNG(seed, stream);}
+
+    /* Number of state variables */
+    static const unsigned num_vars = 17;
+
+    /* Number of noise streams */
+    static const unsigned num_streams = 2;
+
+    /* Point the population variables into a state block */
+    void	bind		(double* state);
+
+    /* Continue with the noise streams of another seed, the noise of the next step is drawn anew */
+    void	reseed		(std::uint64_t seed, unsigned stream)
+    {Rand_Streams.clear(); Rand_vars.clear(); set_RNG(seed, stream);}
 
     /* Get the pointer to the cortical module */
-    void	get_Cortex	(Cortical_Column& C) {Cortex = &C;}
+    void	get_Cortex	(Cortical_Column& C);
+
+    /* Read the afferent cortical axonal flux per RK stage from an external buffer */
+    void	set_afferent(const double* cortical) {afferent_C = cortical;}
 
     /* ODE functions */
     void 	set_RK		(int);
     void 	add_RK	 	(void);
 
+    /* Integrate the synaptic kernels with SRK4 or their exact propagator */
+    void	set_integrator (Integrator mode) {integrator = mode;}
+
     /* Set strength of external input */
     void	set_input	(double I) {input = I;}
 
+    /* Evaluate the gating functions exactly or from the lookup tables */
+    void	set_gating	(Gating_Mode mode) {gating = mode;}
+
+    /* Largest relative error of the lookup tables for a mode */
+    static double gating_error (Gating_Mode mode);
+
 private:
     /* Declaration of private functions */
     /* Initialize the RNGs */
-    void 	set_RNG		(void);
+    void 	set_RNG		(std::uint64_t seed, unsigned stream);
 
     /* Firing rates */
     double 	get_Qt		(int) const;
     double 	get_Qr		(int) const;
 
+    /* Quantities used by several derivatives of a RK stage */
+    struct Stage {
+        double	Qt;				/* TC firing rate										*/
+        double	Qr;				/* RE firing rate										*/
+        double	I_T_t;			/* T-type current of TC population						*/
+        double	I_T_r;			/* T-type current of RE population						*/
+        double	h_inf_T_t;		/* steady state of T channel inactivation in TC			*/
+        double	h_inf_T_r;		/* steady state of T channel inactivation in RE			*/
+        double	tau_h_T_t;		/* time constant of T channel inactivation in TC		*/
+        double	tau_h_T_r;		/* time constant of T channel inactivation in RE		*/
+        double	m_inf_h;		/* steady state of h channel activation					*/
+        double	tau_m_h;		/* time constant of h channel activation				*/
+        double	P_h;			/* calcium bound messenger protein						*/
+        double	y_C;			/* axonal flux of the cortical module					*/
+    };
+    Stage	get_stage	(int) const;
+
+    /* Exact propagators of the synaptic kernels for dt, shared by all columns */
+    struct Kernels;
+    static const Kernels& kernels (void);
+
     /* Synaptic currents */
     double 	I_et		(int) const;
     double 	I_gt		(int) const;
@@ -95,152 +145,181 @@ private:
     double 	I_L_r		(int) const;
     double 	I_LK_t		(int) const;
     double 	I_LK_r		(int) const;
-    double 	I_T_t		(int) const;
-    double 	I_T_r		(int) const;
+    double 	I_T_t		(int, double) const;
+    double 	I_T_r		(int, double) const;
     double 	I_h			(int) const;
 
     /* Noise functions */
     double 	noise_xRK 	(int,int) const;
     double 	noise_aRK 	(int) const;
 
+    /* Set the initial values of the population variables */
+    void 	init_state	(void);
+
     /* Helper functions */
-    inline std::vector<double> init (double value)
-    {return {value, 0.0, 0.0, 0.0, 0.0};}
+    inline void init (double* var, double value)
+    {var[0] = value; var[1] = var[2] = var[3] = var[4] = 0.0;}
 
-    inline void add_RK (std::vector<double>& var)
+    inline void add_RK (double* var)
     {var[0] = (-3*var[0] + 2*var[1] + 4*var[2] + 2*var[3] + var[4])/6;}
 
-    inline void add_RK_noise (std::vector<double>& var, unsigned noise)
-    {var[0] = (-3*var[0] + 2*var[1] + 4*var[2] + 2*var[3] + var[4])/6 + noise_aRK(noise);}
-
     /* Declaration and Initialization of parameters */
+    /* Fixed parameters are compile time constants shared by all instances, */
+    /* only the ones set by the constructor are stored per column			 */
     /* Membrane time in ms */
-    const double 	tau_t 		= 20;
-    const double 	tau_r 		= 20;
+    static constexpr double 	tau_t 		= 20;
+    static constexpr double 	tau_r 		= 20;
 
     /* Maximum firing rate in ms^-1 */
-    const double 	Qt_max		= 400.E-3;
-    const double 	Qr_max		= 400.E-3;
+    static constexpr double 	Qt_max		= 400.E-3;
+    static constexpr double 	Qr_max		= 400.E-3;
 
     /* Sigmoid threshold in mV */
-    const double 	theta_t		= -58.5;
-    const double 	theta_r		= -58.5;
+    static constexpr double 	theta_t		= -58.5;
+    static constexpr double 	theta_r		= -58.5;
 
     /* Sigmoid gain in mV */
-    const double 	sigma_t		= 6.;
-    const double 	sigma_r		= 6.;
+    static constexpr double 	sigma_t		= 6.;
+    static constexpr double 	sigma_r		= 6.;
 
     /* Scaling parameter for sigmoidal mapping (dimensionless) */
-    const double 	C1          = (M_PI/sqrt(3));
+    static constexpr double 	C1          = 1.8137993642342178;	/* pi/sqrt(3)	*/
 
     /* PSP rise time in ms^-1 */
-    const double 	gamma_e		= 70E-3;
-    const double 	gamma_g		= 100E-3;
+    static constexpr double 	gamma_e		= 70E-3;
+    static constexpr double 	gamma_g		= 100E-3;
 
     /* Axonal flux time constant in ms^-1*/
-    const double 	nu			= 120E-3;
+    static constexpr double 	nu			= 120E-3;
 
     /* Membrane capacitance in muF/cm^2 */
-    const double	C_m			= 1.;
+    static constexpr double	C_m			= 1.;
 
     /* Leak weight in aU */
-    const double 	g_L    		= 1.;
+    static constexpr double 	g_L    		= 1.;
 
     /* Synaptic weights in ms */
-    const double 	g_AMPA 		= 1.;
-    const double 	g_GABA 		= 1.;
+    static constexpr double 	g_AMPA 		= 1.;
+    static constexpr double 	g_GABA 		= 1.;
 
     /* Conductivities */
     /* Potassium leak current in mS/m^2 */
     const double 	g_LK 		= 0.02;
 
     /* T current in mS/m^2 */
-    const double	g_T_t		= 3;
-    const double	g_T_r		= 2.3;
+    static constexpr double	g_T_t		= 3;
+    static constexpr double	g_T_r		= 2.3;
 
     /* h current in mS/m^2 */
     const double	g_h			= 0.06;
 
     /* Reversal potentials in mV */
     /* Synaptic */
-    const double 	E_AMPA  	= 0;
-    const double 	E_GABA  	= -70;
+    static constexpr double 	E_AMPA  	= 0;
+    static constexpr double 	E_GABA  	= -70;
 
     /* Leak */
-    const double 	E_L_t 		= -70;
-    const double 	E_L_r 		= -70;
+    static constexpr double 	E_L_t 		= -70;
+    static constexpr double 	E_L_r 		= -70;
 
     /* Potassium */
-    const double 	E_K    		= -100;
+    static constexpr double 	E_K    		= -100;
 
     /* I_T current */
-    const double 	E_Ca    	= 120;
+    static constexpr double 	E_Ca    	= 120;
 
     /* I_h current */
-    const double 	E_h    		= -40;
+    static constexpr double 	E_h    		= -40;
 
     /* Calcium parameters */
-    const double	alpha_Ca	= -51.8E-6;			/* influx per spike in nmol		*/
-    const double	tau_Ca		= 10;				/* calcium time constant in ms	*/
-    const double	Ca_0		= 2.4E-4;			/* resting concentration 		*/
+    static constexpr double	alpha_Ca	= -51.8E-6;			/* influx per spike in nmol		*/
+    static constexpr double	tau_Ca		= 10;				/* calcium time constant in ms	*/
+    static constexpr double	Ca_0		= 2.4E-4;			/* resting concentration 		*/
 
     /* I_h activation parameters */
-    const double 	k1			= 2.5E7;
-    const double 	k2			= 4E-4;
-    const double 	k3			= 1E-1;
-    const double 	k4			= 1E-3;
-    const double 	n_P			= 4;
-    const double 	g_inc		= 2;
+    static constexpr double 	k1			= 2.5E7;
+    static constexpr double 	k2			= 4E-4;
+    static constexpr double 	k3			= 1E-1;
+    static constexpr double 	k4			= 1E-3;
+    static constexpr double 	n_P			= 4;
+    static constexpr double 	g_inc		= 2;
 
     /* Noise parameters in ms^-1 */
-    const double 	mphi		= 0E-3;
-    const double	dphi		= 20E-3;
+    static constexpr double 	mphi		= 0E-3;
+    static constexpr double	dphi		= 20E-3;
     double			input		= 0.0;
 
     /* Connectivities (dimensionless) */
-    const double 	N_rt		= 3.;
-    const double 	N_tr		= 5.;
-    const double 	N_rr		= 25.;
+    static constexpr double 	N_rt		= 3.;
+    static constexpr double 	N_tr		= 5.;
+    static constexpr double 	N_rr		= 25.;
 
     /* Connectivities from cortex (dimensionless) */
     const double 	N_tp		= 2.6;
     const double 	N_rp		= 2.6;
 
-    /* Pointer to cortical column */
-    Cortical_Column* Cortex;
+    /* Afferent axonal flux from the cortex per RK stage */
+    const double*	afferent_C	= nullptr;
+
+    /* Evaluation of the gating functions */
+    Gating_Mode		gating		= Gating_Mode::Exact;
 
     /* Parameters for SRK4 iteration */
-    const std::vector<double> A = {0.5,  0.5,  1.0, 1.0};
-    const std::vector<double> B = {0.75, 0.75, 0.0, 0.0};
+    static constexpr double A[4] = {0.5,  0.5,  1.0, 1.0};
+    static constexpr double B[4] = {0.75, 0.75, 0.0, 0.0};
 
     /* Random number generators */
-    std::vector<randomStreamNormal> MTRands;
+    std::vector<Noise_Buffer>	Rand_Streams;
 
-    /* Container for noise */
+    /* Container for noise and the input at the time it was drawn */
     std::vector<double>	Rand_vars;
-
-    /* Population variables																			*/
-    std::vector<double> Vt		= init(E_L_t),		/* TC membrane voltage								*/
-                        Vr		= init(E_L_r),		/* RE membrane voltage								*/
-                        Ca		= init(Ca_0),		/* Calcium concentration of TC population			*/
-                        s_et	= init(0.0),		/* PostSP from TC population to TC population		*/
-                        s_er	= init(0.0),		/* PostSP from TC population to RE population		*/
-                        s_gt	= init(0.0),		/* PostSP from RE population to TC population		*/
-                        s_gr	= init(0.0),		/* PostSP from RE population to RE population		*/
-                        y		= init(0.0),		/* axonal flux										*/
-                        x_et	= init(0.0),		/* derivative of s_et								*/
-                        x_er	= init(0.0),		/* derivative of s_er								*/
-                        x_gt	= init(0.0),		/* derivative of s_gt								*/
-                        x_gr	= init(0.0),		/* derivative of s_gr								*/
-                        x		= init(0.0),		/* derivative of y									*/
-                        h_T_t	= init(0.0),		/* inactivation of T channel						*/
-                        h_T_r	= init(0.0),		/* inactivation of T channel						*/
-                        m_h		= init(0.0),		/* activation 	of h   channel						*/
-                        m_h2	= init(0.0);		/* activation 	of h   channel bound with protein 	*/
+    double				Rand_input	= 0.0;
+
+    /* Integration scheme of the synaptic kernels */
+    Integrator			integrator	= Integrator::SRK4;
+
+    /* Population variables, each a view of num_stages values in the state block		*/
+    double*	state;				/* begin of the state block of this column				*/
+    double*	Vt;					/* TC membrane voltage									*/
+    double*	Vr;					/* RE membrane voltage									*/
+    double*	Ca;					/* Calcium concentration of TC population				*/
+    double*	s_et;				/* PostSP from TC population to TC population			*/
+    double*	s_er;				/* PostSP from TC population to RE population			*/
+    double*	s_gt;				/* PostSP from RE population to TC population			*/
+    double*	s_gr;				/* PostSP from RE population to RE population			*/
+    double*	y;					/* axonal flux											*/
+    double*	x_et;				/* derivative of s_et									*/
+    double*	x_er;				/* derivative of s_er									*/
+    double*	x_gt;				/* derivative of s_gt									*/
+    double*	x_gr;				/* derivative of s_gr									*/
+    double*	x;					/* derivative of y										*/
+    double*	h_T_t;				/* inactivation of T channel							*/
+    double*	h_T_r;				/* inactivation of T channel							*/
+    double*	m_h;				/* activation 	of h   channel							*/
+    double*	m_h2;				/* activation 	of h   channel bound with protein 		*/
 
     /* Data storage  access */
     friend void get_data (int, Cortical_Column&, Thalamic_Column&, std::vector<double*>&);
     friend class Cortical_Column;
+
+    /* Stimulation protocol access */
+    friend class Stim;
+    friend class Stim_Scheduler;
+
+    /* Ensemble engine access */
+    friend class TC_Ensemble;
+
+    /* Network engine access */
+    friend class TC_Network;
+
+    /* Recorder access */
+    friend class Recorder;
+
+    /* Checkpoint access */
+    friend class Checkpoint;
+
+    /* Real time mode access */
+    friend class Real_Time;
 };
 /****************************************************************************************************/
 /*										 		end			 										*/
@@ -0,0 +1,229 @@
+/*
+ *	Copyright (c) 2015 University of Lübeck
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in
+ *	all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *	THE SOFTWARE.
+ *
+ *	AUTHORS:	Michael Schellenberger Costa: mschellenbergercosta@gmail.com
+ */
+
+/******************************************************************************/
+/*						Work stealing thread pool							  */
+/*																			  */
+/* Every worker owns a deque of tasks. It takes work from the back of its own */
+/* deque and steals from the front of the others once it runs dry, so long	  */
+/* and short jobs balance out without a central queue.						  */
+/******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Thread_Pool {
+public:
+    /* Start the workers, 0 selects the number of hardware threads */
+    explicit Thread_Pool(unsigned num_threads = 0) {
+        if (num_threads == 0) {
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i=0; i < num_threads; ++i) {
+            queues.emplace_back(new Worker_Queue);
+        }
+        for (unsigned i=0; i < num_threads; ++i) {
+            workers.emplace_back(&Thread_Pool::work, this, i);
+        }
+    }
+
+    Thread_Pool(const Thread_Pool&) = delete;
+    Thread_Pool& operator=(const Thread_Pool&) = delete;
+
+    /* Finish all remaining tasks and stop the workers */
+    ~Thread_Pool(void) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        work_available.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /* Add a task, they are dealt round robin to the worker deques */
+    void submit (std::function<void(void)> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++queued;
+            ++pending;
+        }
+        Worker_Queue& queue = *queues[next++ % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        work_available.notify_one();
+    }
+
+    /* Block until all submitted tasks are done, rethrows the first exception */
+    void wait (void) {
+        std::unique_lock<std::mutex> lock(mutex);
+        work_done.wait(lock, [this] {return pending == 0;});
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    /* Number of workers */
+    unsigned size (void) const {return workers.size();}
+
+private:
+    struct Worker_Queue {
+        std::mutex								mutex;
+        std::deque<std::function<void(void)>>	tasks;
+    };
+
+    /* Take a task from the back of the own deque */
+    bool pop (unsigned id, std::function<void(void)>& task) {
+        Worker_Queue& queue = *queues[id];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    /* Take a task from the front of another deque */
+    bool steal (unsigned id, std::function<void(void)>& task) {
+        for (unsigned i=1; i < queues.size(); ++i) {
+            Worker_Queue& queue = *queues[(id + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* Worker loop */
+    void work (unsigned id) {
+        std::function<void(void)> task;
+        while (true) {
+            if (pop(id, task) || steal(id, task)) {
+                --queued;
+                try {
+                    task();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+                task = nullptr;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    work_done.notify_all();
+                }
+                continue;
+            }
+
+            /* Sleep until new tasks arrive */
+            std::unique_lock<std::mutex> lock(mutex);
+            work_available.wait(lock, [this] {return stop || queued > 0;});
+            if (stop && queued == 0) {
+                return;
+            }
+        }
+    }
+
+    /* Deques of the workers */
+    std::vector<std::unique_ptr<Worker_Queue>> queues;
+
+    /* Worker threads */
+    std::vector<std::thread>	workers;
+
+    /* Synchronization of the sleeping workers and of wait() */
+    std::mutex					mutex;
+    std::condition_variable		work_available;
+    std::condition_variable		work_done;
+
+    /* Tasks not yet taken by a worker and tasks not yet finished */
+    std::atomic<int>			queued {0};
+    unsigned					pending = 0;
+
+    /* Next deque for round robin submission */
+    std::atomic<unsigned>		next {0};
+
+    /* Shutdown flag and first exception thrown by a task */
+    bool						stop	= false;
+    std::exception_ptr			error;
+};
+
+/******************************************************************************/
+/*							Spinning barrier								  */
+/*																			  */
+/* For a fixed group of threads that meet every few microseconds. Waiting on  */
+/* a condition variable would cost more than the work between two meetings,	  */
+/* so the threads spin and only yield after a while.						  */
+/******************************************************************************/
+class Spin_Barrier {
+public:
+    explicit Spin_Barrier(unsigned num_threads) : num_threads (num_threads) {}
+
+    Spin_Barrier(const Spin_Barrier&) = delete;
+    Spin_Barrier& operator=(const Spin_Barrier&) = delete;
+
+    /* Block until all threads arrived, writes before are visible to all after */
+    void wait (void) {
+        const unsigned current = generation.load(std::memory_order_acquire);
+        if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == num_threads) {
+            arrived.store(0, std::memory_order_relaxed);
+            generation.fetch_add(1, std::memory_order_release);
+            return;
+        }
+        for (unsigned spin=0; generation.load(std::memory_order_acquire) == current; ++spin) {
+            if (spin >= max_spin) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    /* Number of polls before the waiting threads yield */
+    static const unsigned max_spin = 4096;
+
+    const unsigned num_threads;
+
+    /* Counters on separate cache lines, padded as C++11 new ignores alignas */
+    std::atomic<unsigned>	arrived {0};
+    char					padding[64];
+    std::atomic<unsigned>	generation {0};
+};
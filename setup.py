@@ -0,0 +1,15 @@
+# Build of the Python extension module nm_tc, see TC_python.cpp
+#   python3 setup.py build_ext --inplace
+from setuptools import Extension, setup
+
+nm_tc = Extension(
+    "nm_tc",
+    sources=["TC_python.cpp", "Cortical_Column.cpp", "Sweep.cpp", "TC_Ensemble.cpp", "Thalamic_Column.cpp"],
+    language="c++",
+    extra_compile_args=["-std=c++11", "-O3", "-fopenmp-simd", "-fno-math-errno", "-fno-trapping-math",
+                        "-ffp-contract=off", "-pthread"],
+    extra_link_args=["-pthread"],
+)
+
+setup(name="nm_tc", version="1.0", description="Thalamocortical neural mass model of NREM sleep",
+      ext_modules=[nm_tc])